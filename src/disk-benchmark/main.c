@@ -0,0 +1,788 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+#include <glib/gi18n.h>
+
+#include <glib-unix.h>
+
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <libgdu/libgdu.h>
+
+static UDisksClient *udisks_client = NULL;
+static GMainLoop *main_loop = NULL;
+static GCancellable *cancellable = NULL;
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gint      opt_num_samples = 100;
+static gint      opt_sample_size_mib = 10;
+static gint      opt_num_access_samples = 1000;
+static gboolean  opt_write = FALSE;
+static gboolean  opt_parallel = FALSE;
+static gint      opt_histogram_bins = 20;
+static gchar    *opt_format = NULL;
+static gchar    *opt_output = NULL;
+
+static const GOptionEntry opt_entries[] =
+{
+  { "num-samples", 'n', 0, G_OPTION_ARG_INT, &opt_num_samples, N_("Number of transfer rate samples (default: 100)"), N_("NUM")},
+  { "sample-size", 's', 0, G_OPTION_ARG_INT, &opt_sample_size_mib, N_("Size of each transfer rate sample in MiB (default: 10)"), N_("MIB")},
+  { "num-access-samples", 'a', 0, G_OPTION_ARG_INT, &opt_num_access_samples, N_("Number of access time samples (default: 1000)"), N_("NUM")},
+  { "write", 'w', 0, G_OPTION_ARG_NONE, &opt_write, N_("Also measure the write rate (data is read and written back)"), NULL},
+  { "parallel", 'p', 0, G_OPTION_ARG_NONE, &opt_parallel, N_("Benchmark all devices at the same time"), NULL},
+  { "histogram-bins", 'b', 0, G_OPTION_ARG_INT, &opt_histogram_bins, N_("Number of histogram bins (default: 20)"), N_("NUM")},
+  { "format", 'f', 0, G_OPTION_ARG_STRING, &opt_format, N_("Output format, either “json” (default) or “csv”"), N_("FORMAT")},
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &opt_output, N_("Write results to FILE instead of standard output"), N_("FILE")},
+  { NULL }
+};
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  gchar *device;
+  UDisksObject *object;
+  UDisksObject *drive_object;
+
+  guint64 disk_size;
+  gint64 timestamp_usec;
+  GArray *read_samples;
+  GArray *write_samples;
+  GArray *access_time_samples;
+  GError *error;
+} DeviceData;
+
+static void
+device_data_free (DeviceData *data)
+{
+  g_free (data->device);
+  g_clear_object (&data->object);
+  g_clear_object (&data->drive_object);
+  g_array_unref (data->read_samples);
+  g_array_unref (data->write_samples);
+  g_array_unref (data->access_time_samples);
+  g_clear_error (&data->error);
+  g_free (data);
+}
+
+static DeviceData *
+device_data_new (const gchar *device)
+{
+  DeviceData *data;
+
+  data = g_new0 (DeviceData, 1);
+  data->device = g_strdup (device);
+  data->read_samples = g_array_new (FALSE, FALSE, sizeof (GduBenchmarkSample));
+  data->write_samples = g_array_new (FALSE, FALSE, sizeof (GduBenchmarkSample));
+  data->access_time_samples = g_array_new (FALSE, FALSE, sizeof (GduBenchmarkSample));
+  return data;
+}
+
+static gboolean
+device_data_lookup (DeviceData  *data,
+                    GError     **error)
+{
+  UDisksBlock *block;
+  UDisksDrive *drive;
+  struct stat statbuf;
+
+  if (stat (data->device, &statbuf) != 0)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errno),
+                   _("Error getting information about “%s”: %m"),
+                   data->device);
+      return FALSE;
+    }
+
+  if (!S_ISBLK (statbuf.st_mode))
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_ARGUMENT,
+                   _("“%s” is not a block device"),
+                   data->device);
+      return FALSE;
+    }
+
+  block = udisks_client_get_block_for_dev (udisks_client, statbuf.st_rdev);
+  if (block == NULL)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NOT_FOUND,
+                   _("No udisks object for “%s”"),
+                   data->device);
+      return FALSE;
+    }
+
+  data->object = UDISKS_OBJECT (g_dbus_interface_dup_object (G_DBUS_INTERFACE (block)));
+  drive = udisks_client_get_drive_for_block (udisks_client, block);
+  if (drive != NULL)
+    {
+      data->drive_object = UDISKS_OBJECT (g_dbus_interface_dup_object (G_DBUS_INTERFACE (drive)));
+      g_object_unref (drive);
+    }
+  g_object_unref (block);
+
+  if (opt_write && gdu_utils_is_in_use (udisks_client, data->object))
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_BUSY,
+                   _("“%s” is in use, unmount all filesystems and lock all encrypted devices on it first"),
+                   data->device);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* called from the benchmark thread */
+static void
+on_sample (GduBenchmarkSampleType    type,
+           const GduBenchmarkSample *sample,
+           gpointer                  user_data)
+{
+  DeviceData *data = user_data;
+
+  switch (type)
+    {
+    case GDU_BENCHMARK_SAMPLE_TYPE_READ:
+      g_array_append_val (data->read_samples, *sample);
+      break;
+
+    case GDU_BENCHMARK_SAMPLE_TYPE_WRITE:
+      g_array_append_val (data->write_samples, *sample);
+      break;
+
+    case GDU_BENCHMARK_SAMPLE_TYPE_ACCESS_TIME:
+      g_array_append_val (data->access_time_samples, *sample);
+      break;
+
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static void
+run_benchmark (DeviceData               *data,
+               const GduBenchmarkParams *params)
+{
+  gint fd = -1;
+
+  data->timestamp_usec = g_get_real_time ();
+
+  fd = gdu_benchmark_open_device (udisks_object_peek_block (data->object),
+                                  params->do_write,
+                                  cancellable,
+                                  &data->error);
+  if (fd == -1)
+    goto out;
+
+  if (!gdu_benchmark_get_device_size (fd, &data->disk_size, &data->error))
+    goto out;
+
+  gdu_benchmark_run (fd,
+                     data->disk_size,
+                     params,
+                     on_sample,
+                     data,
+                     cancellable,
+                     &data->error);
+
+ out:
+  if (fd != -1)
+    close (fd);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static GduBenchmarkParams params;
+static GMutex threads_lock;
+static guint num_threads_running = 0;
+
+static gboolean
+on_threads_done (gpointer user_data)
+{
+  g_main_loop_quit (main_loop);
+  return FALSE; /* remove source */
+}
+
+static void
+thread_done (void)
+{
+  g_mutex_lock (&threads_lock);
+  num_threads_running--;
+  if (num_threads_running == 0)
+    g_idle_add (on_threads_done, NULL);
+  g_mutex_unlock (&threads_lock);
+}
+
+/* runs each device in @user_data (a GList) one after another */
+static gpointer
+benchmark_thread (gpointer user_data)
+{
+  GList *l;
+
+  for (l = user_data; l != NULL; l = l->next)
+    {
+      DeviceData *data = l->data;
+      if (data->error == NULL)
+        run_benchmark (data, &params);
+    }
+  g_list_free (user_data);
+
+  thread_done ();
+  return NULL;
+}
+
+static gboolean
+on_sigint (gpointer user_data)
+{
+  g_cancellable_cancel (cancellable);
+  return TRUE; /* keep source */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+append_json_string (GString     *str,
+                    const gchar *value)
+{
+  const gchar *p;
+
+  if (value == NULL)
+    {
+      g_string_append (str, "null");
+      return;
+    }
+
+  g_string_append_c (str, '"');
+  for (p = value; *p != '\0'; p++)
+    {
+      switch (*p)
+        {
+        case '"':
+          g_string_append (str, "\\\"");
+          break;
+        case '\\':
+          g_string_append (str, "\\\\");
+          break;
+        case '\n':
+          g_string_append (str, "\\n");
+          break;
+        case '\t':
+          g_string_append (str, "\\t");
+          break;
+        default:
+          if ((guchar) *p < 0x20)
+            g_string_append_printf (str, "\\u%04x", (guint) *p);
+          else
+            g_string_append_c (str, *p);
+          break;
+        }
+    }
+  g_string_append_c (str, '"');
+}
+
+static void
+append_csv_string (GString     *str,
+                   const gchar *value)
+{
+  const gchar *p;
+
+  if (value == NULL)
+    return;
+
+  if (strpbrk (value, ",\"\n") == NULL)
+    {
+      g_string_append (str, value);
+      return;
+    }
+
+  g_string_append_c (str, '"');
+  for (p = value; *p != '\0'; p++)
+    {
+      if (*p == '"')
+        g_string_append_c (str, '"');
+      g_string_append_c (str, *p);
+    }
+  g_string_append_c (str, '"');
+}
+
+/* A rate can be infinite if the clock didn't advance during a sample.
+ * Neither JSON nor most CSV readers accept "inf" or "nan" so such values
+ * are written as null, which leaves the CSV field empty.
+ */
+static void
+append_double (GString  *str,
+               gdouble   value,
+               gboolean  json)
+{
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+  if (!isfinite (value))
+    {
+      if (json)
+        g_string_append (str, "null");
+      return;
+    }
+  g_string_append (str, g_ascii_dtostr (buf, sizeof buf, value));
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  gdouble min;
+  gdouble max;
+  gdouble avg;
+  guint *bins;
+  guint num_bins;
+} Summary;
+
+static void
+summary_init (Summary *summary,
+              GArray  *samples)
+{
+  guint n;
+
+  memset (summary, 0, sizeof (Summary));
+  if (samples->len == 0)
+    return;
+
+  summary->min = G_MAXDOUBLE;
+  summary->max = -G_MAXDOUBLE;
+  for (n = 0; n < samples->len; n++)
+    {
+      GduBenchmarkSample *sample = &g_array_index (samples, GduBenchmarkSample, n);
+      summary->min = MIN (summary->min, sample->value);
+      summary->max = MAX (summary->max, sample->value);
+      summary->avg += sample->value;
+    }
+  summary->avg /= samples->len;
+
+  /* all samples fall in a single bin if there is no spread */
+  summary->num_bins = summary->max > summary->min ? MAX (opt_histogram_bins, 1) : 1;
+  summary->bins = g_new0 (guint, summary->num_bins);
+  for (n = 0; n < samples->len; n++)
+    {
+      GduBenchmarkSample *sample = &g_array_index (samples, GduBenchmarkSample, n);
+      guint bin = 0;
+      if (summary->num_bins > 1)
+        bin = MIN ((sample->value - summary->min) / (summary->max - summary->min) * summary->num_bins,
+                   summary->num_bins - 1);
+      summary->bins[bin]++;
+    }
+}
+
+static void
+summary_get_bin_range (Summary *summary,
+                       guint    bin,
+                       gdouble *out_lower,
+                       gdouble *out_upper)
+{
+  gdouble width = (summary->max - summary->min) / summary->num_bins;
+  *out_lower = summary->min + bin * width;
+  *out_upper = bin == summary->num_bins - 1 ? summary->max : summary->min + (bin + 1) * width;
+}
+
+static void
+summary_clear (Summary *summary)
+{
+  g_free (summary->bins);
+  summary->bins = NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static const gchar *
+sample_type_to_string (GduBenchmarkSampleType type)
+{
+  switch (type)
+    {
+    case GDU_BENCHMARK_SAMPLE_TYPE_READ:
+      return "read";
+    case GDU_BENCHMARK_SAMPLE_TYPE_WRITE:
+      return "write";
+    case GDU_BENCHMARK_SAMPLE_TYPE_ACCESS_TIME:
+      return "access-time";
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static GArray *
+device_data_get_samples (DeviceData             *data,
+                         GduBenchmarkSampleType  type)
+{
+  switch (type)
+    {
+    case GDU_BENCHMARK_SAMPLE_TYPE_READ:
+      return data->read_samples;
+    case GDU_BENCHMARK_SAMPLE_TYPE_WRITE:
+      return data->write_samples;
+    case GDU_BENCHMARK_SAMPLE_TYPE_ACCESS_TIME:
+      return data->access_time_samples;
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static void
+append_json_device (GString    *str,
+                    DeviceData *data)
+{
+  UDisksBlock *block = NULL;
+  UDisksDrive *drive = NULL;
+  GduBenchmarkSampleType type;
+
+  if (data->object != NULL)
+    block = udisks_object_peek_block (data->object);
+  if (data->drive_object != NULL)
+    drive = udisks_object_peek_drive (data->drive_object);
+
+  g_string_append (str, "    {\n      \"device\": ");
+  append_json_string (str, data->device);
+  g_string_append (str, ",\n      \"object-path\": ");
+  append_json_string (str, data->object != NULL ? g_dbus_object_get_object_path (G_DBUS_OBJECT (data->object)) : NULL);
+  g_string_append (str, ",\n      \"id\": ");
+  append_json_string (str, block != NULL ? udisks_block_get_id (block) : NULL);
+  g_string_append_printf (str, ",\n      \"size\": %" G_GUINT64_FORMAT, data->disk_size);
+  g_string_append_printf (str, ",\n      \"timestamp-usec\": %" G_GINT64_FORMAT, data->timestamp_usec);
+
+  g_string_append (str, ",\n      \"drive\": ");
+  if (drive != NULL)
+    {
+      g_string_append (str, "{\n        \"vendor\": ");
+      append_json_string (str, udisks_drive_get_vendor (drive));
+      g_string_append (str, ",\n        \"model\": ");
+      append_json_string (str, udisks_drive_get_model (drive));
+      g_string_append (str, ",\n        \"revision\": ");
+      append_json_string (str, udisks_drive_get_revision (drive));
+      g_string_append (str, ",\n        \"serial\": ");
+      append_json_string (str, udisks_drive_get_serial (drive));
+      g_string_append (str, ",\n        \"wwn\": ");
+      append_json_string (str, udisks_drive_get_wwn (drive));
+      g_string_append (str, "\n      }");
+    }
+  else
+    {
+      g_string_append (str, "null");
+    }
+
+  g_string_append (str, ",\n      \"error\": ");
+  append_json_string (str, data->error != NULL ? data->error->message : NULL);
+
+  for (type = GDU_BENCHMARK_SAMPLE_TYPE_READ; type <= GDU_BENCHMARK_SAMPLE_TYPE_ACCESS_TIME; type++)
+    {
+      GArray *samples = device_data_get_samples (data, type);
+      Summary summary;
+      guint n;
+
+      g_string_append_printf (str, ",\n      \"%s\": {\n        \"samples\": [", sample_type_to_string (type));
+      for (n = 0; n < samples->len; n++)
+        {
+          GduBenchmarkSample *sample = &g_array_index (samples, GduBenchmarkSample, n);
+          g_string_append_printf (str, "%s\n          {\"offset\": %" G_GUINT64_FORMAT ", \"value\": ",
+                                  n > 0 ? "," : "", sample->offset);
+          append_double (str, sample->value, TRUE);
+          g_string_append_c (str, '}');
+        }
+      g_string_append (str, samples->len > 0 ? "\n        ]" : "]");
+
+      summary_init (&summary, samples);
+      if (samples->len > 0)
+        {
+          g_string_append (str, ",\n        \"min\": ");
+          append_double (str, summary.min, TRUE);
+          g_string_append (str, ",\n        \"avg\": ");
+          append_double (str, summary.avg, TRUE);
+          g_string_append (str, ",\n        \"max\": ");
+          append_double (str, summary.max, TRUE);
+        }
+      g_string_append (str, ",\n        \"histogram\": [");
+      for (n = 0; n < summary.num_bins; n++)
+        {
+          gdouble lower, upper;
+          summary_get_bin_range (&summary, n, &lower, &upper);
+          g_string_append_printf (str, "%s\n          {\"lower\": ", n > 0 ? "," : "");
+          append_double (str, lower, TRUE);
+          g_string_append (str, ", \"upper\": ");
+          append_double (str, upper, TRUE);
+          g_string_append_printf (str, ", \"count\": %u}", summary.bins[n]);
+        }
+      g_string_append (str, summary.num_bins > 0 ? "\n        ]\n      }" : "]\n      }");
+      summary_clear (&summary);
+    }
+  g_string_append (str, "\n    }");
+}
+
+static gchar *
+format_json (GList *devices)
+{
+  GString *str;
+  GList *l;
+
+  str = g_string_new ("{\n");
+  g_string_append (str, "  \"version\": 1,\n");
+  g_string_append (str, "  \"units\": {\"read\": \"bytes/s\", \"write\": \"bytes/s\", \"access-time\": \"s\"},\n");
+  g_string_append_printf (str,
+                          "  \"parameters\": {\n"
+                          "    \"num-samples\": %d,\n"
+                          "    \"sample-size\": %" G_GUINT64_FORMAT ",\n"
+                          "    \"num-access-samples\": %d,\n"
+                          "    \"write\": %s,\n"
+                          "    \"parallel\": %s\n"
+                          "  },\n",
+                          params.num_samples,
+                          ((guint64) params.sample_size_mib) * 1024 * 1024,
+                          params.num_access_samples,
+                          params.do_write ? "true" : "false",
+                          opt_parallel ? "true" : "false");
+  g_string_append (str, "  \"devices\": [\n");
+  for (l = devices; l != NULL; l = l->next)
+    {
+      append_json_device (str, l->data);
+      g_string_append (str, l->next != NULL ? ",\n" : "\n");
+    }
+  g_string_append (str, "  ]\n}\n");
+
+  return g_string_free (str, FALSE);
+}
+
+/* One row per sample, histogram bin and error. Columns not applicable
+ * to a record are left empty.
+ */
+static gchar *
+format_csv (GList *devices)
+{
+  GString *str;
+  GList *l;
+
+  str = g_string_new ("device,vendor,model,serial,size,sample_size,timestamp_usec,record,type,offset,value,lower,upper,count,error\n");
+  for (l = devices; l != NULL; l = l->next)
+    {
+      DeviceData *data = l->data;
+      UDisksDrive *drive = NULL;
+      GString *prefix;
+      GduBenchmarkSampleType type;
+
+      if (data->drive_object != NULL)
+        drive = udisks_object_peek_drive (data->drive_object);
+
+      prefix = g_string_new (NULL);
+      append_csv_string (prefix, data->device);
+      g_string_append_c (prefix, ',');
+      append_csv_string (prefix, drive != NULL ? udisks_drive_get_vendor (drive) : NULL);
+      g_string_append_c (prefix, ',');
+      append_csv_string (prefix, drive != NULL ? udisks_drive_get_model (drive) : NULL);
+      g_string_append_c (prefix, ',');
+      append_csv_string (prefix, drive != NULL ? udisks_drive_get_serial (drive) : NULL);
+      g_string_append_printf (prefix, ",%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%" G_GINT64_FORMAT ",",
+                              data->disk_size,
+                              ((guint64) params.sample_size_mib) * 1024 * 1024,
+                              data->timestamp_usec);
+
+      if (data->error != NULL)
+        {
+          g_string_append (str, prefix->str);
+          g_string_append (str, "error,,,,,,,");
+          append_csv_string (str, data->error->message);
+          g_string_append_c (str, '\n');
+        }
+
+      for (type = GDU_BENCHMARK_SAMPLE_TYPE_READ; type <= GDU_BENCHMARK_SAMPLE_TYPE_ACCESS_TIME; type++)
+        {
+          GArray *samples = device_data_get_samples (data, type);
+          Summary summary;
+          guint n;
+
+          for (n = 0; n < samples->len; n++)
+            {
+              GduBenchmarkSample *sample = &g_array_index (samples, GduBenchmarkSample, n);
+              g_string_append (str, prefix->str);
+              g_string_append_printf (str, "sample,%s,%" G_GUINT64_FORMAT ",",
+                                      sample_type_to_string (type), sample->offset);
+              append_double (str, sample->value, FALSE);
+              g_string_append (str, ",,,,\n");
+            }
+
+          summary_init (&summary, samples);
+          for (n = 0; n < summary.num_bins; n++)
+            {
+              gdouble lower, upper;
+              summary_get_bin_range (&summary, n, &lower, &upper);
+              g_string_append (str, prefix->str);
+              g_string_append_printf (str, "histogram,%s,,,", sample_type_to_string (type));
+              append_double (str, lower, FALSE);
+              g_string_append_c (str, ',');
+              append_double (str, upper, FALSE);
+              g_string_append_printf (str, ",%u,\n", summary.bins[n]);
+            }
+          summary_clear (&summary);
+        }
+
+      g_string_free (prefix, TRUE);
+    }
+
+  return g_string_free (str, FALSE);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+int
+main (int argc, char *argv[])
+{
+  gint ret = 1;
+  GError *error = NULL;
+  gchar *s = NULL;
+  GOptionContext *o = NULL;
+  GList *devices = NULL;
+  GList *l;
+  gboolean use_csv = FALSE;
+  gchar *output = NULL;
+  gint n;
+
+  bindtextdomain (GETTEXT_PACKAGE, GNOMELOCALEDIR);
+  bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
+  textdomain (GETTEXT_PACKAGE);
+
+  o = g_option_context_new (_("DEVICE…"));
+  g_option_context_set_summary (o, _("Benchmark one or more block devices and print the results in a machine-readable format."));
+  g_option_context_add_main_entries (o, opt_entries, GETTEXT_PACKAGE);
+  if (!g_option_context_parse (o, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  if (argc < 2)
+    {
+      s = g_option_context_get_help (o, FALSE, NULL);
+      g_printerr ("%s", s);
+      g_free (s);
+      goto out;
+    }
+
+  if (opt_format == NULL || g_strcmp0 (opt_format, "json") == 0)
+    use_csv = FALSE;
+  else if (g_strcmp0 (opt_format, "csv") == 0)
+    use_csv = TRUE;
+  else
+    {
+      g_printerr (_("Unknown output format “%s”\n"), opt_format);
+      goto out;
+    }
+
+  if (opt_num_samples < 0 || opt_sample_size_mib < 1 || opt_num_access_samples < 0)
+    {
+      g_printerr (_("Invalid benchmark parameters\n"));
+      goto out;
+    }
+
+  params.num_samples = opt_num_samples;
+  params.sample_size_mib = opt_sample_size_mib;
+  params.do_write = opt_write;
+  params.num_access_samples = opt_num_access_samples;
+
+  udisks_client = udisks_client_new_sync (NULL, &error);
+  if (udisks_client == NULL)
+    {
+      g_printerr (_("Error connecting to udisks daemon: %s (%s, %d)\n"),
+                  error->message, g_quark_to_string (error->domain), error->code);
+      g_error_free (error);
+      goto out;
+    }
+
+  /* Devices to benchmark are positional arguments */
+  for (n = 1; n < argc; n++)
+    {
+      DeviceData *data = device_data_new (argv[n]);
+      device_data_lookup (data, &data->error);
+      devices = g_list_append (devices, data);
+    }
+
+  main_loop = g_main_loop_new (NULL, FALSE);
+  cancellable = g_cancellable_new ();
+  g_unix_signal_add (SIGINT, on_sigint, NULL);
+  g_unix_signal_add (SIGTERM, on_sigint, NULL);
+
+  /* The benchmark threads block on I/O so the main loop is only used
+   * to catch signals and to learn when the threads are done
+   */
+  if (opt_parallel)
+    {
+      num_threads_running = g_list_length (devices);
+      for (l = devices; l != NULL; l = l->next)
+        g_thread_unref (g_thread_new ("benchmark-thread", benchmark_thread, g_list_append (NULL, l->data)));
+    }
+  else
+    {
+      num_threads_running = 1;
+      g_thread_unref (g_thread_new ("benchmark-thread", benchmark_thread, g_list_copy (devices)));
+    }
+  g_main_loop_run (main_loop);
+
+  if (use_csv)
+    output = format_csv (devices);
+  else
+    output = format_json (devices);
+
+  if (opt_output != NULL)
+    {
+      if (!g_file_set_contents (opt_output, output, -1, &error))
+        {
+          g_printerr (_("Error writing results to “%s”: %s\n"), opt_output, error->message);
+          g_clear_error (&error);
+          goto out;
+        }
+    }
+  else
+    {
+      g_print ("%s", output);
+    }
+
+  ret = 0;
+  for (l = devices; l != NULL; l = l->next)
+    {
+      DeviceData *data = l->data;
+      if (data->error != NULL)
+        {
+          g_printerr ("%s: %s\n", data->device, data->error->message);
+          ret = 1;
+        }
+    }
+
+ out:
+  g_free (output);
+  g_list_free_full (devices, (GDestroyNotify) device_data_free);
+  if (main_loop != NULL)
+    g_main_loop_unref (main_loop);
+  g_clear_object (&cancellable);
+  g_clear_object (&udisks_client);
+  if (o != NULL)
+    g_option_context_free (o);
+  g_free (opt_format);
+  g_free (opt_output);
+  return ret;
+}
@@ -20,6 +20,8 @@
 #include "gducreateformatdialog.h"
 #include "gdurestorediskimagedialog.h"
 #include "gdunewdiskimagedialog.h"
+#include "gdumultibenchmarkdialog.h"
+#include "gdumultierasedialog.h"
 #include "gduwindow.h"
 #include "gdulocaljob.h"
 
@@ -39,6 +41,15 @@ typedef struct
   GtkApplicationClass parent_class;
 } GduApplicationClass;
 
+enum
+{
+  LOCAL_JOBS_CHANGED_SIGNAL,
+  CAPABILITIES_CHANGED_SIGNAL,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = {0};
+
 G_DEFINE_TYPE (GduApplication, gdu_application, GTK_TYPE_APPLICATION);
 
 static void gdu_application_set_options (GduApplication *app);
@@ -107,6 +118,13 @@ gdu_application_should_exit (GduApplication *app)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static void
+on_capabilities_changed (gpointer user_data)
+{
+  GduApplication *app = GDU_APPLICATION (user_data);
+  g_signal_emit (app, signals[CAPABILITIES_CHANGED_SIGNAL], 0);
+}
+
 static void
 gdu_application_ensure_client (GduApplication *app)
 {
@@ -123,6 +141,9 @@ gdu_application_ensure_client (GduApplication *app)
       g_error ("Error getting udisks client: %s", error->message);
       g_error_free (error);
     }
+
+  /* so pages don't have to wait for udisks to probe for tools when first shown */
+  gdu_utils_prefetch_capabilities (app->client, on_capabilities_changed, app);
  out:
   ;
 }
@@ -304,6 +325,24 @@ attach_disk_image_activated (GSimpleAction *action,
   gdu_window_show_attach_disk_image (app->window);
 }
 
+static void
+benchmark_multiple_disks_activated (GSimpleAction *action,
+                                    GVariant      *parameter,
+                                    gpointer       user_data)
+{
+  GduApplication *app = GDU_APPLICATION (user_data);
+  gdu_multi_benchmark_dialog_show (app->window);
+}
+
+static void
+erase_multiple_disks_activated (GSimpleAction *action,
+                                GVariant      *parameter,
+                                gpointer       user_data)
+{
+  GduApplication *app = GDU_APPLICATION (user_data);
+  gdu_multi_erase_dialog_show (app->window);
+}
+
 static void
 shortcuts_activated (GSimpleAction *action,
                      GVariant      *parameter,
@@ -383,6 +422,8 @@ static GActionEntry app_entries[] =
 {
   { "new_disk_image", new_disk_image_activated, NULL, NULL, NULL },
   { "attach_disk_image", attach_disk_image_activated, NULL, NULL, NULL },
+  { "benchmark_multiple_disks", benchmark_multiple_disks_activated, NULL, NULL, NULL },
+  { "erase_multiple_disks", erase_multiple_disks_activated, NULL, NULL, NULL },
   { "shortcuts", shortcuts_activated, NULL, NULL, NULL },
   { "help", help_activated, NULL, NULL, NULL },
   { "about", about_activated, NULL, NULL, NULL },
@@ -443,6 +484,43 @@ gdu_application_class_init (GduApplicationClass *klass)
   application_class->command_line = gdu_application_command_line;
   application_class->activate     = gdu_application_activate;
   application_class->startup      = gdu_application_startup;
+
+  /**
+   * GduApplication::local-jobs-changed:
+   * @application: A #GduApplication.
+   * @object: The #UDisksObject a local job was created or destroyed for.
+   *
+   * Emitted when a local job is created or destroyed.
+   */
+  signals[LOCAL_JOBS_CHANGED_SIGNAL] = g_signal_new ("local-jobs-changed",
+                                                     G_TYPE_FROM_CLASS (klass),
+                                                     G_SIGNAL_RUN_LAST,
+                                                     0,
+                                                     NULL,
+                                                     NULL,
+                                                     g_cclosure_marshal_VOID__OBJECT,
+                                                     G_TYPE_NONE,
+                                                     1,
+                                                     UDISKS_TYPE_OBJECT);
+
+  /**
+   * GduApplication::capabilities-changed:
+   * @application: A #GduApplication.
+   *
+   * Emitted when udisks answered whether a filesystem type can be
+   * resized, repaired or checked after it was first asked for, or
+   * when the answers were dropped since the supported filesystems
+   * changed.
+   */
+  signals[CAPABILITIES_CHANGED_SIGNAL] = g_signal_new ("capabilities-changed",
+                                                       G_TYPE_FROM_CLASS (klass),
+                                                       G_SIGNAL_RUN_LAST,
+                                                       0,
+                                                       NULL,
+                                                       NULL,
+                                                       g_cclosure_marshal_VOID__VOID,
+                                                       G_TYPE_NONE,
+                                                       0);
 }
 
 GApplication *
@@ -533,6 +611,7 @@ gdu_application_create_local_job  (GduApplication *application,
 
   g_signal_connect (job, "notify", G_CALLBACK (on_local_job_notify), application);
 
+  g_signal_emit (application, signals[LOCAL_JOBS_CHANGED_SIGNAL], 0, object);
   udisks_client_queue_changed (application->client);
 
   return job;
@@ -563,6 +642,7 @@ gdu_application_destroy_local_job (GduApplication *application,
   else
     g_hash_table_remove (application->local_jobs, object);
 
+  g_signal_emit (application, signals[LOCAL_JOBS_CHANGED_SIGNAL], 0, object);
   g_object_unref (job);
 
   udisks_client_queue_changed (application->client);
@@ -31,6 +31,30 @@ enum
   N_COLUMNS,
 };
 
+typedef struct
+{
+  guchar id;
+  GtkTreeIter iter; /* the list store's iters persist */
+  gboolean seen;
+
+  /* cached, only depend on the id and name */
+  gchar *desc_str;
+  gchar *long_desc_str;
+
+  /* raw values the row was last formatted from */
+  guint16 flags;
+  gint current;
+  gint worst;
+  gint threshold;
+  guint64 pretty;
+  gint pretty_unit;
+  const gchar *trend;
+
+  /* oldest recorded value in the trend span, looked up once when the row is created */
+  gboolean have_trend_base;
+  gint64 trend_base;
+} AttributeRow;
+
 typedef struct
 {
   volatile guint ref_count;
@@ -42,6 +66,9 @@ typedef struct
   GtkBuilder *builder;
 
   GtkListStore *attributes_list;
+  GHashTable *attribute_rows; /* attribute id -> AttributeRow */
+
+  GduSmartHistory *history; /* recorded by gsd-disk-utility-notify, may be NULL */
 
   GtkWidget *enabled_switch;
   GtkWidget *status_grid;
@@ -123,6 +150,10 @@ dialog_data_unref (DialogData *data)
 
       if (data->attributes_list != NULL)
         g_object_unref (data->attributes_list);
+      if (data->attribute_rows != NULL)
+        g_hash_table_unref (data->attribute_rows);
+      if (data->history != NULL)
+        gdu_smart_history_free (data->history);
 
       g_free (data);
     }
@@ -769,6 +800,53 @@ pretty_to_string (guint64 pretty,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* The trend arrows compare the current value to the oldest one from the last week */
+#define TREND_SPAN_SECS (7 * 24 * 60 * 60)
+
+/* The history is only loaded when the dialog is opened, so this is only
+ * needed once per attribute rather than on every refresh
+ */
+static gboolean
+attr_get_trend_base (DialogData *data,
+                     gint        id,
+                     gint64     *out_base)
+{
+  gboolean ret = FALSE;
+  GArray *points;
+
+  if (data->history == NULL)
+    goto out;
+
+  points = gdu_smart_history_get_points (data->history, id, time (NULL) - TREND_SPAN_SECS);
+  if (points->len > 0)
+    {
+      *out_base = g_array_index (points, GduSmartHistoryPoint, 0).pretty;
+      ret = TRUE;
+    }
+  g_array_unref (points);
+
+ out:
+  return ret;
+}
+
+static const gchar *
+attr_get_trend (AttributeRow *row,
+                guint64       pretty)
+{
+  const gchar *ret = "";
+
+  if (!row->have_trend_base)
+    goto out;
+
+  if ((gint64) pretty > row->trend_base)
+    ret = " ↑";
+  else if ((gint64) pretty < row->trend_base)
+    ret = " ↓";
+
+ out:
+  return ret;
+}
+
 static gchar *
 calculate_self_test (UDisksDriveAta *ata,
                      gboolean       *out_selftest_running)
@@ -1059,27 +1137,122 @@ gdu_ata_smart_get_one_liner_assessment (UDisksDriveAta *ata,
 /* ---------------------------------------------------------------------------------------------------- */
 
 static void
-update_attributes_list (DialogData *data,
-                        GVariant   *attributes)
+attribute_row_free (AttributeRow *row)
 {
-  GtkTreeIter tree_iter;
-  GtkTreeIter *tree_iter_to_select;
-  gint selected_id;
+  g_free (row->desc_str);
+  g_free (row->long_desc_str);
+  g_free (row);
+}
+
+/* Updates the row of an attribute, only touching the cells whose raw values changed */
+static void
+update_attribute_row (DialogData   *data,
+                      AttributeRow *row,
+                      gboolean      is_new,
+                      guint16       flags,
+                      gint          current,
+                      gint          worst,
+                      gint          threshold,
+                      guint64       pretty,
+                      gint          pretty_unit)
+{
+  const gchar *trend;
+
+  trend = attr_get_trend (row, pretty);
+
+  if (is_new ||
+      row->flags != flags ||
+      row->current != current ||
+      row->worst != worst ||
+      row->threshold != threshold)
+    {
+      gchar *assessment_str;
+      gchar *current_str;
+      gchar *threshold_str;
+      gchar *worst_str;
+      const gchar *type_str;
+      const gchar *updates_str;
+      const gchar *na_str;
+
+      assessment_str = attr_format_assessment (current, worst, threshold, flags);
+
+      if (flags & 0x0001)
+        type_str = _("Pre-Fail");
+      else
+        type_str = _("Old-Age");
+
+      if (flags & 0x0002)
+        updates_str = _("Online");
+      else
+        updates_str = _("Offline");
+
+      /* Translators: Shown for normalized values (current, worst, threshold) if the value is
+       * not applicable, e.g. meaningless. See http://en.wikipedia.org/wiki/N/A
+       */
+      na_str = _("N/A");
+      current_str   = (current == -1   ? g_strdup (na_str) : g_strdup_printf ("%d", current));
+      threshold_str = (threshold == -1 ? g_strdup (na_str) : g_strdup_printf ("%d", threshold));
+      worst_str     = (worst == -1     ? g_strdup (na_str) : g_strdup_printf ("%d", worst));
+
+      gtk_list_store_set (data->attributes_list, &row->iter,
+                          ASSESSMENT_COLUMN, assessment_str,
+                          NORMALIZED_COLUMN, current_str,
+                          THRESHOLD_COLUMN, threshold_str,
+                          WORST_COLUMN, worst_str,
+                          TYPE_COLUMN, type_str,
+                          UPDATES_COLUMN, updates_str,
+                          FLAGS_COLUMN, flags,
+                          -1);
+
+      g_free (assessment_str);
+      g_free (current_str);
+      g_free (threshold_str);
+      g_free (worst_str);
 
-  /* record currently selected row so we can reselect it */
-  selected_id = -1;
-  tree_iter_to_select = NULL;
-  if (gtk_tree_selection_get_selected (gtk_tree_view_get_selection (GTK_TREE_VIEW (data->attributes_treeview)),
-                                       NULL,
-                                       &tree_iter))
+      row->flags = flags;
+      row->current = current;
+      row->worst = worst;
+      row->threshold = threshold;
+    }
+
+  if (is_new ||
+      row->pretty != pretty ||
+      row->pretty_unit != pretty_unit ||
+      row->trend != trend)
     {
-      gtk_tree_model_get (GTK_TREE_MODEL (data->attributes_list),
-                          &tree_iter,
-                          ID_COLUMN, &selected_id,
+      gchar *s;
+      gchar *pretty_str;
+
+      s = pretty_to_string (pretty, pretty_unit);
+      pretty_str = g_strconcat (s, trend, NULL);
+      gtk_list_store_set (data->attributes_list, &row->iter,
+                          PRETTY_COLUMN, pretty_str,
                           -1);
+      g_free (pretty_str);
+      g_free (s);
+
+      row->pretty = pretty;
+      row->pretty_unit = pretty_unit;
+      row->trend = trend;
     }
+}
+
+static void
+update_attributes_list (DialogData *data,
+                        GVariant   *attributes)
+{
+  GHashTableIter hash_iter;
+  AttributeRow *row;
+  GtkTreeIter titer;
+
+  /* rows are keyed by attribute id and only updated where something
+   * changed - this keeps the selection and scroll position and avoids
+   * relayouting the whole list on every refresh
+   */
+  g_hash_table_iter_init (&hash_iter, data->attribute_rows);
+  while (g_hash_table_iter_next (&hash_iter, NULL, (gpointer *) &row))
+    row->seen = FALSE;
 
-  gtk_list_store_clear (data->attributes_list);
   if (attributes != NULL)
     {
       GVariantIter iter;
@@ -1100,88 +1273,54 @@ update_attributes_list (DialogData *data,
                                   &pretty, &pretty_unit,
                                   &expansion))
         {
-          GtkTreeIter titer;
-          gchar *long_desc_str;
-          gchar *desc_str;
-          gchar *assessment_str;
-          gchar *pretty_str;
-          gchar *current_str;
-          gchar *threshold_str;
-          gchar *worst_str;
-          const gchar *type_str;
-          const gchar *updates_str;
-          const gchar *na_str;
-
-          desc_str = attr_format_desc (id, name);
-          long_desc_str = attr_format_long_desc (id, name);
-          assessment_str = attr_format_assessment (current, worst, threshold, flags);
-          pretty_str = pretty_to_string (pretty, pretty_unit);
-
-          if (flags & 0x0001)
-            type_str = _("Pre-Fail");
-          else
-            type_str = _("Old-Age");
-
-          if (flags & 0x0002)
-            updates_str = _("Online");
-          else
-            updates_str = _("Offline");
-
-          /* Translators: Shown for normalized values (current, worst, threshold) if the value is
-           * not applicable, e.g. meaningless. See http://en.wikipedia.org/wiki/N/A
-           */
-          na_str = _("N/A");
-          current_str   = (current == -1   ? g_strdup (na_str) : g_strdup_printf ("%d", current));
-          threshold_str = (threshold == -1 ? g_strdup (na_str) : g_strdup_printf ("%d", threshold));
-          worst_str     = (worst == -1     ? g_strdup (na_str) : g_strdup_printf ("%d", worst));
-
-          gtk_list_store_append (data->attributes_list, &titer);
-          gtk_list_store_set (data->attributes_list, &titer,
-                              ID_COLUMN, (gint) id,
-                              DESC_COLUMN, desc_str,
-                              LONG_DESC_COLUMN, long_desc_str,
-                              ASSESSMENT_COLUMN, assessment_str,
-                              PRETTY_COLUMN, pretty_str,
-                              NORMALIZED_COLUMN, current_str,
-                              THRESHOLD_COLUMN, threshold_str,
-                              WORST_COLUMN, worst_str,
-                              TYPE_COLUMN, type_str,
-                              UPDATES_COLUMN, updates_str,
-                              FLAGS_COLUMN, flags,
-                              -1);
-
-          if (id == selected_id)
-            tree_iter_to_select = gtk_tree_iter_copy (&titer);
-
-          g_free (desc_str);
-          g_free (long_desc_str);
-          g_free (assessment_str);
-          g_free (pretty_str);
-          g_free (current_str);
-          g_free (threshold_str);
-          g_free (worst_str);
+          gboolean is_new = FALSE;
+
+          row = g_hash_table_lookup (data->attribute_rows, GINT_TO_POINTER ((gint) id));
+          if (row == NULL)
+            {
+              /* the descriptions only depend on the id and name so they're formatted once */
+              row = g_new0 (AttributeRow, 1);
+              row->id = id;
+              row->desc_str = attr_format_desc (id, name);
+              row->long_desc_str = attr_format_long_desc (id, name);
+              row->have_trend_base = attr_get_trend_base (data, id, &row->trend_base);
+              gtk_list_store_insert_with_values (data->attributes_list, &row->iter, -1,
+                                                 ID_COLUMN, (gint) id,
+                                                 DESC_COLUMN, row->desc_str,
+                                                 LONG_DESC_COLUMN, row->long_desc_str,
+                                                 -1);
+              g_hash_table_insert (data->attribute_rows, GINT_TO_POINTER ((gint) id), row);
+              is_new = TRUE;
+            }
+          row->seen = TRUE;
+
+          update_attribute_row (data, row, is_new,
+                                flags, current, worst, threshold, pretty, pretty_unit);
 
           g_variant_unref (expansion);
         }
     }
 
-  /* reselect the previously selected row */
-  if (tree_iter_to_select != NULL)
+  /* remove attributes no longer reported */
+  g_hash_table_iter_init (&hash_iter, data->attribute_rows);
+  while (g_hash_table_iter_next (&hash_iter, NULL, (gpointer *) &row))
     {
-      gtk_tree_selection_select_iter (gtk_tree_view_get_selection (GTK_TREE_VIEW (data->attributes_treeview)),
-                                      tree_iter_to_select);
-      gtk_tree_iter_free (tree_iter_to_select);
-    }
-  else
-    {
-      GtkTreeIter titer;
-      /* or the first row, if the previously selected one does not exist anymore */
-      if (gtk_tree_model_get_iter_first (GTK_TREE_MODEL (data->attributes_list), &titer))
+      if (!row->seen)
         {
-          gtk_tree_selection_select_iter (gtk_tree_view_get_selection (GTK_TREE_VIEW (data->attributes_treeview)),
-                                          &titer);
+          gtk_list_store_remove (data->attributes_list, &row->iter);
+          g_hash_table_iter_remove (&hash_iter);
         }
     }
+
+  /* select the first row if nothing is selected, e.g. on the first update */
+  if (!gtk_tree_selection_get_selected (gtk_tree_view_get_selection (GTK_TREE_VIEW (data->attributes_treeview)),
+                                        NULL,
+                                        NULL) &&
+      gtk_tree_model_get_iter_first (GTK_TREE_MODEL (data->attributes_list), &titer))
+    {
+      gtk_tree_selection_select_iter (gtk_tree_view_get_selection (GTK_TREE_VIEW (data->attributes_treeview)),
+                                      &titer);
+    }
 }
 
 static void
@@ -1486,12 +1625,28 @@ gdu_ata_smart_dialog_show (GduWindow    *window,
   GtkCellRenderer *renderer;
   gulong notify_id;
   guint timeout_id;
+  UDisksDrive *drive;
 
   data = g_new0 (DialogData, 1);
   data->ref_count = 1;
   data->object = g_object_ref (object);
   data->ata = udisks_object_peek_drive_ata (data->object);
   data->window = g_object_ref (window);
+  data->attribute_rows = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                                (GDestroyNotify) attribute_row_free);
+
+  drive = udisks_object_peek_drive (data->object);
+  if (drive != NULL && udisks_drive_get_id (drive) != NULL && udisks_drive_get_id (drive)[0] != '\0')
+    {
+      GError *error = NULL;
+      data->history = gdu_smart_history_load (udisks_drive_get_id (drive), &error);
+      if (data->history == NULL)
+        {
+          g_warning ("Error loading ATA SMART history: %s (%s, %d)",
+                     error->message, g_quark_to_string (error->domain), error->code);
+          g_clear_error (&error);
+        }
+    }
 
   data->dialog = GTK_WIDGET (gdu_application_new_widget (gdu_window_get_application (window),
                                                          "smart-dialog.ui",
@@ -10,13 +10,10 @@
 #include "config.h"
 
 #include <glib/gi18n.h>
-#include <gio/gunixfdlist.h>
 #include <gio/gunixinputstream.h>
 #include <gio/gunixoutputstream.h>
 
 #include <glib-unix.h>
-#include <sys/ioctl.h>
-#include <linux/fs.h>
 
 #include <math.h>
 
@@ -26,10 +23,34 @@
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-typedef struct {
-  guint64 offset;
-  gdouble value;
-} BMSample;
+typedef GduBenchmarkSample BMSample;
+
+/* Maximum number of previous runs to overlay on the graph and to compare against */
+#define BM_HISTORY_MAX_RUNS 5
+
+typedef struct
+{
+  gint64 timestamp_usec;
+  guint64 size;
+  guint64 sample_size;
+  GArray *read_samples;
+  GArray *write_samples;
+  GArray *access_time_samples;
+  gboolean full_scan;
+} BMRun;
+
+/* Number of zones the transfer rate of a full surface scan is averaged over */
+#define BM_SCAN_NUM_ZONES 1000
+
+/* Number of slowest chunks to remember during a full surface scan */
+#define BM_SCAN_NUM_SLOWEST 100
+
+typedef struct
+{
+  guint64 bytes;
+  gdouble usec;
+  guint sample_index; /* index into bm_read_samples and bm_scan_min_samples */
+} BMScanZone;
 
 /* ---------------------------------------------------------------------------------------------------- */
 
@@ -37,6 +58,7 @@ typedef enum {
   BM_STATE_NONE,
   BM_STATE_OPENING_DEVICE,
   BM_STATE_TRANSFER_RATE,
+  BM_STATE_SCAN,
   BM_STATE_ACCESS_TIME,
 } BMState;
 
@@ -75,6 +97,10 @@ typedef struct
   gint bm_sample_size_mib;
   gboolean bm_do_write;
   gint bm_num_access_samples;
+  gboolean bm_full_scan;
+
+  /* only accessed with g_atomic_int_*() so scheduling updates doesn't need bm_lock */
+  gint bm_update_timeout_pending;
 
   /* must hold bm_lock when reading/writing these */
   GThread *bm_thread;
@@ -82,7 +108,6 @@ typedef struct
   gboolean bm_in_progress;
   BMState bm_state;
   GError *bm_error; /* set by benchmark thread on termination */
-  gboolean bm_update_timeout_pending;
 
   gint64 bm_time_benchmarked_usec; /* 0 if never benchmarked, otherwise micro-seconds since Epoch */
   guint64 bm_size;
@@ -90,6 +115,20 @@ typedef struct
   GArray *bm_read_samples;
   GArray *bm_write_samples;
   GArray *bm_access_time_samples;
+  GArray *bm_scan_min_samples; /* slowest chunk in each zone, empty unless a full surface scan was done */
+  GArray *bm_scan_zones;       /* of BMScanZone, only valid during a full surface scan */
+  GArray *bm_slowest_chunks;   /* of BMSample, only valid during a full surface scan */
+  guint64 bm_scan_bytes_done;
+
+  /* only used on the main / UI thread */
+  GPtrArray *bm_history; /* of BMRun, previous runs comparable to the current one, newest first */
+  gint64 bm_history_timestamp_usec; /* the run bm_history was loaded for */
+  gboolean bm_read_regression;
+  gboolean bm_write_regression;
+  gboolean bm_access_time_regression;
+  gdouble bm_read_change;
+  gdouble bm_write_change;
+  gdouble bm_access_time_change;
 
 } DialogData;
 
@@ -114,6 +153,12 @@ static void update_dialog (DialogData *data);
 static gboolean maybe_load_data (DialogData  *data,
                                  GError     **error);
 
+static void bm_run_free (BMRun *run);
+static void load_history (DialogData *data);
+static gchar *append_regression_markup (gchar    *s,
+                                        gboolean  regression,
+                                        gdouble   change);
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static DialogData *
@@ -142,6 +187,10 @@ dialog_data_unref (DialogData *data)
       g_array_unref (data->bm_read_samples);
       g_array_unref (data->bm_write_samples);
       g_array_unref (data->bm_access_time_samples);
+      g_array_unref (data->bm_scan_min_samples);
+      g_array_unref (data->bm_scan_zones);
+      g_array_unref (data->bm_slowest_chunks);
+      g_ptr_array_unref (data->bm_history);
       g_clear_object (&data->bm_cancellable);
       g_clear_error (&data->bm_error);
 
@@ -273,6 +322,17 @@ on_drawing_area_draw (GtkWidget      *widget,
                    NULL,
                    NULL);
 
+  for (n = 0; n < data->bm_history->len; n++)
+    {
+      BMRun *run = data->bm_history->pdata[n];
+      gdouble run_max;
+
+      get_max_min_avg (run->read_samples, &run_max, NULL, NULL);
+      read_transfer_rate_max = MAX (read_transfer_rate_max, run_max);
+      get_max_min_avg (run->write_samples, &run_max, NULL, NULL);
+      write_transfer_rate_max = MAX (write_transfer_rate_max, run_max);
+    }
+
   max_speed = MAX (read_transfer_rate_max, write_transfer_rate_max);
   max_time = access_time_max;
 
@@ -511,6 +571,68 @@ on_drawing_area_draw (GtkWidget      *widget,
       cairo_stroke (cr);
     }
 
+  /* draw the slowest chunk of each zone of a full surface scan as a
+   * heatmap at the bottom of the graph, from red (slow) to green (fast)
+   */
+  for (n = 0; n < data->bm_scan_min_samples->len && n < data->bm_read_samples->len; n++)
+    {
+      BMSample *sample = &g_array_index (data->bm_scan_min_samples, BMSample, n);
+      BMSample *zone = &g_array_index (data->bm_read_samples, BMSample, n);
+      guint64 end_offset;
+      gdouble ratio;
+
+      if (n + 1 < data->bm_read_samples->len)
+        end_offset = g_array_index (data->bm_read_samples, BMSample, n + 1).offset;
+      else
+        end_offset = data->bm_size;
+      ratio = CLAMP (sample->value / read_transfer_rate_max, 0.0, 1.0);
+
+      x = gx + gw * zone->offset / data->bm_size;
+      w = gw * (end_offset - zone->offset) / data->bm_size;
+      cairo_set_source_rgba (cr, 1.0 - ratio, ratio, 0.0, 0.75);
+      cairo_rectangle (cr, x + 0.5, gy + gh - 10 + 0.5, MAX (w, 1.0), 10);
+      cairo_fill (cr);
+    }
+
+  /* draw previous runs, older runs are fainter */
+  cairo_set_line_width (cr, 1.0);
+  for (n = 0; n < data->bm_history->len; n++)
+    {
+      BMRun *run = data->bm_history->pdata[n];
+      gdouble alpha = 0.35 * (BM_HISTORY_MAX_RUNS - n) / BM_HISTORY_MAX_RUNS;
+      guint m;
+
+      cairo_set_source_rgba (cr, 0.5, 0.5, 1.0, alpha);
+      for (m = 0; m < run->read_samples->len; m++)
+        {
+          BMSample *sample = &g_array_index (run->read_samples, BMSample, m);
+
+          x = gx + gw * sample->offset / run->size;
+          y = gy + gh - gh * sample->value / max_visible_speed;
+
+          if (m == 0)
+            cairo_move_to (cr, x, y);
+          else
+            cairo_line_to (cr, x, y);
+        }
+      cairo_stroke (cr);
+
+      cairo_set_source_rgba (cr, 1.0, 0.5, 0.5, alpha);
+      for (m = 0; m < run->write_samples->len; m++)
+        {
+          BMSample *sample = &g_array_index (run->write_samples, BMSample, m);
+
+          x = gx + gw * sample->offset / run->size;
+          y = gy + gh - gh * sample->value / max_visible_speed;
+
+          if (m == 0)
+            cairo_move_to (cr, x, y);
+          else
+            cairo_line_to (cr, x, y);
+        }
+      cairo_stroke (cr);
+    }
+
   /* draw read graph */
   cairo_set_source_rgb (cr, 0.5, 0.5, 1.0);
   cairo_set_line_width (cr, 1.5);
@@ -741,6 +863,13 @@ update_updated_label (DialogData *data)
       g_free (s);
       break;
 
+    case BM_STATE_SCAN:
+      s = g_strdup_printf (C_("benchmark-updated", "Scanning surface (%2.1f%% complete)…"),
+                           data->bm_size > 0 ? data->bm_scan_bytes_done * 100.0 / data->bm_size : 0.0);
+      gtk_label_set_markup (GTK_LABEL (data->updated_label), s);
+      g_free (s);
+      break;
+
     case BM_STATE_ACCESS_TIME:
       s = g_strdup_printf (C_("benchmark-updated", "Measuring access time (%2.1f%% complete)…"),
                            data->bm_access_time_samples->len * 100.0 / data->bm_num_access_samples);
@@ -758,7 +887,8 @@ update_updated_label (DialogData *data)
  * non-drive devices etc.)
  */
 static gchar *
-get_bm_filename (DialogData *data)
+get_bm_filename (DialogData  *data,
+                 const gchar *extension)
 {
   gchar *ret = NULL;
   gchar *bench_dir = NULL;
@@ -775,7 +905,7 @@ get_bm_filename (DialogData *data)
       goto out;
     }
 
-  ret = g_strdup_printf ("%s/%s.gnome-disks-benchmark", bench_dir, id);
+  ret = g_strdup_printf ("%s/%s.%s", bench_dir, id, extension);
 
  out:
   g_free (bench_dir);
@@ -853,6 +983,9 @@ update_dialog (DialogData *data)
 
   G_UNLOCK (bm_lock);
 
+  if (!data->bm_in_progress && data->bm_history_timestamp_usec != data->bm_time_benchmarked_usec)
+    load_history (data);
+
   if (data->bm_sample_size == 0)
     s = g_strdup ("–");
   else
@@ -863,14 +996,18 @@ update_dialog (DialogData *data)
   if (read_avg == 0.0)
     s = g_strdup ("–");
   else
-    s = format_transfer_rate_and_num_samples (read_avg, data->bm_read_samples->len);
+    s = append_regression_markup (format_transfer_rate_and_num_samples (read_avg, data->bm_read_samples->len),
+                                  data->bm_read_regression && !data->bm_in_progress,
+                                  data->bm_read_change);
   gtk_label_set_markup (GTK_LABEL (data->read_rate_label), s);
   g_free (s);
 
   if (write_avg == 0.0)
     s = g_strdup ("–");
   else
-    s = format_transfer_rate_and_num_samples (write_avg, data->bm_write_samples->len);
+    s = append_regression_markup (format_transfer_rate_and_num_samples (write_avg, data->bm_write_samples->len),
+                                  data->bm_write_regression && !data->bm_in_progress,
+                                  data->bm_write_change);
   gtk_label_set_markup (GTK_LABEL (data->write_rate_label), s);
   g_free (s);
 
@@ -890,6 +1027,9 @@ update_dialog (DialogData *data)
                                          data->bm_access_time_samples->len),
                             data->bm_access_time_samples->len);
       s = g_strdup_printf ("%s <small>(%s)</small>", s2, s3);
+      s = append_regression_markup (s,
+                                    data->bm_access_time_regression && !data->bm_in_progress,
+                                    data->bm_access_time_change);
       g_free (s3);
       g_free (s2);
     }
@@ -946,12 +1086,13 @@ maybe_load_data (DialogData  *data,
   GVariant *read_samples_variant = NULL;
   GVariant *write_samples_variant = NULL;
   GVariant *access_time_samples_variant = NULL;
+  GVariant *scan_min_samples_variant = NULL;
   gint32 version;
   gint64 timestamp_usec;
   guint64 device_size;
   guint64 sample_size;
 
-  filename = get_bm_filename (data);
+  filename = get_bm_filename (data, "gnome-disks-benchmark");
   if (filename == NULL)
     {
       /* all good since we don't want to load data for this device */
@@ -1043,6 +1184,11 @@ maybe_load_data (DialogData  *data,
   samples_from_gvariant (data->bm_write_samples, write_samples_variant);
   samples_from_gvariant (data->bm_access_time_samples, access_time_samples_variant);
 
+  /* only present if a full surface scan was done */
+  g_array_set_size (data->bm_scan_min_samples, 0);
+  if (g_variant_lookup (value, "scan-min-samples", "@a(td)", &scan_min_samples_variant))
+    samples_from_gvariant (data->bm_scan_min_samples, scan_min_samples_variant);
+
   ret = TRUE;
 
  out:
@@ -1052,6 +1198,8 @@ maybe_load_data (DialogData  *data,
     g_variant_unref (write_samples_variant);
   if (access_time_samples_variant != NULL)
     g_variant_unref (access_time_samples_variant);
+  if (scan_min_samples_variant != NULL)
+    g_variant_unref (scan_min_samples_variant);
   if (value != NULL)
     g_variant_unref (value);
   g_free (variant_data);
@@ -1061,6 +1209,204 @@ maybe_load_data (DialogData  *data,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static void
+bm_run_free (BMRun *run)
+{
+  g_array_unref (run->read_samples);
+  g_array_unref (run->write_samples);
+  g_array_unref (run->access_time_samples);
+  g_free (run);
+}
+
+/* returns NULL if @value isn't a valid version 1 run */
+static BMRun *
+bm_run_new_from_gvariant (GVariant *value)
+{
+  BMRun *run = NULL;
+  GVariant *read_samples_variant = NULL;
+  GVariant *write_samples_variant = NULL;
+  GVariant *access_time_samples_variant = NULL;
+  gint32 version;
+  gint64 timestamp_usec;
+  guint64 device_size;
+  guint64 sample_size;
+
+  if (!g_variant_lookup (value, "version", "i", &version) || version != 1 ||
+      !g_variant_lookup (value, "timestamp-usec", "x", &timestamp_usec) ||
+      !g_variant_lookup (value, "device-size", "t", &device_size) ||
+      !g_variant_lookup (value, "sample-size", "t", &sample_size) ||
+      !g_variant_lookup (value, "read-samples", "@a(td)", &read_samples_variant) ||
+      !g_variant_lookup (value, "write-samples", "@a(td)", &write_samples_variant) ||
+      !g_variant_lookup (value, "access-time-samples", "@a(td)", &access_time_samples_variant))
+    goto out;
+
+  if (device_size == 0)
+    goto out;
+
+  run = g_new0 (BMRun, 1);
+  run->timestamp_usec = timestamp_usec;
+  run->size = device_size;
+  run->sample_size = sample_size;
+  run->read_samples = g_array_new (FALSE, FALSE, sizeof (BMSample));
+  run->write_samples = g_array_new (FALSE, FALSE, sizeof (BMSample));
+  run->access_time_samples = g_array_new (FALSE, FALSE, sizeof (BMSample));
+  samples_from_gvariant (run->read_samples, read_samples_variant);
+  samples_from_gvariant (run->write_samples, write_samples_variant);
+  samples_from_gvariant (run->access_time_samples, access_time_samples_variant);
+  run->full_scan = g_variant_lookup (value, "scan-min-samples", "@a(td)", NULL);
+
+ out:
+  if (read_samples_variant != NULL)
+    g_variant_unref (read_samples_variant);
+  if (write_samples_variant != NULL)
+    g_variant_unref (write_samples_variant);
+  if (access_time_samples_variant != NULL)
+    g_variant_unref (access_time_samples_variant);
+  return run;
+}
+
+/* compares @current against the samples of all runs in the history */
+static gboolean
+check_regression (DialogData *data,
+                  GArray     *current,
+                  goffset     run_samples_offset,
+                  gboolean    higher_is_better,
+                  gdouble    *out_change)
+{
+  GArray *baseline_values;
+  GArray *current_values;
+  gboolean ret;
+  guint n, m;
+
+  baseline_values = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  for (n = 0; n < data->bm_history->len; n++)
+    {
+      BMRun *run = data->bm_history->pdata[n];
+      GArray *samples = G_STRUCT_MEMBER (GArray *, run, run_samples_offset);
+      for (m = 0; m < samples->len; m++)
+        g_array_append_val (baseline_values, g_array_index (samples, BMSample, m).value);
+    }
+
+  current_values = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  for (m = 0; m < current->len; m++)
+    g_array_append_val (current_values, g_array_index (current, BMSample, m).value);
+
+  ret = gdu_benchmark_is_regression ((const gdouble *) baseline_values->data, baseline_values->len,
+                                     (const gdouble *) current_values->data, current_values->len,
+                                     higher_is_better,
+                                     out_change);
+
+  g_array_unref (current_values);
+  g_array_unref (baseline_values);
+  return ret;
+}
+
+/* Loads the previous runs that are comparable to the current one and
+ * checks whether the current one is a regression. Must not be called
+ * while a benchmark is in progress.
+ */
+static void
+load_history (DialogData *data)
+{
+  GduBenchmarkHistory *history = NULL;
+  gchar *filename = NULL;
+  GError *error = NULL;
+  gint n;
+
+  g_ptr_array_set_size (data->bm_history, 0);
+  data->bm_history_timestamp_usec = data->bm_time_benchmarked_usec;
+  data->bm_read_regression = FALSE;
+  data->bm_write_regression = FALSE;
+  data->bm_access_time_regression = FALSE;
+
+  if (data->bm_time_benchmarked_usec == 0)
+    goto out;
+
+  filename = get_bm_filename (data, "gnome-disks-benchmark-history");
+  if (filename == NULL)
+    goto out;
+
+  history = gdu_benchmark_history_load (filename, &error);
+  if (history == NULL)
+    {
+      /* not worth complaining in dialog about */
+      g_warning ("Error loading benchmark history: %s (%s, %d)",
+                 error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  for (n = (gint) gdu_benchmark_history_get_n_runs (history) - 1;
+       n >= 0 && data->bm_history->len < BM_HISTORY_MAX_RUNS;
+       n--)
+    {
+      GVariant *value;
+      BMRun *run;
+
+      value = gdu_benchmark_history_get_run (history, n);
+      run = bm_run_new_from_gvariant (value);
+      g_variant_unref (value);
+      if (run == NULL)
+        continue;
+
+      /* only compare against earlier runs of the same device with the same parameters */
+      if (run->timestamp_usec >= data->bm_time_benchmarked_usec ||
+          run->size != data->bm_size ||
+          run->sample_size != data->bm_sample_size ||
+          run->full_scan != (data->bm_scan_min_samples->len > 0))
+        {
+          bm_run_free (run);
+          continue;
+        }
+      g_ptr_array_add (data->bm_history, run);
+    }
+
+  data->bm_read_regression = check_regression (data,
+                                               data->bm_read_samples,
+                                               G_STRUCT_OFFSET (BMRun, read_samples),
+                                               TRUE, /* higher_is_better */
+                                               &data->bm_read_change);
+  data->bm_write_regression = check_regression (data,
+                                                data->bm_write_samples,
+                                                G_STRUCT_OFFSET (BMRun, write_samples),
+                                                TRUE, /* higher_is_better */
+                                                &data->bm_write_change);
+  data->bm_access_time_regression = check_regression (data,
+                                                      data->bm_access_time_samples,
+                                                      G_STRUCT_OFFSET (BMRun, access_time_samples),
+                                                      FALSE, /* higher_is_better */
+                                                      &data->bm_access_time_change);
+
+ out:
+  if (history != NULL)
+    gdu_benchmark_history_free (history);
+  g_free (filename);
+}
+
+/* takes ownership of @s */
+static gchar *
+append_regression_markup (gchar    *s,
+                          gboolean  regression,
+                          gdouble   change)
+{
+  gchar *s2;
+  gchar *ret;
+
+  if (!regression)
+    return s;
+
+  /* Translators: Shown next to a benchmark result that is significantly worse than
+   * the previous results for the same disk - %.0f is the difference in percent
+   */
+  s2 = g_strdup_printf (C_("benchmark-regression", "%.0f%% worse than previous runs"), fabs (change) * 100.0);
+  ret = g_strdup_printf ("%s — <span foreground=\"#ff0000\"><b>%s</b></span>", s, s2);
+  g_free (s2);
+  g_free (s);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static GVariant *
 samples_to_gvariant (GArray *array)
 {
@@ -1089,7 +1435,7 @@ maybe_save_data (DialogData  *data,
   gconstpointer variant_data;
   gsize variant_size;
 
-  filename = get_bm_filename (data);
+  filename = get_bm_filename (data, "gnome-disks-benchmark");
   if (filename == NULL)
     {
       /* all good since we don't want to save data for this device */
@@ -1105,6 +1451,8 @@ maybe_save_data (DialogData  *data,
   g_variant_builder_add (&builder, "{sv}", "read-samples", samples_to_gvariant (data->bm_read_samples));
   g_variant_builder_add (&builder, "{sv}", "write-samples", samples_to_gvariant (data->bm_write_samples));
   g_variant_builder_add (&builder, "{sv}", "access-time-samples", samples_to_gvariant (data->bm_access_time_samples));
+  if (data->bm_scan_min_samples->len > 0)
+    g_variant_builder_add (&builder, "{sv}", "scan-min-samples", samples_to_gvariant (data->bm_scan_min_samples));
   value = g_variant_builder_end (&builder);
 
   variant_data = g_variant_get_data (value);
@@ -1116,6 +1464,22 @@ maybe_save_data (DialogData  *data,
                             error))
     goto out;
 
+  /* also keep every run around so the dialog can compare against them */
+  g_free (filename);
+  filename = get_bm_filename (data, "gnome-disks-benchmark-history");
+  if (filename != NULL)
+    {
+      GError *local_error = NULL;
+      if (!gdu_benchmark_history_append (filename, value, &local_error))
+        {
+          g_warning ("Error appending to benchmark history: %s (%s, %d)",
+                     local_error->message, g_quark_to_string (local_error->domain), local_error->code);
+          g_clear_error (&local_error);
+        }
+    }
+
+  ret = TRUE;
+
  out:
   if (value != NULL)
     g_variant_unref (value);
@@ -1123,6 +1487,63 @@ maybe_save_data (DialogData  *data,
   return ret;
 }
 
+static gint
+compare_sample_offset (gconstpointer a,
+                       gconstpointer b)
+{
+  const BMSample *sa = a;
+  const BMSample *sb = b;
+  return sa->offset < sb->offset ? -1 : (sa->offset > sb->offset ? 1 : 0);
+}
+
+/* Saves the slowest chunks found by a full surface scan, sorted by
+ * offset, as a small text file that can be compared between scans
+ */
+static gboolean
+maybe_save_slow_regions (DialogData  *data,
+                         GError     **error)
+{
+  gboolean ret = FALSE;
+  gchar *filename = NULL;
+  GString *str = NULL;
+  guint n;
+
+  filename = get_bm_filename (data, "gnome-disks-slow-regions");
+  if (filename == NULL)
+    {
+      /* all good since we don't want to save data for this device */
+      ret = TRUE;
+      goto out;
+    }
+
+  g_array_sort (data->bm_slowest_chunks, compare_sample_offset);
+
+  str = g_string_new (NULL);
+  g_string_append_printf (str, "# %s\n", udisks_block_get_preferred_device (data->block));
+  g_string_append_printf (str, "# device-size=%" G_GUINT64_FORMAT " chunk-size=%" G_GUINT64_FORMAT " timestamp-usec=%" G_GINT64_FORMAT "\n",
+                          data->bm_size, data->bm_sample_size, data->bm_time_benchmarked_usec);
+  g_string_append (str, "# offset,size,bytes-per-second\n");
+  for (n = 0; n < data->bm_slowest_chunks->len; n++)
+    {
+      BMSample *sample = &g_array_index (data->bm_slowest_chunks, BMSample, n);
+      g_string_append_printf (str, "%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%.0f\n",
+                              sample->offset,
+                              MIN (data->bm_sample_size, data->bm_size - sample->offset),
+                              sample->value);
+    }
+
+  if (!g_file_set_contents (filename, str->str, str->len, error))
+    goto out;
+
+  ret = TRUE;
+
+ out:
+  if (str != NULL)
+    g_string_free (str, TRUE);
+  g_free (filename);
+  return ret;
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 /* called on main / UI thread */
@@ -1130,10 +1551,8 @@ static gboolean
 bmt_on_timeout (gpointer user_data)
 {
   DialogData *data = user_data;
+  g_atomic_int_set (&data->bm_update_timeout_pending, FALSE);
   update_dialog (data);
-  G_LOCK (bm_lock);
-  data->bm_update_timeout_pending = FALSE;
-  G_UNLOCK (bm_lock);
   dialog_data_unref (data);
   return FALSE; /* don't run again */
 }
@@ -1142,32 +1561,129 @@ static void
 bmt_schedule_update (DialogData *data)
 {
   /* rate-limit updates */
-  G_LOCK (bm_lock);
-  if (!data->bm_update_timeout_pending)
+  if (g_atomic_int_compare_and_exchange (&data->bm_update_timeout_pending, FALSE, TRUE))
     {
       g_timeout_add (200, /* ms */
                      bmt_on_timeout,
                      dialog_data_ref (data));
-      data->bm_update_timeout_pending = TRUE;
+    }
+}
+
+/* Must hold bm_lock. Averages the chunks of a full surface scan into
+ * zones so the graph and the saved data stay small no matter the size
+ * of the device.
+ */
+static void
+bmt_add_scan_sample (DialogData     *data,
+                     const BMSample *sample)
+{
+  BMScanZone *zone;
+  BMSample *min_sample;
+  guint64 chunk_size;
+  guint zone_num;
+
+  chunk_size = MIN (data->bm_sample_size, data->bm_size - sample->offset);
+  data->bm_scan_bytes_done += chunk_size;
+
+  zone_num = MIN (sample->offset * BM_SCAN_NUM_ZONES / data->bm_size, BM_SCAN_NUM_ZONES - 1);
+  zone = &g_array_index (data->bm_scan_zones, BMScanZone, zone_num);
+  if (zone->bytes == 0)
+    {
+      BMSample zone_sample = {0};
+      guint index = 0;
+      guint n;
+
+      /* the scan threads complete chunks out of order so keep the
+       * samples sorted by offset by inserting the new zone after the
+       * zones before it that already have samples
+       */
+      for (n = 0; n < BM_SCAN_NUM_ZONES; n++)
+        {
+          BMScanZone *other = &g_array_index (data->bm_scan_zones, BMScanZone, n);
+          if (other->bytes == 0)
+            continue;
+          if (n < zone_num)
+            index++;
+          else
+            other->sample_index++;
+        }
+
+      zone_sample.offset = zone_num * data->bm_size / BM_SCAN_NUM_ZONES;
+      zone->sample_index = index;
+      g_array_insert_val (data->bm_read_samples, index, zone_sample);
+      g_array_insert_val (data->bm_scan_min_samples, index, *sample);
+    }
+  zone->bytes += chunk_size;
+  zone->usec += chunk_size * G_USEC_PER_SEC / sample->value;
+  g_array_index (data->bm_read_samples, BMSample, zone->sample_index).value = zone->bytes * G_USEC_PER_SEC / zone->usec;
+
+  min_sample = &g_array_index (data->bm_scan_min_samples, BMSample, zone->sample_index);
+  if (sample->value < min_sample->value)
+    *min_sample = *sample;
+
+  /* keep the slowest chunks by replacing the fastest of them */
+  if (data->bm_slowest_chunks->len < BM_SCAN_NUM_SLOWEST)
+    {
+      g_array_append_val (data->bm_slowest_chunks, *sample);
+    }
+  else
+    {
+      guint fastest = 0;
+      guint n;
+
+      for (n = 1; n < data->bm_slowest_chunks->len; n++)
+        {
+          if (g_array_index (data->bm_slowest_chunks, BMSample, n).value >
+              g_array_index (data->bm_slowest_chunks, BMSample, fastest).value)
+            fastest = n;
+        }
+      if (sample->value < g_array_index (data->bm_slowest_chunks, BMSample, fastest).value)
+        g_array_index (data->bm_slowest_chunks, BMSample, fastest) = *sample;
+    }
+}
+
+static void
+bmt_on_sample (GduBenchmarkSampleType    type,
+               const GduBenchmarkSample *sample,
+               gpointer                  user_data)
+{
+  DialogData *data = user_data;
+
+  G_LOCK (bm_lock);
+  switch (type)
+    {
+    case GDU_BENCHMARK_SAMPLE_TYPE_READ:
+      if (data->bm_state == BM_STATE_SCAN)
+        bmt_add_scan_sample (data, sample);
+      else
+        g_array_append_val (data->bm_read_samples, *sample);
+      break;
+
+    case GDU_BENCHMARK_SAMPLE_TYPE_WRITE:
+      g_array_append_val (data->bm_write_samples, *sample);
+      break;
+
+    case GDU_BENCHMARK_SAMPLE_TYPE_ACCESS_TIME:
+      data->bm_state = BM_STATE_ACCESS_TIME;
+      g_array_append_val (data->bm_access_time_samples, *sample);
+      break;
+
+    default:
+      g_assert_not_reached ();
     }
   G_UNLOCK (bm_lock);
+
+  bmt_schedule_update (data);
 }
 
 static gpointer
 benchmark_thread (gpointer user_data)
 {
   DialogData *data = user_data;
-  GVariant *fd_index = NULL;
-  GUnixFDList *fd_list = NULL;
   GError *error = NULL;
-  guchar *buffer_unaligned = NULL;
-  guchar *buffer = NULL;
-  GRand *rand = NULL;
+  GduBenchmarkParams params = {0};
   int fd = -1;
-  gint n;
-  long page_size;
   guint64 disk_size;
-  GVariantBuilder options_builder;
   guint inhibit_cookie;
 
   //g_print ("bm thread start\n");
@@ -1179,271 +1695,50 @@ benchmark_thread (gpointer user_data)
                                             /* Translators: Reason why suspend/logout is being inhibited */
                                             C_("create-inhibit-message", "Benchmarking device"));
 
-  g_variant_builder_init (&options_builder, G_VARIANT_TYPE_VARDICT);
-  g_variant_builder_add (&options_builder, "{sv}", "writable", g_variant_new_boolean (data->bm_do_write));
-
-  if (!udisks_block_call_open_for_benchmark_sync (data->block,
-                                                  g_variant_builder_end (&options_builder),
-                                                  NULL, /* fd_list */
-                                                  &fd_index,
-                                                  &fd_list,
-                                                  data->bm_cancellable,
-                                                  &error))
+  fd = gdu_benchmark_open_device (data->block, data->bm_do_write, data->bm_cancellable, &error);
+  if (fd == -1)
     goto out;
 
-  fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (fd_index), NULL);
-  g_clear_object (&fd_list);
-
-  /* We can't use udisks_block_get_size() because the media may have
-   * changed and udisks may not have noticed. TODO: maybe have a
-   * Block.GetSize() method instead...
-   */
-  if (ioctl (fd, BLKGETSIZE64, &disk_size) != 0)
-    {
-      g_set_error (&error,
-                   G_IO_ERROR,
-                   g_io_error_from_errno (errno),
-                   C_("benchmarking", "Error getting size of device: %m"));
-      goto out;
-    }
-
-  page_size = sysconf (_SC_PAGESIZE);
-  if (page_size < 1)
-    {
-      g_set_error (&error,
-                   G_IO_ERROR,
-                   g_io_error_from_errno (errno),
-                   C_("benchmarking", "Error getting page size: %m\n"));
-      goto out;
-    }
+  if (!gdu_benchmark_get_device_size (fd, &disk_size, &error))
+    goto out;
 
-  buffer_unaligned = g_new0 (guchar, data->bm_sample_size_mib*1024*1024 + page_size);
-  buffer = (guchar*) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
+  params.num_samples = data->bm_num_samples;
+  params.sample_size_mib = data->bm_sample_size_mib;
+  params.do_write = data->bm_do_write;
+  params.num_access_samples = data->bm_num_access_samples;
 
   /* transfer rate... */
   G_LOCK (bm_lock);
   data->bm_size = disk_size;
   data->bm_sample_size = data->bm_sample_size_mib*1024*1024;
-  data->bm_state = BM_STATE_TRANSFER_RATE;
+  data->bm_state = data->bm_full_scan ? BM_STATE_SCAN : BM_STATE_TRANSFER_RATE;
   G_UNLOCK (bm_lock);
-  for (n = 0; n < data->bm_num_samples; n++)
-    {
-      gchar *s, *s2;
-      gint64 begin_usec;
-      gint64 end_usec;
-      gint64 offset;
-      ssize_t num_read;
-      BMSample sample = {0};
 
-      if (g_cancellable_set_error_if_cancelled (data->bm_cancellable, &error))
-        goto out;
-
-      /* figure out offset and align to page-size */
-      offset = n * disk_size / data->bm_num_samples;
-      offset &= ~(page_size - 1);
-
-      if (lseek (fd, offset, SEEK_SET) != offset)
-        {
-          g_set_error (&error,
-                       G_IO_ERROR,
-                       g_io_error_from_errno (errno),
-                       C_("benchmarking", "Error seeking to offset %lld"),
-                       (long long int) offset);
-          goto out;
-        }
-      if (read (fd, buffer, page_size) != page_size)
-        {
-          s = g_format_size_full (page_size, G_FORMAT_SIZE_LONG_FORMAT);
-          s2 = g_format_size_full (offset, G_FORMAT_SIZE_LONG_FORMAT);
-          g_set_error (&error,
-                       G_IO_ERROR,
-                       g_io_error_from_errno (errno),
-                       C_("benchmarking", "Error pre-reading %s from offset %s"),
-                       s, s2);
-          g_free (s2);
-          g_free (s);
-          goto out;
-        }
-      if (lseek (fd, offset, SEEK_SET) != offset)
-        {
-          s = g_format_size_full (offset, G_FORMAT_SIZE_LONG_FORMAT);
-          g_set_error (&error,
-                       G_IO_ERROR,
-                       g_io_error_from_errno (errno),
-                       C_("benchmarking", "Error seeking to offset %s"),
-                       s);
-          g_free (s);
-          goto out;
-        }
-      begin_usec = g_get_monotonic_time ();
-      num_read = read (fd, buffer, data->bm_sample_size_mib*1024*1024);
-      if (G_UNLIKELY (num_read < 0))
-        {
-          s = g_format_size_full (data->bm_sample_size_mib * 1024 * 1024, G_FORMAT_SIZE_LONG_FORMAT);
-          s2 = g_format_size_full (offset, G_FORMAT_SIZE_LONG_FORMAT);
-          g_set_error (&error,
-                       G_IO_ERROR,
-                       g_io_error_from_errno (errno),
-                       C_("benchmarking", "Error reading %s from offset %s"),
-                       s, s2);
-          g_free (s2);
-          g_free (s);
-          goto out;
-        }
-      end_usec = g_get_monotonic_time ();
-
-      sample.offset = offset;
-      sample.value = ((gdouble) G_USEC_PER_SEC) * num_read / (end_usec - begin_usec);
-      G_LOCK (bm_lock);
-      g_array_append_val (data->bm_read_samples, sample);
-      G_UNLOCK (bm_lock);
-
-      bmt_schedule_update (data);
-
-      if (data->bm_do_write)
-        {
-          ssize_t num_written;
-
-          /* and now write the same block again... */
-          if (lseek (fd, offset, SEEK_SET) != offset)
-            {
-              g_set_error (&error,
-                           G_IO_ERROR,
-                           g_io_error_from_errno (errno),
-                           C_("benchmarking", "Error seeking to offset %lld"),
-                           (long long int) offset);
-              goto out;
-            }
-          if (read (fd, buffer, page_size) != page_size)
-            {
-              g_set_error (&error,
-                           G_IO_ERROR,
-                           g_io_error_from_errno (errno),
-                           C_("benchmarking", "Error pre-reading %lld bytes from offset %lld"),
-                           (long long int) page_size,
-                           (long long int) offset);
-              goto out;
-            }
-          if (lseek (fd, offset, SEEK_SET) != offset)
-            {
-              g_set_error (&error,
-                           G_IO_ERROR,
-                           g_io_error_from_errno (errno),
-                           C_("benchmarking", "Error seeking to offset %lld"),
-                           (long long int) offset);
-              goto out;
-            }
-          begin_usec = g_get_monotonic_time ();
-          num_written = write (fd, buffer, num_read);
-          if (G_UNLIKELY (num_written < 0))
-            {
-              g_set_error (&error,
-                           G_IO_ERROR,
-                           g_io_error_from_errno (errno),
-                           C_("benchmarking", "Error writing %lld bytes at offset %lld: %m"),
-                           (long long int) num_read,
-                           (long long int) offset);
-              goto out;
-            }
-          if (num_written != num_read)
-            {
-              g_set_error (&error,
-                           G_IO_ERROR,
-                           g_io_error_from_errno (errno),
-                           C_("benchmarking", "Expected to write %lld bytes, only wrote %lld: %m"),
-                           (long long int) num_read,
-                           (long long int) num_written);
-              goto out;
-            }
-          if (fsync (fd) != 0)
-            {
-              g_set_error (&error,
-                           G_IO_ERROR,
-                           g_io_error_from_errno (errno),
-                           C_("benchmarking", "Error syncing (at offset %lld): %m"),
-                           (long long int) offset);
-              goto out;
-            }
-          end_usec = g_get_monotonic_time ();
-
-          sample.offset = offset;
-          sample.value = ((gdouble) G_USEC_PER_SEC) * num_written / (end_usec - begin_usec);
-          G_LOCK (bm_lock);
-          g_array_append_val (data->bm_write_samples, sample);
-          G_UNLOCK (bm_lock);
-
-          bmt_schedule_update (data);
-        }
-    }
-
-  /* access time... */
-  G_LOCK (bm_lock);
-  data->bm_state = BM_STATE_ACCESS_TIME;
-  G_UNLOCK (bm_lock);
-  rand = g_rand_new_with_seed (42); /* want this to be deterministic (per size) so it's repeatable */
-  for (n = 0; n < data->bm_num_access_samples; n++)
+  /* ... either by reading the whole device ... */
+  if (data->bm_full_scan)
     {
-      gint64 begin_usec;
-      gint64 end_usec;
-      gint64 offset;
-      ssize_t num_read;
-      BMSample sample = {0};
-
-      if (g_cancellable_set_error_if_cancelled (data->bm_cancellable, &error))
+      if (!gdu_benchmark_scan (fd, disk_size, data->bm_sample_size_mib, bmt_on_sample, data, data->bm_cancellable, &error))
         goto out;
-
-      offset = (guint64) g_rand_double_range (rand, 0, (gdouble) disk_size);
-      offset &= ~(page_size - 1);
-
-      if (lseek (fd, offset, SEEK_SET) != offset)
-        {
-          g_set_error (&error,
-                       G_IO_ERROR,
-                       g_io_error_from_errno (errno),
-                       C_("benchmarking", "Error seeking to offset %lld: %m"),
-                       (long long int) offset);
-          goto out;
-        }
-
-      begin_usec = g_get_monotonic_time ();
-      num_read = read (fd, buffer, page_size);
-      if (G_UNLIKELY (num_read < 0))
-        {
-          g_set_error (&error,
-                       G_IO_ERROR,
-                       g_io_error_from_errno (errno),
-                       C_("benchmarking", "Error reading %lld bytes from offset %lld"),
-                       (long long int) page_size,
-                       (long long int) offset);
-          goto out;
-        }
-      end_usec = g_get_monotonic_time ();
-
-      sample.offset = offset;
-      sample.value = (end_usec - begin_usec) / ((gdouble) G_USEC_PER_SEC);
-      G_LOCK (bm_lock);
-      g_array_append_val (data->bm_access_time_samples, sample);
-      G_UNLOCK (bm_lock);
-
-      bmt_schedule_update (data);
+      params.num_samples = 0;
+      params.do_write = FALSE;
     }
 
+  /* ... or sampling it, followed by access time, see bmt_on_sample() */
+  if (!gdu_benchmark_run (fd, disk_size, &params, bmt_on_sample, data, data->bm_cancellable, &error))
+    goto out;
+
   G_LOCK (bm_lock);
   data->bm_time_benchmarked_usec = g_get_real_time ();
   G_UNLOCK (bm_lock);
   if (!maybe_save_data (data, &error))
     goto out;
 
- out:
-  if (rand != NULL)
-    g_rand_free (rand);
-  g_clear_object (&fd_list);
+  if (data->bm_full_scan && !maybe_save_slow_regions (data, &error))
+    goto out;
 
-  if (fd_index != NULL)
-    g_variant_unref (fd_index);
+ out:
   if (fd != -1)
     close (fd);
-  g_free (buffer_unaligned);
   data->bm_in_progress = FALSE;
   data->bm_thread = NULL;
   data->bm_state = BM_STATE_NONE;
@@ -1458,6 +1753,7 @@ benchmark_thread (gpointer user_data)
       g_array_set_size (data->bm_read_samples, 0);
       g_array_set_size (data->bm_write_samples, 0);
       g_array_set_size (data->bm_access_time_samples, 0);
+      g_array_set_size (data->bm_scan_min_samples, 0);
       data->bm_time_benchmarked_usec = 0;
       data->bm_sample_size = 0;
       data->bm_size = 0;
@@ -1487,6 +1783,11 @@ start_benchmark2 (DialogData *data)
   g_array_set_size (data->bm_read_samples, 0);
   g_array_set_size (data->bm_write_samples, 0);
   g_array_set_size (data->bm_access_time_samples, 0);
+  g_array_set_size (data->bm_scan_min_samples, 0);
+  g_array_set_size (data->bm_scan_zones, 0);
+  g_array_set_size (data->bm_scan_zones, data->bm_full_scan ? BM_SCAN_NUM_ZONES : 0);
+  g_array_set_size (data->bm_slowest_chunks, 0);
+  data->bm_scan_bytes_done = 0;
   data->bm_time_benchmarked_usec = 0;
   g_cancellable_reset (data->bm_cancellable);
 
@@ -1517,6 +1818,7 @@ start_benchmark (DialogData *data)
   GtkWidget *sample_size_spinbutton;
   GtkWidget *write_checkbutton;
   GtkWidget *num_access_samples_spinbutton;
+  GtkWidget *full_scan_checkbutton;
   GSettings *settings;
   gint response;
 
@@ -1535,17 +1837,25 @@ start_benchmark (DialogData *data)
   sample_size_spinbutton = GTK_WIDGET (gtk_builder_get_object (builder, "sample-size-spinbutton"));
   write_checkbutton = GTK_WIDGET (gtk_builder_get_object (builder, "write-checkbutton"));
   num_access_samples_spinbutton = GTK_WIDGET (gtk_builder_get_object (builder, "num-access-samples-spinbutton"));
+  full_scan_checkbutton = GTK_WIDGET (gtk_builder_get_object (builder, "full-scan-checkbutton"));
 
   settings = g_settings_new ("org.gnome.Disks.benchmark");
   data->bm_num_samples = g_settings_get_int (settings, "num-samples");
   data->bm_sample_size_mib = g_settings_get_int (settings, "sample-size-mib");
   data->bm_do_write = g_settings_get_boolean (settings, "do-write");
   data->bm_num_access_samples = g_settings_get_int (settings, "num-access-samples");
+  data->bm_full_scan = g_settings_get_boolean (settings, "full-scan");
 
   gtk_spin_button_set_value (GTK_SPIN_BUTTON(num_samples_spinbutton), data->bm_num_samples);
   gtk_spin_button_set_value (GTK_SPIN_BUTTON(sample_size_spinbutton), data->bm_sample_size_mib);
   gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (write_checkbutton), data->bm_do_write);
   gtk_spin_button_set_value (GTK_SPIN_BUTTON(num_access_samples_spinbutton), data->bm_num_access_samples);
+  gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (full_scan_checkbutton), data->bm_full_scan);
+
+  /* a full surface scan only reads and replaces the sampled transfer rate test */
+  g_object_bind_property (full_scan_checkbutton, "active",
+                          num_samples_spinbutton, "sensitive",
+                          G_BINDING_SYNC_CREATE | G_BINDING_INVERT_BOOLEAN);
 
   /* if device is read-only, uncheck the "perform write-test"
    * check-button and also make it insensitive
@@ -1574,11 +1884,16 @@ start_benchmark (DialogData *data)
   data->bm_sample_size_mib = gtk_spin_button_get_value (GTK_SPIN_BUTTON (sample_size_spinbutton));
   data->bm_do_write = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (write_checkbutton));
   data->bm_num_access_samples = gtk_spin_button_get_value (GTK_SPIN_BUTTON (num_access_samples_spinbutton));
+  data->bm_full_scan = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (full_scan_checkbutton));
 
   g_settings_set_int (settings, "num-samples", data->bm_num_samples);
   g_settings_set_int (settings, "sample-size-mib", data->bm_sample_size_mib);
   g_settings_set_boolean (settings, "do-write", data->bm_do_write);
   g_settings_set_int (settings, "num-access-samples", data->bm_num_access_samples);
+  g_settings_set_boolean (settings, "full-scan", data->bm_full_scan);
+
+  if (data->bm_full_scan)
+    data->bm_do_write = FALSE;
 
   //g_print ("num_samples=%d\n", data->bm_num_samples);
   //g_print ("sample_size=%d MB\n", data->bm_sample_size_mib);
@@ -1633,6 +1948,16 @@ gdu_benchmark_dialog_show (GduWindow    *window,
   data->bm_access_time_samples = g_array_new (FALSE, /* zero-terminated */
                                               FALSE, /* clear */
                                               sizeof (BMSample));
+  data->bm_scan_min_samples = g_array_new (FALSE, /* zero-terminated */
+                                           FALSE, /* clear */
+                                           sizeof (BMSample));
+  data->bm_scan_zones = g_array_new (FALSE, /* zero-terminated */
+                                     TRUE,  /* clear */
+                                     sizeof (BMScanZone));
+  data->bm_slowest_chunks = g_array_new (FALSE, /* zero-terminated */
+                                         FALSE, /* clear */
+                                         sizeof (BMSample));
+  data->bm_history = g_ptr_array_new_with_free_func ((GDestroyNotify) bm_run_free);
 
   data->dialog = GTK_WIDGET (gdu_application_new_widget (gdu_window_get_application (window),
                                                          "benchmark-dialog.ui",
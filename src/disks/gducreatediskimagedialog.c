@@ -20,6 +20,7 @@
 #include <glib-unix.h>
 #include <sys/ioctl.h>
 #include <linux/fs.h>
+#include <linux/cdrom.h>
 
 #include <canberra-gtk.h>
 
@@ -28,6 +29,7 @@
 #include "gducreatediskimagedialog.h"
 #include "gduvolumegrid.h"
 #include "gduestimator.h"
+#include "gduprogress.h"
 #include "gdulocaljob.h"
 
 #include "gdudvdsupport.h"
@@ -39,12 +41,53 @@
  *   this. See http://libguestfs.org/
  * - Support a Apple DMG-ish format
  * - Sliding buffer size
- * - Update time remaining / speed exactly every 1/10th second instead of when we've read a full buffer
  *
  */
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* how often the job is updated while copying */
+#define UPDATE_INTERVAL_MSEC 200
+
+/* Unreadable sectors on optical discs come in small clusters (e.g. a
+ * scratch) so instead of giving up on the entire block, the part that
+ * couldn't be read is retried a sector at a time. While in a damaged
+ * region the drive is slowed down since that often helps. Once enough
+ * blocks have been read without errors, it's sped up again.
+ *
+ * Like ddrescue(1), the rest of the block is skipped after a run of bad
+ * sectors instead of retrying every sector in a large damaged area. It
+ * ends up in the map file so it can be revisited with other tools.
+ */
+#define OPTICAL_SECTOR_SIZE          2048
+#define OPTICAL_NUM_RETRIES          3
+#define OPTICAL_NUM_BAD_TO_SKIP      4  /* consecutive sectors */
+#define OPTICAL_SLOW_SPEED           4  /* see CDROM_SELECT_SPEED */
+#define OPTICAL_NUM_CLEAN_TO_SPEEDUP 32 /* blocks */
+
+typedef struct
+{
+  guint64 offset;
+  guint64 size;
+} BadRange;
+
+typedef struct
+{
+  int fd;
+  int direct_fd;         /* O_DIRECT so single sectors can be read, -1 if not available */
+  gboolean slowed_down;
+  guint num_clean_blocks;
+  GArray *bad_ranges;    /* of BadRange, sorted by offset */
+} OpticalReader;
+
+typedef enum
+{
+  COPY_STATE_NONE,
+  COPY_STATE_RETRIEVING_DVD_KEYS,
+  COPY_STATE_ALLOCATING_FILE,
+  COPY_STATE_COPYING
+} CopyState;
+
 typedef struct
 {
   volatile gint ref_count;
@@ -69,19 +112,16 @@ typedef struct
   GCancellable *cancellable;
   GFile *output_file;
   GFileOutputStream *output_file_stream;
+  GFile *map_file; /* only set if some sectors were unreadable */
 
-  /* must hold copy_lock when reading/writing these */
-  GMutex copy_lock;
-  GduEstimator *estimator;
+  /* only written by the copy thread, see copy_thread_func() */
+  GduProgress progress;
 
-  gboolean allocating_file;
-  gboolean retrieving_dvd_keys;
-  guint64 num_error_bytes;
-  gint64 start_time_usec;
-  gint64 end_time_usec;
+  /* only used on the main / UI thread */
+  GduEstimator *estimator;
+  guint update_timeout_id;
   gboolean played_read_error_sound;
 
-  guint update_id;
   GError *copy_error;
 
   gulong response_signal_handler_id;
@@ -164,6 +204,8 @@ dialog_data_unref (DialogData *data)
 
       g_clear_object (&data->cancellable);
       g_clear_object (&data->output_file_stream);
+      g_clear_object (&data->output_file);
+      g_clear_object (&data->map_file);
       g_object_unref (data->window);
       g_object_unref (data->object);
       g_object_unref (data->block);
@@ -171,25 +213,10 @@ dialog_data_unref (DialogData *data)
       if (data->builder != NULL)
         g_object_unref (data->builder);
       g_clear_object (&data->estimator);
-      g_mutex_clear (&data->copy_lock);
       g_free (data);
     }
 }
 
-static gboolean
-unref_in_idle (gpointer user_data)
-{
-  DialogData *data = user_data;
-  dialog_data_unref (data);
-  return FALSE; /* remove source */
-}
-
-static void
-dialog_data_unref_in_idle (DialogData *data)
-{
-  g_idle_add (unref_in_idle, data);
-}
-
 /* ---------------------------------------------------------------------------------------------------- */
 
 static void
@@ -324,25 +351,24 @@ update_job (DialogData *data,
   guint64 usec_remaining = 0;
   guint64 num_error_bytes = 0;
   gdouble progress = 0.0;
+  gint state = COPY_STATE_NONE;
   gchar *s2, *s3;
 
-  g_mutex_lock (&data->copy_lock);
-  if (data->estimator != NULL)
+  gdu_progress_read (&data->progress, &state, &bytes_target, &bytes_completed, &num_error_bytes);
+  if (state == COPY_STATE_COPYING)
     {
+      if (data->estimator == NULL)
+        data->estimator = gdu_estimator_new (bytes_target);
+      gdu_estimator_add_sample (data->estimator, bytes_completed);
       bytes_per_sec = gdu_estimator_get_bytes_per_sec (data->estimator);
       usec_remaining = gdu_estimator_get_usec_remaining (data->estimator);
-      bytes_completed = gdu_estimator_get_completed_bytes (data->estimator);
-      bytes_target = gdu_estimator_get_target_bytes (data->estimator);
-      num_error_bytes = data->num_error_bytes;
     }
-  data->update_id = 0;
-  g_mutex_unlock (&data->copy_lock);
 
-  if (data->allocating_file)
+  if (state == COPY_STATE_ALLOCATING_FILE)
     {
       extra_markup = g_strdup (_("Allocating Disk Image"));
     }
-  else if (data->retrieving_dvd_keys)
+  else if (state == COPY_STATE_RETRIEVING_DVD_KEYS)
     {
       extra_markup = g_strdup (_("Retrieving DVD keys"));
     }
@@ -416,11 +442,27 @@ play_complete_sound (DialogData *data)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Samples the progress published by the copy thread from a timer in the
+ * main thread so the copy thread never has to wake up the main thread.
+ * Unlike the frame clock it keeps running while the window is hidden.
+ */
 static gboolean
-on_update_job (gpointer user_data)
+on_update_timeout (gpointer user_data)
 {
   DialogData *data = user_data;
   update_job (data, FALSE);
+  return TRUE; /* keep timeout around */
+}
+
+static gboolean
+on_copy_thread_done (gpointer user_data)
+{
+  DialogData *data = user_data;
+  if (data->update_timeout_id != 0)
+    {
+      g_source_remove (data->update_timeout_id);
+      data->update_timeout_id = 0;
+    }
   dialog_data_unref (data);
   return FALSE; /* remove source */
 }
@@ -452,6 +494,8 @@ static gboolean
 on_success (gpointer user_data)
 {
   DialogData *data = user_data;
+  guint64 target_bytes = 0;
+  guint64 num_error_bytes = 0;
 
   update_job (data, TRUE);
 
@@ -463,7 +507,8 @@ on_success (gpointer user_data)
    * zeroes. Bring up a modal dialog to inform the user of this and
    * allow him to delete the file, if so desired.
    */
-  if (data->num_error_bytes > 0)
+  gdu_progress_read (&data->progress, NULL, &target_bytes, NULL, &num_error_bytes);
+  if (num_error_bytes > 0)
     {
       GtkWidget *dialog;
       GError *error = NULL;
@@ -478,8 +523,8 @@ on_success (gpointer user_data)
                                                    "<big><b>%s</b></big>",
                                                    /* Translators: Primary message in dialog shown if some data was unreadable while creating a disk image */
                                                    _("Unrecoverable read errors while creating disk image"));
-      s = g_format_size (data->num_error_bytes);
-      percentage = 100.0 * ((gdouble) data->num_error_bytes) / ((gdouble) gdu_estimator_get_target_bytes (data->estimator));
+      s = g_format_size (num_error_bytes);
+      percentage = 100.0 * ((gdouble) num_error_bytes) / ((gdouble) target_bytes);
       gtk_message_dialog_format_secondary_markup (GTK_MESSAGE_DIALOG (dialog),
                                                   /* Translators: Secondary message in dialog shown if some data was unreadable while creating a disk image.
                                                    * The %f is the percentage of unreadable data (ex. 13.0).
@@ -508,6 +553,12 @@ on_success (gpointer user_data)
                          error->message, g_quark_to_string (error->domain), error->code);
               g_clear_error (&error);
             }
+          if (data->map_file != NULL && !g_file_delete (data->map_file, NULL, &error))
+            {
+              g_warning ("Error deleting file: %s (%s, %d)",
+                         error->message, g_quark_to_string (error->domain), error->code);
+              g_clear_error (&error);
+            }
         }
     }
 
@@ -517,8 +568,171 @@ on_success (gpointer user_data)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static void
+optical_reader_set_slowed_down (OpticalReader *reader,
+                                gboolean       slowed_down)
+{
+  if (reader->slowed_down == slowed_down)
+    return;
+
+  /* 0 means the maximum speed - not all drives support this so ignore errors */
+  if (ioctl (reader->fd, CDROM_SELECT_SPEED, slowed_down ? OPTICAL_SLOW_SPEED : 0) != 0)
+    g_debug ("Error changing drive speed: %m");
+  reader->slowed_down = slowed_down;
+  reader->num_clean_blocks = 0;
+}
+
+static void
+optical_reader_add_bad_range (OpticalReader *reader,
+                              guint64        offset,
+                              guint64        size)
+{
+  BadRange range;
+
+  /* since we're reading sequentially we only ever need to merge with the last range */
+  if (reader->bad_ranges->len > 0)
+    {
+      BadRange *last = &g_array_index (reader->bad_ranges, BadRange, reader->bad_ranges->len - 1);
+      if (last->offset + last->size == offset)
+        {
+          last->size += size;
+          return;
+        }
+    }
+  range.offset = offset;
+  range.size = size;
+  g_array_append_val (reader->bad_ranges, range);
+}
+
+static gboolean
+optical_reader_read_sector (OpticalReader *reader,
+                            GduDVDSupport *dvd_support,
+                            guchar        *buffer,
+                            guint64        offset,
+                            guint64        size)
+{
+  ssize_t num_bytes_read;
+  int fd;
+
+  if (dvd_support != NULL)
+    return gdu_dvd_support_read (dvd_support, reader->fd, buffer, offset, size) == (gssize) size;
+
+  /* O_DIRECT can only be used for whole sectors */
+  fd = reader->direct_fd;
+  if (fd == -1 || size != OPTICAL_SECTOR_SIZE)
+    fd = reader->fd;
+
+ read_again:
+  num_bytes_read = pread (fd, buffer, size, offset);
+  if (num_bytes_read < 0 && (errno == EAGAIN || errno == EINTR))
+    goto read_again;
+
+  return num_bytes_read == (ssize_t) size;
+}
+
+/* Retries reading [@offset, @offset + @size) a sector at a time. The
+ * buffer and every sector in it are 2048-byte aligned which is enough
+ * for O_DIRECT on optical drives. After OPTICAL_NUM_BAD_TO_SKIP bad
+ * sectors in a row the rest of the span is given up on.
+ *
+ * Returns: The number of bytes that could be read. Unreadable sectors are zeroed.
+ */
+static guint64
+optical_reader_retry (OpticalReader *reader,
+                      GduDVDSupport *dvd_support,
+                      guchar        *buffer,
+                      guint64        offset,
+                      guint64        size,
+                      GCancellable  *cancellable)
+{
+  guint64 ret = 0;
+  guint64 pos;
+  guint num_bad = 0;
+
+  optical_reader_set_slowed_down (reader, TRUE);
+
+  for (pos = 0; pos < size; pos += OPTICAL_SECTOR_SIZE)
+    {
+      guint64 sector_size = MIN (OPTICAL_SECTOR_SIZE, size - pos);
+      gboolean read_ok = FALSE;
+      guint n;
+
+      for (n = 0; n < OPTICAL_NUM_RETRIES && !read_ok; n++)
+        {
+          if (g_cancellable_is_cancelled (cancellable))
+            break;
+          read_ok = optical_reader_read_sector (reader, dvd_support, buffer + pos, offset + pos, sector_size);
+        }
+
+      if (read_ok)
+        {
+          ret += sector_size;
+          num_bad = 0;
+        }
+      else if (++num_bad >= OPTICAL_NUM_BAD_TO_SKIP)
+        {
+          memset (buffer + pos, 0, size - pos);
+          optical_reader_add_bad_range (reader, offset + pos, size - pos);
+          break;
+        }
+      else
+        {
+          memset (buffer + pos, 0, sector_size);
+          optical_reader_add_bad_range (reader, offset + pos, sector_size);
+        }
+    }
+
+  return ret;
+}
+
+/* Writes a map of the unreadable sectors in the format used by GNU
+ * ddrescue(1) so the image can be completed with other tools later
+ */
+static gboolean
+optical_reader_save_map (OpticalReader  *reader,
+                         guint64         device_size,
+                         GFile          *file,
+                         GError        **error)
+{
+  GString *str;
+  guint64 pos = 0;
+  gboolean ret;
+  guint n;
+
+  str = g_string_new ("# Mapfile. Created by GNOME Disks " PACKAGE_VERSION "\n"
+                      "# current_pos  current_status\n");
+  g_string_append_printf (str, "0x%08" G_GINT64_MODIFIER "x     +\n", device_size);
+  g_string_append (str, "#      pos        size  status\n");
+  for (n = 0; n < reader->bad_ranges->len; n++)
+    {
+      BadRange *range = &g_array_index (reader->bad_ranges, BadRange, n);
+      if (pos < range->offset)
+        g_string_append_printf (str, "0x%08" G_GINT64_MODIFIER "x  0x%08" G_GINT64_MODIFIER "x  +\n",
+                                pos, range->offset - pos);
+      g_string_append_printf (str, "0x%08" G_GINT64_MODIFIER "x  0x%08" G_GINT64_MODIFIER "x  -\n",
+                              range->offset, range->size);
+      pos = range->offset + range->size;
+    }
+  if (pos < device_size)
+    g_string_append_printf (str, "0x%08" G_GINT64_MODIFIER "x  0x%08" G_GINT64_MODIFIER "x  +\n",
+                            pos, device_size - pos);
+
+  ret = g_file_replace_contents (file, str->str, str->len,
+                                 NULL, /* etag */
+                                 FALSE, /* make_backup */
+                                 G_FILE_CREATE_NONE,
+                                 NULL, /* new_etag */
+                                 NULL, /* cancellable */
+                                 error);
+  g_string_free (str, TRUE);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 /* Note that error on reading is *not* considered an error - instead 0
- * is returned.
+ * is returned. If @optical is not %NULL, the unread part is retried a
+ * sector at a time, see optical_reader_retry().
  *
  * Error conditions include failure to seek or write to output.
  *
@@ -532,6 +746,7 @@ copy_span (int              fd,
            guchar          *buffer,
            gboolean         pad_with_zeroes,
            GduDVDSupport   *dvd_support,
+           OpticalReader   *optical,
            GCancellable    *cancellable,
            GError         **error)
 {
@@ -587,11 +802,28 @@ copy_span (int              fd,
     }
 
   num_bytes_to_write = num_bytes_read;
-  if (pad_with_zeroes && (guint64) num_bytes_read < size)
+  if (optical != NULL && (guint64) num_bytes_read < size)
+    {
+      /* unreadable sectors are zeroed so the whole span is written */
+      num_bytes_read -= num_bytes_read % OPTICAL_SECTOR_SIZE;
+      num_bytes_read += optical_reader_retry (optical,
+                                              dvd_support,
+                                              buffer + num_bytes_read,
+                                              offset + num_bytes_read,
+                                              size - num_bytes_read,
+                                              cancellable);
+      num_bytes_to_write = size;
+    }
+  else if (pad_with_zeroes && (guint64) num_bytes_read < size)
     {
       memset (buffer + num_bytes_read, 0, size - num_bytes_read);
       num_bytes_to_write = size;
     }
+  else if (optical != NULL && optical->slowed_down &&
+           ++optical->num_clean_blocks >= OPTICAL_NUM_CLEAN_TO_SPEEDUP)
+    {
+      optical_reader_set_slowed_down (optical, FALSE);
+    }
 
   if (!g_seekable_seek (G_SEEKABLE (output_stream),
                         offset,
@@ -639,10 +871,11 @@ copy_thread_func (gpointer user_data)
   long page_size;
   GError *error = NULL;
   GError *error2 = NULL;
-  gint64 last_update_usec = -1;
   gint fd = -1;
   gint buffer_size;
   guint64 num_bytes_completed = 0;
+  guint64 num_error_bytes = 0;
+  OpticalReader *optical = NULL;
 
   /* default to 1 MiB blocks */
   buffer_size = (1 * 1024 * 1024);
@@ -660,6 +893,11 @@ copy_thread_func (gpointer user_data)
       const gchar *device_file = udisks_block_get_device (data->block);
       fd = open (device_file, O_RDONLY);
 
+      optical = g_new0 (OpticalReader, 1);
+      optical->fd = -1;
+      optical->direct_fd = open (device_file, O_RDONLY | O_DIRECT);
+      optical->bad_ranges = g_array_new (FALSE, FALSE, sizeof (BadRange));
+
       /* Use libdvdcss (if available on the system) on DVDs with UDF
        * filesystems - otherwise the backup process may fail because
        * of unreadable/scrambled sectors
@@ -668,17 +906,9 @@ copy_thread_func (gpointer user_data)
           g_strcmp0 (udisks_block_get_id_type (data->block), "udf") == 0 &&
           g_str_has_prefix (udisks_drive_get_media (data->drive), "optical_dvd"))
         {
-          g_mutex_lock (&data->copy_lock);
-          data->retrieving_dvd_keys = TRUE;
-          g_mutex_unlock (&data->copy_lock);
-          g_idle_add (on_update_job, dialog_data_ref (data));
-
+          gdu_progress_publish (&data->progress, COPY_STATE_RETRIEVING_DVD_KEYS, 0, 0, 0);
           dvd_support = gdu_dvd_support_new (device_file, udisks_block_get_size (data->block));
-
-          g_mutex_lock (&data->copy_lock);
-          data->retrieving_dvd_keys = FALSE;
-          g_mutex_unlock (&data->copy_lock);
-          g_idle_add (on_update_job, dialog_data_ref (data));
+          gdu_progress_publish (&data->progress, COPY_STATE_NONE, 0, 0, 0);
         }
     }
 
@@ -710,6 +940,8 @@ copy_thread_func (gpointer user_data)
     }
 
   g_assert (fd != -1);
+  if (optical != NULL)
+    optical->fd = fd;
 
   /* We can't use udisks_block_get_size() because the media may have
    * changed and udisks may not have noticed. TODO: maybe have a
@@ -738,10 +970,7 @@ copy_thread_func (gpointer user_data)
       gint output_fd = g_file_descriptor_based_get_fd (G_FILE_DESCRIPTOR_BASED (data->output_file_stream));
       gint rc;
 
-      g_mutex_lock (&data->copy_lock);
-      data->allocating_file = TRUE;
-      g_mutex_unlock (&data->copy_lock);
-      g_idle_add (on_update_job, dialog_data_ref (data));
+      gdu_progress_publish (&data->progress, COPY_STATE_ALLOCATING_FILE, block_device_size, 0, 0);
 
       rc = fallocate (output_fd,
                       0, /* mode */
@@ -763,24 +992,12 @@ copy_thread_func (gpointer user_data)
               goto out;
             }
         }
-
-      g_mutex_lock (&data->copy_lock);
-      data->allocating_file = FALSE;
-      g_mutex_unlock (&data->copy_lock);
-      g_idle_add (on_update_job, dialog_data_ref (data));
     }
 
   page_size = sysconf (_SC_PAGESIZE);
   buffer_unaligned = g_new0 (guchar, buffer_size + page_size);
   buffer = (guchar*) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
 
-  g_mutex_lock (&data->copy_lock);
-  data->estimator = gdu_estimator_new (block_device_size);
-  data->update_id = 0;
-  data->num_error_bytes = 0;
-  data->start_time_usec = g_get_real_time ();
-  g_mutex_unlock (&data->copy_lock);
-
   /* Read huge (e.g. 1 MiB) blocks and write it to the output
    * file even if it was only partially read.
    */
@@ -789,24 +1006,14 @@ copy_thread_func (gpointer user_data)
     {
       gssize num_bytes_to_read;
       gssize num_bytes_read;
-      gint64 now_usec;
 
       num_bytes_to_read = buffer_size;
       if (num_bytes_to_read + num_bytes_completed > block_device_size)
         num_bytes_to_read = block_device_size - num_bytes_completed;
 
-      /* Update GUI - but only every 200 ms and only if last update isn't pending */
-      g_mutex_lock (&data->copy_lock);
-      now_usec = g_get_monotonic_time ();
-      if (now_usec - last_update_usec > 200 * G_USEC_PER_SEC / 1000 || last_update_usec < 0)
-        {
-          if (num_bytes_completed > 0)
-            gdu_estimator_add_sample (data->estimator, num_bytes_completed);
-          if (data->update_id == 0)
-            data->update_id = g_idle_add (on_update_job, dialog_data_ref (data));
-          last_update_usec = now_usec;
-        }
-      g_mutex_unlock (&data->copy_lock);
+      /* The GUI picks this up on its own, see on_update_timeout() */
+      gdu_progress_publish (&data->progress, COPY_STATE_COPYING,
+                            block_device_size, num_bytes_completed, num_error_bytes);
 
       num_bytes_read = copy_span (fd,
                                   G_OUTPUT_STREAM (data->output_file_stream),
@@ -815,6 +1022,7 @@ copy_thread_func (gpointer user_data)
                                   buffer,
                                   TRUE, /* pad_with_zeroes */
                                   dvd_support,
+                                  optical,
                                   data->cancellable,
                                   &error);
       if (num_bytes_read < 0)
@@ -826,20 +1034,43 @@ copy_thread_func (gpointer user_data)
                num_bytes_completed);*/
 
       if (num_bytes_read < num_bytes_to_read)
-        {
-          guint64 num_bytes_skipped = num_bytes_to_read - num_bytes_read;
-          g_mutex_lock (&data->copy_lock);
-          data->num_error_bytes += num_bytes_skipped;
-          g_mutex_unlock (&data->copy_lock);
-        }
+        num_error_bytes += num_bytes_to_read - num_bytes_read;
       num_bytes_completed += num_bytes_to_read;
     }
+  gdu_progress_publish (&data->progress, COPY_STATE_COPYING,
+                        block_device_size, num_bytes_completed, num_error_bytes);
 
  out:
   if (dvd_support != NULL)
     gdu_dvd_support_free (dvd_support);
 
-  data->end_time_usec = g_get_real_time ();
+  if (optical != NULL)
+    {
+      if (error == NULL && optical->bad_ranges->len > 0)
+        {
+          gchar *basename = g_file_get_basename (data->output_file);
+          gchar *map_basename = g_strdup_printf ("%s.map", basename);
+          GFile *parent = g_file_get_parent (data->output_file);
+
+          data->map_file = g_file_get_child (parent, map_basename);
+          if (!optical_reader_save_map (optical, block_device_size, data->map_file, &error2))
+            {
+              g_warning ("Error saving map of unreadable sectors: %s (%s, %d)",
+                         error2->message, g_quark_to_string (error2->domain), error2->code);
+              g_clear_error (&error2);
+              g_clear_object (&data->map_file);
+            }
+          g_object_unref (parent);
+          g_free (map_basename);
+          g_free (basename);
+        }
+      if (optical->fd != -1)
+        optical_reader_set_slowed_down (optical, FALSE);
+      if (optical->direct_fd != -1)
+        close (optical->direct_fd);
+      g_array_unref (optical->bad_ranges);
+      g_free (optical);
+    }
 
   /* in either case, close the stream */
   if (!g_output_stream_close (G_OUTPUT_STREAM (data->output_file_stream),
@@ -883,7 +1114,7 @@ copy_thread_func (gpointer user_data)
 
   g_free (buffer_unaligned);
 
-  dialog_data_unref_in_idle (data); /* unref on main thread */
+  g_idle_add (on_copy_thread_done, data); /* unref on main thread */
   return NULL;
 }
 
@@ -1006,6 +1237,13 @@ start_copying (DialogData *data)
 
   dialog_data_hide (data);
 
+  gdu_progress_init (&data->progress);
+  data->update_timeout_id = g_timeout_add_full (G_PRIORITY_DEFAULT,
+                                                 UPDATE_INTERVAL_MSEC,
+                                                 on_update_timeout,
+                                                 dialog_data_ref (data),
+                                                 (GDestroyNotify) dialog_data_unref);
+
   g_thread_new ("copy-disk-image-thread",
                 copy_thread_func,
                 dialog_data_ref (data));
@@ -1084,7 +1322,6 @@ gdu_create_disk_image_dialog_show (GduWindow    *window,
 
   data = g_new0 (DialogData, 1);
   data->ref_count = 1;
-  g_mutex_init (&data->copy_lock);
   data->window = g_object_ref (window);
   data->object = g_object_ref (object);
   data->block = udisks_object_get_block (object);
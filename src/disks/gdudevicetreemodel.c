@@ -9,6 +9,19 @@
 
 #define SPINNER_TIMEOUT_MSEC 80
 
+/* How long to collect changes before updating the affected rows */
+#define UPDATE_TIMEOUT_MSEC 100
+
+/* The power state of each drive is checked every POWER_STATE_MIN_INTERVAL_SEC,
+ * backing off up to POWER_STATE_MAX_INTERVAL_SEC while it doesn't change. The
+ * first checks of the drives are spread out instead of all happening at once
+ * and a single timeout is kept for whichever check is due first. Results are
+ * collected for up to POWER_STATE_BATCH_MSEC before the rows are updated.
+ */
+#define POWER_STATE_MIN_INTERVAL_SEC  5
+#define POWER_STATE_MAX_INTERVAL_SEC  60
+#define POWER_STATE_BATCH_MSEC        1000
+
 #include "config.h"
 #include <glib/gi18n.h>
 
@@ -34,10 +47,33 @@ struct _GduDeviceTreeModel
   GtkTreeIter block_iter;
   gboolean block_iter_valid;
 
+  /* object path -> link in current_drives / current_blocks, so single
+   * objects can be looked up and removed without walking the lists
+   */
+  GHashTable *current_drive_links;
+  GHashTable *current_block_links;
+
+  /* object path -> GtkTreeIter for the rows of current_drives and
+   * current_blocks. Iters of a GtkTreeStore stay valid until the row is
+   * removed so there is no need for GtkTreeRowReference here.
+   */
+  GHashTable *iters;
+
+  /* object paths of rows to update when update_timeout_id fires */
+  GHashTable *pending_updates;
+  guint update_timeout_id;
+
   guint spinner_timeout;
 
   /* "Polling Every Few Seconds" ... e.g. power state */
   guint pefs_timeout_id;
+  gboolean pefs_paused;
+
+  /* object path -> PowerStateCheck */
+  GHashTable *power_state_checks;
+  /* object path -> GduPowerStateFlags of checks not yet applied to the rows */
+  GHashTable *power_state_results;
+  gint64 power_state_results_due; /* monotonic time, in usec */
 
   GHashTable *sort_mz;
 };
@@ -47,6 +83,15 @@ typedef struct
   GtkTreeStoreClass parent_class;
 } GduDeviceTreeModelClass;
 
+typedef struct
+{
+  gint64 next_check;   /* monotonic time, in usec */
+  guint interval;      /* in seconds */
+  gboolean checking;
+  gboolean have_flags;
+  GduPowerStateFlags flags;
+} PowerStateCheck;
+
 enum
 {
   PROP_0,
@@ -54,12 +99,41 @@ enum
   PROP_FLAGS
 };
 
+enum
+{
+  POWER_STATE_CHANGED_SIGNAL,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = {0};
+
 G_DEFINE_TYPE (GduDeviceTreeModel, gdu_device_tree_model, GTK_TYPE_TREE_STORE);
 
 static void coldplug (GduDeviceTreeModel *model);
 
-static void on_client_changed (UDisksClient  *client,
-                               gpointer       user_data);
+static void on_object_added (GDBusObjectManager *manager,
+                             GDBusObject        *object,
+                             gpointer            user_data);
+
+static void on_interface_added (GDBusObjectManager *manager,
+                                GDBusObject        *object,
+                                GDBusInterface     *interface,
+                                gpointer            user_data);
+
+static void on_interface_proxy_properties_changed (GDBusObjectManagerClient *manager,
+                                                   GDBusObjectProxy         *object_proxy,
+                                                   GDBusProxy               *interface_proxy,
+                                                   GVariant                 *changed_properties,
+                                                   const gchar *const       *invalidated_properties,
+                                                   gpointer                  user_data);
+
+static void on_local_jobs_changed (GduApplication *application,
+                                   UDisksObject   *object,
+                                   gpointer        user_data);
+
+static gboolean on_update_timeout (gpointer user_data);
+
+static void schedule_power_state_checks (GduDeviceTreeModel *model);
 
 static gboolean update_drive (GduDeviceTreeModel *model,
                               UDisksObject       *object,
@@ -81,13 +155,24 @@ gdu_device_tree_model_finalize (GObject *object)
   if (model->spinner_timeout != 0)
     g_source_remove (model->spinner_timeout);
 
-  g_signal_handlers_disconnect_by_func (model->client,
-                                        G_CALLBACK (on_client_changed),
+  if (model->update_timeout_id != 0)
+    g_source_remove (model->update_timeout_id);
+
+  g_signal_handlers_disconnect_by_data (udisks_client_get_object_manager (model->client), model);
+  g_signal_handlers_disconnect_by_func (model->application,
+                                        G_CALLBACK (on_local_jobs_changed),
                                         model);
 
   g_list_foreach (model->current_drives, (GFunc) g_object_unref, NULL);
   g_list_free (model->current_drives);
 
+  g_hash_table_unref (model->current_drive_links);
+  g_hash_table_unref (model->current_block_links);
+  g_hash_table_unref (model->iters);
+  g_hash_table_unref (model->pending_updates);
+  g_hash_table_unref (model->power_state_checks);
+  g_hash_table_unref (model->power_state_results);
+
   g_object_unref (model->application);
 
   G_OBJECT_CLASS (gdu_device_tree_model_parent_class)->finalize (object);
@@ -96,6 +181,16 @@ gdu_device_tree_model_finalize (GObject *object)
 static void
 gdu_device_tree_model_init (GduDeviceTreeModel *model)
 {
+  model->iters = g_hash_table_new_full (g_str_hash,
+                                        g_str_equal,
+                                        g_free,
+                                        (GDestroyNotify) gtk_tree_iter_free);
+  /* keys are owned by the objects in the lists */
+  model->current_drive_links = g_hash_table_new (g_str_hash, g_str_equal);
+  model->current_block_links = g_hash_table_new (g_str_hash, g_str_equal);
+  model->pending_updates = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  model->power_state_checks = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  model->power_state_results = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 }
 
 static void
@@ -149,51 +244,40 @@ gdu_device_tree_model_set_property (GObject      *object,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-typedef struct
+/* Adds a reference to @object to *@list */
+static void
+current_objects_add (GList       **list,
+                     GHashTable   *links,
+                     UDisksObject *object)
 {
-  UDisksObject *object;
-  const gchar *object_path;
-  GtkTreeIter iter;
-  gboolean found;
-} FindIterData;
+  *list = g_list_prepend (*list, g_object_ref (object));
+  g_hash_table_insert (links, (gpointer) g_dbus_object_get_object_path (G_DBUS_OBJECT (object)), *list);
+}
 
-static gboolean
-find_iter_for_object_cb (GtkTreeModel  *model,
-                         GtkTreePath   *path,
-                         GtkTreeIter   *iter,
-                         gpointer       user_data)
+/* Removes @link from *@list, the caller takes over the reference to the object */
+static void
+current_objects_remove_link (GList      **list,
+                             GHashTable  *links,
+                             GList       *link)
 {
-  FindIterData *data = user_data;
-  UDisksObject *iter_object;
-
-  iter_object = NULL;
-
-  gtk_tree_model_get (model,
-                      iter,
-                      GDU_DEVICE_TREE_MODEL_COLUMN_OBJECT, &iter_object,
-                      -1);
-  if (iter_object == NULL)
-    goto out;
-
-  if (iter_object == data->object)
-    {
-      data->iter = *iter;
-      data->found = TRUE;
-      goto out;
-    }
+  g_hash_table_remove (links, g_dbus_object_get_object_path (G_DBUS_OBJECT (link->data)));
+  *list = g_list_delete_link (*list, link);
+}
 
-  if (g_strcmp0 (g_dbus_object_get_object_path (G_DBUS_OBJECT (iter_object)), data->object_path) == 0)
-    {
-      data->iter = *iter;
-      data->found = TRUE;
-      goto out;
-    }
+static gboolean
+find_iter_for_object_path (GduDeviceTreeModel *model,
+                           const gchar        *object_path,
+                           GtkTreeIter        *out_iter)
+{
+  GtkTreeIter *iter;
 
+  iter = g_hash_table_lookup (model->iters, object_path);
+  if (iter == NULL)
+    return FALSE;
 
- out:
-  if (iter_object != NULL)
-    g_object_unref (iter_object);
-  return data->found;
+  if (out_iter != NULL)
+    *out_iter = *iter;
+  return TRUE;
 }
 
 static gboolean
@@ -201,21 +285,9 @@ find_iter_for_object (GduDeviceTreeModel *model,
                       UDisksObject       *object,
                       GtkTreeIter        *out_iter)
 {
-  FindIterData data;
-
-  memset (&data, 0, sizeof (data));
-  data.object = object;
-  data.found = FALSE;
-  gtk_tree_model_foreach (GTK_TREE_MODEL (model),
-                          find_iter_for_object_cb,
-                          &data);
-  if (data.found)
-    {
-      if (out_iter != NULL)
-        *out_iter = data.iter;
-    }
-
-  return data.found;
+  return find_iter_for_object_path (model,
+                                    g_dbus_object_get_object_path (G_DBUS_OBJECT (object)),
+                                    out_iter);
 }
 
 gboolean
@@ -223,33 +295,57 @@ gdu_device_tree_model_get_iter_for_object (GduDeviceTreeModel *model,
                                            UDisksObject       *object,
                                            GtkTreeIter        *iter)
 {
+  /* the caller may have just created @object, e.g. by setting up a loop
+   * device, so don't make it wait for the pending updates
+   */
+  if (model->update_timeout_id != 0 &&
+      g_hash_table_contains (model->pending_updates, g_dbus_object_get_object_path (G_DBUS_OBJECT (object))))
+    {
+      g_source_remove (model->update_timeout_id);
+      on_update_timeout (model);
+    }
+
   return find_iter_for_object (model, object, iter);
 }
 
+static void
+insert_object (GduDeviceTreeModel *model,
+               UDisksObject       *object,
+               GtkTreeIter        *parent)
+{
+  GtkTreeIter iter;
+  gtk_tree_store_insert_with_values (GTK_TREE_STORE (model),
+                                     &iter,
+                                     parent,
+                                     0,
+                                     GDU_DEVICE_TREE_MODEL_COLUMN_OBJECT, object,
+                                     -1);
+  g_hash_table_insert (model->iters,
+                       g_strdup (g_dbus_object_get_object_path (G_DBUS_OBJECT (object))),
+                       gtk_tree_iter_copy (&iter));
+}
 
-#if 0
-static gboolean
-find_iter_for_object_path (GduDeviceTreeModel *model,
-                           const gchar        *object_path,
-                           GtkTreeIter        *out_iter)
+static void
+remove_object (GduDeviceTreeModel *model,
+               UDisksObject       *object)
 {
-  FindIterData data;
+  GtkTreeIter iter;
 
-  memset (&data, 0, sizeof (data));
-  data.object_path = object_path;
-  data.found = FALSE;
-  gtk_tree_model_foreach (GTK_TREE_MODEL (model),
-                          find_iter_for_object_cb,
-                          &data);
-  if (data.found)
+  if (!find_iter_for_object (model,
+                             object,
+                             &iter))
     {
-      if (out_iter != NULL)
-        *out_iter = data.iter;
+      g_warning ("Error finding iter for object at %s",
+                 g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+      goto out;
     }
 
-  return data.found;
+  g_hash_table_remove (model->iters, g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+  gtk_tree_store_remove (GTK_TREE_STORE (model), &iter);
+
+ out:
+  ;
 }
-#endif
 
 /* ---------------------------------------------------------------------------------------------------- */
 
@@ -364,86 +460,192 @@ pm_get_state_cb (GObject       *source_object,
     }
 
  out:
+  /* the row is updated together with the results of other checks, see on_pefs_timeout() */
   object = g_dbus_interface_get_object (G_DBUS_INTERFACE (source_object));
   if (object != NULL)
     {
+      const gchar *object_path = g_dbus_object_get_object_path (object);
+      PowerStateCheck *check;
+
+      check = g_hash_table_lookup (model->power_state_checks, object_path);
+      if (check != NULL)
+        {
+          if (check->have_flags && check->flags == flags)
+            check->interval = MIN (check->interval * 2, POWER_STATE_MAX_INTERVAL_SEC);
+          else
+            check->interval = POWER_STATE_MIN_INTERVAL_SEC;
+          check->checking = FALSE;
+          check->have_flags = TRUE;
+          check->flags = flags;
+          check->next_check = g_get_monotonic_time () + check->interval * G_USEC_PER_SEC;
+
+          if (g_hash_table_size (model->power_state_results) == 0)
+            model->power_state_results_due = g_get_monotonic_time () + POWER_STATE_BATCH_MSEC * 1000;
+          g_hash_table_insert (model->power_state_results,
+                               g_strdup (object_path),
+                               GUINT_TO_POINTER (flags));
+          schedule_power_state_checks (model);
+        }
+    }
+
+  g_object_unref (model);
+}
+
+static void
+apply_power_state_results (GduDeviceTreeModel *model)
+{
+  GHashTableIter hash_iter;
+  const gchar *object_path;
+  gpointer value;
+
+  g_hash_table_iter_init (&hash_iter, model->power_state_results);
+  while (g_hash_table_iter_next (&hash_iter, (gpointer *) &object_path, &value))
+    {
+      GduPowerStateFlags flags = GPOINTER_TO_UINT (value);
+      GduPowerStateFlags cur_flags = GDU_POWER_STATE_FLAGS_NONE;
+      UDisksObject *object = NULL;
       GtkTreeIter iter;
-      if (gdu_device_tree_model_get_iter_for_object (model, UDISKS_OBJECT (object), &iter))
+
+      if (!find_iter_for_object_path (model, object_path, &iter))
+        continue;
+
+      gtk_tree_model_get (GTK_TREE_MODEL (model),
+                          &iter,
+                          GDU_DEVICE_TREE_MODEL_COLUMN_OBJECT, &object,
+                          GDU_DEVICE_TREE_MODEL_COLUMN_POWER_STATE_FLAGS, &cur_flags,
+                          -1);
+      if (cur_flags != flags)
         {
           gtk_tree_store_set (GTK_TREE_STORE (model),
                               &iter,
                               GDU_DEVICE_TREE_MODEL_COLUMN_POWER_STATE_FLAGS, flags,
                               -1);
+          if (object != NULL)
+            g_signal_emit (model, signals[POWER_STATE_CHANGED_SIGNAL], 0, object);
         }
+      g_clear_object (&object);
     }
-
-  g_object_unref (model);
+  g_hash_table_remove_all (model->power_state_results);
 }
 
-
-static gboolean
-pefs_timeout_foreach_cb (GtkTreeModel  *_model,
-                         GtkTreePath   *path,
-                         GtkTreeIter   *iter,
-                         gpointer       user_data)
+static void
+maybe_check_power_state (GduDeviceTreeModel *model,
+                         UDisksObject       *object,
+                         gint64              now)
 {
-  GduDeviceTreeModel *model = GDU_DEVICE_TREE_MODEL (_model);
-  UDisksObject *object = NULL;
-  UDisksDriveAta *ata = NULL;
-  GduPowerStateFlags cur_flags = GDU_POWER_STATE_FLAGS_NONE;
-
-  gtk_tree_model_get (GTK_TREE_MODEL (model),
-                      iter,
-                      GDU_DEVICE_TREE_MODEL_COLUMN_OBJECT, &object,
-                      GDU_DEVICE_TREE_MODEL_COLUMN_POWER_STATE_FLAGS, &cur_flags,
-                      -1);
+  const gchar *object_path;
+  UDisksDriveAta *ata;
+  PowerStateCheck *check;
+  GVariantBuilder options_builder;
 
-  if (object == NULL)
+  /* TODO: add support for other PM interfaces */
+  ata = udisks_object_peek_drive_ata (object);
+  if (ata == NULL || !udisks_drive_ata_get_pm_supported (ata) || !udisks_drive_ata_get_pm_enabled (ata))
     goto out;
 
+  object_path = g_dbus_object_get_object_path (G_DBUS_OBJECT (object));
+  check = g_hash_table_lookup (model->power_state_checks, object_path);
+  if (check == NULL)
+    {
+      /* spread out the first check of each drive */
+      check = g_new0 (PowerStateCheck, 1);
+      check->interval = POWER_STATE_MIN_INTERVAL_SEC;
+      check->next_check = now + g_random_int_range (0, POWER_STATE_MIN_INTERVAL_SEC * G_USEC_PER_SEC);
+      g_hash_table_insert (model->power_state_checks, g_strdup (object_path), check);
+    }
+
   /* Don't check power state if
    *
    *  - a check is already pending; or
-   *  - a check failed in the past
+   *  - a check failed in the past; or
+   *  - it's not time yet
    */
-  if (cur_flags & GDU_POWER_STATE_FLAGS_CHECKING || cur_flags & GDU_POWER_STATE_FLAGS_FAILED)
+  if (check->checking || (check->flags & GDU_POWER_STATE_FLAGS_FAILED) || now < check->next_check)
     goto out;
 
-  ata = udisks_object_peek_drive_ata (object);
-  if (ata != NULL && udisks_drive_ata_get_pm_supported (ata) && udisks_drive_ata_get_pm_enabled (ata))
-    {
-      GVariantBuilder options_builder;
-      g_variant_builder_init (&options_builder, G_VARIANT_TYPE_VARDICT);
-      g_variant_builder_add (&options_builder,
-                             "{sv}", "auth.no_user_interaction", g_variant_new_boolean (TRUE));
-      udisks_drive_ata_call_pm_get_state (ata,
-                                          g_variant_builder_end (&options_builder),
-                                          NULL, /* GCancellable */
-                                          pm_get_state_cb,
-                                          g_object_ref (model));
-
-      cur_flags |= GDU_POWER_STATE_FLAGS_CHECKING;
-      gtk_tree_store_set (GTK_TREE_STORE (model),
-                          iter,
-                          GDU_DEVICE_TREE_MODEL_COLUMN_POWER_STATE_FLAGS, cur_flags,
-                          -1);
-    }
-
-  /* TODO: add support for other PM interfaces */
+  g_variant_builder_init (&options_builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&options_builder,
+                         "{sv}", "auth.no_user_interaction", g_variant_new_boolean (TRUE));
+  udisks_drive_ata_call_pm_get_state (ata,
+                                      g_variant_builder_end (&options_builder),
+                                      NULL, /* GCancellable */
+                                      pm_get_state_cb,
+                                      g_object_ref (model));
+  check->checking = TRUE;
 
  out:
-  g_clear_object (&object);
-  return FALSE; /* continue iterating */
+  ;
 }
 
 static gboolean
 on_pefs_timeout (gpointer user_data)
 {
   GduDeviceTreeModel *model = GDU_DEVICE_TREE_MODEL (user_data);
-  gtk_tree_model_foreach (GTK_TREE_MODEL (model),
-                          pefs_timeout_foreach_cb,
-                          NULL);
-  return TRUE; /* keep timeout around */
+  gint64 now;
+  GList *l;
+
+  model->pefs_timeout_id = 0;
+
+  apply_power_state_results (model);
+
+  now = g_get_monotonic_time ();
+  for (l = model->current_drives; l != NULL; l = l->next)
+    maybe_check_power_state (model, UDISKS_OBJECT (l->data), now);
+
+  schedule_power_state_checks (model);
+
+  return FALSE; /* remove source */
+}
+
+/* (Re)arms the timeout for the earliest due check or batch of results.
+ * No timeout is kept while paused or if no drive needs checking.
+ */
+static void
+schedule_power_state_checks (GduDeviceTreeModel *model)
+{
+  gint64 now;
+  gint64 due = G_MAXINT64;
+  GList *l;
+
+  if (model->pefs_timeout_id != 0)
+    {
+      g_source_remove (model->pefs_timeout_id);
+      model->pefs_timeout_id = 0;
+    }
+
+  if (!(model->flags & GDU_DEVICE_TREE_MODEL_FLAGS_UPDATE_POWER_STATE) || model->pefs_paused)
+    return;
+
+  now = g_get_monotonic_time ();
+
+  if (g_hash_table_size (model->power_state_results) > 0)
+    due = model->power_state_results_due;
+
+  for (l = model->current_drives; l != NULL; l = l->next)
+    {
+      UDisksObject *object = UDISKS_OBJECT (l->data);
+      UDisksDriveAta *ata;
+      PowerStateCheck *check;
+
+      ata = udisks_object_peek_drive_ata (object);
+      if (ata == NULL || !udisks_drive_ata_get_pm_supported (ata) || !udisks_drive_ata_get_pm_enabled (ata))
+        continue;
+
+      check = g_hash_table_lookup (model->power_state_checks,
+                                   g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+      /* new drives get their first check spread out by maybe_check_power_state() */
+      if (check == NULL)
+        due = now;
+      else if (!check->checking && !(check->flags & GDU_POWER_STATE_FLAGS_FAILED))
+        due = MIN (due, check->next_check);
+    }
+
+  if (due == G_MAXINT64)
+    return;
+
+  model->pefs_timeout_id = g_timeout_add (due > now ? (guint) ((due - now + 999) / 1000) : 0,
+                                          on_pefs_timeout,
+                                          model);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -452,6 +654,7 @@ static void
 gdu_device_tree_model_constructed (GObject *object)
 {
   GduDeviceTreeModel *model = GDU_DEVICE_TREE_MODEL (object);
+  GDBusObjectManager *object_manager;
   GType types[GDU_DEVICE_TREE_MODEL_N_COLUMNS];
 
   G_STATIC_ASSERT (13 == GDU_DEVICE_TREE_MODEL_N_COLUMNS);
@@ -475,17 +678,34 @@ gdu_device_tree_model_constructed (GObject *object)
 
   g_assert (gtk_tree_model_get_flags (GTK_TREE_MODEL (model)) & GTK_TREE_MODEL_ITERS_PERSIST);
 
-  g_signal_connect (model->client,
-                    "changed",
-                    G_CALLBACK (on_client_changed),
+  object_manager = udisks_client_get_object_manager (model->client);
+  g_signal_connect (object_manager,
+                    "object-added",
+                    G_CALLBACK (on_object_added),
+                    model);
+  g_signal_connect (object_manager,
+                    "object-removed",
+                    G_CALLBACK (on_object_added),
+                    model);
+  g_signal_connect (object_manager,
+                    "interface-added",
+                    G_CALLBACK (on_interface_added),
+                    model);
+  g_signal_connect (object_manager,
+                    "interface-removed",
+                    G_CALLBACK (on_interface_added),
+                    model);
+  g_signal_connect (object_manager,
+                    "interface-proxy-properties-changed",
+                    G_CALLBACK (on_interface_proxy_properties_changed),
+                    model);
+  g_signal_connect (model->application,
+                    "local-jobs-changed",
+                    G_CALLBACK (on_local_jobs_changed),
                     model);
   coldplug (model);
 
-  if (model->flags & GDU_DEVICE_TREE_MODEL_FLAGS_UPDATE_POWER_STATE)
-    {
-      model->pefs_timeout_id = g_timeout_add_seconds (5, on_pefs_timeout, model);
-      on_pefs_timeout (model);
-    }
+  schedule_power_state_checks (model);
 
   if (model->flags & GDU_DEVICE_TREE_MODEL_FLAGS_INCLUDE_NONE_ITEM)
     {
@@ -541,6 +761,25 @@ gdu_device_tree_model_class_init (GduDeviceTreeModelClass *klass)
                                                        G_PARAM_WRITABLE |
                                                        G_PARAM_CONSTRUCT_ONLY |
                                                        G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GduDeviceTreeModel::power-state-changed:
+   * @model: A #GduDeviceTreeModel.
+   * @object: The drive object.
+   *
+   * Emitted when the %GDU_DEVICE_TREE_MODEL_COLUMN_POWER_STATE_FLAGS
+   * column of the row for @object changes.
+   */
+  signals[POWER_STATE_CHANGED_SIGNAL] = g_signal_new ("power-state-changed",
+                                                      G_TYPE_FROM_CLASS (klass),
+                                                      G_SIGNAL_RUN_LAST,
+                                                      0,
+                                                      NULL,
+                                                      NULL,
+                                                      g_cclosure_marshal_VOID__OBJECT,
+                                                      G_TYPE_NONE,
+                                                      1,
+                                                      UDISKS_TYPE_OBJECT);
 }
 
 /**
@@ -594,6 +833,76 @@ gdu_device_tree_model_get_flags (GduDeviceTreeModel *model)
   return model->flags;
 }
 
+/**
+ * gdu_device_tree_model_set_power_state_paused:
+ * @model: A #GduDeviceTreeModel.
+ * @paused: Whether to stop checking the power state of drives.
+ *
+ * Pauses or resumes checking the power state of drives, e.g. while
+ * nothing showing @model is visible. Only relevant if @model was
+ * constructed with %GDU_DEVICE_TREE_MODEL_FLAGS_UPDATE_POWER_STATE.
+ */
+void
+gdu_device_tree_model_set_power_state_paused (GduDeviceTreeModel *model,
+                                              gboolean            paused)
+{
+  GHashTableIter hash_iter;
+  PowerStateCheck *check;
+  gint64 now;
+
+  g_return_if_fail (GDU_IS_DEVICE_TREE_MODEL (model));
+
+  paused = !!paused;
+  if (model->pefs_paused == paused)
+    goto out;
+  model->pefs_paused = paused;
+
+  if (!paused)
+    {
+      /* spread out the checks that became due while paused */
+      now = g_get_monotonic_time ();
+      g_hash_table_iter_init (&hash_iter, model->power_state_checks);
+      while (g_hash_table_iter_next (&hash_iter, NULL, (gpointer *) &check))
+        {
+          if (check->next_check < now)
+            check->next_check = now + g_random_int_range (0, POWER_STATE_MIN_INTERVAL_SEC * G_USEC_PER_SEC);
+        }
+    }
+
+  /* nothing is polled while paused */
+  schedule_power_state_checks (model);
+
+ out:
+  ;
+}
+
+/**
+ * gdu_device_tree_model_recheck_power_state:
+ * @model: A #GduDeviceTreeModel.
+ * @object: A drive object.
+ *
+ * Makes @model check the power state of @object as soon as possible,
+ * e.g. after it was put into standby.
+ */
+void
+gdu_device_tree_model_recheck_power_state (GduDeviceTreeModel *model,
+                                           UDisksObject       *object)
+{
+  PowerStateCheck *check;
+
+  g_return_if_fail (GDU_IS_DEVICE_TREE_MODEL (model));
+  g_return_if_fail (UDISKS_IS_OBJECT (object));
+
+  check = g_hash_table_lookup (model->power_state_checks,
+                               g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+  if (check != NULL)
+    {
+      check->interval = POWER_STATE_MIN_INTERVAL_SEC;
+      check->next_check = 0;
+      schedule_power_state_checks (model);
+    }
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static GtkTreeIter *
@@ -640,34 +949,18 @@ add_drive (GduDeviceTreeModel *model,
            UDisksObject       *object,
            GtkTreeIter        *parent)
 {
-  GtkTreeIter iter;
-  gtk_tree_store_insert_with_values (GTK_TREE_STORE (model),
-                                     &iter,
-                                     parent,
-                                     0,
-                                     GDU_DEVICE_TREE_MODEL_COLUMN_OBJECT, object,
-                                     -1);
+  insert_object (model, object, parent);
 }
 
 static void
 remove_drive (GduDeviceTreeModel *model,
               UDisksObject       *object)
 {
-  GtkTreeIter iter;
+  const gchar *object_path = g_dbus_object_get_object_path (G_DBUS_OBJECT (object));
 
-  if (!find_iter_for_object (model,
-                             object,
-                             &iter))
-    {
-      g_warning ("Error finding iter for object at %s",
-                 g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
-      goto out;
-    }
-
-  gtk_tree_store_remove (GTK_TREE_STORE (model), &iter);
-
- out:
-  ;
+  g_hash_table_remove (model->power_state_checks, object_path);
+  g_hash_table_remove (model->power_state_results, object_path);
+  remove_object (model, object);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -978,15 +1271,18 @@ update_drives (GduDeviceTreeModel *model)
   for (l = removed_drives; l != NULL; l = l->next)
     {
       UDisksObject *object = UDISKS_OBJECT (l->data);
-      g_assert (g_list_find (model->current_drives, object) != NULL);
-      model->current_drives = g_list_remove (model->current_drives, object);
+      GList *link;
+
+      link = g_hash_table_lookup (model->current_drive_links, g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+      g_assert (link != NULL && link->data == object);
+      current_objects_remove_link (&model->current_drives, model->current_drive_links, link);
       remove_drive (model, object);
       g_object_unref (object);
     }
   for (l = added_drives; l != NULL; l = l->next)
     {
       UDisksObject *object = UDISKS_OBJECT (l->data);
-      model->current_drives = g_list_prepend (model->current_drives, g_object_ref (object));
+      current_objects_add (&model->current_drives, model->current_drive_links, object);
       add_drive (model, object, get_drive_header_iter (model));
     }
 
@@ -1054,34 +1350,14 @@ add_block (GduDeviceTreeModel  *model,
            UDisksObject        *object,
            GtkTreeIter         *parent)
 {
-  GtkTreeIter iter;
-  gtk_tree_store_insert_with_values (GTK_TREE_STORE (model),
-                                     &iter,
-                                     parent,
-                                     0,
-                                     GDU_DEVICE_TREE_MODEL_COLUMN_OBJECT, object,
-                                     -1);
+  insert_object (model, object, parent);
 }
 
 static void
 remove_block (GduDeviceTreeModel  *model,
               UDisksObject        *object)
 {
-  GtkTreeIter iter;
-
-  if (!find_iter_for_object (model,
-                             object,
-                             &iter))
-    {
-      g_warning ("Error finding iter for object at %s",
-                 g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
-      goto out;
-    }
-
-  gtk_tree_store_remove (GTK_TREE_STORE (model), &iter);
-
- out:
-  ;
+  remove_object (model, object);
 }
 
 static gboolean
@@ -1275,16 +1551,19 @@ update_blocks (GduDeviceTreeModel *model)
     {
       UDisksObject *object = UDISKS_OBJECT (l->data);
 
-      g_assert (g_list_find (model->current_blocks, object) != NULL);
+      GList *link;
+
+      link = g_hash_table_lookup (model->current_block_links, g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+      g_assert (link != NULL && link->data == object);
 
-      model->current_blocks = g_list_remove (model->current_blocks, object);
+      current_objects_remove_link (&model->current_blocks, model->current_block_links, link);
       remove_block (model, object);
       g_object_unref (object);
     }
   for (l = added_blocks; l != NULL; l = l->next)
     {
       UDisksObject *object = UDISKS_OBJECT (l->data);
-      model->current_blocks = g_list_prepend (model->current_blocks, g_object_ref (object));
+      current_objects_add (&model->current_blocks, model->current_block_links, object);
       add_block (model, object, get_block_header_iter (model));
     }
 
@@ -1311,7 +1590,6 @@ update_blocks (GduDeviceTreeModel *model)
 static void
 update_all (GduDeviceTreeModel *model)
 {
-  /* TODO: if this is CPU intensive we could coalesce all updates / schedule timeouts */
   update_drives (model);
   update_blocks (model);
 }
@@ -1322,12 +1600,220 @@ coldplug (GduDeviceTreeModel *model)
   update_all (model);
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Adds, removes or updates the row for the object at @object_path */
 static void
-on_client_changed (UDisksClient  *client,
-                   gpointer       user_data)
+update_object_path (GduDeviceTreeModel *model,
+                    const gchar        *object_path)
+{
+  UDisksObject *object;
+  GList *drive_link;
+  GList *block_link;
+  gboolean is_drive = FALSE;
+  gboolean is_block = FALSE;
+
+  object = udisks_client_get_object (model->client, object_path);
+  if (object != NULL)
+    {
+      is_drive = (udisks_object_peek_drive (object) != NULL);
+      is_block = (udisks_object_peek_block (object) != NULL && should_include_block (object));
+    }
+
+  drive_link = g_hash_table_lookup (model->current_drive_links, object_path);
+  if (drive_link != NULL && !is_drive)
+    {
+      UDisksObject *drive_object = UDISKS_OBJECT (drive_link->data);
+      current_objects_remove_link (&model->current_drives, model->current_drive_links, drive_link);
+      remove_drive (model, drive_object);
+      g_object_unref (drive_object);
+    }
+  else if (drive_link == NULL && is_drive)
+    {
+      current_objects_add (&model->current_drives, model->current_drive_links, object);
+      add_drive (model, object, get_drive_header_iter (model));
+    }
+  if (is_drive)
+    update_drive (model, object, FALSE);
+
+  block_link = g_hash_table_lookup (model->current_block_links, object_path);
+  if (block_link != NULL && !is_block)
+    {
+      UDisksObject *block_object = UDISKS_OBJECT (block_link->data);
+      current_objects_remove_link (&model->current_blocks, model->current_block_links, block_link);
+      remove_block (model, block_object);
+      g_object_unref (block_object);
+    }
+  else if (block_link == NULL && is_block)
+    {
+      current_objects_add (&model->current_blocks, model->current_block_links, object);
+      add_block (model, object, get_block_header_iter (model));
+    }
+  if (is_block)
+    update_block (model, object, FALSE);
+
+  g_clear_object (&object);
+}
+
+static gboolean
+on_update_timeout (gpointer user_data)
 {
   GduDeviceTreeModel *model = GDU_DEVICE_TREE_MODEL (user_data);
-  update_all (model);
+  GHashTable *pending_updates;
+  GHashTableIter hash_iter;
+  const gchar *object_path;
+
+  model->update_timeout_id = 0;
+
+  /* steal the set in case an update causes new changes to be queued */
+  pending_updates = model->pending_updates;
+  model->pending_updates = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  g_hash_table_iter_init (&hash_iter, pending_updates);
+  while (g_hash_table_iter_next (&hash_iter, (gpointer *) &object_path, NULL))
+    update_object_path (model, object_path);
+  g_hash_table_unref (pending_updates);
+
+  if (model->current_drives == NULL)
+    nuke_drive_header (model);
+  if (model->current_blocks == NULL)
+    nuke_block_header (model);
+
+  /* drives may have come, gone or changed whether they support power management */
+  schedule_power_state_checks (model);
+
+  return FALSE; /* remove source */
+}
+
+static void
+queue_update_for_object_path (GduDeviceTreeModel *model,
+                              const gchar        *object_path)
+{
+  if (object_path == NULL || g_strcmp0 (object_path, "/") == 0)
+    return;
+
+  g_hash_table_add (model->pending_updates, g_strdup (object_path));
+
+  /* Not restarted on every change so a steady stream of changes still
+   * gets shown
+   */
+  if (model->update_timeout_id == 0)
+    model->update_timeout_id = g_timeout_add (UPDATE_TIMEOUT_MSEC, on_update_timeout, model);
+}
+
+static void queue_update_for_object (GduDeviceTreeModel *model,
+                                     UDisksObject       *object);
+
+static void
+queue_update_for_related_object_path (GduDeviceTreeModel *model,
+                                      const gchar        *object_path)
+{
+  UDisksObject *object;
+
+  if (object_path == NULL || g_strcmp0 (object_path, "/") == 0)
+    return;
+
+  object = udisks_client_get_object (model->client, object_path);
+  if (object != NULL)
+    {
+      queue_update_for_object (model, object);
+      g_object_unref (object);
+    }
+}
+
+/* Queues an update of the row for @object and of the rows showing
+ * information derived from it, e.g. the drive of a block device or the
+ * device a job is running on.
+ */
+static void
+queue_update_for_object (GduDeviceTreeModel *model,
+                         UDisksObject       *object)
+{
+  UDisksBlock *block;
+  UDisksPartition *partition;
+  UDisksJob *job;
+  UDisksMDRaid *mdraid;
+
+  queue_update_for_object_path (model, g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
+
+  block = udisks_object_peek_block (object);
+  if (block != NULL)
+    {
+      queue_update_for_object_path (model, udisks_block_get_drive (block));
+      queue_update_for_related_object_path (model, udisks_block_get_crypto_backing_device (block));
+    }
+
+  partition = udisks_object_peek_partition (object);
+  if (partition != NULL)
+    queue_update_for_related_object_path (model, udisks_partition_get_table (partition));
+
+  job = udisks_object_peek_job (object);
+  if (job != NULL)
+    {
+      const gchar *const *job_objects;
+      guint n;
+
+      job_objects = udisks_job_get_objects (job);
+      for (n = 0; job_objects != NULL && job_objects[n] != NULL; n++)
+        queue_update_for_related_object_path (model, job_objects[n]);
+    }
+
+  mdraid = udisks_object_peek_mdraid (object);
+  if (mdraid != NULL)
+    {
+      GList *blocks, *l;
+
+      blocks = udisks_client_get_all_blocks_for_mdraid (model->client, mdraid);
+      for (l = blocks; l != NULL; l = l->next)
+        {
+          GDBusObject *block_object = g_dbus_interface_get_object (G_DBUS_INTERFACE (l->data));
+          if (block_object != NULL)
+            queue_update_for_object_path (model, g_dbus_object_get_object_path (block_object));
+        }
+      g_list_free_full (blocks, g_object_unref);
+    }
+}
+
+/* Also used for ::object-removed */
+static void
+on_object_added (GDBusObjectManager *manager,
+                 GDBusObject        *object,
+                 gpointer            user_data)
+{
+  GduDeviceTreeModel *model = GDU_DEVICE_TREE_MODEL (user_data);
+  queue_update_for_object (model, UDISKS_OBJECT (object));
+}
+
+/* Also used for ::interface-removed */
+static void
+on_interface_added (GDBusObjectManager *manager,
+                    GDBusObject        *object,
+                    GDBusInterface     *interface,
+                    gpointer            user_data)
+{
+  GduDeviceTreeModel *model = GDU_DEVICE_TREE_MODEL (user_data);
+  queue_update_for_object (model, UDISKS_OBJECT (object));
+}
+
+static void
+on_interface_proxy_properties_changed (GDBusObjectManagerClient *manager,
+                                       GDBusObjectProxy         *object_proxy,
+                                       GDBusProxy               *interface_proxy,
+                                       GVariant                 *changed_properties,
+                                       const gchar *const       *invalidated_properties,
+                                       gpointer                  user_data)
+{
+  GduDeviceTreeModel *model = GDU_DEVICE_TREE_MODEL (user_data);
+  queue_update_for_object (model, UDISKS_OBJECT (object_proxy));
+}
+
+static void
+on_local_jobs_changed (GduApplication *application,
+                       UDisksObject   *object,
+                       gpointer        user_data)
+{
+  GduDeviceTreeModel *model = GDU_DEVICE_TREE_MODEL (user_data);
+  queue_update_for_object (model, object);
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
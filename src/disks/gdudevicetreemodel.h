@@ -42,6 +42,10 @@ GduDeviceTreeModel *gdu_device_tree_model_new                 (GduApplication
                                                                GduDeviceTreeModelFlags  flags);
 GduApplication     *gdu_device_tree_model_get_application     (GduDeviceTreeModel *model);
 GduDeviceTreeModelFlags gdu_device_tree_model_get_flags       (GduDeviceTreeModel *model);
+void                gdu_device_tree_model_set_power_state_paused (GduDeviceTreeModel *model,
+                                                                  gboolean            paused);
+void                gdu_device_tree_model_recheck_power_state (GduDeviceTreeModel *model,
+                                                               UDisksObject       *object);
 gboolean            gdu_device_tree_model_get_iter_for_object (GduDeviceTreeModel *model,
                                                                UDisksObject       *object,
                                                                GtkTreeIter        *iter);
@@ -11,6 +11,8 @@
 
 #include <gmodule.h>
 #include <glib-unix.h>
+#include <fcntl.h>
+#include <string.h>
 #include <sys/ioctl.h>
 #include <linux/fs.h>
 
@@ -27,6 +29,12 @@
 #define DVDCSS_READ_DECRYPT   (1 << 0)
 #define DVDCSS_SEEK_KEY       (1 << 1)
 
+/* How far ahead of the current read we ask the kernel to read. Optical
+ * drives have a high latency per request so keep the drive busy while
+ * the caller is writing out what it just read.
+ */
+#define READ_AHEAD_SIZE       (8 * 1024 * 1024)
+
 struct dvdcss_s;
 typedef struct dvdcss_s* dvdcss_t;
 
@@ -115,12 +123,157 @@ struct GduDVDSupport
 
   Range *ranges;
   guint num_ranges;
+  guint64 device_size;
 
   Range *last_read_range;
+
+  /* the block libdvdcss will read next, -1 if unknown */
+  gint css_next_block;
+
+  /* end of the range the kernel has been asked to read ahead */
+  guint64 read_ahead_end;
 };
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Finding the ranges means asking for the CSS key of every VOB file
+ * which can take minutes on some discs. So we cache the range table,
+ * keyed by the UDF volume identifier and volume set identifier (which
+ * contains a serial number) of the disc. The keys themselves don't need
+ * to be fetched up front - they are fetched when reading a range for
+ * the first time and libdvdcss keeps its own cache of those.
+ */
+
+#define RANGES_CACHE_TYPE "a(ttb)"
+
+/* returns NULL if the disc cannot be identified */
+static gchar *
+get_ranges_cache_filename (GduDVDSupport *support,
+                           guint64        device_size)
+{
+  gchar *ret = NULL;
+  gchar *cache_dir = NULL;
+  gchar volid[33];
+  guchar volsetid[128];
+  GChecksum *checksum = NULL;
+
+  memset (volid, 0, sizeof volid);
+  if (DVDUDFVolumeInfo (support->dvd, volid, sizeof volid - 1, volsetid, sizeof volsetid) != 0)
+    goto out;
+
+  cache_dir = g_strdup_printf ("%s/gnome-disks/dvd-ranges", g_get_user_cache_dir ());
+  if (g_mkdir_with_parents (cache_dir, 0777) != 0)
+    {
+      g_warning ("Error creating directory %s: %m", cache_dir);
+      goto out;
+    }
+
+  checksum = g_checksum_new (G_CHECKSUM_SHA256);
+  g_checksum_update (checksum, (const guchar *) volid, sizeof volid);
+  g_checksum_update (checksum, volsetid, sizeof volsetid);
+  g_checksum_update (checksum, (const guchar *) &device_size, sizeof device_size);
+
+  ret = g_strdup_printf ("%s/%s", cache_dir, g_checksum_get_string (checksum));
+
+ out:
+  if (checksum != NULL)
+    g_checksum_free (checksum);
+  g_free (cache_dir);
+  return ret;
+}
+
+static gboolean
+load_ranges (GduDVDSupport *support,
+             const gchar   *filename,
+             guint64        device_size)
+{
+  gboolean ret = FALSE;
+  gchar *contents = NULL;
+  gsize length;
+  GVariant *value = NULL;
+  GVariantIter iter;
+  GArray *a = NULL;
+  Range range = {0};
+  guint64 pos;
+  gboolean have_scrambled = FALSE;
+
+  if (!g_file_get_contents (filename, &contents, &length, NULL))
+    goto out;
+
+  value = g_variant_new_from_data (G_VARIANT_TYPE (RANGES_CACHE_TYPE),
+                                   contents, length,
+                                   FALSE, /* trusted */
+                                   g_free, contents);
+  contents = NULL;
+  g_variant_ref_sink (value);
+
+  /* the ranges must cover the entire disc without overlapping, just like
+   * the ones built in gdu_dvd_support_new()
+   */
+  a = g_array_new (FALSE, FALSE, sizeof (Range));
+  pos = 0;
+  g_variant_iter_init (&iter, value);
+  while (g_variant_iter_next (&iter, "(ttb)", &range.start, &range.end, &range.scrambled))
+    {
+      if (range.start != pos || range.end <= range.start)
+        goto out;
+      if (range.scrambled)
+        have_scrambled = TRUE;
+      g_array_append_val (a, range);
+      pos = range.end;
+    }
+  if (pos != device_size || !have_scrambled)
+    goto out;
+
+  support->num_ranges = a->len;
+  support->ranges = (Range*) g_array_free (a, FALSE);
+  a = NULL;
+
+  if (G_UNLIKELY (support->debug))
+    g_print ("Loaded %u ranges from %s\n", support->num_ranges, filename);
+
+  ret = TRUE;
+
+ out:
+  if (a != NULL)
+    g_array_unref (a);
+  if (value != NULL)
+    g_variant_unref (value);
+  g_free (contents);
+  return ret;
+}
+
+static void
+save_ranges (GduDVDSupport *support,
+             const gchar   *filename)
+{
+  GVariantBuilder builder;
+  GVariant *value;
+  GError *error = NULL;
+  guint n;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE (RANGES_CACHE_TYPE));
+  for (n = 0; n < support->num_ranges; n++)
+    {
+      Range *range = support->ranges + n;
+      g_variant_builder_add (&builder, "(ttb)", range->start, range->end, range->scrambled);
+    }
+  value = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+  if (!g_file_set_contents (filename,
+                            g_variant_get_data (value),
+                            g_variant_get_size (value),
+                            &error))
+    {
+      g_warning ("Error saving DVD ranges: %s (%s, %d)",
+                 error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+    }
+  g_variant_unref (value);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 GduDVDSupport *
 gdu_dvd_support_new  (const gchar *device_file,
                       guint64      device_size)
@@ -132,6 +285,7 @@ gdu_dvd_support_new  (const gchar *device_file,
   guint64 pos;
   GArray *a;
   Range *prev_range;
+  gchar *cache_filename = NULL;
 
   /* We use dlopen() to access libdvdcss since it's normally not
    * shipped (so we can't hard-depend on it) but it may be installed
@@ -141,6 +295,8 @@ gdu_dvd_support_new  (const gchar *device_file,
     goto out;
 
   support = g_new0 (GduDVDSupport, 1);
+  support->device_size = device_size;
+  support->css_next_block = -1;
 
   if (g_getenv ("GDU_DEBUG") != NULL)
     support->debug = TRUE;
@@ -153,6 +309,10 @@ gdu_dvd_support_new  (const gchar *device_file,
   if (support->dvdcss == NULL)
     goto fail;
 
+  cache_filename = get_ranges_cache_filename (support, device_size);
+  if (cache_filename != NULL && load_ranges (support, cache_filename, device_size))
+    goto out;
+
   /* It follows from "6.9.1 Constraints imposed on UDF by DVD-Video"
    * of the OSTA UDF 2.60 spec (March 1, 2005) that
    *
@@ -318,8 +478,12 @@ gdu_dvd_support_new  (const gchar *device_file,
         }
     }
 
+  if (cache_filename != NULL)
+    save_ranges (support, cache_filename);
+
  out:
   g_list_free_full (scrambled_ranges, g_free);
+  g_free (cache_filename);
   return support;
 
  fail:
@@ -341,6 +505,53 @@ gdu_dvd_support_free (GduDVDSupport *support)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Returns the index of the range containing @offset or num_ranges if there is none */
+static guint
+find_range (GduDVDSupport *support,
+            guint64        offset)
+{
+  guint lo = 0;
+  guint hi = support->num_ranges;
+
+  /* the ranges are sorted and don't overlap so find the first one ending after @offset */
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+      if (support->ranges[mid].end <= offset)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  if (lo < support->num_ranges && offset < support->ranges[lo].start)
+    lo = support->num_ranges;
+
+  return lo;
+}
+
+/* Asks the kernel to start reading the data following @offset. This
+ * also helps libdvdcss since it reads from the same device and thus
+ * shares the page cache with @fd.
+ */
+static void
+maybe_read_ahead (GduDVDSupport *support,
+                  int            fd,
+                  guint64        offset)
+{
+  guint64 start;
+  guint64 end;
+
+  /* only extend the window once half of it has been consumed */
+  if (offset + READ_AHEAD_SIZE / 2 < support->read_ahead_end)
+    return;
+
+  start = MAX (offset, support->read_ahead_end);
+  end = MIN (offset + READ_AHEAD_SIZE, support->device_size);
+  if (start < end)
+    posix_fadvise (fd, start, end - start, POSIX_FADV_WILLNEED);
+  support->read_ahead_end = end;
+}
+
 gssize
 gdu_dvd_support_read (GduDVDSupport *support,
                       int            fd,
@@ -369,14 +580,15 @@ gdu_dvd_support_read (GduDVDSupport *support,
     }
   else
     {
-      /* Otherwise look through all ranges, starting form the first */
-      for (n = 0; n < support->num_ranges; n++)
-        {
-          if (offset >= support->ranges[n].start &&
-              offset < support->ranges[n].end)
-            break;
-        }
+      n = find_range (support, offset);
+    }
+
+  if (support->read_ahead_end > offset + size + READ_AHEAD_SIZE)
+    {
+      /* the caller jumped backwards, start over */
+      support->read_ahead_end = 0;
     }
+  maybe_read_ahead (support, fd, offset + size);
 
   /* Break the read request into multiple requests not crossing any of
    * the ranges... we only want to use dvdcss_read() for the encrypted
@@ -431,8 +643,13 @@ gdu_dvd_support_read (GduDVDSupport *support,
               support->last_read_range = r;
             }
 
-          if (dvdcss_seek (support->dvdcss, block_offset, flags) != block_offset)
-            goto out;
+          /* dvdcss_read() advances the position so only seek if needed */
+          if (flags != 0 || block_offset != support->css_next_block)
+            {
+              support->css_next_block = -1;
+              if (dvdcss_seek (support->dvdcss, block_offset, flags) != block_offset)
+                goto out;
+            }
 
         dvdcss_read_again:
           num_blocks_read = dvdcss_read (support->dvdcss,
@@ -444,16 +661,19 @@ gdu_dvd_support_read (GduDVDSupport *support,
               if (errno == EAGAIN || errno == EINTR)
                 goto dvdcss_read_again;
               /* treat as partial read */
+              support->css_next_block = -1;
               ret = size - num_left;
               goto out;
             }
           if (num_blocks_read == 0)
             {
               /* treat as partial read */
+              support->css_next_block = -1;
               ret = size - num_left;
               goto out;
             }
           g_assert (num_blocks_read <= num_blocks_to_request);
+          support->css_next_block = block_offset + num_blocks_read;
           num_bytes_read = num_blocks_read * 2048;
         }
       else
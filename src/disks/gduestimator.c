@@ -11,33 +11,62 @@
 #include <glib/gi18n.h>
 
 #include <math.h>
+#include <string.h>
 #include <gdk/gdkkeysyms.h>
 #include <gdk/gdkx.h>
 #include <stdlib.h>
 
 #include "gduestimator.h"
 
-//#define MAX_SAMPLES 100
-#define MAX_SAMPLES 50
+/* Number of speeds (one per interval between two samples) the median is taken over */
+#define MAX_SPEEDS 50
 
-typedef struct
-{
-  gint64 time_usec;
-  guint64 value;
-} Sample;
+/* Time constants of the long-term rate that is reported and of the
+ * short-term rate used to detect when the throughput shifts (e.g. when a
+ * write cache is exhausted)
+ */
+#define LONG_TAU_SEC   5.0
+#define SHORT_TAU_SEC  1.0
+
+/* Speeds further than this factor from the median are clamped before
+ * being fed to the long-term rate so a single stall or burst doesn't
+ * distort it
+ */
+#define OUTLIER_FACTOR 3.0
+
+/* The short-term rate must be off by more than this factor for at least
+ * PHASE_SHIFT_USEC before it's considered a new phase
+ */
+#define PHASE_SHIFT_FACTOR 1.5
+#define PHASE_SHIFT_USEC   (3 * G_USEC_PER_SEC)
 
 typedef struct _GduEstimatorClass GduEstimatorClass;
 struct _GduEstimator
 {
   GObject parent;
 
+  /* protects everything below so threads can feed samples without
+   * having to hold any lock of their own
+   */
+  GMutex lock;
+
   guint64 target_bytes;
   guint64 completed_bytes;
   guint64 bytes_per_sec;
   guint64 usec_remaining;
 
-  Sample samples[MAX_SAMPLES];
-  guint num_samples;
+  gint64 last_time_usec;  /* of the previous sample, -1 if none */
+  guint64 last_value;
+
+  /* ring buffer of the last MAX_SPEEDS speeds and the same sorted */
+  gdouble speeds[MAX_SPEEDS];
+  gdouble sorted_speeds[MAX_SPEEDS];
+  guint speeds_head;
+  guint num_speeds;
+
+  gdouble long_rate;
+  gdouble short_rate;
+  gint64 phase_shift_start_usec; /* -1 if rates agree */
 };
 
 struct _GduEstimatorClass
@@ -59,7 +88,9 @@ G_DEFINE_TYPE (GduEstimator, gdu_estimator, G_TYPE_OBJECT)
 static void
 gdu_estimator_finalize (GObject *object)
 {
-  //GduEstimator *estimator = GDU_ESTIMATOR (object);
+  GduEstimator *estimator = GDU_ESTIMATOR (object);
+
+  g_mutex_clear (&estimator->lock);
 
   G_OBJECT_CLASS (gdu_estimator_parent_class)->finalize (object);
 }
@@ -118,42 +149,123 @@ gdu_estimator_set_property (GObject      *object,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Adds @speed to the window, dropping the oldest one - keeps sorted_speeds sorted
+ * with a single move instead of sorting everything again
+ */
 static void
-update (GduEstimator *estimator)
+add_speed (GduEstimator *estimator,
+           gdouble       speed)
 {
   guint n;
-  gdouble sum_of_speeds;
-  guint num_speeds;
+  guint pos;
 
-  num_speeds = 0;
-  sum_of_speeds = 0.0;
-  for (n = 1; n < estimator->num_samples; n++)
+  if (estimator->num_speeds == MAX_SPEEDS)
     {
-      Sample *a = &estimator->samples[n-1];
-      Sample *b = &estimator->samples[n];
-      gdouble speed;
-      speed = (b->value - a->value) / (((gdouble) (b->time_usec - a->time_usec)) / G_USEC_PER_SEC);
-      sum_of_speeds += speed;
-      num_speeds++;
+      gdouble oldest = estimator->speeds[estimator->speeds_head];
+      for (n = 0; n < estimator->num_speeds; n++)
+        {
+          if (estimator->sorted_speeds[n] == oldest)
+            break;
+        }
+      memmove (estimator->sorted_speeds + n, estimator->sorted_speeds + n + 1,
+               sizeof (gdouble) * (estimator->num_speeds - n - 1));
+      estimator->num_speeds--;
     }
-  estimator->bytes_per_sec = 0;
-  estimator->usec_remaining = 0;
-  if (num_speeds > 0)
+  estimator->speeds[estimator->speeds_head] = speed;
+  estimator->speeds_head = (estimator->speeds_head + 1) % MAX_SPEEDS;
+
+  for (pos = 0; pos < estimator->num_speeds; pos++)
     {
-      gdouble speed;
-      speed = sum_of_speeds / num_speeds;
-      estimator->bytes_per_sec = speed;
-      if (estimator->bytes_per_sec > 0)
+      if (estimator->sorted_speeds[pos] > speed)
+        break;
+    }
+  memmove (estimator->sorted_speeds + pos + 1, estimator->sorted_speeds + pos,
+           sizeof (gdouble) * (estimator->num_speeds - pos));
+  estimator->sorted_speeds[pos] = speed;
+  estimator->num_speeds++;
+}
+
+static void
+clear_speeds (GduEstimator *estimator)
+{
+  estimator->speeds_head = 0;
+  estimator->num_speeds = 0;
+}
+
+static gdouble
+get_median_speed (GduEstimator *estimator)
+{
+  guint n = estimator->num_speeds;
+  if (n % 2 == 1)
+    return estimator->sorted_speeds[n / 2];
+  return (estimator->sorted_speeds[n / 2 - 1] + estimator->sorted_speeds[n / 2]) / 2.0;
+}
+
+/* must be called with the lock held */
+static void
+update (GduEstimator *estimator,
+        gint64        now_usec,
+        guint64       value)
+{
+  gdouble dt;
+  gdouble speed;
+  gdouble clamped_speed;
+
+  if (estimator->last_time_usec < 0 || now_usec <= estimator->last_time_usec)
+    goto out;
+
+  dt = ((gdouble) (now_usec - estimator->last_time_usec)) / G_USEC_PER_SEC;
+  speed = (value - estimator->last_value) / dt;
+
+  if (estimator->num_speeds == 0)
+    {
+      /* first speed of this phase */
+      estimator->long_rate = speed;
+      estimator->short_rate = speed;
+      clamped_speed = speed;
+    }
+  else
+    {
+      gdouble median = get_median_speed (estimator);
+      clamped_speed = CLAMP (speed, median / OUTLIER_FACTOR, median * OUTLIER_FACTOR);
+      estimator->long_rate += (1.0 - exp (-dt / LONG_TAU_SEC)) * (clamped_speed - estimator->long_rate);
+      estimator->short_rate += (1.0 - exp (-dt / SHORT_TAU_SEC)) * (speed - estimator->short_rate);
+    }
+  add_speed (estimator, speed);
+
+  /* If the short-term rate stays off for a while, the old samples no
+   * longer say anything about the rest of the operation - start over
+   * from the short-term rate.
+   */
+  if (estimator->short_rate > estimator->long_rate * PHASE_SHIFT_FACTOR ||
+      estimator->short_rate < estimator->long_rate / PHASE_SHIFT_FACTOR)
+    {
+      if (estimator->phase_shift_start_usec < 0)
+        estimator->phase_shift_start_usec = now_usec;
+      else if (now_usec - estimator->phase_shift_start_usec > PHASE_SHIFT_USEC)
         {
-          guint64 remaining_bytes = estimator->target_bytes - estimator->completed_bytes;
-          estimator->usec_remaining = G_USEC_PER_SEC * remaining_bytes / estimator->bytes_per_sec;
+          clear_speeds (estimator);
+          add_speed (estimator, estimator->short_rate);
+          estimator->long_rate = estimator->short_rate;
+          estimator->phase_shift_start_usec = -1;
         }
     }
+  else
+    {
+      estimator->phase_shift_start_usec = -1;
+    }
 
-  g_object_freeze_notify (G_OBJECT (estimator));
-  g_object_notify (G_OBJECT (estimator), "bytes-per-sec");
-  g_object_notify (G_OBJECT (estimator), "usec-remaining");
-  g_object_thaw_notify (G_OBJECT (estimator));
+  estimator->bytes_per_sec = MAX (estimator->long_rate, 0.0);
+  estimator->usec_remaining = 0;
+  if (estimator->bytes_per_sec > 0 && value < estimator->target_bytes)
+    {
+      guint64 remaining_bytes = estimator->target_bytes - value;
+      estimator->usec_remaining = G_USEC_PER_SEC * remaining_bytes / estimator->bytes_per_sec;
+    }
+
+ out:
+  estimator->last_time_usec = now_usec;
+  estimator->last_value = value;
 }
 
 static void
@@ -196,6 +308,9 @@ gdu_estimator_class_init (GduEstimatorClass *klass)
 static void
 gdu_estimator_init (GduEstimator *estimator)
 {
+  g_mutex_init (&estimator->lock);
+  estimator->last_time_usec = -1;
+  estimator->phase_shift_start_usec = -1;
 }
 
 GduEstimator *
@@ -209,50 +324,76 @@ gdu_estimator_new (guint64  target_bytes)
 guint64
 gdu_estimator_get_target_bytes (GduEstimator *estimator)
 {
+  guint64 ret;
   g_return_val_if_fail (GDU_IS_ESTIMATOR (estimator), 0);
-  return estimator->target_bytes;
+  g_mutex_lock (&estimator->lock);
+  ret = estimator->target_bytes;
+  g_mutex_unlock (&estimator->lock);
+  return ret;
 }
 
 guint64
 gdu_estimator_get_completed_bytes (GduEstimator *estimator)
 {
+  guint64 ret;
   g_return_val_if_fail (GDU_IS_ESTIMATOR (estimator), 0);
-  return estimator->completed_bytes;
+  g_mutex_lock (&estimator->lock);
+  ret = estimator->completed_bytes;
+  g_mutex_unlock (&estimator->lock);
+  return ret;
 }
 
 guint64
 gdu_estimator_get_bytes_per_sec (GduEstimator *estimator)
 {
+  guint64 ret;
   g_return_val_if_fail (GDU_IS_ESTIMATOR (estimator), 0);
-  return estimator->bytes_per_sec;
+  g_mutex_lock (&estimator->lock);
+  ret = estimator->bytes_per_sec;
+  g_mutex_unlock (&estimator->lock);
+  return ret;
 }
 
 guint64
 gdu_estimator_get_usec_remaining (GduEstimator *estimator)
 {
+  guint64 ret;
   g_return_val_if_fail (GDU_IS_ESTIMATOR (estimator), 0);
-  return estimator->usec_remaining;
+  g_mutex_lock (&estimator->lock);
+  ret = estimator->usec_remaining;
+  g_mutex_unlock (&estimator->lock);
+  return ret;
 }
 
+/**
+ * gdu_estimator_add_sample:
+ * @estimator: A #GduEstimator.
+ * @completed_bytes: The number of bytes completed so far.
+ *
+ * Adds a sample. This takes constant time and may be called from any
+ * thread without holding a lock.
+ */
 void
 gdu_estimator_add_sample (GduEstimator    *estimator,
                           guint64          completed_bytes)
 {
-  Sample *sample;
-  g_return_if_fail (GDU_IS_ESTIMATOR (estimator));
-  g_return_if_fail (completed_bytes >= estimator->completed_bytes);
+  gboolean valid;
 
-  estimator->completed_bytes = completed_bytes;
+  g_return_if_fail (GDU_IS_ESTIMATOR (estimator));
 
-  if (estimator->num_samples == MAX_SAMPLES)
+  g_mutex_lock (&estimator->lock);
+  valid = (completed_bytes >= estimator->completed_bytes);
+  if (valid)
     {
-      memmove (estimator->samples, estimator->samples + 1, sizeof (Sample) * (MAX_SAMPLES - 1));
-      estimator->num_samples -= 1;
+      estimator->completed_bytes = completed_bytes;
+      update (estimator, g_get_monotonic_time (), completed_bytes);
     }
-  sample = &estimator->samples[estimator->num_samples++];
+  g_mutex_unlock (&estimator->lock);
+  g_return_if_fail (valid);
 
-  sample->time_usec = g_get_real_time ();
-  sample->value = completed_bytes;
-
-  update (estimator);
+  g_object_freeze_notify (G_OBJECT (estimator));
+  g_object_notify (G_OBJECT (estimator), "completed-bytes");
+  g_object_notify (G_OBJECT (estimator), "bytes-per-sec");
+  g_object_notify (G_OBJECT (estimator), "usec-remaining");
+  g_object_thaw_notify (G_OBJECT (estimator));
 }
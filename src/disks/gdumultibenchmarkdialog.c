@@ -0,0 +1,731 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <glib/gi18n.h>
+#include <unistd.h>
+
+#include "gduapplication.h"
+#include "gduwindow.h"
+#include "gdumultibenchmarkdialog.h"
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+enum
+{
+  COLUMN_SELECTED,
+  COLUMN_SENSITIVE,
+  COLUMN_NAME,
+  COLUMN_READ_RATE,
+  COLUMN_WRITE_RATE,
+  COLUMN_PROGRESS,
+  COLUMN_PROGRESS_TEXT,
+  COLUMN_DRIVE_DATA,
+  N_COLUMNS
+};
+
+typedef struct DialogData DialogData;
+
+typedef struct
+{
+  DialogData *data; /* not referenced */
+  UDisksObject *object;
+  UDisksObject *block_object;
+  GtkTreeIter iter;
+
+  /* must hold data->lock when reading/writing these */
+  gboolean in_progress;
+  gboolean opened;
+  guint num_read_samples;
+  gdouble read_rate_sum;
+  guint num_write_samples;
+  gdouble write_rate_sum;
+  GError *error; /* set by benchmark thread on termination */
+} DriveData;
+
+struct DialogData
+{
+  volatile gint ref_count;
+
+  GduWindow *window;
+  GtkBuilder *builder;
+
+  GtkWidget *dialog;
+  GtkWidget *disks_treeview;
+  GtkWidget *num_samples_spinbutton;
+  GtkWidget *sample_size_spinbutton;
+  GtkWidget *write_checkbutton;
+  GtkWidget *read_rate_label;
+  GtkWidget *write_rate_label;
+
+  GtkWidget *start_benchmark_button;
+  GtkWidget *stop_benchmark_button;
+
+  GtkListStore *store;
+  GPtrArray *drives;
+
+  GCancellable *cancellable;
+  GduBenchmarkParams params;
+  guint inhibit_cookie;
+
+  /* must hold lock when reading/writing these */
+  GMutex lock;
+  GCond cond;
+  guint num_started;
+  guint num_opened;
+  guint num_running;
+  gboolean update_timeout_pending;
+};
+
+static const struct {
+  goffset offset;
+  const gchar *name;
+} widget_mapping[] = {
+  {G_STRUCT_OFFSET (DialogData, disks_treeview), "disks-treeview"},
+  {G_STRUCT_OFFSET (DialogData, num_samples_spinbutton), "num-samples-spinbutton"},
+  {G_STRUCT_OFFSET (DialogData, sample_size_spinbutton), "sample-size-spinbutton"},
+  {G_STRUCT_OFFSET (DialogData, write_checkbutton), "write-checkbutton"},
+  {G_STRUCT_OFFSET (DialogData, read_rate_label), "read-rate-label"},
+  {G_STRUCT_OFFSET (DialogData, write_rate_label), "write-rate-label"},
+  {G_STRUCT_OFFSET (DialogData, start_benchmark_button), "start-benchmark-button"},
+  {G_STRUCT_OFFSET (DialogData, stop_benchmark_button), "stop-benchmark-button"},
+  {0, NULL}
+};
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+drive_data_free (DriveData *drive_data)
+{
+  g_clear_object (&drive_data->object);
+  g_clear_object (&drive_data->block_object);
+  g_clear_error (&drive_data->error);
+  g_free (drive_data);
+}
+
+static DialogData *
+dialog_data_ref (DialogData *data)
+{
+  g_atomic_int_inc (&data->ref_count);
+  return data;
+}
+
+static void
+dialog_data_unref (DialogData *data)
+{
+  if (g_atomic_int_dec_and_test (&data->ref_count))
+    {
+      if (data->dialog != NULL)
+        {
+          gtk_widget_hide (data->dialog);
+          gtk_widget_destroy (data->dialog);
+          data->dialog = NULL;
+        }
+
+      g_clear_object (&data->window);
+      g_clear_object (&data->builder);
+      g_clear_object (&data->store);
+      g_clear_object (&data->cancellable);
+      g_ptr_array_unref (data->drives);
+      g_mutex_clear (&data->lock);
+      g_cond_clear (&data->cond);
+
+      g_free (data);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gchar *
+format_transfer_rate (gdouble bytes_per_sec)
+{
+  gchar *ret = NULL;
+  gchar *s;
+
+  s = g_format_size ((guint64) bytes_per_sec);
+  /* Translators: %s is the formatted size, e.g. "42 MB" and the trailing "/s" means per second */
+  ret = g_strdup_printf (C_("benchmark-transfer-rate", "%s/s"), s);
+  g_free (s);
+  return ret;
+}
+
+static void
+update_dialog (DialogData *data)
+{
+  gdouble combined_read = 0.0;
+  gdouble combined_write = 0.0;
+  gboolean in_progress;
+  gchar *s;
+  guint n;
+
+  g_mutex_lock (&data->lock);
+  in_progress = (data->num_running > 0);
+  for (n = 0; n < data->drives->len; n++)
+    {
+      DriveData *drive_data = data->drives->pdata[n];
+      gdouble read_avg = 0.0;
+      gdouble write_avg = 0.0;
+      gchar *read_str = NULL;
+      gchar *write_str = NULL;
+      gchar *progress_str = NULL;
+      gint progress = 0;
+
+      if (drive_data->num_read_samples > 0)
+        {
+          read_avg = drive_data->read_rate_sum / drive_data->num_read_samples;
+          read_str = format_transfer_rate (read_avg);
+          combined_read += read_avg;
+          progress = drive_data->num_read_samples * 100 / data->params.num_samples;
+        }
+      if (drive_data->num_write_samples > 0)
+        {
+          write_avg = drive_data->write_rate_sum / drive_data->num_write_samples;
+          write_str = format_transfer_rate (write_avg);
+          combined_write += write_avg;
+        }
+
+      if (drive_data->error != NULL)
+        {
+          if (drive_data->error->domain == G_IO_ERROR && drive_data->error->code == G_IO_ERROR_CANCELLED)
+            progress_str = g_strdup (C_("multi-benchmark-status", "Aborted"));
+          else
+            progress_str = g_strdup (drive_data->error->message);
+        }
+      else if (drive_data->in_progress && !drive_data->opened)
+        {
+          progress_str = g_strdup (C_("multi-benchmark-status", "Opening Device…"));
+        }
+      else if (drive_data->in_progress || progress > 0)
+        {
+          progress_str = g_strdup_printf ("%d%%", progress);
+        }
+
+      gtk_list_store_set (data->store, &drive_data->iter,
+                          COLUMN_SENSITIVE, !in_progress,
+                          COLUMN_READ_RATE, read_str != NULL ? read_str : "–",
+                          COLUMN_WRITE_RATE, write_str != NULL ? write_str : "–",
+                          COLUMN_PROGRESS, progress,
+                          COLUMN_PROGRESS_TEXT, progress_str,
+                          -1);
+      g_free (progress_str);
+      g_free (write_str);
+      g_free (read_str);
+    }
+  g_mutex_unlock (&data->lock);
+
+  if (combined_read == 0.0)
+    s = g_strdup ("–");
+  else
+    s = format_transfer_rate (combined_read);
+  gtk_label_set_text (GTK_LABEL (data->read_rate_label), s);
+  g_free (s);
+
+  if (combined_write == 0.0)
+    s = g_strdup ("–");
+  else
+    s = format_transfer_rate (combined_write);
+  gtk_label_set_text (GTK_LABEL (data->write_rate_label), s);
+  g_free (s);
+
+  gtk_widget_set_visible (data->start_benchmark_button, !in_progress);
+  gtk_widget_set_visible (data->stop_benchmark_button, in_progress);
+  gtk_widget_set_sensitive (data->num_samples_spinbutton, !in_progress);
+  gtk_widget_set_sensitive (data->sample_size_spinbutton, !in_progress);
+  gtk_widget_set_sensitive (data->write_checkbutton, !in_progress);
+
+  if (!in_progress && data->inhibit_cookie > 0)
+    {
+      gtk_application_uninhibit (GTK_APPLICATION (gdu_window_get_application (data->window)),
+                                 data->inhibit_cookie);
+      data->inhibit_cookie = 0;
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* called on main / UI thread */
+static gboolean
+bmt_on_timeout (gpointer user_data)
+{
+  DialogData *data = user_data;
+  if (data->dialog != NULL)
+    update_dialog (data);
+  g_mutex_lock (&data->lock);
+  data->update_timeout_pending = FALSE;
+  g_mutex_unlock (&data->lock);
+  dialog_data_unref (data);
+  return FALSE; /* don't run again */
+}
+
+static void
+bmt_schedule_update (DialogData *data)
+{
+  /* rate-limit updates */
+  g_mutex_lock (&data->lock);
+  if (!data->update_timeout_pending)
+    {
+      g_timeout_add (200, /* ms */
+                     bmt_on_timeout,
+                     dialog_data_ref (data));
+      data->update_timeout_pending = TRUE;
+    }
+  g_mutex_unlock (&data->lock);
+}
+
+static void
+bmt_on_sample (GduBenchmarkSampleType    type,
+               const GduBenchmarkSample *sample,
+               gpointer                  user_data)
+{
+  DriveData *drive_data = user_data;
+  DialogData *data = drive_data->data;
+
+  g_mutex_lock (&data->lock);
+  switch (type)
+    {
+    case GDU_BENCHMARK_SAMPLE_TYPE_READ:
+      drive_data->num_read_samples++;
+      drive_data->read_rate_sum += sample->value;
+      break;
+
+    case GDU_BENCHMARK_SAMPLE_TYPE_WRITE:
+      drive_data->num_write_samples++;
+      drive_data->write_rate_sum += sample->value;
+      break;
+
+    case GDU_BENCHMARK_SAMPLE_TYPE_ACCESS_TIME:
+    default:
+      g_assert_not_reached ();
+    }
+  g_mutex_unlock (&data->lock);
+
+  bmt_schedule_update (data);
+}
+
+static gpointer
+benchmark_thread (gpointer user_data)
+{
+  DriveData *drive_data = user_data;
+  DialogData *data = drive_data->data;
+  UDisksBlock *block;
+  GError *error = NULL;
+  guint64 disk_size = 0;
+  gint fd;
+
+  block = udisks_object_peek_block (drive_data->block_object);
+  fd = gdu_benchmark_open_device (block, data->params.do_write, data->cancellable, &error);
+  if (fd != -1)
+    gdu_benchmark_get_device_size (fd, &disk_size, &error);
+
+  /* Wait until every device is open so all disks are loaded at the same time */
+  g_mutex_lock (&data->lock);
+  drive_data->opened = TRUE;
+  data->num_opened++;
+  g_cond_broadcast (&data->cond);
+  while (data->num_opened < data->num_started && !g_cancellable_is_cancelled (data->cancellable))
+    g_cond_wait (&data->cond, &data->lock);
+  g_mutex_unlock (&data->lock);
+
+  bmt_schedule_update (data);
+
+  if (error == NULL)
+    gdu_benchmark_run (fd, disk_size, &data->params, bmt_on_sample, drive_data, data->cancellable, &error);
+
+  if (fd != -1)
+    close (fd);
+
+  g_mutex_lock (&data->lock);
+  drive_data->in_progress = FALSE;
+  drive_data->error = error;
+  data->num_running--;
+  g_mutex_unlock (&data->lock);
+
+  bmt_schedule_update (data);
+
+  dialog_data_unref (data);
+  return NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static GList *
+get_selected_drives (DialogData *data)
+{
+  GList *ret = NULL;
+  guint n;
+
+  for (n = 0; n < data->drives->len; n++)
+    {
+      DriveData *drive_data = data->drives->pdata[n];
+      gboolean selected;
+
+      gtk_tree_model_get (GTK_TREE_MODEL (data->store), &drive_data->iter,
+                          COLUMN_SELECTED, &selected,
+                          -1);
+      if (selected)
+        ret = g_list_prepend (ret, drive_data);
+    }
+  return g_list_reverse (ret);
+}
+
+static void
+start_benchmark2 (DialogData *data)
+{
+  GList *selected;
+  GList *l;
+
+  selected = get_selected_drives (data);
+
+  data->inhibit_cookie = gtk_application_inhibit (GTK_APPLICATION (gdu_window_get_application (data->window)),
+                                                  GTK_WINDOW (data->dialog),
+                                                  GTK_APPLICATION_INHIBIT_SUSPEND |
+                                                  GTK_APPLICATION_INHIBIT_LOGOUT,
+                                                  /* Translators: Reason why suspend/logout is being inhibited */
+                                                  C_("create-inhibit-message", "Benchmarking device"));
+  g_cancellable_reset (data->cancellable);
+
+  g_mutex_lock (&data->lock);
+  data->num_started = g_list_length (selected);
+  data->num_opened = 0;
+  data->num_running = data->num_started;
+  for (l = selected; l != NULL; l = l->next)
+    {
+      DriveData *drive_data = l->data;
+      drive_data->in_progress = TRUE;
+      drive_data->opened = FALSE;
+      drive_data->num_read_samples = 0;
+      drive_data->read_rate_sum = 0.0;
+      drive_data->num_write_samples = 0;
+      drive_data->write_rate_sum = 0.0;
+      g_clear_error (&drive_data->error);
+    }
+  g_mutex_unlock (&data->lock);
+
+  /* one thread per device */
+  for (l = selected; l != NULL; l = l->next)
+    {
+      DriveData *drive_data = l->data;
+      dialog_data_ref (data);
+      g_thread_unref (g_thread_new ("benchmark-thread",
+                                    benchmark_thread,
+                                    drive_data));
+    }
+  g_list_free (selected);
+
+  update_dialog (data);
+}
+
+static void
+ensure_unused_cb (GduWindow     *window,
+                  GAsyncResult  *res,
+                  gpointer       user_data)
+{
+  DialogData *data = user_data;
+  if (gdu_window_ensure_unused_list_finish (window, res, NULL) && data->dialog != NULL)
+    {
+      start_benchmark2 (data);
+    }
+  dialog_data_unref (data);
+}
+
+static void
+start_benchmark (DialogData *data)
+{
+  GList *selected;
+  GList *objects = NULL;
+  GList *l;
+  GSettings *settings;
+
+  selected = get_selected_drives (data);
+  if (selected == NULL)
+    goto out;
+
+  data->params.num_samples = gtk_spin_button_get_value (GTK_SPIN_BUTTON (data->num_samples_spinbutton));
+  data->params.sample_size_mib = gtk_spin_button_get_value (GTK_SPIN_BUTTON (data->sample_size_spinbutton));
+  data->params.do_write = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (data->write_checkbutton));
+  data->params.num_access_samples = 0; /* only interested in the transfer rate */
+
+  settings = g_settings_new ("org.gnome.Disks.benchmark");
+  g_settings_set_int (settings, "num-samples", data->params.num_samples);
+  g_settings_set_int (settings, "sample-size-mib", data->params.sample_size_mib);
+  g_object_unref (settings);
+
+  if (data->params.do_write)
+    {
+      for (l = selected; l != NULL; l = l->next)
+        {
+          DriveData *drive_data = l->data;
+          objects = g_list_append (objects, drive_data->block_object);
+        }
+      /* ensure the devices are unused (e.g. unmounted) before writing to them... */
+      gdu_window_ensure_unused_list (data->window,
+                                     objects,
+                                     (GAsyncReadyCallback) ensure_unused_cb,
+                                     NULL, /* GCancellable */
+                                     dialog_data_ref (data));
+      g_list_free (objects);
+    }
+  else
+    {
+      start_benchmark2 (data);
+    }
+
+ out:
+  g_list_free (selected);
+}
+
+static void
+abort_benchmark (DialogData *data)
+{
+  g_cancellable_cancel (data->cancellable);
+  /* wake up threads waiting for the other devices to open */
+  g_mutex_lock (&data->lock);
+  g_cond_broadcast (&data->cond);
+  g_mutex_unlock (&data->lock);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+on_selected_toggled (GtkCellRendererToggle *renderer,
+                     gchar                 *path_string,
+                     gpointer               user_data)
+{
+  DialogData *data = user_data;
+  GtkTreeIter iter;
+  gboolean selected;
+
+  if (!gtk_tree_model_get_iter_from_string (GTK_TREE_MODEL (data->store), &iter, path_string))
+    return;
+
+  gtk_tree_model_get (GTK_TREE_MODEL (data->store), &iter,
+                      COLUMN_SELECTED, &selected,
+                      -1);
+  gtk_list_store_set (data->store, &iter,
+                      COLUMN_SELECTED, !selected,
+                      -1);
+}
+
+static gint
+drive_data_compare (gconstpointer a,
+                    gconstpointer b)
+{
+  DriveData *da = *((DriveData **) a);
+  DriveData *db = *((DriveData **) b);
+  return g_strcmp0 (udisks_block_get_preferred_device (udisks_object_peek_block (da->block_object)),
+                    udisks_block_get_preferred_device (udisks_object_peek_block (db->block_object)));
+}
+
+static void
+populate (DialogData *data)
+{
+  UDisksClient *client;
+  GList *objects;
+  GList *l;
+  guint n;
+
+  client = gdu_window_get_client (data->window);
+  objects = g_dbus_object_manager_get_objects (udisks_client_get_object_manager (client));
+  for (l = objects; l != NULL; l = l->next)
+    {
+      UDisksObject *object = UDISKS_OBJECT (l->data);
+      UDisksDrive *drive;
+      UDisksBlock *block;
+      DriveData *drive_data;
+
+      drive = udisks_object_peek_drive (object);
+      if (drive == NULL)
+        continue;
+
+      block = udisks_client_get_block_for_drive (client, drive, FALSE /* get_physical */);
+      if (block == NULL)
+        continue;
+
+      if (udisks_block_get_size (block) == 0)
+        {
+          g_object_unref (block);
+          continue;
+        }
+
+      drive_data = g_new0 (DriveData, 1);
+      drive_data->data = data;
+      drive_data->object = g_object_ref (object);
+      drive_data->block_object = UDISKS_OBJECT (g_dbus_interface_dup_object (G_DBUS_INTERFACE (block)));
+      g_ptr_array_add (data->drives, drive_data);
+      g_object_unref (block);
+    }
+  g_list_free_full (objects, g_object_unref);
+
+  g_ptr_array_sort (data->drives, drive_data_compare);
+
+  for (n = 0; n < data->drives->len; n++)
+    {
+      DriveData *drive_data = data->drives->pdata[n];
+      UDisksObjectInfo *info;
+      gchar *s;
+
+      info = udisks_client_get_object_info (client, drive_data->object);
+      s = g_strdup_printf ("%s\n<small>%s</small>",
+                           udisks_object_info_get_description (info),
+                           udisks_block_get_preferred_device (udisks_object_peek_block (drive_data->block_object)));
+      gtk_list_store_insert_with_values (data->store, &drive_data->iter, -1,
+                                         COLUMN_SELECTED, FALSE,
+                                         COLUMN_SENSITIVE, TRUE,
+                                         COLUMN_NAME, s,
+                                         COLUMN_READ_RATE, "–",
+                                         COLUMN_WRITE_RATE, "–",
+                                         COLUMN_PROGRESS, 0,
+                                         COLUMN_PROGRESS_TEXT, NULL,
+                                         COLUMN_DRIVE_DATA, drive_data,
+                                         -1);
+      g_free (s);
+      g_object_unref (info);
+    }
+}
+
+static void
+init_treeview (DialogData *data)
+{
+  GtkTreeViewColumn *column;
+  GtkCellRenderer *renderer;
+
+  data->store = gtk_list_store_new (N_COLUMNS,
+                                    G_TYPE_BOOLEAN,  /* COLUMN_SELECTED */
+                                    G_TYPE_BOOLEAN,  /* COLUMN_SENSITIVE */
+                                    G_TYPE_STRING,   /* COLUMN_NAME */
+                                    G_TYPE_STRING,   /* COLUMN_READ_RATE */
+                                    G_TYPE_STRING,   /* COLUMN_WRITE_RATE */
+                                    G_TYPE_INT,      /* COLUMN_PROGRESS */
+                                    G_TYPE_STRING,   /* COLUMN_PROGRESS_TEXT */
+                                    G_TYPE_POINTER); /* COLUMN_DRIVE_DATA */
+  gtk_tree_view_set_model (GTK_TREE_VIEW (data->disks_treeview), GTK_TREE_MODEL (data->store));
+
+  column = gtk_tree_view_column_new ();
+  /* Translators: Column header for the disk name in the "Benchmark Multiple Disks" dialog */
+  gtk_tree_view_column_set_title (column, C_("multi-benchmark", "Disk"));
+  gtk_tree_view_column_set_expand (column, TRUE);
+  gtk_tree_view_append_column (GTK_TREE_VIEW (data->disks_treeview), column);
+
+  renderer = gtk_cell_renderer_toggle_new ();
+  gtk_tree_view_column_pack_start (column, renderer, FALSE);
+  gtk_tree_view_column_set_attributes (column, renderer,
+                                       "active", COLUMN_SELECTED,
+                                       "activatable", COLUMN_SENSITIVE,
+                                       NULL);
+  g_signal_connect (renderer, "toggled", G_CALLBACK (on_selected_toggled), data);
+
+  renderer = gtk_cell_renderer_text_new ();
+  g_object_set (G_OBJECT (renderer),
+                "ellipsize", PANGO_ELLIPSIZE_MIDDLE,
+                NULL);
+  gtk_tree_view_column_pack_start (column, renderer, TRUE);
+  gtk_tree_view_column_set_attributes (column, renderer,
+                                       "markup", COLUMN_NAME,
+                                       NULL);
+
+  renderer = gtk_cell_renderer_progress_new ();
+  /* Translators: Column header for the progress in the "Benchmark Multiple Disks" dialog */
+  column = gtk_tree_view_column_new_with_attributes (C_("multi-benchmark", "Progress"), renderer,
+                                                     "value", COLUMN_PROGRESS,
+                                                     "text", COLUMN_PROGRESS_TEXT,
+                                                     NULL);
+  gtk_tree_view_column_set_min_width (column, 120);
+  gtk_tree_view_append_column (GTK_TREE_VIEW (data->disks_treeview), column);
+
+  renderer = gtk_cell_renderer_text_new ();
+  /* Translators: Column header for the average read rate in the "Benchmark Multiple Disks" dialog */
+  column = gtk_tree_view_column_new_with_attributes (C_("multi-benchmark", "Read Rate"), renderer,
+                                                     "text", COLUMN_READ_RATE,
+                                                     NULL);
+  gtk_tree_view_append_column (GTK_TREE_VIEW (data->disks_treeview), column);
+
+  renderer = gtk_cell_renderer_text_new ();
+  /* Translators: Column header for the average write rate in the "Benchmark Multiple Disks" dialog */
+  column = gtk_tree_view_column_new_with_attributes (C_("multi-benchmark", "Write Rate"), renderer,
+                                                     "text", COLUMN_WRITE_RATE,
+                                                     NULL);
+  gtk_tree_view_append_column (GTK_TREE_VIEW (data->disks_treeview), column);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+void
+gdu_multi_benchmark_dialog_show (GduWindow *window)
+{
+  DialogData *data;
+  GSettings *settings;
+  guint n;
+
+  data = g_new0 (DialogData, 1);
+  data->ref_count = 1;
+  data->window = g_object_ref (window);
+  data->cancellable = g_cancellable_new ();
+  data->drives = g_ptr_array_new_with_free_func ((GDestroyNotify) drive_data_free);
+  g_mutex_init (&data->lock);
+  g_cond_init (&data->cond);
+
+  data->dialog = GTK_WIDGET (gdu_application_new_widget (gdu_window_get_application (window),
+                                                         "benchmark-multiple-disks-dialog.ui",
+                                                         "benchmark-multiple-disks-dialog",
+                                                         &data->builder));
+  for (n = 0; widget_mapping[n].name != NULL; n++)
+    {
+      gpointer *p = (gpointer *) ((char *) data + widget_mapping[n].offset);
+      *p = GTK_WIDGET (gtk_builder_get_object (data->builder, widget_mapping[n].name));
+    }
+  gtk_window_set_transient_for (GTK_WINDOW (data->dialog), GTK_WINDOW (window));
+
+  settings = g_settings_new ("org.gnome.Disks.benchmark");
+  gtk_spin_button_set_value (GTK_SPIN_BUTTON (data->num_samples_spinbutton),
+                             g_settings_get_int (settings, "num-samples"));
+  gtk_spin_button_set_value (GTK_SPIN_BUTTON (data->sample_size_spinbutton),
+                             g_settings_get_int (settings, "sample-size-mib"));
+  g_object_unref (settings);
+
+  init_treeview (data);
+  populate (data);
+  update_dialog (data);
+
+  while (TRUE)
+    {
+      gint response;
+      response = gtk_dialog_run (GTK_DIALOG (data->dialog));
+
+      if (response < 0)
+        break;
+
+      /* Keep in sync with .ui file */
+      switch (response)
+        {
+        case 0: /* start benchmark */
+          start_benchmark (data);
+          break;
+
+        case 1: /* abort benchmark */
+          abort_benchmark (data);
+          break;
+
+        default:
+          g_assert_not_reached ();
+        }
+    }
+
+  abort_benchmark (data);
+  if (data->inhibit_cookie > 0)
+    {
+      gtk_application_uninhibit (GTK_APPLICATION (gdu_window_get_application (data->window)),
+                                 data->inhibit_cookie);
+      data->inhibit_cookie = 0;
+    }
+  gtk_widget_hide (data->dialog);
+  gtk_widget_destroy (data->dialog);
+  data->dialog = NULL;
+  dialog_data_unref (data);
+}
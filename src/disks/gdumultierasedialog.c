@@ -0,0 +1,727 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <glib/gi18n.h>
+#include <unistd.h>
+
+#include "gduapplication.h"
+#include "gduwindow.h"
+#include "gdumultierasedialog.h"
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+enum
+{
+  COLUMN_SELECTED,
+  COLUMN_SENSITIVE,
+  COLUMN_NAME,
+  COLUMN_PROGRESS,
+  COLUMN_PROGRESS_TEXT,
+  COLUMN_DRIVE_DATA,
+  N_COLUMNS
+};
+
+typedef struct DialogData DialogData;
+
+typedef struct
+{
+  DialogData *data; /* not referenced */
+  UDisksObject *object;
+  UDisksObject *block_object;
+  GtkTreeIter iter;
+
+  /* must hold data->lock when reading/writing these */
+  gboolean in_progress;
+  gboolean opened;
+  gboolean verifying; /* stays set once verification finished */
+  gboolean done;
+  guint64 disk_size;
+  guint64 bytes_erased;
+  GduEraseMethod method;
+  GError *error; /* set by erase thread on termination */
+} DriveData;
+
+struct DialogData
+{
+  volatile gint ref_count;
+
+  GduWindow *window;
+  GtkBuilder *builder;
+
+  GtkWidget *dialog;
+  GtkWidget *disks_treeview;
+  GtkWidget *erase_combobox;
+  GtkWidget *verify_checkbutton;
+  GtkWidget *progress_label;
+  GtkWidget *rate_label;
+
+  GtkWidget *start_erase_button;
+  GtkWidget *stop_erase_button;
+
+  GtkListStore *store;
+  GPtrArray *drives;
+
+  GCancellable *cancellable;
+  gboolean allow_discard;
+  gboolean verify;
+  gint64 start_time_usec;
+  guint inhibit_cookie;
+
+  /* must hold lock when reading/writing these */
+  GMutex lock;
+  guint num_running;
+  gboolean update_timeout_pending;
+};
+
+static const struct {
+  goffset offset;
+  const gchar *name;
+} widget_mapping[] = {
+  {G_STRUCT_OFFSET (DialogData, disks_treeview), "disks-treeview"},
+  {G_STRUCT_OFFSET (DialogData, erase_combobox), "erase-combobox"},
+  {G_STRUCT_OFFSET (DialogData, verify_checkbutton), "verify-checkbutton"},
+  {G_STRUCT_OFFSET (DialogData, progress_label), "progress-label"},
+  {G_STRUCT_OFFSET (DialogData, rate_label), "rate-label"},
+  {G_STRUCT_OFFSET (DialogData, start_erase_button), "start-erase-button"},
+  {G_STRUCT_OFFSET (DialogData, stop_erase_button), "stop-erase-button"},
+  {0, NULL}
+};
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+drive_data_free (DriveData *drive_data)
+{
+  g_clear_object (&drive_data->object);
+  g_clear_object (&drive_data->block_object);
+  g_clear_error (&drive_data->error);
+  g_free (drive_data);
+}
+
+static DialogData *
+dialog_data_ref (DialogData *data)
+{
+  g_atomic_int_inc (&data->ref_count);
+  return data;
+}
+
+static void
+dialog_data_unref (DialogData *data)
+{
+  if (g_atomic_int_dec_and_test (&data->ref_count))
+    {
+      if (data->dialog != NULL)
+        {
+          gtk_widget_hide (data->dialog);
+          gtk_widget_destroy (data->dialog);
+          data->dialog = NULL;
+        }
+
+      g_clear_object (&data->window);
+      g_clear_object (&data->builder);
+      g_clear_object (&data->store);
+      g_clear_object (&data->cancellable);
+      g_ptr_array_unref (data->drives);
+      g_mutex_clear (&data->lock);
+
+      g_free (data);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static const gchar *
+get_method_description (GduEraseMethod method)
+{
+  switch (method)
+    {
+    case GDU_ERASE_METHOD_SECURE_DISCARD:
+      return C_("multi-erase-method", "Securely Discarding");
+    case GDU_ERASE_METHOD_DISCARD:
+      return C_("multi-erase-method", "Discarding");
+    case GDU_ERASE_METHOD_ZERO_OUT:
+      return C_("multi-erase-method", "Zeroing");
+    case GDU_ERASE_METHOD_WRITE:
+      return C_("multi-erase-method", "Writing Zeroes");
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static void
+update_dialog (DialogData *data)
+{
+  guint64 total_size = 0;
+  guint64 total_erased = 0;
+  gboolean in_progress;
+  gchar *s;
+  guint n;
+
+  g_mutex_lock (&data->lock);
+  in_progress = (data->num_running > 0);
+  for (n = 0; n < data->drives->len; n++)
+    {
+      DriveData *drive_data = data->drives->pdata[n];
+      gchar *progress_str = NULL;
+      gint progress = 0;
+
+      if (drive_data->disk_size > 0)
+        {
+          progress = drive_data->bytes_erased * 100 / drive_data->disk_size;
+          total_size += drive_data->disk_size;
+          total_erased += drive_data->bytes_erased;
+        }
+
+      if (drive_data->error != NULL)
+        {
+          if (drive_data->error->domain == G_IO_ERROR && drive_data->error->code == G_IO_ERROR_CANCELLED)
+            progress_str = g_strdup (C_("multi-erase-status", "Aborted"));
+          else
+            progress_str = g_strdup (drive_data->error->message);
+        }
+      else if (drive_data->in_progress && !drive_data->opened)
+        {
+          progress_str = g_strdup (C_("multi-erase-status", "Opening Device…"));
+        }
+      else if (drive_data->in_progress && drive_data->verifying)
+        {
+          progress_str = g_strdup (C_("multi-erase-status", "Verifying…"));
+        }
+      else if (drive_data->in_progress)
+        {
+          /* Translators: Status of a disk being erased. The first %d is the percentage
+           * and the %s is how the disk is being erased, e.g. "Discarding".
+           */
+          progress_str = g_strdup_printf (C_("multi-erase-status", "%d%% (%s)"),
+                                          progress, get_method_description (drive_data->method));
+        }
+      else if (drive_data->done)
+        {
+          if (drive_data->verifying)
+            progress_str = g_strdup (C_("multi-erase-status", "Erased and Verified"));
+          else
+            progress_str = g_strdup (C_("multi-erase-status", "Erased"));
+        }
+
+      gtk_list_store_set (data->store, &drive_data->iter,
+                          COLUMN_SENSITIVE, !in_progress,
+                          COLUMN_PROGRESS, progress,
+                          COLUMN_PROGRESS_TEXT, progress_str,
+                          -1);
+      g_free (progress_str);
+    }
+  g_mutex_unlock (&data->lock);
+
+  if (total_size == 0)
+    {
+      s = g_strdup ("–");
+    }
+  else
+    {
+      gchar *erased_str = g_format_size (total_erased);
+      gchar *size_str = g_format_size (total_size);
+      /* Translators: Used for the combined progress when erasing multiple disks.
+       * The first two %s are sizes, e.g. "1.2 TB" and the %d is the percentage.
+       */
+      s = g_strdup_printf (C_("multi-erase-progress", "%s of %s (%d%%)"),
+                           erased_str, size_str, (gint) (total_erased * 100 / total_size));
+      g_free (size_str);
+      g_free (erased_str);
+    }
+  gtk_label_set_text (GTK_LABEL (data->progress_label), s);
+  g_free (s);
+
+  if (in_progress && total_erased > 0 && g_get_monotonic_time () > data->start_time_usec)
+    {
+      gdouble secs = (g_get_monotonic_time () - data->start_time_usec) / ((gdouble) G_USEC_PER_SEC);
+      gchar *rate_str = g_format_size ((guint64) (total_erased / secs));
+      /* Translators: %s is the formatted size, e.g. "42 MB" and the trailing "/s" means per second */
+      s = g_strdup_printf (C_("multi-erase-rate", "%s/s"), rate_str);
+      g_free (rate_str);
+    }
+  else
+    {
+      s = g_strdup ("–");
+    }
+  gtk_label_set_text (GTK_LABEL (data->rate_label), s);
+  g_free (s);
+
+  gtk_widget_set_visible (data->start_erase_button, !in_progress);
+  gtk_widget_set_visible (data->stop_erase_button, in_progress);
+  gtk_widget_set_sensitive (data->erase_combobox, !in_progress);
+  gtk_widget_set_sensitive (data->verify_checkbutton, !in_progress);
+
+  if (!in_progress && data->inhibit_cookie > 0)
+    {
+      gtk_application_uninhibit (GTK_APPLICATION (gdu_window_get_application (data->window)),
+                                 data->inhibit_cookie);
+      data->inhibit_cookie = 0;
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* called on main / UI thread */
+static gboolean
+erase_on_timeout (gpointer user_data)
+{
+  DialogData *data = user_data;
+  if (data->dialog != NULL)
+    update_dialog (data);
+  g_mutex_lock (&data->lock);
+  data->update_timeout_pending = FALSE;
+  g_mutex_unlock (&data->lock);
+  dialog_data_unref (data);
+  return FALSE; /* don't run again */
+}
+
+static void
+erase_schedule_update (DialogData *data)
+{
+  /* rate-limit updates */
+  g_mutex_lock (&data->lock);
+  if (!data->update_timeout_pending)
+    {
+      g_timeout_add (200, /* ms */
+                     erase_on_timeout,
+                     dialog_data_ref (data));
+      data->update_timeout_pending = TRUE;
+    }
+  g_mutex_unlock (&data->lock);
+}
+
+static void
+erase_on_progress (guint64         bytes_erased,
+                   GduEraseMethod  method,
+                   gpointer        user_data)
+{
+  DriveData *drive_data = user_data;
+  DialogData *data = drive_data->data;
+
+  g_mutex_lock (&data->lock);
+  drive_data->bytes_erased = bytes_erased;
+  drive_data->method = method;
+  g_mutex_unlock (&data->lock);
+
+  erase_schedule_update (data);
+}
+
+static gpointer
+erase_thread (gpointer user_data)
+{
+  DriveData *drive_data = user_data;
+  DialogData *data = drive_data->data;
+  UDisksBlock *block;
+  GError *error = NULL;
+  GError *error2 = NULL;
+  guint64 disk_size = 0;
+  gint fd;
+
+  block = udisks_object_peek_block (drive_data->block_object);
+  fd = gdu_erase_open_device (block, data->cancellable, &error);
+  if (fd != -1)
+    gdu_benchmark_get_device_size (fd, &disk_size, &error);
+
+  g_mutex_lock (&data->lock);
+  drive_data->opened = TRUE;
+  drive_data->disk_size = disk_size;
+  g_mutex_unlock (&data->lock);
+
+  erase_schedule_update (data);
+
+  if (error == NULL)
+    gdu_erase_run (fd, disk_size, data->allow_discard, erase_on_progress, drive_data, data->cancellable, &error);
+
+  if (error == NULL && data->verify)
+    {
+      g_mutex_lock (&data->lock);
+      drive_data->verifying = TRUE;
+      g_mutex_unlock (&data->lock);
+      erase_schedule_update (data);
+
+      gdu_erase_verify (fd, disk_size, data->cancellable, &error);
+    }
+
+  if (fd != -1)
+    close (fd);
+
+  /* finally, request that the core OS / kernel rescans the device */
+  if (!udisks_block_call_rescan_sync (block,
+                                      g_variant_new ("a{sv}", NULL), /* options */
+                                      NULL, /* cancellable */
+                                      &error2))
+    {
+      g_warning ("Error rescanning device: %s (%s, %d)",
+                 error2->message, g_quark_to_string (error2->domain), error2->code);
+      g_clear_error (&error2);
+    }
+
+  g_mutex_lock (&data->lock);
+  drive_data->in_progress = FALSE;
+  drive_data->done = (error == NULL);
+  drive_data->error = error;
+  data->num_running--;
+  g_mutex_unlock (&data->lock);
+
+  erase_schedule_update (data);
+
+  dialog_data_unref (data);
+  return NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static GList *
+get_selected_drives (DialogData *data)
+{
+  GList *ret = NULL;
+  guint n;
+
+  for (n = 0; n < data->drives->len; n++)
+    {
+      DriveData *drive_data = data->drives->pdata[n];
+      gboolean selected;
+
+      gtk_tree_model_get (GTK_TREE_MODEL (data->store), &drive_data->iter,
+                          COLUMN_SELECTED, &selected,
+                          -1);
+      if (selected)
+        ret = g_list_prepend (ret, drive_data);
+    }
+  return g_list_reverse (ret);
+}
+
+static void
+start_erase2 (DialogData *data)
+{
+  GList *selected;
+  GList *l;
+
+  selected = get_selected_drives (data);
+
+  data->inhibit_cookie = gtk_application_inhibit (GTK_APPLICATION (gdu_window_get_application (data->window)),
+                                                  GTK_WINDOW (data->dialog),
+                                                  GTK_APPLICATION_INHIBIT_SUSPEND |
+                                                  GTK_APPLICATION_INHIBIT_LOGOUT,
+                                                  /* Translators: Reason why suspend/logout is being inhibited */
+                                                  C_("erase-inhibit-message", "Erasing devices"));
+  g_cancellable_reset (data->cancellable);
+  data->start_time_usec = g_get_monotonic_time ();
+
+  g_mutex_lock (&data->lock);
+  data->num_running = g_list_length (selected);
+  for (l = selected; l != NULL; l = l->next)
+    {
+      DriveData *drive_data = l->data;
+      drive_data->in_progress = TRUE;
+      drive_data->opened = FALSE;
+      drive_data->verifying = FALSE;
+      drive_data->done = FALSE;
+      drive_data->disk_size = 0;
+      drive_data->bytes_erased = 0;
+      drive_data->method = data->allow_discard ? GDU_ERASE_METHOD_SECURE_DISCARD : GDU_ERASE_METHOD_ZERO_OUT;
+      g_clear_error (&drive_data->error);
+    }
+  g_mutex_unlock (&data->lock);
+
+  /* one thread per device so all of them are erased at the same time */
+  for (l = selected; l != NULL; l = l->next)
+    {
+      DriveData *drive_data = l->data;
+      dialog_data_ref (data);
+      g_thread_unref (g_thread_new ("erase-thread",
+                                    erase_thread,
+                                    drive_data));
+    }
+  g_list_free (selected);
+
+  update_dialog (data);
+}
+
+static void
+ensure_unused_cb (GduWindow     *window,
+                  GAsyncResult  *res,
+                  gpointer       user_data)
+{
+  DialogData *data = user_data;
+  if (gdu_window_ensure_unused_list_finish (window, res, NULL) && data->dialog != NULL)
+    {
+      start_erase2 (data);
+    }
+  dialog_data_unref (data);
+}
+
+static void
+start_erase (DialogData *data)
+{
+  GList *selected;
+  GList *objects = NULL;
+  GList *l;
+
+  selected = get_selected_drives (data);
+  if (selected == NULL)
+    goto out;
+
+  data->allow_discard = (g_strcmp0 (gtk_combo_box_get_active_id (GTK_COMBO_BOX (data->erase_combobox)), "discard") == 0);
+  data->verify = gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (data->verify_checkbutton));
+
+  for (l = selected; l != NULL; l = l->next)
+    {
+      DriveData *drive_data = l->data;
+      objects = g_list_append (objects, drive_data->block_object);
+    }
+
+  if (!gdu_utils_show_confirmation (GTK_WINDOW (data->dialog),
+                                    C_("multi-erase", "Are you sure you want to erase the selected disks?"),
+                                    C_("multi-erase", "All data on the selected disks will be lost but may still be recoverable by data recovery services unless the disk discards or zeroes it securely."),
+                                    C_("multi-erase", "_Erase"),
+                                    NULL, NULL,
+                                    gdu_window_get_client (data->window), objects, TRUE))
+    goto out;
+
+  /* ensure the devices are unused (e.g. unmounted) before erasing them... */
+  gdu_window_ensure_unused_list (data->window,
+                                 objects,
+                                 (GAsyncReadyCallback) ensure_unused_cb,
+                                 NULL, /* GCancellable */
+                                 dialog_data_ref (data));
+
+ out:
+  g_list_free (objects);
+  g_list_free (selected);
+}
+
+static void
+abort_erase (DialogData *data)
+{
+  g_cancellable_cancel (data->cancellable);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+on_selected_toggled (GtkCellRendererToggle *renderer,
+                     gchar                 *path_string,
+                     gpointer               user_data)
+{
+  DialogData *data = user_data;
+  GtkTreeIter iter;
+  gboolean selected;
+
+  if (!gtk_tree_model_get_iter_from_string (GTK_TREE_MODEL (data->store), &iter, path_string))
+    return;
+
+  gtk_tree_model_get (GTK_TREE_MODEL (data->store), &iter,
+                      COLUMN_SELECTED, &selected,
+                      -1);
+  gtk_list_store_set (data->store, &iter,
+                      COLUMN_SELECTED, !selected,
+                      -1);
+}
+
+static gint
+drive_data_compare (gconstpointer a,
+                    gconstpointer b)
+{
+  DriveData *da = *((DriveData **) a);
+  DriveData *db = *((DriveData **) b);
+  return g_strcmp0 (udisks_block_get_preferred_device (udisks_object_peek_block (da->block_object)),
+                    udisks_block_get_preferred_device (udisks_object_peek_block (db->block_object)));
+}
+
+static void
+populate (DialogData *data)
+{
+  UDisksClient *client;
+  GList *objects;
+  GList *l;
+  guint n;
+
+  client = gdu_window_get_client (data->window);
+  objects = g_dbus_object_manager_get_objects (udisks_client_get_object_manager (client));
+  for (l = objects; l != NULL; l = l->next)
+    {
+      UDisksObject *object = UDISKS_OBJECT (l->data);
+      UDisksDrive *drive;
+      UDisksBlock *block;
+      DriveData *drive_data;
+
+      drive = udisks_object_peek_drive (object);
+      if (drive == NULL)
+        continue;
+
+      block = udisks_client_get_block_for_drive (client, drive, FALSE /* get_physical */);
+      if (block == NULL)
+        continue;
+
+      /* skip empty and read-only media such as optical discs */
+      if (udisks_block_get_size (block) == 0 || udisks_block_get_read_only (block))
+        {
+          g_object_unref (block);
+          continue;
+        }
+
+      drive_data = g_new0 (DriveData, 1);
+      drive_data->data = data;
+      drive_data->object = g_object_ref (object);
+      drive_data->block_object = UDISKS_OBJECT (g_dbus_interface_dup_object (G_DBUS_INTERFACE (block)));
+      g_ptr_array_add (data->drives, drive_data);
+      g_object_unref (block);
+    }
+  g_list_free_full (objects, g_object_unref);
+
+  g_ptr_array_sort (data->drives, drive_data_compare);
+
+  for (n = 0; n < data->drives->len; n++)
+    {
+      DriveData *drive_data = data->drives->pdata[n];
+      UDisksObjectInfo *info;
+      gchar *s;
+
+      info = udisks_client_get_object_info (client, drive_data->object);
+      s = g_strdup_printf ("%s\n<small>%s</small>",
+                           udisks_object_info_get_description (info),
+                           udisks_block_get_preferred_device (udisks_object_peek_block (drive_data->block_object)));
+      gtk_list_store_insert_with_values (data->store, &drive_data->iter, -1,
+                                         COLUMN_SELECTED, FALSE,
+                                         COLUMN_SENSITIVE, TRUE,
+                                         COLUMN_NAME, s,
+                                         COLUMN_PROGRESS, 0,
+                                         COLUMN_PROGRESS_TEXT, NULL,
+                                         COLUMN_DRIVE_DATA, drive_data,
+                                         -1);
+      g_free (s);
+      g_object_unref (info);
+    }
+}
+
+static void
+init_treeview (DialogData *data)
+{
+  GtkTreeViewColumn *column;
+  GtkCellRenderer *renderer;
+
+  data->store = gtk_list_store_new (N_COLUMNS,
+                                    G_TYPE_BOOLEAN,  /* COLUMN_SELECTED */
+                                    G_TYPE_BOOLEAN,  /* COLUMN_SENSITIVE */
+                                    G_TYPE_STRING,   /* COLUMN_NAME */
+                                    G_TYPE_INT,      /* COLUMN_PROGRESS */
+                                    G_TYPE_STRING,   /* COLUMN_PROGRESS_TEXT */
+                                    G_TYPE_POINTER); /* COLUMN_DRIVE_DATA */
+  gtk_tree_view_set_model (GTK_TREE_VIEW (data->disks_treeview), GTK_TREE_MODEL (data->store));
+
+  column = gtk_tree_view_column_new ();
+  /* Translators: Column header for the disk name in the "Erase Multiple Disks" dialog */
+  gtk_tree_view_column_set_title (column, C_("multi-erase", "Disk"));
+  gtk_tree_view_column_set_expand (column, TRUE);
+  gtk_tree_view_append_column (GTK_TREE_VIEW (data->disks_treeview), column);
+
+  renderer = gtk_cell_renderer_toggle_new ();
+  gtk_tree_view_column_pack_start (column, renderer, FALSE);
+  gtk_tree_view_column_set_attributes (column, renderer,
+                                       "active", COLUMN_SELECTED,
+                                       "activatable", COLUMN_SENSITIVE,
+                                       NULL);
+  g_signal_connect (renderer, "toggled", G_CALLBACK (on_selected_toggled), data);
+
+  renderer = gtk_cell_renderer_text_new ();
+  g_object_set (G_OBJECT (renderer),
+                "ellipsize", PANGO_ELLIPSIZE_MIDDLE,
+                NULL);
+  gtk_tree_view_column_pack_start (column, renderer, TRUE);
+  gtk_tree_view_column_set_attributes (column, renderer,
+                                       "markup", COLUMN_NAME,
+                                       NULL);
+
+  renderer = gtk_cell_renderer_progress_new ();
+  /* Translators: Column header for the progress in the "Erase Multiple Disks" dialog */
+  column = gtk_tree_view_column_new_with_attributes (C_("multi-erase", "Progress"), renderer,
+                                                     "value", COLUMN_PROGRESS,
+                                                     "text", COLUMN_PROGRESS_TEXT,
+                                                     NULL);
+  gtk_tree_view_column_set_min_width (column, 200);
+  gtk_tree_view_append_column (GTK_TREE_VIEW (data->disks_treeview), column);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+void
+gdu_multi_erase_dialog_show (GduWindow *window)
+{
+  DialogData *data;
+  guint n;
+
+  data = g_new0 (DialogData, 1);
+  data->ref_count = 1;
+  data->window = g_object_ref (window);
+  data->cancellable = g_cancellable_new ();
+  data->drives = g_ptr_array_new_with_free_func ((GDestroyNotify) drive_data_free);
+  g_mutex_init (&data->lock);
+
+  data->dialog = GTK_WIDGET (gdu_application_new_widget (gdu_window_get_application (window),
+                                                         "erase-multiple-disks-dialog.ui",
+                                                         "erase-multiple-disks-dialog",
+                                                         &data->builder));
+  for (n = 0; widget_mapping[n].name != NULL; n++)
+    {
+      gpointer *p = (gpointer *) ((char *) data + widget_mapping[n].offset);
+      *p = GTK_WIDGET (gtk_builder_get_object (data->builder, widget_mapping[n].name));
+    }
+  gtk_window_set_transient_for (GTK_WINDOW (data->dialog), GTK_WINDOW (window));
+
+  /* Translators: Erase type that lets the disk discard or zero its blocks if it can */
+  gtk_combo_box_text_append (GTK_COMBO_BOX_TEXT (data->erase_combobox), "discard",
+                             C_("multi-erase-type", "Quick (discard or zero blocks in the disk)"));
+  /* Translators: Erase type that never discards blocks, only zeroes them */
+  gtk_combo_box_text_append (GTK_COMBO_BOX_TEXT (data->erase_combobox), "zero",
+                             C_("multi-erase-type", "Overwrite existing data with zeroes"));
+  gtk_combo_box_set_active_id (GTK_COMBO_BOX (data->erase_combobox), "discard");
+
+  init_treeview (data);
+  populate (data);
+  update_dialog (data);
+
+  while (TRUE)
+    {
+      gint response;
+      response = gtk_dialog_run (GTK_DIALOG (data->dialog));
+
+      if (response < 0)
+        break;
+
+      /* Keep in sync with .ui file */
+      switch (response)
+        {
+        case 0: /* start erase */
+          start_erase (data);
+          break;
+
+        case 1: /* abort erase */
+          abort_erase (data);
+          break;
+
+        default:
+          g_assert_not_reached ();
+        }
+    }
+
+  abort_erase (data);
+  if (data->inhibit_cookie > 0)
+    {
+      gtk_application_uninhibit (GTK_APPLICATION (gdu_window_get_application (data->window)),
+                                 data->inhibit_cookie);
+      data->inhibit_cookie = 0;
+    }
+  gtk_widget_hide (data->dialog);
+  gtk_widget_destroy (data->dialog);
+  data->dialog = NULL;
+  dialog_data_unref (data);
+}
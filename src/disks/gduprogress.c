@@ -0,0 +1,114 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include "gduprogress.h"
+
+/* The fields are protected by a sequence counter: the writer makes it
+ * odd, updates the fields and makes it even again. A reader retries if
+ * the counter was odd or changed while it copied the fields. Only a
+ * single thread may call gdu_progress_publish().
+ *
+ * The fields themselves are accessed with relaxed atomics so the
+ * concurrent accesses aren't a data race; the ordering comes from the
+ * full barriers on the counter. GLib has no 64-bit atomics so the
+ * compiler builtins are used directly.
+ */
+#define FIELD_SET(field, value) __atomic_store_n (&(field), (value), __ATOMIC_RELAXED)
+#define FIELD_GET(field)        __atomic_load_n (&(field), __ATOMIC_RELAXED)
+
+/**
+ * gdu_progress_init:
+ * @progress: A #GduProgress.
+ *
+ * Initializes @progress. Must be called before the worker is started.
+ */
+void
+gdu_progress_init (GduProgress *progress)
+{
+  progress->seq = 0;
+  progress->state = 0;
+  progress->target_bytes = 0;
+  progress->completed_bytes = 0;
+  progress->error_bytes = 0;
+}
+
+/**
+ * gdu_progress_publish:
+ * @progress: A #GduProgress.
+ * @state: A caller-defined state.
+ * @target_bytes: The total number of bytes or 0 if not yet known.
+ * @completed_bytes: The number of bytes completed so far.
+ * @error_bytes: The number of bytes that couldn't be processed.
+ *
+ * Publishes the current progress. Never blocks.
+ */
+void
+gdu_progress_publish (GduProgress *progress,
+                      gint         state,
+                      guint64      target_bytes,
+                      guint64      completed_bytes,
+                      guint64      error_bytes)
+{
+  g_atomic_int_inc (&progress->seq);
+  FIELD_SET (progress->state, state);
+  FIELD_SET (progress->target_bytes, target_bytes);
+  FIELD_SET (progress->completed_bytes, completed_bytes);
+  FIELD_SET (progress->error_bytes, error_bytes);
+  g_atomic_int_inc (&progress->seq);
+}
+
+/**
+ * gdu_progress_read:
+ * @progress: A #GduProgress.
+ * @out_state: Return location for the state or %NULL.
+ * @out_target_bytes: Return location for the total number of bytes or %NULL.
+ * @out_completed_bytes: Return location for the number of completed bytes or %NULL.
+ * @out_error_bytes: Return location for the number of error bytes or %NULL.
+ *
+ * Gets a consistent snapshot of the progress last published.
+ *
+ * Returns: A sequence number that changes every time progress is published.
+ */
+guint
+gdu_progress_read (GduProgress *progress,
+                   gint        *out_state,
+                   guint64     *out_target_bytes,
+                   guint64     *out_completed_bytes,
+                   guint64     *out_error_bytes)
+{
+  gint seq;
+  gint state;
+  guint64 target_bytes;
+  guint64 completed_bytes;
+  guint64 error_bytes;
+
+  do
+    {
+      seq = g_atomic_int_get (&progress->seq);
+      state = FIELD_GET (progress->state);
+      target_bytes = FIELD_GET (progress->target_bytes);
+      completed_bytes = FIELD_GET (progress->completed_bytes);
+      error_bytes = FIELD_GET (progress->error_bytes);
+      /* adding 0 is a full barrier so the copies above can't move past it */
+    }
+  while ((seq & 1) != 0 || g_atomic_int_add (&progress->seq, 0) != seq);
+
+  if (out_state != NULL)
+    *out_state = state;
+  if (out_target_bytes != NULL)
+    *out_target_bytes = target_bytes;
+  if (out_completed_bytes != NULL)
+    *out_completed_bytes = completed_bytes;
+  if (out_error_bytes != NULL)
+    *out_error_bytes = error_bytes;
+
+  return seq;
+}
@@ -0,0 +1,47 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_PROGRESS_H__
+#define __GDU_PROGRESS_H__
+
+#include <gtk/gtk.h>
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+/* Progress published by a single worker thread and read by the UI
+ * thread without either of them ever blocking on a lock.
+ */
+struct GduProgress
+{
+  /*< private >*/
+  gint seq; /* odd while the worker is writing */
+  gint state;
+  guint64 target_bytes;
+  guint64 completed_bytes;
+  guint64 error_bytes;
+};
+
+void  gdu_progress_init    (GduProgress *progress);
+
+void  gdu_progress_publish (GduProgress *progress,
+                            gint         state,
+                            guint64      target_bytes,
+                            guint64      completed_bytes,
+                            guint64      error_bytes);
+
+guint gdu_progress_read    (GduProgress *progress,
+                            gint        *out_state,
+                            guint64     *out_target_bytes,
+                            guint64     *out_completed_bytes,
+                            guint64     *out_error_bytes);
+
+G_END_DECLS
+
+#endif /* __GDU_PROGRESS_H__ */
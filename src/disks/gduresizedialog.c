@@ -876,13 +876,27 @@ gdu_resize_dialog_show (GduWindow    *window,
       data->min_size = gdu_utils_calc_space_to_shrink_extended (data->client, data->table, data->partition);
     }
 
-  if (data->filesystem != NULL)
-    {
-      gboolean available;
-
-      available = gdu_utils_can_resize (data->client, udisks_block_get_id_type (data->block), FALSE,
-                                        &data->support, NULL);
-      g_assert (available);
+  /* the answer may have been dropped since the Resize item was shown,
+   * e.g. because the supported filesystems changed
+   */
+  if (data->filesystem != NULL &&
+      !gdu_utils_can_resize (data->client, udisks_block_get_id_type (data->block), FALSE,
+                             &data->support, NULL))
+    {
+      GError *error;
+
+      error = g_error_new (G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                           /* Translators: Shown if udisks hasn't said yet whether the filesystem can be resized.
+                            * The %s is the filesystem type (ex. "ext4").
+                            */
+                           _("Resizing %s filesystems is not available at the moment. Try again later."),
+                           udisks_block_get_id_type (data->block));
+      gdu_utils_show_error (GTK_WINDOW (data->window),
+                            _("Error resizing filesystem"),
+                            error);
+      g_error_free (error);
+      resize_dialog_data_unref (data);
+      return;
     }
 
   data->max_size = data->current_size;
@@ -24,12 +24,22 @@
 #include "gdurestorediskimagedialog.h"
 #include "gduvolumegrid.h"
 #include "gduestimator.h"
+#include "gduprogress.h"
 #include "gdulocaljob.h"
 #include "gdudevicetreemodel.h"
 #include "gduxzdecompressor.h"
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* how often the job is updated while copying */
+#define UPDATE_INTERVAL_MSEC 200
+
+typedef enum
+{
+  COPY_STATE_NONE,
+  COPY_STATE_COPYING
+} CopyState;
+
 typedef struct
 {
   volatile gint ref_count;
@@ -68,8 +78,6 @@ typedef struct
   GtkWidget *cancel_button;
 
   guint64 block_size;
-  gint64 start_time_usec;
-  gint64 end_time_usec;
 
   GCancellable *cancellable;
   GOutputStream *block_stream;
@@ -81,10 +89,13 @@ typedef struct
   guint64 buffer_bytes_written;
   guint64 buffer_bytes_to_write;
 
-  /* must hold copy_lock when reading/writing these */
-  GMutex copy_lock;
+  /* only written by the copy thread, see copy_thread_func() */
+  GduProgress progress;
+
+  /* only used on the main / UI thread */
   GduEstimator *estimator;
-  guint update_id;
+  guint update_timeout_id;
+
   GError *copy_error;
 
   guint inhibit_cookie;
@@ -190,28 +201,12 @@ dialog_data_unref (DialogData *data)
       g_clear_object (&data->cancellable);
       g_clear_object (&data->input_stream);
       g_clear_object (&data->block_stream);
-      g_mutex_clear (&data->copy_lock);
       g_free (data);
     }
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-static gboolean
-unref_in_idle (gpointer user_data)
-{
-  DialogData *data = user_data;
-  dialog_data_unref (data);
-  return FALSE; /* remove source */
-}
-
-static void
-dialog_data_unref_in_idle (DialogData *data)
-{
-  g_idle_add (unref_in_idle, data);
-}
-
-/* ---------------------------------------------------------------------------------------------------- */
 
 static void
 dialog_data_complete_and_unref (DialogData *data)
@@ -565,17 +560,17 @@ update_job (DialogData *data,
   guint64 bytes_per_sec = 0;
   guint64 usec_remaining = 0;
   gdouble progress = 0.0;
+  gint state = COPY_STATE_NONE;
 
-  g_mutex_lock (&data->copy_lock);
-  if (data->estimator != NULL)
+  gdu_progress_read (&data->progress, &state, &bytes_target, &bytes_completed, NULL);
+  if (state == COPY_STATE_COPYING)
     {
+      if (data->estimator == NULL)
+        data->estimator = gdu_estimator_new (bytes_target);
+      gdu_estimator_add_sample (data->estimator, bytes_completed);
       bytes_per_sec = gdu_estimator_get_bytes_per_sec (data->estimator);
       usec_remaining = gdu_estimator_get_usec_remaining (data->estimator);
-      bytes_completed = gdu_estimator_get_completed_bytes (data->estimator);
-      bytes_target = gdu_estimator_get_target_bytes (data->estimator);
     }
-  data->update_id = 0;
-  g_mutex_unlock (&data->copy_lock);
 
   if (data->local_job != NULL)
     {
@@ -626,11 +621,27 @@ play_complete_sound (DialogData *data)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Samples the progress published by the copy thread from a timer in the
+ * main thread so the copy thread never has to wake up the main thread.
+ * Unlike the frame clock it keeps running while the window is hidden.
+ */
 static gboolean
-on_update_job (gpointer user_data)
+on_update_timeout (gpointer user_data)
 {
   DialogData *data = user_data;
   update_job (data, FALSE);
+  return TRUE; /* keep timeout around */
+}
+
+static gboolean
+on_copy_thread_done (gpointer user_data)
+{
+  DialogData *data = user_data;
+  if (data->update_timeout_id != 0)
+    {
+      g_source_remove (data->update_timeout_id);
+      data->update_timeout_id = 0;
+    }
   dialog_data_unref (data);
   return FALSE; /* remove source */
 }
@@ -686,7 +697,6 @@ copy_thread_func (gpointer user_data)
   long page_size;
   GError *error = NULL;
   GError *error2 = NULL;
-  gint64 last_update_usec = -1;
   gint fd = -1;
   gint buffer_size;
   guint64 num_bytes_completed = 0;
@@ -744,12 +754,6 @@ copy_thread_func (gpointer user_data)
   buffer_unaligned = g_new0 (guchar, buffer_size + page_size);
   buffer = (guchar*) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
 
-  g_mutex_lock (&data->copy_lock);
-  data->estimator = gdu_estimator_new (data->input_size);
-  data->update_id = 0;
-  data->start_time_usec = g_get_real_time ();
-  g_mutex_unlock (&data->copy_lock);
-
   /* Read huge (e.g. 1 MiB) blocks and write it to the output
    * device even if it was only partially read.
    */
@@ -759,24 +763,14 @@ copy_thread_func (gpointer user_data)
       gsize num_bytes_to_read;
       gsize num_bytes_read;
       ssize_t num_bytes_written;
-      gint64 now_usec;
 
       num_bytes_to_read = buffer_size;
       if (num_bytes_to_read + num_bytes_completed > data->input_size)
         num_bytes_to_read = data->input_size - num_bytes_completed;
 
-      /* Update GUI - but only every 200 ms and only if last update isn't pending */
-      g_mutex_lock (&data->copy_lock);
-      now_usec = g_get_monotonic_time ();
-      if (now_usec - last_update_usec > 200 * G_USEC_PER_SEC / 1000 || last_update_usec < 0)
-        {
-          if (num_bytes_completed > 0)
-            gdu_estimator_add_sample (data->estimator, num_bytes_completed);
-          if (data->update_id == 0)
-            data->update_id = g_idle_add (on_update_job, dialog_data_ref (data));
-          last_update_usec = now_usec;
-        }
-      g_mutex_unlock (&data->copy_lock);
+      /* The GUI picks this up on its own, see on_update_timeout() */
+      gdu_progress_publish (&data->progress, COPY_STATE_COPYING,
+                            data->input_size, num_bytes_completed, 0);
 
       if (!g_input_stream_read_all (data->input_stream,
                                     buffer,
@@ -821,10 +815,10 @@ copy_thread_func (gpointer user_data)
 
       num_bytes_completed += num_bytes_written;
     }
+  gdu_progress_publish (&data->progress, COPY_STATE_COPYING,
+                        data->input_size, num_bytes_completed, 0);
 
  out:
-  data->end_time_usec = g_get_real_time ();
-
   /* in either case, close the stream */
   if (!g_input_stream_close (G_INPUT_STREAM (data->input_stream),
                               NULL, /* cancellable */
@@ -890,7 +884,7 @@ copy_thread_func (gpointer user_data)
       g_clear_error (&error2);
     }
 
-  dialog_data_unref_in_idle (data); /* unref on main thread */
+  g_idle_add (on_copy_thread_done, data); /* unref on main thread */
   return NULL;
 }
 
@@ -988,6 +982,13 @@ start_copying (DialogData *data)
   if (data->switch_to_object)
     gdu_window_select_object (data->window, data->object);
 
+  gdu_progress_init (&data->progress);
+  data->update_timeout_id = g_timeout_add_full (G_PRIORITY_DEFAULT,
+                                                 UPDATE_INTERVAL_MSEC,
+                                                 on_update_timeout,
+                                                 dialog_data_ref (data),
+                                                 (GDestroyNotify) dialog_data_unref);
+
   g_thread_new ("copy-disk-image-thread",
                 copy_thread_func,
                 dialog_data_ref (data));
@@ -1074,7 +1075,6 @@ gdu_restore_disk_image_dialog_show (GduWindow    *window,
 
   data = g_new0 (DialogData, 1);
   data->ref_count = 1;
-  g_mutex_init (&data->copy_lock);
   data->window = g_object_ref (window);
   set_destination_object (data, object);
   if (object == NULL)
@@ -0,0 +1,599 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <glib/gi18n.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gduapplication.h"
+#include "gduwindow.h"
+#include "gdutestdiskdialog.h"
+#include "gduestimator.h"
+#include "gdulocaljob.h"
+
+/* The test is a burn-in test similar to badblocks(8) in destructive
+ * mode: each pass writes a pattern to the whole disk and then reads it
+ * back and compares. This goes on until the user cancels the job.
+ *
+ * There is no dialog once the test has been started (only the job is
+ * shown), so several disks can be tested at the same time.
+ */
+
+/* Size of each read and write - big enough that the disk is the bottleneck */
+#define TEST_BUFFER_SIZE (16*1024*1024)
+
+/* Granularity used for counting errors */
+#define TEST_BLOCK_SIZE 4096
+
+#define PATTERN_RANDOM (-1)
+
+static const gint patterns[] = {0xaa, 0x55, 0xff, 0x00, PATTERN_RANDOM};
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  volatile gint ref_count;
+
+  GduWindow *window;
+  UDisksObject *object;
+  UDisksBlock *block;
+
+  GCancellable *cancellable;
+
+  /* must hold test_lock when reading/writing these */
+  GMutex test_lock;
+  GduEstimator *estimator;
+  guint pass;
+  gint pattern;
+  guint64 num_errors;
+  gint64 start_time_usec;
+
+  guint update_id;
+  GError *test_error;
+
+  gboolean completed;
+
+  guint inhibit_cookie;
+
+  GduLocalJob *local_job;
+} DialogData;
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static DialogData *
+dialog_data_ref (DialogData *data)
+{
+  g_atomic_int_inc (&data->ref_count);
+  return data;
+}
+
+static void
+dialog_data_terminate_job (DialogData *data)
+{
+  if (data->local_job != NULL)
+    {
+      gdu_application_destroy_local_job (gdu_window_get_application (data->window), data->local_job);
+      data->local_job = NULL;
+    }
+}
+
+static void
+dialog_data_uninhibit (DialogData *data)
+{
+  if (data->inhibit_cookie > 0)
+    {
+      gtk_application_uninhibit (GTK_APPLICATION (gdu_window_get_application (data->window)),
+                                 data->inhibit_cookie);
+      data->inhibit_cookie = 0;
+    }
+}
+
+static void
+dialog_data_unref (DialogData *data)
+{
+  if (g_atomic_int_dec_and_test (&data->ref_count))
+    {
+      dialog_data_terminate_job (data);
+      dialog_data_uninhibit (data);
+
+      g_clear_object (&data->cancellable);
+      g_object_unref (data->window);
+      g_object_unref (data->object);
+      g_object_unref (data->block);
+      g_clear_object (&data->estimator);
+      g_mutex_clear (&data->test_lock);
+      g_free (data);
+    }
+}
+
+static gboolean
+unref_in_idle (gpointer user_data)
+{
+  DialogData *data = user_data;
+  dialog_data_unref (data);
+  return FALSE; /* remove source */
+}
+
+static void
+dialog_data_unref_in_idle (DialogData *data)
+{
+  g_idle_add (unref_in_idle, data);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+dialog_data_complete_and_unref (DialogData *data)
+{
+  if (!data->completed)
+    {
+      data->completed = TRUE;
+      g_cancellable_cancel (data->cancellable);
+    }
+  dialog_data_uninhibit (data);
+  dialog_data_unref (data);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+update_job (DialogData *data)
+{
+  gchar *extra_markup = NULL;
+  guint64 bytes_completed = 0;
+  guint64 bytes_target = 0;
+  guint64 bytes_per_sec = 0;
+  guint64 usec_remaining = 0;
+  guint64 num_errors = 0;
+  gint64 start_time_usec = 0;
+  guint pass = 0;
+  gint pattern = 0;
+  gdouble progress = 0.0;
+  gchar *pattern_str;
+  gchar *errors_str;
+  gchar *elapsed_str;
+
+  g_mutex_lock (&data->test_lock);
+  if (data->estimator != NULL)
+    {
+      bytes_per_sec = gdu_estimator_get_bytes_per_sec (data->estimator);
+      usec_remaining = gdu_estimator_get_usec_remaining (data->estimator);
+      bytes_completed = gdu_estimator_get_completed_bytes (data->estimator);
+      bytes_target = gdu_estimator_get_target_bytes (data->estimator);
+    }
+  pass = data->pass;
+  pattern = data->pattern;
+  num_errors = data->num_errors;
+  start_time_usec = data->start_time_usec;
+  data->update_id = 0;
+  g_mutex_unlock (&data->test_lock);
+
+  if (data->local_job == NULL || pass == 0)
+    goto out;
+
+  if (pattern == PATTERN_RANDOM)
+    {
+      /* Translators: Used in the job's status line for the pattern being written to the disk */
+      pattern_str = g_strdup (C_("test-disk-pattern", "random data"));
+    }
+  else
+    {
+      /* Translators: Used in the job's status line for the pattern being written to the disk.
+       *              The %02x is the byte being written, e.g. "aa".
+       */
+      pattern_str = g_strdup_printf (C_("test-disk-pattern", "pattern 0x%02x"), pattern);
+    }
+
+  errors_str = g_strdup_printf (dngettext (GETTEXT_PACKAGE,
+                                           "%d error",
+                                           "%d errors",
+                                           (gint) num_errors),
+                                (gint) num_errors);
+  if (num_errors > 0)
+    {
+      /* TODO: once https://bugzilla.gnome.org/show_bug.cgi?id=657194 is resolved, use that instead
+       * of hard-coding the color
+       */
+      gchar *s = g_strdup_printf ("<span foreground=\"#ff0000\">%s</span>", errors_str);
+      g_free (errors_str);
+      errors_str = s;
+    }
+
+  elapsed_str = gdu_utils_format_duration_usec (g_get_real_time () - start_time_usec,
+                                                GDU_FORMAT_DURATION_FLAGS_NONE);
+
+  /* Translators: Shown below the job's progress bar.
+   *              The %u is the number of the pass, e.g. 33.
+   *              The first %s is the pattern, e.g. "pattern 0xaa" or "random data".
+   *              The second %s is the number of errors, e.g. "0 errors".
+   *              The third %s is the time since the test was started, e.g. "2 days and 5 hours".
+   */
+  extra_markup = g_strdup_printf (_("Pass %u: Testing with %s — %s — %s elapsed"),
+                                  pass, pattern_str, errors_str, elapsed_str);
+  g_free (elapsed_str);
+  g_free (errors_str);
+  g_free (pattern_str);
+
+  /* each pass writes and then reads back the whole disk, see test_thread_func() */
+  udisks_job_set_bytes (UDISKS_JOB (data->local_job), bytes_target);
+  udisks_job_set_rate (UDISKS_JOB (data->local_job), bytes_per_sec);
+
+  if (bytes_target != 0)
+    progress = ((gdouble) bytes_completed) / ((gdouble) bytes_target);
+  udisks_job_set_progress (UDISKS_JOB (data->local_job), progress);
+
+  if (usec_remaining == 0)
+    udisks_job_set_expected_end_time (UDISKS_JOB (data->local_job), 0);
+  else
+    udisks_job_set_expected_end_time (UDISKS_JOB (data->local_job), usec_remaining + g_get_real_time ());
+
+  gdu_local_job_set_extra_markup (data->local_job, extra_markup);
+
+ out:
+  g_free (extra_markup);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+on_update_job (gpointer user_data)
+{
+  DialogData *data = user_data;
+  update_job (data);
+  dialog_data_unref (data);
+  return FALSE; /* remove source */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+on_show_error (gpointer user_data)
+{
+  DialogData *data = user_data;
+
+  dialog_data_uninhibit (data);
+
+  g_assert (data->test_error != NULL);
+  gdu_utils_show_error (GTK_WINDOW (data->window),
+                        _("Error testing disk"),
+                        data->test_error);
+  g_clear_error (&data->test_error);
+
+  /* the job may already have been canceled, which completes and unrefs */
+  if (!data->completed)
+    {
+      dialog_data_terminate_job (data);
+      dialog_data_complete_and_unref (data);
+    }
+
+  dialog_data_unref (data);
+  return FALSE; /* remove source */
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Fills @buffer with the data expected at @offset on the disk.
+ *
+ * Random data is generated with a xorshift generator seeded from
+ * @seed and the block number so the verification can regenerate
+ * exactly what was written without keeping a copy of it.
+ */
+static void
+fill_pattern (guchar  *buffer,
+              gsize    size,
+              guint64  offset,
+              gint     pattern,
+              guint64  seed)
+{
+  gsize n;
+
+  if (pattern != PATTERN_RANDOM)
+    {
+      memset (buffer, pattern, size);
+      return;
+    }
+
+  for (n = 0; n < size; n += TEST_BLOCK_SIZE)
+    {
+      guint64 *p = (guint64 *) (buffer + n);
+      guint64 x;
+      gsize num_words;
+      gsize m;
+
+      x = seed ^ (((offset + n) / TEST_BLOCK_SIZE) * G_GUINT64_CONSTANT (0x9e3779b97f4a7c15));
+      x |= 1; /* xorshift gets stuck at zero */
+      num_words = MIN (TEST_BLOCK_SIZE, size - n) / sizeof (guint64);
+      for (m = 0; m < num_words; m++)
+        {
+          x ^= x << 13;
+          x ^= x >> 7;
+          x ^= x << 17;
+          p[m] = x;
+        }
+    }
+}
+
+/* Writes @expected to, or reads @size bytes into @buffer from, @offset and
+ * compares them to @expected. If this fails, the span is retried a block at
+ * a time to find out how many blocks are bad.
+ *
+ * Returns FALSE only if the test can't continue, e.g. if the device went
+ * away.
+ */
+static gboolean
+test_span (gint           fd,
+           gboolean       do_write,
+           guchar        *buffer,
+           const guchar  *expected,
+           guint64        offset,
+           gsize          size,
+           guint64       *out_num_bad_blocks,
+           GError       **error)
+{
+  gssize num_bytes;
+  gsize n;
+
+  *out_num_bad_blocks = 0;
+
+  if (do_write)
+    num_bytes = pwrite (fd, expected, size, offset);
+  else
+    num_bytes = pread (fd, buffer, size, offset);
+  if (num_bytes == (gssize) size && (do_write || memcmp (buffer, expected, size) == 0))
+    return TRUE;
+
+  for (n = 0; n < size; n += TEST_BLOCK_SIZE)
+    {
+      gsize block_size = MIN (TEST_BLOCK_SIZE, size - n);
+
+      if (do_write)
+        num_bytes = pwrite (fd, expected + n, block_size, offset + n);
+      else
+        num_bytes = pread (fd, buffer + n, block_size, offset + n);
+
+      if (num_bytes < 0 && errno != EIO)
+        {
+          g_set_error (error,
+                       G_IO_ERROR,
+                       g_io_error_from_errno (errno),
+                       do_write ?
+                       _("Error writing %" G_GSIZE_FORMAT " bytes to offset %" G_GUINT64_FORMAT ": %m") :
+                       _("Error reading %" G_GSIZE_FORMAT " bytes from offset %" G_GUINT64_FORMAT ": %m"),
+                       block_size,
+                       offset + n);
+          return FALSE;
+        }
+
+      if (num_bytes != (gssize) block_size ||
+          (!do_write && memcmp (buffer + n, expected + n, block_size) != 0))
+        *out_num_bad_blocks += 1;
+    }
+
+  return TRUE;
+}
+
+static gpointer
+test_thread_func (gpointer user_data)
+{
+  DialogData *data = user_data;
+  guchar *buffer_unaligned = NULL;
+  guchar *buffer;
+  guchar *expected;
+  guint64 disk_size;
+  glong page_size;
+  gint64 last_update_usec = -1;
+  GError *error = NULL;
+  guint pass;
+  gint fd = -1;
+
+  fd = gdu_benchmark_open_device (data->block, TRUE, data->cancellable, &error);
+  if (fd == -1)
+    goto out;
+
+  if (!gdu_benchmark_get_device_size (fd, &disk_size, &error))
+    goto out;
+
+  /* The device is opened with O_DIRECT so the buffers must be aligned */
+  page_size = sysconf (_SC_PAGESIZE);
+  if (page_size < 1)
+    page_size = 4096;
+  buffer_unaligned = g_new0 (guchar, 2 * TEST_BUFFER_SIZE + page_size);
+  buffer = (guchar*) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
+  expected = buffer + TEST_BUFFER_SIZE;
+
+  g_mutex_lock (&data->test_lock);
+  data->start_time_usec = g_get_real_time ();
+  g_mutex_unlock (&data->test_lock);
+
+  /* runs until cancelled */
+  for (pass = 1; ; pass++)
+    {
+      gint pattern;
+      guint64 seed;
+      guint phase;
+
+      pattern = patterns[(pass - 1) % G_N_ELEMENTS (patterns)];
+      seed = (((guint64) g_random_int ()) << 32) | g_random_int ();
+
+      g_mutex_lock (&data->test_lock);
+      data->pass = pass;
+      data->pattern = pattern;
+      g_clear_object (&data->estimator);
+      data->estimator = gdu_estimator_new (2 * disk_size);
+      g_mutex_unlock (&data->test_lock);
+
+      /* constant patterns only need to be generated once per pass */
+      if (pattern != PATTERN_RANDOM)
+        fill_pattern (expected, TEST_BUFFER_SIZE, 0, pattern, seed);
+
+      /* phase 0 writes the pattern, phase 1 reads it back and verifies it */
+      for (phase = 0; phase < 2; phase++)
+        {
+          guint64 offset;
+
+          for (offset = 0; offset < disk_size; offset += TEST_BUFFER_SIZE)
+            {
+              guint64 num_bad_blocks;
+              gsize size;
+              gint64 now_usec;
+
+              if (g_cancellable_set_error_if_cancelled (data->cancellable, &error))
+                goto out;
+
+              size = MIN (TEST_BUFFER_SIZE, disk_size - offset);
+              if (pattern == PATTERN_RANDOM)
+                fill_pattern (expected, size, offset, pattern, seed);
+
+              if (!test_span (fd, phase == 0, buffer, expected, offset, size, &num_bad_blocks, &error))
+                goto out;
+
+              /* Update GUI - but only every 200 ms and only if last update isn't pending */
+              g_mutex_lock (&data->test_lock);
+              data->num_errors += num_bad_blocks;
+              now_usec = g_get_monotonic_time ();
+              if (now_usec - last_update_usec > 200 * G_USEC_PER_SEC / 1000 || last_update_usec < 0 ||
+                  num_bad_blocks > 0)
+                {
+                  gdu_estimator_add_sample (data->estimator, phase * disk_size + offset + size);
+                  if (data->update_id == 0)
+                    data->update_id = g_idle_add (on_update_job, dialog_data_ref (data));
+                  last_update_usec = now_usec;
+                }
+              g_mutex_unlock (&data->test_lock);
+            }
+        }
+    }
+
+ out:
+  if (error != NULL)
+    {
+      /* show error in GUI */
+      if (!(error->domain == G_IO_ERROR && error->code == G_IO_ERROR_CANCELLED))
+        {
+          data->test_error = error; error = NULL;
+          g_idle_add (on_show_error, dialog_data_ref (data));
+        }
+      g_clear_error (&error);
+    }
+
+  if (fd != -1)
+    {
+      if (close (fd) != 0)
+        g_warning ("Error closing fd: %m");
+    }
+
+  g_free (buffer_unaligned);
+
+  dialog_data_unref_in_idle (data); /* unref on main thread */
+  return NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+on_local_job_canceled (GduLocalJob  *job,
+                       gpointer      user_data)
+{
+  DialogData *data = user_data;
+  if (!data->completed)
+    {
+      dialog_data_terminate_job (data);
+      dialog_data_complete_and_unref (data);
+    }
+}
+
+static void
+start_testing (DialogData *data)
+{
+  data->inhibit_cookie = gtk_application_inhibit (GTK_APPLICATION (gdu_window_get_application (data->window)),
+                                                  GTK_WINDOW (data->window),
+                                                  GTK_APPLICATION_INHIBIT_SUSPEND |
+                                                  GTK_APPLICATION_INHIBIT_LOGOUT,
+                                                  /* Translators: Reason why suspend/logout is being inhibited */
+                                                  C_("test-disk-inhibit-message", "Testing disk"));
+
+  data->local_job = gdu_application_create_local_job (gdu_window_get_application (data->window),
+                                                      data->object);
+  udisks_job_set_operation (UDISKS_JOB (data->local_job), "x-gdu-test-disk");
+  /* Translators: this is the description of the job */
+  gdu_local_job_set_description (data->local_job, _("Testing Disk"));
+  udisks_job_set_progress_valid (UDISKS_JOB (data->local_job), TRUE);
+  udisks_job_set_cancelable (UDISKS_JOB (data->local_job), TRUE);
+  g_signal_connect (data->local_job, "canceled",
+                    G_CALLBACK (on_local_job_canceled),
+                    data);
+
+  g_thread_unref (g_thread_new ("test-disk-thread",
+                                test_thread_func,
+                                dialog_data_ref (data)));
+}
+
+static void
+ensure_unused_cb (GduWindow     *window,
+                  GAsyncResult  *res,
+                  gpointer       user_data)
+{
+  DialogData *data = user_data;
+  if (gdu_window_ensure_unused_finish (window, res, NULL))
+    {
+      start_testing (data);
+    }
+  else
+    {
+      dialog_data_complete_and_unref (data);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+void
+gdu_test_disk_dialog_show (GduWindow    *window,
+                           UDisksObject *object)
+{
+  DialogData *data;
+  GList *objects = NULL;
+
+  data = g_new0 (DialogData, 1);
+  data->ref_count = 1;
+  data->window = g_object_ref (window);
+  data->object = g_object_ref (object);
+  data->block = udisks_object_get_block (object);
+  g_assert (data->block != NULL);
+  data->cancellable = g_cancellable_new ();
+  g_mutex_init (&data->test_lock);
+
+  objects = g_list_append (NULL, object);
+  if (!gdu_utils_show_confirmation (GTK_WINDOW (window),
+                                    _("Are you sure you want to test the disk?"),
+                                    _("The test writes patterns to the whole disk and reads them back, "
+                                      "pass after pass, until it is cancelled. "
+                                      "All data on the disk will be lost."),
+                                    _("_Test"),
+                                    NULL, NULL,
+                                    gdu_window_get_client (window), objects, TRUE))
+    {
+      dialog_data_complete_and_unref (data);
+      goto out;
+    }
+
+  /* ensure the disk is unused (e.g. unmounted) before testing it... */
+  gdu_window_ensure_unused (data->window,
+                            data->object,
+                            (GAsyncReadyCallback) ensure_unused_cb,
+                            NULL, /* GCancellable */
+                            data);
+
+ out:
+  g_list_free (objects);
+}
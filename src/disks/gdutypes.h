@@ -49,6 +49,9 @@ typedef struct GduLocalJob GduLocalJob;
 struct GduXzDecompressor;
 typedef struct GduXzDecompressor GduXzDecompressor;
 
+struct GduProgress;
+typedef struct GduProgress GduProgress;
+
 G_END_DECLS
 
 #endif /* __GDU_TYPES_H__ */
@@ -22,6 +22,9 @@
 
 #define ELEMENT_MINIMUM_WIDTH 60
 
+/* how far rendering an element may extend past its right and bottom edge */
+#define ELEMENT_RENDER_PADDING 4
+
 typedef enum
 {
   GRID_EDGE_NONE    = 0,
@@ -58,6 +61,17 @@ struct GridElement
   GridEdgeFlags edge_flags;
 
   gchar *text;
+  /* cached layout for text, created in render_element() */
+  PangoLayout *layout;
+
+  /* cached rendering of the element, see render_slice() */
+  cairo_surface_t *surface;
+  guint surface_width;
+  guint surface_height;
+  gint surface_scale;
+  GridEdgeFlags surface_edge_flags;
+  GtkStateFlags surface_state;
+  gboolean surface_focused;
 
   gboolean show_spinner;
   gboolean show_padlock_open;
@@ -81,6 +95,10 @@ grid_element_free (GridElement *element)
   if (element->object != NULL)
     g_object_unref (element->object);
   g_free (element->text);
+  if (element->layout != NULL)
+    g_object_unref (element->layout);
+  if (element->surface != NULL)
+    cairo_surface_destroy (element->surface);
   g_list_foreach (element->embedded_elements, (GFunc) grid_element_free, NULL);
   g_list_free (element->embedded_elements);
 
@@ -99,12 +117,19 @@ struct _GduVolumeGrid
   UDisksObject *block_object;
 
   GList *elements;
+  /* all elements in depth-first order, sorted by both offset and x */
+  GPtrArray *flat_elements;
 
   GridElement *selected;
   GridElement *focused;
 
   gboolean animating_spinner;
 
+  /* the allocation the geometry of elements was last computed for */
+  gboolean geometry_valid;
+  gint geometry_width;
+  gint geometry_height;
+
   gchar *no_media_string;
 };
 
@@ -144,6 +169,9 @@ static void recompute_size (GduVolumeGrid *grid,
                             guint          width,
                             guint          height);
 
+static void queue_draw_element (GduVolumeGrid *grid,
+                                GridElement   *element);
+
 static GridElement *find_element_for_position (GduVolumeGrid *grid,
                                                guint x,
                                                guint y);
@@ -165,6 +193,7 @@ gdu_volume_grid_finalize (GObject *object)
 
   g_list_foreach (grid->elements, (GFunc) grid_element_free, NULL);
   g_list_free (grid->elements);
+  g_ptr_array_unref (grid->flat_elements);
 
   if (grid->block_object != NULL)
     g_object_unref (grid->block_object);
@@ -347,6 +376,9 @@ gdu_volume_grid_key_press_event (GtkWidget      *widget,
 
     if (target != NULL)
       {
+        queue_draw_element (grid, grid->selected);
+        queue_draw_element (grid, grid->focused);
+        queue_draw_element (grid, target);
         if ((event->state & GDK_CONTROL_MASK) != 0)
           {
             grid->focused = target;
@@ -361,7 +393,6 @@ gdu_volume_grid_key_press_event (GtkWidget      *widget,
 
             gdu_volume_grid_set_accessible_name_for_grid_element (grid, target);
           }
-        gtk_widget_queue_draw (GTK_WIDGET (grid));
       }
     handled = TRUE;
     break;
@@ -371,11 +402,12 @@ gdu_volume_grid_key_press_event (GtkWidget      *widget,
     if (grid->focused != grid->selected &&
         grid->focused != NULL)
       {
+        queue_draw_element (grid, grid->selected);
+        queue_draw_element (grid, grid->focused);
         grid->selected = grid->focused;
         g_signal_emit (grid,
                        signals[CHANGED_SIGNAL],
                        0);
-        gtk_widget_queue_draw (GTK_WIDGET (grid));
       }
     handled = TRUE;
     break;
@@ -407,13 +439,15 @@ gdu_volume_grid_button_press_event (GtkWidget      *widget,
       element = find_element_for_position (grid, event->x, event->y);
       if (element != NULL)
         {
+          queue_draw_element (grid, grid->selected);
+          queue_draw_element (grid, grid->focused);
+          queue_draw_element (grid, element);
           grid->selected = element;
           grid->focused = element;
           g_signal_emit (grid,
                          signals[CHANGED_SIGNAL],
                          0);
           gtk_widget_grab_focus (GTK_WIDGET (grid));
-          gtk_widget_queue_draw (GTK_WIDGET (grid));
 
           gdu_volume_grid_set_accessible_name_for_grid_element (grid, element);
         }
@@ -517,6 +551,31 @@ gdu_volume_grid_get_preferred_height (GtkWidget *widget,
   *minimal_height = *natural_height = 120;
 }
 
+static void
+clear_caches_for_slice (GList *elements)
+{
+  GList *l;
+
+  for (l = elements; l != NULL; l = l->next)
+    {
+      GridElement *element = l->data;
+      g_clear_object (&element->layout);
+      g_clear_pointer (&element->surface, cairo_surface_destroy);
+      clear_caches_for_slice (element->embedded_elements);
+    }
+}
+
+static void
+gdu_volume_grid_style_updated (GtkWidget *widget)
+{
+  GduVolumeGrid *grid = GDU_VOLUME_GRID (widget);
+
+  GTK_WIDGET_CLASS (gdu_volume_grid_parent_class)->style_updated (widget);
+
+  /* the cached layouts and renderings are tied to the old style */
+  clear_caches_for_slice (grid->elements);
+}
+
 static void
 gdu_volume_grid_class_init (GduVolumeGridClass *klass)
 {
@@ -536,6 +595,7 @@ gdu_volume_grid_class_init (GduVolumeGridClass *klass)
   gtkwidget_class->get_preferred_width  = gdu_volume_grid_get_preferred_width;
   gtkwidget_class->get_preferred_height = gdu_volume_grid_get_preferred_height;
   gtkwidget_class->draw                 = gdu_volume_grid_draw;
+  gtkwidget_class->style_updated        = gdu_volume_grid_style_updated;
 
   g_object_class_install_property (gobject_class,
                                    PROP_APPLICATION,
@@ -585,6 +645,8 @@ gdu_volume_grid_init (GduVolumeGrid *grid)
 {
   gtk_widget_set_can_focus (GTK_WIDGET (grid), TRUE);
   gtk_widget_set_app_paintable (GTK_WIDGET (grid), TRUE);
+
+  grid->flat_elements = g_ptr_array_new ();
 }
 
 GtkWidget *
@@ -725,6 +787,7 @@ recompute_size_for_slice (GList          *elements,
           element->height = height;
         }
 
+      element->edge_flags = GRID_EDGE_NONE;
       if (element->x == 0)
         element->edge_flags |= GRID_EDGE_LEFT;
       if (element->y == 0)
@@ -921,21 +984,30 @@ render_element (GduVolumeGrid *grid,
       animate_spinner = TRUE;
     }
 
-  /* text */
-  layout = pango_cairo_create_layout (cr);
+  /* text - the layout is kept around so it only needs to be laid out
+   * again when the text or the width changes
+   */
   text = element->text;
   if (text == NULL)
     text = grid->no_media_string;
-  pango_layout_set_text (layout, text, -1);
-  desc = pango_font_description_from_string ("Sans 7.0");
-  pango_layout_set_font_description (layout, desc);
-  pango_font_description_free (desc);
-  pango_layout_set_alignment (layout, PANGO_ALIGN_CENTER);
+  layout = element->layout;
+  if (layout == NULL)
+    {
+      layout = gtk_widget_create_pango_layout (GTK_WIDGET (grid), text);
+      desc = pango_font_description_from_string ("Sans 7.0");
+      pango_layout_set_font_description (layout, desc);
+      pango_font_description_free (desc);
+      pango_layout_set_alignment (layout, PANGO_ALIGN_CENTER);
+      pango_layout_set_ellipsize (layout, PANGO_ELLIPSIZE_END);
+      element->layout = layout;
+    }
+  else if (g_strcmp0 (pango_layout_get_text (layout), text) != 0)
+    {
+      pango_layout_set_text (layout, text, -1);
+    }
   pango_layout_set_width (layout, pango_units_from_double (w));
-  pango_layout_set_ellipsize (layout, PANGO_ELLIPSIZE_END);
   pango_layout_get_size (layout, &text_width, &text_height);
   gtk_render_layout (context, cr, x, y + floor (h / 2.0 - text_height/2/PANGO_SCALE), layout);
-  g_object_unref (layout);
 
   gtk_style_context_restore (context);
   cairo_restore (cr);
@@ -943,6 +1015,63 @@ render_element (GduVolumeGrid *grid,
   return animate_spinner;
 }
 
+/* Renders @element through its cached surface, re-rendering it only if
+ * the size, edges or state changed since last time.
+ */
+static void
+render_element_cached (GduVolumeGrid *grid,
+                       cairo_t       *cr,
+                       GridElement   *element,
+                       gboolean       is_selected,
+                       gboolean       is_focused,
+                       gboolean       is_grid_focused)
+{
+  GtkStateFlags state;
+  gint scale;
+
+  state = gtk_widget_get_state_flags (GTK_WIDGET (grid));
+  state &= ~(GTK_STATE_FLAG_SELECTED | GTK_STATE_FLAG_FOCUSED | GTK_STATE_FLAG_ACTIVE);
+  if (is_selected)
+    state |= GTK_STATE_FLAG_SELECTED;
+  if (is_grid_focused)
+    state |= GTK_STATE_FLAG_FOCUSED;
+  scale = gtk_widget_get_scale_factor (GTK_WIDGET (grid));
+
+  if (element->surface == NULL ||
+      element->surface_width != element->width ||
+      element->surface_height != element->height ||
+      element->surface_scale != scale ||
+      element->surface_edge_flags != element->edge_flags ||
+      element->surface_state != state ||
+      element->surface_focused != is_focused)
+    {
+      cairo_t *surface_cr;
+
+      if (element->surface != NULL)
+        cairo_surface_destroy (element->surface);
+      element->surface = gdk_window_create_similar_surface (gtk_widget_get_window (GTK_WIDGET (grid)),
+                                                            CAIRO_CONTENT_COLOR_ALPHA,
+                                                            element->width + ELEMENT_RENDER_PADDING,
+                                                            element->height + ELEMENT_RENDER_PADDING);
+      element->surface_width = element->width;
+      element->surface_height = element->height;
+      element->surface_scale = scale;
+      element->surface_edge_flags = element->edge_flags;
+      element->surface_state = state;
+      element->surface_focused = is_focused;
+
+      surface_cr = cairo_create (element->surface);
+      cairo_translate (surface_cr, - (gdouble) element->x, - (gdouble) element->y);
+      render_element (grid, surface_cr, element, is_selected, is_focused, is_grid_focused);
+      cairo_destroy (surface_cr);
+    }
+
+  cairo_save (cr);
+  cairo_set_source_surface (cr, element->surface, element->x, element->y);
+  cairo_paint (cr);
+  cairo_restore (cr);
+}
+
 static gboolean
 render_slice (GduVolumeGrid *grid,
               cairo_t       *cr,
@@ -950,15 +1079,31 @@ render_slice (GduVolumeGrid *grid,
 {
   GList *l;
   gboolean animate_spinner;
+  GdkRectangle clip;
 
   animate_spinner = FALSE;
+  if (!gdk_cairo_get_clip_rectangle (cr, &clip))
+    goto out;
+
   for (l = elements; l != NULL; l = l->next)
     {
       GridElement *element = l->data;
+      GdkRectangle rect;
       gboolean is_selected;
       gboolean is_focused;
       gboolean is_grid_focused;
 
+      /* children are always below their parent so check them anyway */
+      rect.x = element->x;
+      rect.y = element->y;
+      rect.width = element->width + ELEMENT_RENDER_PADDING;
+      rect.height = element->height + ELEMENT_RENDER_PADDING;
+      if (!gdk_rectangle_intersect (&rect, &clip, NULL))
+        {
+          animate_spinner |= element->show_spinner;
+          goto next;
+        }
+
       is_selected = FALSE;
       is_focused = FALSE;
       is_grid_focused = gtk_widget_has_focus (GTK_WIDGET (grid));
@@ -972,21 +1117,56 @@ render_slice (GduVolumeGrid *grid,
             is_focused = TRUE;
         }
 
-      animate_spinner |= render_element (grid,
-                                         cr,
-                                         element,
-                                         is_selected,
-                                         is_focused,
-                                         is_grid_focused);
+      /* the spinner is animated so there's no point in caching it */
+      if (element->show_spinner)
+        {
+          animate_spinner |= render_element (grid,
+                                             cr,
+                                             element,
+                                             is_selected,
+                                             is_focused,
+                                             is_grid_focused);
+        }
+      else
+        {
+          render_element_cached (grid,
+                                 cr,
+                                 element,
+                                 is_selected,
+                                 is_focused,
+                                 is_grid_focused);
+        }
 
+    next:
       animate_spinner |= render_slice (grid,
                                        cr,
                                        element->embedded_elements);
     }
 
+ out:
   return animate_spinner;
 }
 
+static void
+queue_draw_element (GduVolumeGrid *grid,
+                    GridElement   *element)
+{
+  if (element == NULL)
+    return;
+
+  if (!grid->geometry_valid)
+    {
+      gtk_widget_queue_draw (GTK_WIDGET (grid));
+      return;
+    }
+
+  gtk_widget_queue_draw_area (GTK_WIDGET (grid),
+                              element->x,
+                              element->y,
+                              element->width + ELEMENT_RENDER_PADDING,
+                              element->height + ELEMENT_RENDER_PADDING);
+}
+
 static gboolean
 gdu_volume_grid_draw (GtkWidget *widget,
                       cairo_t   *cr)
@@ -996,7 +1176,15 @@ gdu_volume_grid_draw (GtkWidget *widget,
   gboolean animate_spinner;
 
   gtk_widget_get_allocation (widget, &allocation);
-  recompute_size (grid, allocation.width, allocation.height);
+  if (!grid->geometry_valid ||
+      grid->geometry_width != allocation.width ||
+      grid->geometry_height != allocation.height)
+    {
+      recompute_size (grid, allocation.width, allocation.height);
+      grid->geometry_valid = TRUE;
+      grid->geometry_width = allocation.width;
+      grid->geometry_height = allocation.height;
+    }
 
   animate_spinner = render_slice (grid, cr, grid->elements);
 
@@ -1015,36 +1203,18 @@ gdu_volume_grid_draw (GtkWidget *widget,
   return FALSE;
 }
 
-static GridElement *
-do_find_element_for_position (GList *elements,
-                              guint  x,
-                              guint  y)
+static void
+build_flat_elements (GPtrArray *flat_elements,
+                     GList     *elements)
 {
   GList *l;
-  GridElement *ret;
-
-  ret = NULL;
 
   for (l = elements; l != NULL; l = l->next)
     {
       GridElement *e = l->data;
-
-      if ((x >= e->x) &&
-          (x  < e->x + e->width) &&
-          (y >= e->y) &&
-          (y  < e->y + e->height))
-        {
-          ret = e;
-          goto out;
-        }
-
-      ret = do_find_element_for_position (e->embedded_elements, x, y);
-      if (ret != NULL)
-        goto out;
+      g_ptr_array_add (flat_elements, e);
+      build_flat_elements (flat_elements, e->embedded_elements);
     }
-
- out:
-  return ret;
 }
 
 static GridElement *
@@ -1052,31 +1222,36 @@ find_element_for_position (GduVolumeGrid *grid,
                            guint x,
                            guint y)
 {
-  return do_find_element_for_position (grid->elements, x, y);
-}
-
-static GridElement *
-do_find_element_for_offset_and_object (GList        *elements,
-                                       gint64        offset,
-                                       UDisksObject *object)
-{
-  GList *l;
   GridElement *ret;
+  guint lo, hi;
 
   ret = NULL;
 
-  for (l = elements; l != NULL; l = l->next)
+  /* the flat array is in depth-first order so elements are sorted by
+   * x - find the last element starting at or before x. Since children
+   * always cover their parent that's the deepest element at x and the
+   * only other candidates are its ancestors.
+   */
+  lo = 0;
+  hi = grid->flat_elements->len;
+  while (lo < hi)
     {
-      GridElement *e = l->data;
-
-      if (e->offset == offset && e->object == object)
-        {
-          ret = e;
-          goto out;
-        }
+      guint mid = lo + (hi - lo) / 2;
+      GridElement *e = grid->flat_elements->pdata[mid];
+      if (e->x <= x)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  if (lo == 0)
+    goto out;
 
-      ret = do_find_element_for_offset_and_object (e->embedded_elements, offset, object);
-      if (ret != NULL)
+  for (ret = grid->flat_elements->pdata[lo - 1]; ret != NULL; ret = ret->parent)
+    {
+      if ((x >= ret->x) &&
+          (x  < ret->x + ret->width) &&
+          (y >= ret->y) &&
+          (y  < ret->y + ret->height))
         goto out;
     }
 
@@ -1089,7 +1264,40 @@ find_element_for_offset_and_object (GduVolumeGrid   *grid,
                                     gint64           offset,
                                     UDisksObject    *object)
 {
-  return do_find_element_for_offset_and_object (grid->elements, offset, object);
+  GridElement *ret;
+  guint lo, hi;
+  guint n;
+
+  ret = NULL;
+
+  /* the flat array is also sorted by offset, find the first element at offset */
+  lo = 0;
+  hi = grid->flat_elements->len;
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+      GridElement *e = grid->flat_elements->pdata[mid];
+      if (e->offset < offset)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  /* several elements (e.g. a LUKS device and its cleartext device) may share the offset */
+  for (n = lo; n < grid->flat_elements->len; n++)
+    {
+      GridElement *e = grid->flat_elements->pdata[n];
+      if (e->offset != offset)
+        break;
+      if (e->object == object)
+        {
+          ret = e;
+          goto out;
+        }
+    }
+
+ out:
+  return ret;
 }
 
 static gint
@@ -1180,6 +1388,7 @@ maybe_add_crypto (GduVolumeGrid    *grid,
           cleartext_element = grid_element_new (GDU_VOLUME_GRID_ELEMENT_TYPE_DEVICE);
           cleartext_element->parent = element;
           cleartext_element->object = g_object_ref (cleartext_object);
+          cleartext_element->offset = element->offset;
           cleartext_element->size = udisks_block_get_size (udisks_object_peek_block (cleartext_object));
           grid_element_set_details (grid, cleartext_element);
 
@@ -1302,9 +1511,105 @@ recompute_grid_add_partitions (GduVolumeGrid  *grid,
   return ret;
 }
 
+/* Returns TRUE if @a and @b would render the same, not counting children */
+static gboolean
+grid_element_equal (GridElement *a,
+                    GridElement *b)
+{
+  return a->type == b->type &&
+    a->fixed_width == b->fixed_width &&
+    a->size_ratio == b->size_ratio &&
+    a->object == b->object &&
+    a->offset == b->offset &&
+    a->size == b->size &&
+    a->unused == b->unused &&
+    a->show_spinner == b->show_spinner &&
+    a->show_padlock_open == b->show_padlock_open &&
+    a->show_padlock_closed == b->show_padlock_closed &&
+    a->show_mounted == b->show_mounted &&
+    a->show_configured == b->show_configured &&
+    g_strcmp0 (a->text, b->text) == 0;
+}
+
+/* Returns TRUE if the trees @a and @b would render the same */
+static gboolean
+grid_elements_equal (GList *a,
+                     GList *b)
+{
+  for (; a != NULL && b != NULL; a = a->next, b = b->next)
+    {
+      GridElement *ea = a->data;
+      GridElement *eb = b->data;
+
+      if (!grid_element_equal (ea, eb))
+        return FALSE;
+
+      if (!grid_elements_equal (ea->embedded_elements, eb->embedded_elements))
+        return FALSE;
+    }
+
+  return a == NULL && b == NULL;
+}
+
+/* Moves the cached layouts, and renderings of unchanged elements, from
+ * @old_elements to the corresponding elements in @elements. Both lists
+ * are sorted by offset so a single merge-like pass per level is enough.
+ */
+static void
+grid_elements_steal_caches (GList *elements,
+                            GList *old_elements)
+{
+  GList *l;
+  GList *o;
+
+  l = elements;
+  o = old_elements;
+  while (l != NULL && o != NULL)
+    {
+      GridElement *e = l->data;
+      GridElement *oe = o->data;
+
+      if (oe->offset < e->offset)
+        {
+          o = o->next;
+        }
+      else if (oe->offset > e->offset)
+        {
+          l = l->next;
+        }
+      else
+        {
+          if (e->type == oe->type && e->object == oe->object)
+            {
+              if (e->layout == NULL)
+                {
+                  e->layout = oe->layout;
+                  oe->layout = NULL;
+                }
+              /* the key is checked in render_element_cached() */
+              if (e->surface == NULL && grid_element_equal (e, oe))
+                {
+                  e->surface = oe->surface;
+                  e->surface_width = oe->surface_width;
+                  e->surface_height = oe->surface_height;
+                  e->surface_scale = oe->surface_scale;
+                  e->surface_edge_flags = oe->surface_edge_flags;
+                  e->surface_state = oe->surface_state;
+                  e->surface_focused = oe->surface_focused;
+                  oe->surface = NULL;
+                }
+              grid_elements_steal_caches (e->embedded_elements, oe->embedded_elements);
+            }
+          l = l->next;
+          o = o->next;
+        }
+    }
+}
+
 static void
 recompute_grid (GduVolumeGrid *grid)
 {
+  GList *elements;
   GList *partitions;
   GList *logical_partitions;
   UDisksObject *extended_partition;
@@ -1337,10 +1642,7 @@ recompute_grid (GduVolumeGrid *grid)
       cur_focused_object = grid->focused->object;
     }
 
-  /* delete all old elements */
-  g_list_foreach (grid->elements, (GFunc) grid_element_free, NULL);
-  g_list_free (grid->elements);
-  grid->elements = NULL;
+  elements = NULL;
 
   //g_debug ("TODO: recompute grid for %s",
   //         grid->block_object != NULL ?
@@ -1349,12 +1651,12 @@ recompute_grid (GduVolumeGrid *grid)
   if (grid->block_object == NULL)
     {
       element = grid_element_new (GDU_VOLUME_GRID_ELEMENT_TYPE_NO_MEDIA);
-      if (grid->elements != NULL)
+      if (elements != NULL)
         {
-          ((GridElement *) grid->elements->data)->next = element;
-          element->prev = ((GridElement *) grid->elements->data);
+          ((GridElement *) elements->data)->next = element;
+          element->prev = ((GridElement *) elements->data);
         }
-      grid->elements = g_list_append (grid->elements, element);
+      elements = g_list_append (elements, element);
       grid_element_set_details (grid, element);
       goto out;
     }
@@ -1413,19 +1715,19 @@ recompute_grid (GduVolumeGrid *grid)
               /* If we can't detect media change, just always assume media */
               element = grid_element_new (GDU_VOLUME_GRID_ELEMENT_TYPE_DEVICE);
               element->object = g_object_ref (grid->block_object);
-              grid->elements = g_list_append (grid->elements, element);
+              elements = g_list_append (elements, element);
               grid_element_set_details (grid, element);
             }
           else
             {
               element = grid_element_new (GDU_VOLUME_GRID_ELEMENT_TYPE_NO_MEDIA);
               element->size = top_size;
-              if (grid->elements != NULL)
+              if (elements != NULL)
                 {
-                  ((GridElement *) grid->elements->data)->next = element;
-                  element->prev = ((GridElement *) grid->elements->data);
+                  ((GridElement *) elements->data)->next = element;
+                  element->prev = ((GridElement *) elements->data);
                 }
-              grid->elements = g_list_append (grid->elements, element);
+              elements = g_list_append (elements, element);
               grid_element_set_details (grid, element);
             }
           g_clear_object (&drive);
@@ -1436,12 +1738,12 @@ recompute_grid (GduVolumeGrid *grid)
           element = grid_element_new (GDU_VOLUME_GRID_ELEMENT_TYPE_DEVICE);
           element->size = top_size;
           element->object = g_object_ref (grid->block_object);
-          if (grid->elements != NULL)
+          if (elements != NULL)
             {
-              ((GridElement *) grid->elements->data)->next = element;
-              element->prev = ((GridElement *) grid->elements->data);
+              ((GridElement *) elements->data)->next = element;
+              element->prev = ((GridElement *) elements->data);
             }
-          grid->elements = g_list_append (grid->elements, element);
+          elements = g_list_append (elements, element);
           grid_element_set_details (grid, element);
           cleartext_element = maybe_add_crypto (grid, element);
           if (cleartext_element != NULL)
@@ -1460,12 +1762,12 @@ recompute_grid (GduVolumeGrid *grid)
                                               partitions,
                                               extended_partition,
                                               logical_partitions);
-      if (grid->elements != NULL)
+      if (elements != NULL)
         {
-          ((GridElement *) grid->elements->data)->next = ((GridElement *) result->data);
-          ((GridElement *) result->data)->prev =((GridElement *) grid->elements->data);
+          ((GridElement *) elements->data)->next = ((GridElement *) result->data);
+          ((GridElement *) result->data)->prev =((GridElement *) elements->data);
         }
-      grid->elements = g_list_concat (grid->elements, result);
+      elements = g_list_concat (elements, result);
     }
 
   g_list_free (logical_partitions);
@@ -1475,18 +1777,43 @@ recompute_grid (GduVolumeGrid *grid)
 
  out:
 
-  /* reselect focused and selected elements */
-  grid->selected = find_element_for_offset_and_object (grid, cur_selected_offset, cur_selected_object);
-  grid->focused = find_element_for_offset_and_object (grid, cur_focused_offset, cur_focused_object);
-
   /* ensure we have at least one element */
-  if (grid->elements == NULL)
+  if (elements == NULL)
     {
       element = grid_element_new (GDU_VOLUME_GRID_ELEMENT_TYPE_NO_MEDIA);
-      grid->elements = g_list_append (NULL, element);
+      elements = g_list_append (NULL, element);
       grid_element_set_details (grid, element);
     }
 
+  /* Nothing to do if nothing visible changed - this is the common case
+   * since we get called for every property change on every object
+   */
+  if (grid->elements != NULL && grid_elements_equal (grid->elements, elements))
+    {
+      g_list_foreach (elements, (GFunc) grid_element_free, NULL);
+      g_list_free (elements);
+
+      if (grid->selected == NULL)
+        grid->selected = grid->elements->data;
+      if (grid->focused == NULL)
+        grid->focused = grid->elements->data;
+      return;
+    }
+
+  g_ptr_array_set_size (grid->flat_elements, 0);
+  build_flat_elements (grid->flat_elements, elements);
+
+  /* reselect focused and selected elements */
+  grid->selected = find_element_for_offset_and_object (grid, cur_selected_offset, cur_selected_object);
+  grid->focused = find_element_for_offset_and_object (grid, cur_focused_offset, cur_focused_object);
+
+  /* carry over layouts and delete all old elements */
+  grid_elements_steal_caches (elements, grid->elements);
+  g_list_foreach (grid->elements, (GFunc) grid_element_free, NULL);
+  g_list_free (grid->elements);
+  grid->elements = elements;
+  grid->geometry_valid = FALSE;
+
   /* ensure something is always focused/selected */
   if (grid->selected == NULL)
     grid->selected = grid->elements->data;
@@ -1922,37 +2249,58 @@ gdu_volume_grid_includes_object (GduVolumeGrid   *grid,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* Returns the offset the element for @object is shown at - see recompute_grid() */
+static gint64
+get_offset_for_object (GduVolumeGrid *grid,
+                       UDisksObject  *object)
+{
+  UDisksPartition *partition;
+  UDisksBlock *block;
+  UDisksObject *crypto_object;
+
+  partition = udisks_object_peek_partition (object);
+  if (partition != NULL)
+    return udisks_partition_get_offset (partition);
+
+  /* cleartext devices are shown at the offset of their crypto device */
+  block = udisks_object_peek_block (object);
+  if (block != NULL)
+    {
+      crypto_object = udisks_client_peek_object (grid->client,
+                                                 udisks_block_get_crypto_backing_device (block));
+      if (crypto_object != NULL && crypto_object != object)
+        return get_offset_for_object (grid, crypto_object);
+    }
+
+  return 0;
+}
+
 static GridElement *
-find_element_for_object_list (GList         *elements,
-                              UDisksObject  *object)
+find_element_for_object (GduVolumeGrid *grid,
+                         UDisksObject  *object)
 {
-  GridElement *ret = NULL;
-  GList *l;
+  GridElement *ret;
+  guint n;
 
-  for (l = elements; l != NULL; l = l->next)
+  ret = find_element_for_offset_and_object (grid, get_offset_for_object (grid, object), object);
+  if (ret != NULL)
+    goto out;
+
+  /* overlapping partitions aren't shown at their real offset so fall back to a full scan */
+  for (n = 0; n < grid->flat_elements->len; n++)
     {
-      GridElement *e = l->data;
+      GridElement *e = grid->flat_elements->pdata[n];
       if (e->object == object)
         {
           ret = e;
           goto out;
         }
-      ret = find_element_for_object_list (e->embedded_elements, object);
-      if (ret != NULL)
-        goto out;
     }
+
  out:
   return ret;
 }
 
-static GridElement *
-find_element_for_object (GduVolumeGrid *grid,
-                         UDisksObject  *object)
-{
-  return find_element_for_object_list (grid->elements, object);
-}
-
-
 /* ---------------------------------------------------------------------------------------------------- */
 
 gboolean
@@ -1968,11 +2316,13 @@ gdu_volume_grid_select_object (GduVolumeGrid   *grid,
   elem = find_element_for_object (grid, block_object);
   if (elem != NULL)
     {
+      queue_draw_element (grid, grid->selected);
+      queue_draw_element (grid, grid->focused);
+      queue_draw_element (grid, elem);
       grid->selected = elem;
       grid->focused = elem;
       ret = TRUE;
       g_signal_emit (grid, signals[CHANGED_SIGNAL], 0);
-      gtk_widget_queue_draw (GTK_WIDGET (grid));
     }
   return ret;
 }
@@ -2002,6 +2352,7 @@ gdu_volume_grid_set_no_media_string   (GduVolumeGrid       *grid,
 
   g_object_notify (G_OBJECT (grid), "no-media-string");
 
+  clear_caches_for_slice (grid->elements);
   gtk_widget_queue_draw (GTK_WIDGET (grid));
 
  out:
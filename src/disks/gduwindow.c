@@ -25,6 +25,7 @@
 #include "gduvolumegrid.h"
 #include "gduatasmartdialog.h"
 #include "gdubenchmarkdialog.h"
+#include "gdutestdiskdialog.h"
 #include "gducrypttabdialog.h"
 #include "gdufstabdialog.h"
 #include "gdufilesystemdialog.h"
@@ -41,6 +42,13 @@
 
 #define JOB_SENSITIVITY_DELAY_MS 300
 
+typedef enum
+{
+  UPDATE_FLAGS_NONE  = 0,
+  UPDATE_FLAGS_PAGE  = (1<<0), /* everything shown for the current object */
+  UPDATE_FLAGS_JOBS  = (1<<1), /* only the progress of the jobs shown */
+} UpdateFlags;
+
 struct _GduWindow
 {
   HdyApplicationWindow parent_instance;
@@ -57,6 +65,14 @@ struct _GduWindow
   gboolean has_volume_job;
   guint delay_job_update_id;
 
+  /* updates are coalesced and done at most once per frame */
+  UpdateFlags pending_update_flags;
+  guint update_tick_id;
+
+  /* the jobs currently shown in the drive and volume job grids */
+  UDisksJob *shown_drive_job;
+  UDisksJob *shown_volume_job;
+
   GtkWidget *volume_grid;
 
   GtkWidget *toolbutton_volume_menu;
@@ -202,6 +218,7 @@ typedef enum
   SHOW_FLAGS_DRIVE_MENU_STANDBY_NOW           = (1<<6),
   SHOW_FLAGS_DRIVE_MENU_RESUME_NOW            = (1<<7),
   SHOW_FLAGS_DRIVE_MENU_POWER_OFF             = (1<<8),
+  SHOW_FLAGS_DRIVE_MENU_TEST_DISK             = (1<<9),
 } ShowFlagsDriveMenu;
 
 typedef enum {
@@ -293,6 +310,9 @@ static void on_drive_menu_item_restore_disk_image (GSimpleAction *action,
 static void on_drive_menu_item_benchmark (GSimpleAction *action,
                                           GVariant      *parameter,
                                           gpointer       user_data);
+static void on_drive_menu_item_test_disk (GSimpleAction *action,
+                                          GVariant      *parameter,
+                                          gpointer       user_data);
 
 static void on_volume_menu_item_configure_fstab (GSimpleAction *action,
                                                  GVariant      *parameter,
@@ -364,6 +384,7 @@ static const GActionEntry actions[] = {
 	{ "create-disk-image", on_drive_menu_item_create_disk_image },
 	{ "restore-disk-image", on_drive_menu_item_restore_disk_image },
 	{ "benchmark-disk", on_drive_menu_item_benchmark },
+	{ "test-disk", on_drive_menu_item_test_disk },
 	{ "view-smart", on_drive_menu_item_view_smart },
 	{ "disk-settings", on_drive_menu_item_disk_settings },
 	{ "standby-now", on_drive_menu_item_standby_now },
@@ -391,8 +412,35 @@ gdu_window_init (GduWindow *window)
 {
 }
 
-static void on_client_changed (UDisksClient  *client,
-                               gpointer       user_data);
+static void on_object_added (GDBusObjectManager *manager,
+                             GDBusObject        *object,
+                             gpointer            user_data);
+
+static void on_interface_added (GDBusObjectManager *manager,
+                                GDBusObject        *object,
+                                GDBusInterface     *interface,
+                                gpointer            user_data);
+
+static void on_interface_proxy_properties_changed (GDBusObjectManagerClient *manager,
+                                                   GDBusObjectProxy         *object_proxy,
+                                                   GDBusProxy               *interface_proxy,
+                                                   GVariant                 *changed_properties,
+                                                   const gchar *const       *invalidated_properties,
+                                                   gpointer                  user_data);
+
+static void on_local_jobs_changed (GduApplication *application,
+                                   UDisksObject   *object,
+                                   gpointer        user_data);
+
+static void on_capabilities_changed (GduApplication *application,
+                                     gpointer        user_data);
+
+static void set_shown_job (GduWindow *window,
+                           gboolean   is_volume,
+                           UDisksJob *job);
+
+static void queue_update (GduWindow   *window,
+                          UpdateFlags  flags);
 
 static
 gboolean
@@ -412,14 +460,24 @@ gdu_window_finalize (GObject *object)
                               'd',
                               window->device_tree_treeview);
 
-  g_signal_handlers_disconnect_by_func (window->client,
-                                        G_CALLBACK (on_client_changed),
+  g_signal_handlers_disconnect_by_data (udisks_client_get_object_manager (window->client), window);
+  g_signal_handlers_disconnect_by_func (window->application,
+                                        G_CALLBACK (on_local_jobs_changed),
+                                        window);
+  g_signal_handlers_disconnect_by_func (window->application,
+                                        G_CALLBACK (on_capabilities_changed),
                                         window);
 
+  if (window->update_tick_id != 0)
+    gtk_widget_remove_tick_callback (GTK_WIDGET (window), window->update_tick_id);
+  set_shown_job (window, FALSE, NULL);
+  set_shown_job (window, TRUE, NULL);
+
   if (window->current_object != NULL)
     g_object_unref (window->current_object);
 
   g_object_unref (window->builder);
+  g_signal_handlers_disconnect_by_data (window->model, window);
   g_object_unref (window->model);
   g_object_unref (window->client);
   g_object_unref (window->application);
@@ -505,6 +563,9 @@ update_for_show_flags (GduWindow *window,
   g_simple_action_set_enabled (G_SIMPLE_ACTION (g_action_map_lookup_action (G_ACTION_MAP (window),
                               "benchmark-disk")),
                               show_flags->drive_menu & SHOW_FLAGS_DRIVE_MENU_BENCHMARK);
+  g_simple_action_set_enabled (G_SIMPLE_ACTION (g_action_map_lookup_action (G_ACTION_MAP (window),
+                              "test-disk")),
+                              show_flags->drive_menu & SHOW_FLAGS_DRIVE_MENU_TEST_DISK);
 
 
   g_simple_action_set_enabled (G_SIMPLE_ACTION (g_action_map_lookup_action (G_ACTION_MAP (window),
@@ -989,7 +1050,6 @@ power_state_cell_func (GtkTreeViewColumn *column,
 {
   gboolean visible = FALSE;
   GduPowerStateFlags flags;
-  GduWindow *window = GDU_WINDOW (user_data);
 
   gtk_tree_model_get (model,
                       iter,
@@ -1000,7 +1060,32 @@ power_state_cell_func (GtkTreeViewColumn *column,
     visible = TRUE;
 
   gtk_cell_renderer_set_visible (renderer, visible);
-  update_all (window, FALSE);
+}
+
+static void
+on_power_state_changed (GduDeviceTreeModel *model,
+                        UDisksObject       *object,
+                        gpointer            user_data)
+{
+  GduWindow *window = GDU_WINDOW (user_data);
+
+  /* the drive menu offers either Standby Now or Wake-up From Standby */
+  if (object == window->current_object)
+    queue_update (window, UPDATE_FLAGS_PAGE);
+}
+
+static gboolean
+on_window_state_event (GtkWidget           *widget,
+                       GdkEventWindowState *event,
+                       gpointer             user_data)
+{
+  GduWindow *window = GDU_WINDOW (widget);
+
+  /* no need to wake up for the power state of drives nobody sees */
+  gdu_device_tree_model_set_power_state_paused (window->model,
+                                                (event->new_window_state & (GDK_WINDOW_STATE_ICONIFIED |
+                                                                            GDK_WINDOW_STATE_WITHDRAWN)) != 0);
+  return FALSE; /* propagate event */
 }
 
 static void
@@ -1066,6 +1151,7 @@ gdu_window_constructed (GObject *object)
   GtkCellRenderer *renderer;
   GtkTreeSelection *selection;
   GtkStyleContext *context;
+  GDBusObjectManager *object_manager;
   GList *children, *l;
   guint n;
   GtkBuilder *builder;
@@ -1144,6 +1230,14 @@ gdu_window_constructed (GObject *object)
                                              GDU_DEVICE_TREE_MODEL_FLAGS_UPDATE_POWER_STATE |
                                              GDU_DEVICE_TREE_MODEL_FLAGS_UPDATE_PULSE |
                                              GDU_DEVICE_TREE_MODEL_FLAGS_FLAT);
+  g_signal_connect (window->model,
+                    "power-state-changed",
+                    G_CALLBACK (on_power_state_changed),
+                    window);
+  g_signal_connect (window,
+                    "window-state-event",
+                    G_CALLBACK (on_window_state_event),
+                    NULL);
 
   gtk_tree_view_set_model (GTK_TREE_VIEW (window->device_tree_treeview), GTK_TREE_MODEL (window->model));
   gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (window->model),
@@ -1229,9 +1323,34 @@ gdu_window_constructed (GObject *object)
                     window);
   gtk_tree_view_expand_all (GTK_TREE_VIEW (window->device_tree_treeview));
 
-  g_signal_connect (window->client,
-                    "changed",
-                    G_CALLBACK (on_client_changed),
+  object_manager = udisks_client_get_object_manager (window->client);
+  g_signal_connect (object_manager,
+                    "object-added",
+                    G_CALLBACK (on_object_added),
+                    window);
+  g_signal_connect (object_manager,
+                    "object-removed",
+                    G_CALLBACK (on_object_added),
+                    window);
+  g_signal_connect (object_manager,
+                    "interface-added",
+                    G_CALLBACK (on_interface_added),
+                    window);
+  g_signal_connect (object_manager,
+                    "interface-removed",
+                    G_CALLBACK (on_interface_added),
+                    window);
+  g_signal_connect (object_manager,
+                    "interface-proxy-properties-changed",
+                    G_CALLBACK (on_interface_proxy_properties_changed),
+                    window);
+  g_signal_connect (window->application,
+                    "local-jobs-changed",
+                    G_CALLBACK (on_local_jobs_changed),
+                    window);
+  g_signal_connect (window->application,
+                    "capabilities-changed",
+                    G_CALLBACK (on_capabilities_changed),
                     window);
 
   /* set up non-standard widgets that isn't in the .ui file */
@@ -1603,6 +1722,13 @@ update_all (GduWindow *window, gboolean is_delayed_job_update)
   ShowFlags show_flags = {0};
   GtkWidget *page = window->disks_not_implemented;
 
+  /* everything is updated now, see on_update_tick() */
+  window->pending_update_flags = UPDATE_FLAGS_NONE;
+
+  /* set again by update_jobs() if they are still shown */
+  set_shown_job (window, FALSE, NULL);
+  set_shown_job (window, TRUE, NULL);
+
   /* figure out page to display */
   if (window->current_object != NULL)
     {
@@ -1635,13 +1761,210 @@ update_all (GduWindow *window, gboolean is_delayed_job_update)
   update_for_show_flags (window, &show_flags);
 }
 
+static void update_shown_jobs (GduWindow *window);
+
+static gboolean
+on_update_tick (GtkWidget     *widget,
+                GdkFrameClock *frame_clock,
+                gpointer       user_data)
+{
+  GduWindow *window = GDU_WINDOW (widget);
+  UpdateFlags flags = window->pending_update_flags;
+
+  window->pending_update_flags = UPDATE_FLAGS_NONE;
+  window->update_tick_id = 0;
+
+  if (flags & UPDATE_FLAGS_PAGE)
+    update_all (window, FALSE);
+  else if (flags & UPDATE_FLAGS_JOBS)
+    update_shown_jobs (window);
+
+  return G_SOURCE_REMOVE;
+}
+
 static void
-on_client_changed (UDisksClient   *client,
-                   gpointer        user_data)
+queue_update (GduWindow   *window,
+              UpdateFlags  flags)
+{
+  window->pending_update_flags |= flags;
+  if (window->update_tick_id == 0)
+    window->update_tick_id = gtk_widget_add_tick_callback (GTK_WIDGET (window), on_update_tick, NULL, NULL);
+}
+
+static gboolean object_is_shown (GduWindow    *window,
+                                 UDisksObject *object);
+
+static gboolean
+object_path_is_shown (GduWindow   *window,
+                      const gchar *object_path)
+{
+  UDisksObject *object;
+  gboolean ret = FALSE;
+
+  if (object_path == NULL || g_strcmp0 (object_path, "/") == 0)
+    goto out;
+
+  if (g_strcmp0 (object_path, g_dbus_object_get_object_path (G_DBUS_OBJECT (window->current_object))) == 0)
+    {
+      ret = TRUE;
+      goto out;
+    }
+
+  object = udisks_client_get_object (window->client, object_path);
+  if (object != NULL)
+    {
+      ret = object_is_shown (window, object);
+      g_object_unref (object);
+    }
+
+ out:
+  return ret;
+}
+
+/* Returns TRUE if a change to @object may change what is shown for the
+ * current object, i.e. if it is the current object, a block device,
+ * partition or cleartext device on it, a job running on any of those or
+ * the RAID array it is part of. Changes to objects we don't know about
+ * are assumed to matter.
+ */
+static gboolean
+object_is_shown (GduWindow    *window,
+                 UDisksObject *object)
+{
+  const gchar *object_path;
+  UDisksBlock *block;
+  UDisksPartition *partition;
+  UDisksJob *job;
+  UDisksMDRaid *mdraid;
+  gboolean ret = FALSE;
+
+  if (window->current_object == NULL)
+    goto out;
+
+  object_path = g_dbus_object_get_object_path (G_DBUS_OBJECT (object));
+  if (g_strcmp0 (object_path, g_dbus_object_get_object_path (G_DBUS_OBJECT (window->current_object))) == 0)
+    {
+      ret = TRUE;
+      goto out;
+    }
+
+  block = udisks_object_peek_block (object);
+  partition = udisks_object_peek_partition (object);
+  job = udisks_object_peek_job (object);
+  mdraid = udisks_object_peek_mdraid (object);
+
+  if (block != NULL)
+    {
+      if (object_path_is_shown (window, udisks_block_get_drive (block)) ||
+          object_path_is_shown (window, udisks_block_get_crypto_backing_device (block)))
+        {
+          ret = TRUE;
+          goto out;
+        }
+    }
+
+  if (partition != NULL && object_path_is_shown (window, udisks_partition_get_table (partition)))
+    {
+      ret = TRUE;
+      goto out;
+    }
+
+  if (job != NULL)
+    {
+      const gchar *const *job_objects;
+      guint n;
+
+      job_objects = udisks_job_get_objects (job);
+      for (n = 0; job_objects != NULL && job_objects[n] != NULL; n++)
+        {
+          if (object_path_is_shown (window, job_objects[n]))
+            {
+              ret = TRUE;
+              goto out;
+            }
+        }
+    }
+
+  if (mdraid != NULL)
+    {
+      UDisksBlock *current_block;
+
+      current_block = udisks_object_peek_block (window->current_object);
+      if (current_block != NULL &&
+          (g_strcmp0 (udisks_block_get_mdraid (current_block), object_path) == 0 ||
+           g_strcmp0 (udisks_block_get_mdraid_member (current_block), object_path) == 0))
+        {
+          ret = TRUE;
+          goto out;
+        }
+    }
+
+  if (block == NULL && job == NULL && mdraid == NULL && udisks_object_peek_drive (object) == NULL)
+    ret = TRUE;
+
+ out:
+  return ret;
+}
+
+/* Also used for ::object-removed */
+static void
+on_object_added (GDBusObjectManager *manager,
+                 GDBusObject        *object,
+                 gpointer            user_data)
 {
   GduWindow *window = GDU_WINDOW (user_data);
-  //g_debug ("on_client_changed");
-  update_all (window, FALSE);
+  if (object_is_shown (window, UDISKS_OBJECT (object)))
+    queue_update (window, UPDATE_FLAGS_PAGE);
+}
+
+/* Also used for ::interface-removed */
+static void
+on_interface_added (GDBusObjectManager *manager,
+                    GDBusObject        *object,
+                    GDBusInterface     *interface,
+                    gpointer            user_data)
+{
+  GduWindow *window = GDU_WINDOW (user_data);
+  if (object_is_shown (window, UDISKS_OBJECT (object)))
+    queue_update (window, UPDATE_FLAGS_PAGE);
+}
+
+static void
+on_interface_proxy_properties_changed (GDBusObjectManagerClient *manager,
+                                       GDBusObjectProxy         *object_proxy,
+                                       GDBusProxy               *interface_proxy,
+                                       GVariant                 *changed_properties,
+                                       const gchar *const       *invalidated_properties,
+                                       gpointer                  user_data)
+{
+  GduWindow *window = GDU_WINDOW (user_data);
+
+  /* progress of a job we show - no need to update the rest of the page */
+  if ((gpointer) interface_proxy == (gpointer) window->shown_drive_job ||
+      (gpointer) interface_proxy == (gpointer) window->shown_volume_job)
+    queue_update (window, UPDATE_FLAGS_JOBS);
+  else if (object_is_shown (window, UDISKS_OBJECT (object_proxy)))
+    queue_update (window, UPDATE_FLAGS_PAGE);
+}
+
+static void
+on_local_jobs_changed (GduApplication *application,
+                       UDisksObject   *object,
+                       gpointer        user_data)
+{
+  GduWindow *window = GDU_WINDOW (user_data);
+  if (object_is_shown (window, object))
+    queue_update (window, UPDATE_FLAGS_PAGE);
+}
+
+static void
+on_capabilities_changed (GduApplication *application,
+                         gpointer        user_data)
+{
+  GduWindow *window = GDU_WINDOW (user_data);
+
+  /* the Resize, Repair and Check items may have been hidden while unknown */
+  queue_update (window, UPDATE_FLAGS_PAGE);
 }
 
 static void
@@ -1780,10 +2103,41 @@ delayed_job_update (gpointer user_data)
 }
 
 static void
-update_jobs (GduWindow *window,
-             GList     *jobs,
-             gboolean   is_volume,
-             gboolean   is_delayed_job_update)
+on_shown_local_job_notify (GObject    *object,
+                           GParamSpec *pspec,
+                           gpointer    user_data)
+{
+  GduWindow *window = GDU_WINDOW (user_data);
+  queue_update (window, UPDATE_FLAGS_JOBS);
+}
+
+static void
+set_shown_job (GduWindow *window,
+               gboolean   is_volume,
+               UDisksJob *job)
+{
+  UDisksJob **shown_job = is_volume ? &window->shown_volume_job : &window->shown_drive_job;
+
+  if (*shown_job == job)
+    return;
+
+  /* D-Bus jobs are handled in on_interface_proxy_properties_changed() */
+  if (*shown_job != NULL && GDU_IS_LOCAL_JOB (*shown_job))
+    g_signal_handlers_disconnect_by_func (*shown_job, G_CALLBACK (on_shown_local_job_notify), window);
+  g_clear_object (shown_job);
+
+  if (job != NULL)
+    {
+      *shown_job = g_object_ref (job);
+      if (GDU_IS_LOCAL_JOB (job))
+        g_signal_connect (job, "notify", G_CALLBACK (on_shown_local_job_notify), window);
+    }
+}
+
+static void
+show_job (GduWindow *window,
+          UDisksJob *job,
+          gboolean   is_volume)
 {
   GtkWidget *label = window->devtab_drive_job_label;
   GtkWidget *grid = window->devtab_drive_job_grid;
@@ -1791,9 +2145,7 @@ update_jobs (GduWindow *window,
   GtkWidget *remaining_label = window->devtab_drive_job_remaining_label;
   GtkWidget *no_progress_label = window->devtab_drive_job_no_progress_label;
   GtkWidget *cancel_button = window->devtab_drive_job_cancel_button;
-  gboolean drive_sensitivity;
-  gboolean selected_volume_sensitivity;
-  gboolean gets_sensitive;
+  gchar *s, *s2;
 
   if (is_volume)
     {
@@ -1805,6 +2157,81 @@ update_jobs (GduWindow *window,
       cancel_button = window->devtab_job_cancel_button;
     }
 
+  gtk_widget_show (label);
+  gtk_widget_show (grid);
+  if (udisks_job_get_progress_valid (job))
+    {
+      gdouble progress = udisks_job_get_progress (job);
+      gtk_widget_show (progressbar);
+      gtk_widget_hide (no_progress_label);
+
+      gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (progressbar), progress);
+
+      if (GDU_IS_LOCAL_JOB (job))
+        s2 = g_strdup (gdu_local_job_get_description (GDU_LOCAL_JOB (job)));
+      else
+        s2 = udisks_client_get_job_description (window->client, job);
+      /* Translators: Used in job progress bar.
+       *              The %s is the job description (e.g. "Erasing Device").
+       *              The %f is the completion percentage (between 0.0 and 100.0).
+       */
+      s = g_strdup_printf (_("%s: %2.1f%%"),
+                            s2,
+                            100.0 * progress);
+      g_free (s2);
+      gtk_progress_bar_set_show_text (GTK_PROGRESS_BAR (progressbar), TRUE);
+      gtk_progress_bar_set_text (GTK_PROGRESS_BAR (progressbar), s);
+      g_free (s);
+
+      s = get_job_progress_text (window, job);
+      if (s != NULL)
+        {
+          gtk_widget_show (remaining_label);
+          gtk_label_set_markup (GTK_LABEL (remaining_label), s);
+          g_free (s);
+        }
+      else
+        {
+          gtk_widget_hide (remaining_label);
+        }
+    }
+  else
+    {
+      gtk_widget_hide (progressbar);
+      gtk_widget_hide (remaining_label);
+      gtk_widget_show (no_progress_label);
+      if (GDU_IS_LOCAL_JOB (job))
+        s = g_strdup (gdu_local_job_get_description (GDU_LOCAL_JOB (job)));
+      else
+        s = udisks_client_get_job_description (window->client, job);
+      gtk_label_set_text (GTK_LABEL (no_progress_label), s);
+      g_free (s);
+    }
+  if (udisks_job_get_cancelable (job))
+    gtk_widget_show (cancel_button);
+  else
+    gtk_widget_hide (cancel_button);
+}
+
+static void
+update_shown_jobs (GduWindow *window)
+{
+  if (window->shown_drive_job != NULL)
+    show_job (window, window->shown_drive_job, FALSE);
+  if (window->shown_volume_job != NULL)
+    show_job (window, window->shown_volume_job, TRUE);
+}
+
+static void
+update_jobs (GduWindow *window,
+             GList     *jobs,
+             gboolean   is_volume,
+             gboolean   is_delayed_job_update)
+{
+  gboolean drive_sensitivity;
+  gboolean selected_volume_sensitivity;
+  gboolean gets_sensitive;
+
   drive_sensitivity = !gdu_application_has_running_job (window->application, window->current_object);
   selected_volume_sensitivity = (!window->has_volume_job && !window->has_drive_job);
   gets_sensitive = (drive_sensitivity && !gtk_widget_get_sensitive (window->devtab_drive_menu_button))
@@ -1830,68 +2257,14 @@ update_jobs (GduWindow *window,
 
   if (jobs == NULL)
     {
-      gtk_widget_hide (label);
-      gtk_widget_hide (grid);
+      gtk_widget_hide (is_volume ? window->devtab_job_label : window->devtab_drive_job_label);
+      gtk_widget_hide (is_volume ? window->devtab_job_grid : window->devtab_drive_job_grid);
+      set_shown_job (window, is_volume, NULL);
     }
   else
     {
-      UDisksJob *job = UDISKS_JOB (jobs->data);
-      gchar *s, *s2;
-
-      gtk_widget_show (label);
-      gtk_widget_show (grid);
-      if (udisks_job_get_progress_valid (job))
-        {
-          gdouble progress = udisks_job_get_progress (job);
-          gtk_widget_show (progressbar);
-          gtk_widget_hide (no_progress_label);
-
-          gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (progressbar), progress);
-
-          if (GDU_IS_LOCAL_JOB (job))
-            s2 = g_strdup (gdu_local_job_get_description (GDU_LOCAL_JOB (job)));
-          else
-            s2 = udisks_client_get_job_description (window->client, job);
-          /* Translators: Used in job progress bar.
-           *              The %s is the job description (e.g. "Erasing Device").
-           *              The %f is the completion percentage (between 0.0 and 100.0).
-           */
-          s = g_strdup_printf (_("%s: %2.1f%%"),
-                                s2,
-                                100.0 * progress);
-          g_free (s2);
-          gtk_progress_bar_set_show_text (GTK_PROGRESS_BAR (progressbar), TRUE);
-          gtk_progress_bar_set_text (GTK_PROGRESS_BAR (progressbar), s);
-          g_free (s);
-
-          s = get_job_progress_text (window, job);
-          if (s != NULL)
-            {
-              gtk_widget_show (remaining_label);
-              gtk_label_set_markup (GTK_LABEL (remaining_label), s);
-              g_free (s);
-            }
-          else
-            {
-              gtk_widget_hide (remaining_label);
-            }
-        }
-      else
-        {
-          gtk_widget_hide (progressbar);
-          gtk_widget_hide (remaining_label);
-          gtk_widget_show (no_progress_label);
-          if (GDU_IS_LOCAL_JOB (job))
-            s = g_strdup (gdu_local_job_get_description (GDU_LOCAL_JOB (job)));
-          else
-            s = udisks_client_get_job_description (window->client, job);
-          gtk_label_set_text (GTK_LABEL (no_progress_label), s);
-          g_free (s);
-        }
-      if (udisks_job_get_cancelable (job))
-        gtk_widget_show (cancel_button);
-      else
-        gtk_widget_hide (cancel_button);
+      show_job (window, UDISKS_JOB (jobs->data), is_volume);
+      set_shown_job (window, is_volume, UDISKS_JOB (jobs->data));
     }
 }
 
@@ -2422,6 +2795,8 @@ update_device_page_for_block (GduWindow          *window,
       show_flags->drive_menu |= SHOW_FLAGS_DRIVE_MENU_CREATE_DISK_IMAGE;
       if (!read_only)
         show_flags->drive_menu |= SHOW_FLAGS_DRIVE_MENU_RESTORE_DISK_IMAGE;
+      if (!read_only)
+        show_flags->drive_menu |= SHOW_FLAGS_DRIVE_MENU_TEST_DISK;
       if (!read_only)
         {
           show_flags->volume_menu |= SHOW_FLAGS_VOLUME_MENU_RESTORE_VOLUME_IMAGE;
@@ -2742,6 +3117,7 @@ update_device_page_for_free_space (GduWindow          *window,
       show_flags->drive_menu |= SHOW_FLAGS_DRIVE_MENU_FORMAT_DISK;
       show_flags->drive_menu |= SHOW_FLAGS_DRIVE_MENU_CREATE_DISK_IMAGE;
       show_flags->drive_menu |= SHOW_FLAGS_DRIVE_MENU_RESTORE_DISK_IMAGE;
+      show_flags->drive_menu |= SHOW_FLAGS_DRIVE_MENU_TEST_DISK;
     }
 
   if (loop != NULL)
@@ -3434,6 +3810,21 @@ on_drive_menu_item_benchmark (GSimpleAction *action,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+static void
+on_drive_menu_item_test_disk (GSimpleAction *action,
+                              GVariant      *parameter,
+                              gpointer       user_data)
+{
+  GduWindow *window = GDU_WINDOW (user_data);
+  UDisksObject *object;
+
+  object = gdu_volume_grid_get_block_object (GDU_VOLUME_GRID (window->volume_grid));
+  g_assert (object != NULL);
+  gdu_test_disk_dialog_show (window, object);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static void
 on_volume_menu_item_create_volume_image (GSimpleAction *action,
                                          GVariant      *parameter,
@@ -3545,6 +3936,12 @@ ata_pm_standby_cb (GObject      *source_object,
                             error);
       g_clear_error (&error);
     }
+  else
+    {
+      GDBusObject *object = g_dbus_interface_get_object (G_DBUS_INTERFACE (source_object));
+      if (object != NULL)
+        gdu_device_tree_model_recheck_power_state (window->model, UDISKS_OBJECT (object));
+    }
 
   g_object_unref (window);
 }
@@ -3592,6 +3989,12 @@ ata_pm_wakeup_cb (GObject      *source_object,
                             error);
       g_clear_error (&error);
     }
+  else
+    {
+      GDBusObject *object = g_dbus_interface_get_object (G_DBUS_INTERFACE (source_object));
+      if (object != NULL)
+        gdu_device_tree_model_recheck_power_state (window->model, UDISKS_OBJECT (object));
+    }
 
   g_object_unref (window);
 }
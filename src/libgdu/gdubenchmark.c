@@ -0,0 +1,524 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <glib/gi18n.h>
+#include <gio/gunixfdlist.h>
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#include "gdubenchmark.h"
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * gdu_benchmark_open_device:
+ * @block: The block device to open.
+ * @writable: Whether the device needs to be opened for writing.
+ * @cancellable: A #GCancellable or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Asks udisks to open @block for benchmarking. This blocks the
+ * calling thread so it should be used from a worker thread.
+ *
+ * Returns: A file descriptor (free with close()) or -1 if @error is set.
+ */
+gint
+gdu_benchmark_open_device (UDisksBlock   *block,
+                           gboolean       writable,
+                           GCancellable  *cancellable,
+                           GError       **error)
+{
+  GVariantBuilder options_builder;
+  GVariant *fd_index = NULL;
+  GUnixFDList *fd_list = NULL;
+  gint fd = -1;
+
+  g_variant_builder_init (&options_builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&options_builder, "{sv}", "writable", g_variant_new_boolean (writable));
+
+  if (!udisks_block_call_open_for_benchmark_sync (block,
+                                                  g_variant_builder_end (&options_builder),
+                                                  NULL, /* fd_list */
+                                                  &fd_index,
+                                                  &fd_list,
+                                                  cancellable,
+                                                  error))
+    goto out;
+
+  fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (fd_index), error);
+
+ out:
+  g_clear_object (&fd_list);
+  if (fd_index != NULL)
+    g_variant_unref (fd_index);
+  return fd;
+}
+
+/**
+ * gdu_benchmark_get_device_size:
+ * @fd: A file descriptor for a block device.
+ * @out_size: Return location for the size in bytes.
+ * @error: Return location for error or %NULL.
+ *
+ * Gets the size of the block device referred to by @fd.
+ *
+ * Returns: %TRUE if @out_size was set, %FALSE if @error is set.
+ */
+gboolean
+gdu_benchmark_get_device_size (gint      fd,
+                               guint64  *out_size,
+                               GError  **error)
+{
+  /* We can't use udisks_block_get_size() because the media may have
+   * changed and udisks may not have noticed. TODO: maybe have a
+   * Block.GetSize() method instead...
+   */
+  if (ioctl (fd, BLKGETSIZE64, out_size) != 0)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errno),
+                   C_("benchmarking", "Error getting size of device: %m"));
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * gdu_benchmark_run:
+ * @fd: A file descriptor obtained from gdu_benchmark_open_device().
+ * @disk_size: The size of the device as returned by gdu_benchmark_get_device_size().
+ * @params: The benchmark parameters.
+ * @sample_func: Function to call for every sample.
+ * @user_data: User data to pass to @sample_func.
+ * @cancellable: A #GCancellable or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Measures the transfer rate (reading and, if requested, writing
+ * back the data just read) at @params->num_samples points evenly
+ * spread over the device followed by @params->num_access_samples
+ * random access time measurements. Either part is skipped if the
+ * corresponding number of samples is zero.
+ *
+ * This blocks the calling thread for the duration of the benchmark
+ * and @sample_func is invoked in that thread.
+ *
+ * Returns: %TRUE if the benchmark completed, %FALSE if @error is set.
+ */
+gboolean
+gdu_benchmark_run (gint                       fd,
+                   guint64                    disk_size,
+                   const GduBenchmarkParams  *params,
+                   GduBenchmarkSampleFunc     sample_func,
+                   gpointer                   user_data,
+                   GCancellable              *cancellable,
+                   GError                   **error)
+{
+  gboolean ret = FALSE;
+  guchar *buffer_unaligned = NULL;
+  guchar *buffer = NULL;
+  GRand *rand = NULL;
+  gint n;
+  long page_size;
+  gsize sample_size;
+
+  page_size = sysconf (_SC_PAGESIZE);
+  if (page_size < 1)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errno),
+                   C_("benchmarking", "Error getting page size: %m\n"));
+      goto out;
+    }
+
+  sample_size = ((gsize) params->sample_size_mib) * 1024 * 1024;
+  buffer_unaligned = g_new0 (guchar, sample_size + page_size);
+  buffer = (guchar*) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
+
+  /* transfer rate... */
+  for (n = 0; n < params->num_samples; n++)
+    {
+      gchar *s, *s2;
+      gint64 begin_usec;
+      gint64 end_usec;
+      gint64 offset;
+      ssize_t num_read;
+      GduBenchmarkSample sample = {0};
+
+      if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        goto out;
+
+      /* figure out offset and align to page-size */
+      offset = n * disk_size / params->num_samples;
+      offset &= ~(page_size - 1);
+
+      if (lseek (fd, offset, SEEK_SET) != offset)
+        {
+          g_set_error (error,
+                       G_IO_ERROR,
+                       g_io_error_from_errno (errno),
+                       C_("benchmarking", "Error seeking to offset %lld"),
+                       (long long int) offset);
+          goto out;
+        }
+      if (read (fd, buffer, page_size) != page_size)
+        {
+          s = g_format_size_full (page_size, G_FORMAT_SIZE_LONG_FORMAT);
+          s2 = g_format_size_full (offset, G_FORMAT_SIZE_LONG_FORMAT);
+          g_set_error (error,
+                       G_IO_ERROR,
+                       g_io_error_from_errno (errno),
+                       C_("benchmarking", "Error pre-reading %s from offset %s"),
+                       s, s2);
+          g_free (s2);
+          g_free (s);
+          goto out;
+        }
+      if (lseek (fd, offset, SEEK_SET) != offset)
+        {
+          s = g_format_size_full (offset, G_FORMAT_SIZE_LONG_FORMAT);
+          g_set_error (error,
+                       G_IO_ERROR,
+                       g_io_error_from_errno (errno),
+                       C_("benchmarking", "Error seeking to offset %s"),
+                       s);
+          g_free (s);
+          goto out;
+        }
+      begin_usec = g_get_monotonic_time ();
+      num_read = read (fd, buffer, sample_size);
+      if (G_UNLIKELY (num_read < 0))
+        {
+          s = g_format_size_full (sample_size, G_FORMAT_SIZE_LONG_FORMAT);
+          s2 = g_format_size_full (offset, G_FORMAT_SIZE_LONG_FORMAT);
+          g_set_error (error,
+                       G_IO_ERROR,
+                       g_io_error_from_errno (errno),
+                       C_("benchmarking", "Error reading %s from offset %s"),
+                       s, s2);
+          g_free (s2);
+          g_free (s);
+          goto out;
+        }
+      end_usec = g_get_monotonic_time ();
+
+      sample.offset = offset;
+      sample.value = ((gdouble) G_USEC_PER_SEC) * num_read / (end_usec - begin_usec);
+      sample_func (GDU_BENCHMARK_SAMPLE_TYPE_READ, &sample, user_data);
+
+      if (params->do_write)
+        {
+          ssize_t num_written;
+
+          /* and now write the same block again... */
+          if (lseek (fd, offset, SEEK_SET) != offset)
+            {
+              g_set_error (error,
+                           G_IO_ERROR,
+                           g_io_error_from_errno (errno),
+                           C_("benchmarking", "Error seeking to offset %lld"),
+                           (long long int) offset);
+              goto out;
+            }
+          if (read (fd, buffer, page_size) != page_size)
+            {
+              g_set_error (error,
+                           G_IO_ERROR,
+                           g_io_error_from_errno (errno),
+                           C_("benchmarking", "Error pre-reading %lld bytes from offset %lld"),
+                           (long long int) page_size,
+                           (long long int) offset);
+              goto out;
+            }
+          if (lseek (fd, offset, SEEK_SET) != offset)
+            {
+              g_set_error (error,
+                           G_IO_ERROR,
+                           g_io_error_from_errno (errno),
+                           C_("benchmarking", "Error seeking to offset %lld"),
+                           (long long int) offset);
+              goto out;
+            }
+          begin_usec = g_get_monotonic_time ();
+          num_written = write (fd, buffer, num_read);
+          if (G_UNLIKELY (num_written < 0))
+            {
+              g_set_error (error,
+                           G_IO_ERROR,
+                           g_io_error_from_errno (errno),
+                           C_("benchmarking", "Error writing %lld bytes at offset %lld: %m"),
+                           (long long int) num_read,
+                           (long long int) offset);
+              goto out;
+            }
+          if (num_written != num_read)
+            {
+              g_set_error (error,
+                           G_IO_ERROR,
+                           g_io_error_from_errno (errno),
+                           C_("benchmarking", "Expected to write %lld bytes, only wrote %lld: %m"),
+                           (long long int) num_read,
+                           (long long int) num_written);
+              goto out;
+            }
+          if (fsync (fd) != 0)
+            {
+              g_set_error (error,
+                           G_IO_ERROR,
+                           g_io_error_from_errno (errno),
+                           C_("benchmarking", "Error syncing (at offset %lld): %m"),
+                           (long long int) offset);
+              goto out;
+            }
+          end_usec = g_get_monotonic_time ();
+
+          sample.offset = offset;
+          sample.value = ((gdouble) G_USEC_PER_SEC) * num_written / (end_usec - begin_usec);
+          sample_func (GDU_BENCHMARK_SAMPLE_TYPE_WRITE, &sample, user_data);
+        }
+    }
+
+  /* access time... */
+  rand = g_rand_new_with_seed (42); /* want this to be deterministic (per size) so it's repeatable */
+  for (n = 0; n < params->num_access_samples; n++)
+    {
+      gint64 begin_usec;
+      gint64 end_usec;
+      gint64 offset;
+      ssize_t num_read;
+      GduBenchmarkSample sample = {0};
+
+      if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        goto out;
+
+      offset = (guint64) g_rand_double_range (rand, 0, (gdouble) disk_size);
+      offset &= ~(page_size - 1);
+
+      if (lseek (fd, offset, SEEK_SET) != offset)
+        {
+          g_set_error (error,
+                       G_IO_ERROR,
+                       g_io_error_from_errno (errno),
+                       C_("benchmarking", "Error seeking to offset %lld: %m"),
+                       (long long int) offset);
+          goto out;
+        }
+
+      begin_usec = g_get_monotonic_time ();
+      num_read = read (fd, buffer, page_size);
+      if (G_UNLIKELY (num_read < 0))
+        {
+          g_set_error (error,
+                       G_IO_ERROR,
+                       g_io_error_from_errno (errno),
+                       C_("benchmarking", "Error reading %lld bytes from offset %lld"),
+                       (long long int) page_size,
+                       (long long int) offset);
+          goto out;
+        }
+      end_usec = g_get_monotonic_time ();
+
+      sample.offset = offset;
+      sample.value = (end_usec - begin_usec) / ((gdouble) G_USEC_PER_SEC);
+      sample_func (GDU_BENCHMARK_SAMPLE_TYPE_ACCESS_TIME, &sample, user_data);
+    }
+
+  ret = TRUE;
+
+ out:
+  if (rand != NULL)
+    g_rand_free (rand);
+  g_free (buffer_unaligned);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  gint fd;
+  guint64 disk_size;
+  gsize chunk_size;
+  long page_size;
+  GduBenchmarkSampleFunc sample_func;
+  gpointer user_data;
+  GCancellable *cancellable;
+
+  /* must hold lock when reading/writing these */
+  GMutex lock;
+  guint64 next_offset;
+  gint64 last_completion_usec;
+  GError *error;
+} ScanData;
+
+/* Reads chunks until the whole device is done, an error occurs or
+ * the scan is cancelled. Runs in two threads at the same time so the
+ * next request is already queued when the current one completes.
+ */
+static gpointer
+scan_thread (gpointer user_data)
+{
+  ScanData *data = user_data;
+  guchar *buffer_unaligned;
+  guchar *buffer;
+
+  buffer_unaligned = g_new0 (guchar, data->chunk_size + data->page_size);
+  buffer = (guchar*) (((gintptr) (buffer_unaligned + data->page_size)) & (~(data->page_size - 1)));
+
+  while (TRUE)
+    {
+      GduBenchmarkSample sample = {0};
+      GError *error = NULL;
+      guint64 offset;
+      gsize size;
+      gint64 begin_usec;
+      gint64 end_usec;
+      ssize_t num_read;
+      gsize pos;
+
+      g_mutex_lock (&data->lock);
+      if (data->error != NULL || data->next_offset >= data->disk_size)
+        {
+          g_mutex_unlock (&data->lock);
+          break;
+        }
+      if (g_cancellable_set_error_if_cancelled (data->cancellable, &data->error))
+        {
+          g_mutex_unlock (&data->lock);
+          break;
+        }
+      offset = data->next_offset;
+      size = MIN (data->chunk_size, data->disk_size - offset);
+      data->next_offset += size;
+      g_mutex_unlock (&data->lock);
+
+      /* next_offset has already moved past the whole chunk so all of it must be read */
+      begin_usec = g_get_monotonic_time ();
+      pos = 0;
+      while (pos < size)
+        {
+          num_read = pread (data->fd, buffer + pos, size - pos, offset + pos);
+          if (G_UNLIKELY (num_read <= 0))
+            {
+              gchar *s, *s2;
+              if (num_read < 0 && errno == EINTR)
+                continue;
+              s = g_format_size_full (size - pos, G_FORMAT_SIZE_LONG_FORMAT);
+              s2 = g_format_size_full (offset + pos, G_FORMAT_SIZE_LONG_FORMAT);
+              g_set_error (&error,
+                           G_IO_ERROR,
+                           num_read < 0 ? g_io_error_from_errno (errno) : G_IO_ERROR_FAILED,
+                           C_("benchmarking", "Error reading %s from offset %s"),
+                           s, s2);
+              g_free (s2);
+              g_free (s);
+              break;
+            }
+          pos += num_read;
+        }
+      end_usec = g_get_monotonic_time ();
+
+      g_mutex_lock (&data->lock);
+      if (error != NULL)
+        {
+          if (data->error == NULL)
+            data->error = error;
+          else
+            g_error_free (error);
+          g_mutex_unlock (&data->lock);
+          break;
+        }
+      /* With two requests in flight the time between completions is
+       * what the device needed for this chunk
+       */
+      sample.offset = offset;
+      sample.value = ((gdouble) G_USEC_PER_SEC) * size /
+        MAX (end_usec - MAX (begin_usec, data->last_completion_usec), 1);
+      data->last_completion_usec = end_usec;
+      data->sample_func (GDU_BENCHMARK_SAMPLE_TYPE_READ, &sample, data->user_data);
+      g_mutex_unlock (&data->lock);
+    }
+
+  g_free (buffer_unaligned);
+  return NULL;
+}
+
+/**
+ * gdu_benchmark_scan:
+ * @fd: A file descriptor obtained from gdu_benchmark_open_device().
+ * @disk_size: The size of the device as returned by gdu_benchmark_get_device_size().
+ * @chunk_size_mib: The size of each read in MiB.
+ * @sample_func: Function to call for every chunk read.
+ * @user_data: User data to pass to @sample_func.
+ * @cancellable: A #GCancellable or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Reads the entire device sequentially in chunks of @chunk_size_mib
+ * and reports the transfer rate of each chunk as a
+ * %GDU_BENCHMARK_SAMPLE_TYPE_READ sample. Two reads are kept in
+ * flight so the device is never idle waiting for the next request.
+ *
+ * This blocks the calling thread for the duration of the scan.
+ * @sample_func may be invoked from a helper thread but never
+ * concurrently and samples are not necessarily reported in offset
+ * order.
+ *
+ * Returns: %TRUE if the whole device was read, %FALSE if @error is set.
+ */
+gboolean
+gdu_benchmark_scan (gint                     fd,
+                    guint64                  disk_size,
+                    gint                     chunk_size_mib,
+                    GduBenchmarkSampleFunc   sample_func,
+                    gpointer                 user_data,
+                    GCancellable            *cancellable,
+                    GError                 **error)
+{
+  ScanData data = {0};
+  GThread *thread;
+
+  data.page_size = sysconf (_SC_PAGESIZE);
+  if (data.page_size < 1)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (errno),
+                   C_("benchmarking", "Error getting page size: %m\n"));
+      return FALSE;
+    }
+
+  data.fd = fd;
+  data.disk_size = disk_size;
+  data.chunk_size = ((gsize) chunk_size_mib) * 1024 * 1024;
+  data.sample_func = sample_func;
+  data.user_data = user_data;
+  data.cancellable = cancellable;
+  g_mutex_init (&data.lock);
+
+  thread = g_thread_new ("scan-thread", scan_thread, &data);
+  scan_thread (&data);
+  g_thread_join (thread);
+
+  g_mutex_clear (&data.lock);
+
+  if (data.error != NULL)
+    {
+      g_propagate_error (error, data.error);
+      return FALSE;
+    }
+  return TRUE;
+}
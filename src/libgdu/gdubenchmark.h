@@ -0,0 +1,63 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_BENCHMARK_H__
+#define __GDU_BENCHMARK_H__
+
+#include "libgdutypes.h"
+
+G_BEGIN_DECLS
+
+typedef struct
+{
+  guint64 offset;
+  gdouble value;
+} GduBenchmarkSample;
+
+typedef struct
+{
+  gint     num_samples;
+  gint     sample_size_mib;
+  gboolean do_write;
+  gint     num_access_samples;
+} GduBenchmarkParams;
+
+/* Called from the thread running gdu_benchmark_run() for every sample taken */
+typedef void (*GduBenchmarkSampleFunc) (GduBenchmarkSampleType    type,
+                                        const GduBenchmarkSample *sample,
+                                        gpointer                  user_data);
+
+gint     gdu_benchmark_open_device     (UDisksBlock               *block,
+                                        gboolean                   writable,
+                                        GCancellable              *cancellable,
+                                        GError                   **error);
+
+gboolean gdu_benchmark_get_device_size (gint                       fd,
+                                        guint64                   *out_size,
+                                        GError                   **error);
+
+gboolean gdu_benchmark_run             (gint                       fd,
+                                        guint64                    disk_size,
+                                        const GduBenchmarkParams  *params,
+                                        GduBenchmarkSampleFunc     sample_func,
+                                        gpointer                   user_data,
+                                        GCancellable              *cancellable,
+                                        GError                   **error);
+
+gboolean gdu_benchmark_scan            (gint                       fd,
+                                        guint64                    disk_size,
+                                        gint                       chunk_size_mib,
+                                        GduBenchmarkSampleFunc     sample_func,
+                                        gpointer                   user_data,
+                                        GCancellable              *cancellable,
+                                        GError                   **error);
+
+G_END_DECLS
+
+#endif /* __GDU_BENCHMARK_H__ */
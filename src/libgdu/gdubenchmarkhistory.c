@@ -0,0 +1,443 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "gdubenchmarkhistory.h"
+
+/* The history file is a 16 byte header followed by records that are
+ * only ever appended. Each record is an 8 byte header (little-endian
+ * guint32 size of the payload and a guint32 reserved for flags)
+ * followed by the payload, a serialized a{sv} in the same format as
+ * the .gnome-disks-benchmark files, padded to a multiple of 8 bytes.
+ *
+ * Since all records start at 8 byte aligned offsets the file can be
+ * mapped and the runs handed out as GVariants without copying. A
+ * truncated record or header at the end (e.g. from a crash while
+ * appending) is ignored and cut off by the next append.
+ */
+
+#define HISTORY_MAGIC        "GDUBMHST"
+#define HISTORY_VERSION      1
+#define HISTORY_HEADER_SIZE  16
+#define RECORD_HEADER_SIZE   8
+#define RECORD_ALIGN         8
+
+/* A change is only flagged if it's significant at the 99% level (two-sided,
+ * normal approximation of Welch's t-test) and bigger than 5%. The latter
+ * keeps large sample counts from flagging differences nobody would notice.
+ */
+#define REGRESSION_T_THRESHOLD       2.576
+#define REGRESSION_CHANGE_THRESHOLD  0.05
+
+struct _GduBenchmarkHistory
+{
+  GMappedFile *mapped_file;
+  GBytes *bytes;
+  GArray *offsets; /* of gsize, offset of each record's payload */
+  GArray *sizes;   /* of gsize, size of each record's payload */
+};
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * gdu_benchmark_history_load:
+ * @filename: The history file to load.
+ * @error: Return location for error or %NULL.
+ *
+ * Maps @filename and indexes the runs stored in it. A missing file is
+ * treated as an empty history.
+ *
+ * Returns: A #GduBenchmarkHistory (free with gdu_benchmark_history_free()) or %NULL if @error is set.
+ */
+GduBenchmarkHistory *
+gdu_benchmark_history_load (const gchar  *filename,
+                            GError      **error)
+{
+  GduBenchmarkHistory *history;
+  GError *local_error = NULL;
+  const guchar *data;
+  gsize size;
+  gsize offset;
+
+  history = g_new0 (GduBenchmarkHistory, 1);
+  history->offsets = g_array_new (FALSE, FALSE, sizeof (gsize));
+  history->sizes = g_array_new (FALSE, FALSE, sizeof (gsize));
+
+  history->mapped_file = g_mapped_file_new (filename, FALSE, &local_error);
+  if (history->mapped_file == NULL)
+    {
+      if (local_error->domain == G_FILE_ERROR && local_error->code == G_FILE_ERROR_NOENT)
+        {
+          /* don't complain about a missing file */
+          g_clear_error (&local_error);
+          goto out;
+        }
+      g_propagate_error (error, local_error);
+      gdu_benchmark_history_free (history);
+      history = NULL;
+      goto out;
+    }
+
+  history->bytes = g_mapped_file_get_bytes (history->mapped_file);
+  data = g_bytes_get_data (history->bytes, &size);
+  /* also covers a header cut short by a crash */
+  if (size < HISTORY_HEADER_SIZE)
+    goto out;
+
+  if (memcmp (data, HISTORY_MAGIC, strlen (HISTORY_MAGIC)) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   C_("benchmark-history", "%s is not a benchmark history file"), filename);
+      gdu_benchmark_history_free (history);
+      history = NULL;
+      goto out;
+    }
+  if (GUINT32_FROM_LE (*((const guint32 *) (data + 8))) != HISTORY_VERSION)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   C_("benchmark-history", "Cannot decode version %d history"),
+                   GUINT32_FROM_LE (*((const guint32 *) (data + 8))));
+      gdu_benchmark_history_free (history);
+      history = NULL;
+      goto out;
+    }
+
+  offset = HISTORY_HEADER_SIZE;
+  while (offset + RECORD_HEADER_SIZE <= size)
+    {
+      gsize record_size;
+      gsize payload_offset;
+
+      record_size = GUINT32_FROM_LE (*((const guint32 *) (data + offset)));
+      payload_offset = offset + RECORD_HEADER_SIZE;
+      if (record_size > size - payload_offset)
+        break;
+
+      g_array_append_val (history->offsets, payload_offset);
+      g_array_append_val (history->sizes, record_size);
+
+      offset = payload_offset + record_size;
+      offset = (offset + RECORD_ALIGN - 1) & ~((gsize) RECORD_ALIGN - 1);
+    }
+
+ out:
+  return history;
+}
+
+/**
+ * gdu_benchmark_history_free:
+ * @history: A #GduBenchmarkHistory.
+ *
+ * Frees @history and unmaps the underlying file once all runs
+ * returned by gdu_benchmark_history_get_run() have been freed.
+ */
+void
+gdu_benchmark_history_free (GduBenchmarkHistory *history)
+{
+  if (history->bytes != NULL)
+    g_bytes_unref (history->bytes);
+  if (history->mapped_file != NULL)
+    g_mapped_file_unref (history->mapped_file);
+  g_array_unref (history->offsets);
+  g_array_unref (history->sizes);
+  g_free (history);
+}
+
+/**
+ * gdu_benchmark_history_get_n_runs:
+ * @history: A #GduBenchmarkHistory.
+ *
+ * Returns: The number of runs in @history.
+ */
+guint
+gdu_benchmark_history_get_n_runs (GduBenchmarkHistory *history)
+{
+  return history->offsets->len;
+}
+
+/**
+ * gdu_benchmark_history_get_run:
+ * @history: A #GduBenchmarkHistory.
+ * @index: The index of the run, oldest first.
+ *
+ * Gets a run without copying it out of the mapped file.
+ *
+ * Returns: A #GVariant of type a{sv}. Free with g_variant_unref().
+ */
+GVariant *
+gdu_benchmark_history_get_run (GduBenchmarkHistory *history,
+                               guint                index)
+{
+  GBytes *bytes;
+  GVariant *ret;
+
+  g_return_val_if_fail (index < history->offsets->len, NULL);
+
+  bytes = g_bytes_new_from_bytes (history->bytes,
+                                  g_array_index (history->offsets, gsize, index),
+                                  g_array_index (history->sizes, gsize, index));
+  ret = g_variant_new_from_bytes (G_VARIANT_TYPE_VARDICT, bytes, FALSE);
+  g_bytes_unref (bytes);
+  return g_variant_ref_sink (ret);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Returns the size of the valid part of the file, i.e. without a
+ * truncated record at the end, or 0 if even the header is incomplete
+ */
+static gboolean
+get_valid_size (gint          fd,
+                const gchar  *filename,
+                gsize         size,
+                gsize        *out_valid_size,
+                GError      **error)
+{
+  guchar header[HISTORY_HEADER_SIZE];
+  gsize offset;
+
+  *out_valid_size = 0;
+  if (size < HISTORY_HEADER_SIZE)
+    return TRUE;
+
+  if (pread (fd, header, HISTORY_HEADER_SIZE, 0) != HISTORY_HEADER_SIZE)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   C_("benchmark-history", "Error reading from %s: %m"), filename);
+      return FALSE;
+    }
+  if (memcmp (header, HISTORY_MAGIC, strlen (HISTORY_MAGIC)) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   C_("benchmark-history", "%s is not a benchmark history file"), filename);
+      return FALSE;
+    }
+  if (GUINT32_FROM_LE (*((const guint32 *) (header + 8))) != HISTORY_VERSION)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   C_("benchmark-history", "Cannot decode version %d history"),
+                   GUINT32_FROM_LE (*((const guint32 *) (header + 8))));
+      return FALSE;
+    }
+
+  /* same walk as in gdu_benchmark_history_load() */
+  offset = HISTORY_HEADER_SIZE;
+  while (offset + RECORD_HEADER_SIZE <= size)
+    {
+      guint32 u32;
+      gsize record_size;
+      gsize payload_offset;
+
+      if (pread (fd, &u32, sizeof u32, offset) != sizeof u32)
+        {
+          g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                       C_("benchmark-history", "Error reading from %s: %m"), filename);
+          return FALSE;
+        }
+      record_size = GUINT32_FROM_LE (u32);
+      payload_offset = offset + RECORD_HEADER_SIZE;
+      if (record_size > size - payload_offset)
+        break;
+
+      offset = payload_offset + record_size;
+      offset = (offset + RECORD_ALIGN - 1) & ~((gsize) RECORD_ALIGN - 1);
+    }
+
+  /* may be past the end of the file if only the padding is missing - it's restored by the truncation */
+  *out_valid_size = offset;
+  return TRUE;
+}
+
+/**
+ * gdu_benchmark_history_append:
+ * @filename: The history file to append to.
+ * @run: A #GVariant of type a{sv} describing the run.
+ * @error: Return location for error or %NULL.
+ *
+ * Appends @run to @filename, creating the file if needed.
+ *
+ * Returns: %TRUE if @run was appended, %FALSE if @error is set.
+ */
+gboolean
+gdu_benchmark_history_append (const gchar  *filename,
+                              GVariant     *run,
+                              GError      **error)
+{
+  gboolean ret = FALSE;
+  GByteArray *buf;
+  GVariant *normal = NULL;
+  struct stat statbuf;
+  gsize valid_size;
+  guint32 u32;
+  gsize size;
+  gint fd;
+
+  fd = g_open (filename, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+  if (fd == -1)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   C_("benchmark-history", "Error opening %s: %m"), filename);
+      goto out;
+    }
+
+  /* serializes concurrent writers */
+  if (flock (fd, LOCK_EX) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   C_("benchmark-history", "Error locking %s: %m"), filename);
+      goto out;
+    }
+
+  if (fstat (fd, &statbuf) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   C_("benchmark-history", "Error getting information about %s: %m"), filename);
+      goto out;
+    }
+
+  /* cut off whatever a crash while appending left behind so the new record is readable */
+  if (!get_valid_size (fd, filename, statbuf.st_size, &valid_size, error))
+    goto out;
+  if (valid_size != (gsize) statbuf.st_size && ftruncate (fd, valid_size) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   C_("benchmark-history", "Error truncating %s: %m"), filename);
+      goto out;
+    }
+
+  buf = g_byte_array_new ();
+  if (valid_size == 0)
+    {
+      g_byte_array_append (buf, (const guint8 *) HISTORY_MAGIC, strlen (HISTORY_MAGIC));
+      u32 = GUINT32_TO_LE (HISTORY_VERSION);
+      g_byte_array_append (buf, (const guint8 *) &u32, sizeof u32);
+      u32 = 0;
+      g_byte_array_append (buf, (const guint8 *) &u32, sizeof u32);
+    }
+
+  normal = g_variant_get_normal_form (run);
+  size = g_variant_get_size (normal);
+  u32 = GUINT32_TO_LE (size);
+  g_byte_array_append (buf, (const guint8 *) &u32, sizeof u32);
+  u32 = 0;
+  g_byte_array_append (buf, (const guint8 *) &u32, sizeof u32);
+  g_byte_array_append (buf, g_variant_get_data (normal), size);
+  while (buf->len % RECORD_ALIGN != 0)
+    {
+      guint8 zero = 0;
+      g_byte_array_append (buf, &zero, 1);
+    }
+
+  if (pwrite (fd, buf->data, buf->len, valid_size) != (ssize_t) buf->len)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   C_("benchmark-history", "Error writing to %s: %m"), filename);
+      g_byte_array_unref (buf);
+      goto out;
+    }
+  g_byte_array_unref (buf);
+
+  ret = TRUE;
+
+ out:
+  if (normal != NULL)
+    g_variant_unref (normal);
+  if (fd != -1)
+    close (fd);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+get_mean_variance (const gdouble *values,
+                   guint          num_values,
+                   gdouble       *out_mean,
+                   gdouble       *out_variance)
+{
+  gdouble sum = 0.0;
+  gdouble sum_sq = 0.0;
+  gdouble mean;
+  guint n;
+
+  for (n = 0; n < num_values; n++)
+    sum += values[n];
+  mean = sum / num_values;
+  for (n = 0; n < num_values; n++)
+    sum_sq += (values[n] - mean) * (values[n] - mean);
+
+  *out_mean = mean;
+  *out_variance = sum_sq / (num_values - 1);
+}
+
+/**
+ * gdu_benchmark_is_regression:
+ * @baseline: Samples from previous runs.
+ * @num_baseline: Number of elements in @baseline.
+ * @current: Samples from the run to check.
+ * @num_current: Number of elements in @current.
+ * @higher_is_better: %TRUE for transfer rates, %FALSE for access times.
+ * @out_change: Return location for the relative change of the mean or %NULL.
+ *
+ * Checks whether @current is significantly worse than @baseline using
+ * Welch's t-test.
+ *
+ * Returns: %TRUE if @current is a regression.
+ */
+gboolean
+gdu_benchmark_is_regression (const gdouble *baseline,
+                             guint          num_baseline,
+                             const gdouble *current,
+                             guint          num_current,
+                             gboolean       higher_is_better,
+                             gdouble       *out_change)
+{
+  gdouble baseline_mean, baseline_var;
+  gdouble current_mean, current_var;
+  gdouble change;
+  gdouble se;
+  gdouble t;
+
+  if (out_change != NULL)
+    *out_change = 0.0;
+
+  if (num_baseline < 2 || num_current < 2)
+    return FALSE;
+
+  get_mean_variance (baseline, num_baseline, &baseline_mean, &baseline_var);
+  get_mean_variance (current, num_current, &current_mean, &current_var);
+  if (baseline_mean == 0.0)
+    return FALSE;
+
+  change = (current_mean - baseline_mean) / baseline_mean;
+  if (out_change != NULL)
+    *out_change = change;
+
+  if (higher_is_better ? change > -REGRESSION_CHANGE_THRESHOLD : change < REGRESSION_CHANGE_THRESHOLD)
+    return FALSE;
+
+  se = sqrt (baseline_var / num_baseline + current_var / num_current);
+  if (se == 0.0)
+    return TRUE;
+  t = fabs (current_mean - baseline_mean) / se;
+
+  return t > REGRESSION_T_THRESHOLD;
+}
@@ -0,0 +1,39 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_BENCHMARK_HISTORY_H__
+#define __GDU_BENCHMARK_HISTORY_H__
+
+#include "libgdutypes.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GduBenchmarkHistory GduBenchmarkHistory;
+
+GduBenchmarkHistory *gdu_benchmark_history_load        (const gchar          *filename,
+                                                        GError              **error);
+void                 gdu_benchmark_history_free        (GduBenchmarkHistory  *history);
+guint                gdu_benchmark_history_get_n_runs  (GduBenchmarkHistory  *history);
+GVariant            *gdu_benchmark_history_get_run     (GduBenchmarkHistory  *history,
+                                                        guint                 index);
+
+gboolean             gdu_benchmark_history_append      (const gchar          *filename,
+                                                        GVariant             *run,
+                                                        GError              **error);
+
+gboolean             gdu_benchmark_is_regression       (const gdouble        *baseline,
+                                                        guint                 num_baseline,
+                                                        const gdouble        *current,
+                                                        guint                 num_current,
+                                                        gboolean              higher_is_better,
+                                                        gdouble              *out_change);
+
+G_END_DECLS
+
+#endif /* __GDU_BENCHMARK_HISTORY_H__ */
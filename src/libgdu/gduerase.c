@@ -0,0 +1,568 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+
+#include <glib/gi18n.h>
+#include <gio/gunixfdlist.h>
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#include "gduerase.h"
+
+/* The ioctls are handed big spans so the kernel and the device can do
+ * the work on their own. Spans are still limited so progress can be
+ * reported and cancellation doesn't take forever.
+ */
+#define ERASE_SPAN_SIZE   (1024ULL * 1024 * 1024)
+
+/* The size of each write if the device has to be overwritten by hand */
+#define ERASE_WRITE_SIZE  (4 * 1024 * 1024)
+
+/* After discarding or zeroing a span, this much is read back at its
+ * start, middle and end to check that it now reads as zeroes
+ */
+#define ERASE_CHECK_SIZE  4096
+
+/* Verification reads enough random blocks that, if at least
+ * VERIFY_MISSED_FRACTION of the device wasn't erased, the chance of not
+ * noticing is below VERIFY_ERROR_PROBABILITY. That's about 14000 reads
+ * regardless of the size of the device.
+ */
+#define VERIFY_SAMPLE_SIZE        4096
+#define VERIFY_MISSED_FRACTION    0.001
+#define VERIFY_ERROR_PROBABILITY  1e-6
+
+/* Areas where partition tables and filesystem or RAID superblocks
+ * live are always read in full
+ */
+#define VERIFY_METADATA_SIZE      (1024 * 1024)
+
+/* The number of reads in flight at the same time */
+#define VERIFY_QUEUE_DEPTH        8
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * gdu_erase_open_device:
+ * @block: The block device to open.
+ * @cancellable: A #GCancellable or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Asks udisks to open @block exclusively for reading and writing,
+ * bypassing the page cache. This blocks the calling thread so it
+ * should be used from a worker thread.
+ *
+ * Returns: A file descriptor (free with close()) or -1 if @error is set.
+ */
+gint
+gdu_erase_open_device (UDisksBlock   *block,
+                       GCancellable  *cancellable,
+                       GError       **error)
+{
+  GVariantBuilder options_builder;
+  GVariant *fd_index = NULL;
+  GUnixFDList *fd_list = NULL;
+  gint fd = -1;
+
+  g_variant_builder_init (&options_builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&options_builder, "{sv}", "flags", g_variant_new_int32 (O_DIRECT | O_EXCL | O_CLOEXEC));
+
+  if (!udisks_block_call_open_device_sync (block,
+                                           "rw",
+                                           g_variant_builder_end (&options_builder),
+                                           NULL, /* fd_list */
+                                           &fd_index,
+                                           &fd_list,
+                                           cancellable,
+                                           error))
+    goto out;
+
+  fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (fd_index), error);
+
+ out:
+  g_clear_object (&fd_list);
+  if (fd_index != NULL)
+    g_variant_unref (fd_index);
+  return fd;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gboolean
+is_unsupported_errno (int errsv)
+{
+  return errsv == EOPNOTSUPP || errsv == ENOTTY || errsv == EINVAL;
+}
+
+static gboolean
+buffer_is_zero (const guchar *buffer,
+                gsize         size)
+{
+  const guint64 *p = (const guint64 *) buffer;
+  guint64 acc = 0;
+  gsize n;
+
+  /* buffer is page-aligned and size a multiple of 8. There's no early
+   * exit so the compiler can vectorize the loop - the common case is a
+   * buffer of zeroes which has to be scanned completely anyway.
+   */
+  for (n = 0; n < size / sizeof (guint64); n++)
+    acc |= p[n];
+  return acc == 0;
+}
+
+/* Checks whether the start, middle and end of the span read as zeroes */
+static gboolean
+check_span_is_zero (gint          fd,
+                    guchar       *buffer,
+                    guint64       offset,
+                    guint64       size,
+                    gboolean     *out_is_zero,
+                    GError      **error)
+{
+  guint64 check_offsets[3];
+  guint n;
+
+  check_offsets[0] = offset;
+  check_offsets[1] = offset + (size / 2 / ERASE_CHECK_SIZE) * ERASE_CHECK_SIZE;
+  check_offsets[2] = offset + size - MIN (size, ERASE_CHECK_SIZE);
+
+  *out_is_zero = FALSE;
+  for (n = 0; n < G_N_ELEMENTS (check_offsets); n++)
+    {
+      gsize check_size = MIN (ERASE_CHECK_SIZE, offset + size - check_offsets[n]);
+      ssize_t num_read;
+
+    read_again:
+      num_read = pread (fd, buffer, check_size, check_offsets[n]);
+      if (num_read < 0)
+        {
+          if (errno == EAGAIN || errno == EINTR)
+            goto read_again;
+          g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                       C_("erase", "Error reading %" G_GSIZE_FORMAT " bytes from offset %" G_GUINT64_FORMAT ": %m"),
+                       check_size, check_offsets[n]);
+          return FALSE;
+        }
+      if ((gsize) num_read != check_size || !buffer_is_zero (buffer, check_size))
+        return TRUE;
+    }
+  *out_is_zero = TRUE;
+  return TRUE;
+}
+
+/* Reports progress after every write since this is slow enough that a
+ * whole span can take a minute on e.g. a USB disk
+ */
+static gboolean
+write_zeroes (gint                   fd,
+              guchar                *buffer,
+              guint64                offset,
+              guint64                size,
+              GduEraseProgressFunc   progress_func,
+              gpointer               user_data,
+              GCancellable          *cancellable,
+              GError               **error)
+{
+  guint64 pos = 0;
+
+  memset (buffer, 0, ERASE_WRITE_SIZE);
+  while (pos < size)
+    {
+      gsize to_write = MIN (ERASE_WRITE_SIZE, size - pos);
+      ssize_t num_written;
+
+      if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        return FALSE;
+
+    write_again:
+      num_written = pwrite (fd, buffer, to_write, offset + pos);
+      if (num_written < 0)
+        {
+          if (errno == EAGAIN || errno == EINTR)
+            goto write_again;
+          g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                       C_("erase", "Error writing %" G_GSIZE_FORMAT " bytes to offset %" G_GUINT64_FORMAT ": %m"),
+                       to_write, offset + pos);
+          return FALSE;
+        }
+      pos += num_written;
+
+      progress_func (offset + pos, GDU_ERASE_METHOD_WRITE, user_data);
+    }
+  return TRUE;
+}
+
+/* Erases the span using *method, falling back to slower methods and
+ * updating *method if the device doesn't support it
+ */
+static gboolean
+erase_span (gint                   fd,
+            GduEraseMethod        *method,
+            guchar                *buffer,
+            guint64                offset,
+            guint64                size,
+            GduEraseProgressFunc   progress_func,
+            gpointer               user_data,
+            GCancellable          *cancellable,
+            GError               **error)
+{
+  guint64 range[2];
+  gboolean is_zero;
+
+  range[0] = offset;
+  range[1] = size;
+
+  switch (*method)
+    {
+    case GDU_ERASE_METHOD_SECURE_DISCARD:
+    case GDU_ERASE_METHOD_DISCARD:
+      if (ioctl (fd, *method == GDU_ERASE_METHOD_SECURE_DISCARD ? BLKSECDISCARD : BLKDISCARD, range) != 0)
+        {
+          if (!is_unsupported_errno (errno))
+            goto ioctl_error;
+          *method = (*method == GDU_ERASE_METHOD_SECURE_DISCARD) ? GDU_ERASE_METHOD_DISCARD : GDU_ERASE_METHOD_ZERO_OUT;
+          return erase_span (fd, method, buffer, offset, size, progress_func, user_data, cancellable, error);
+        }
+      /* Discarded blocks aren't guaranteed to read back as zeroes - if
+       * they don't, zero them and don't bother discarding from now on
+       */
+      if (!check_span_is_zero (fd, buffer, offset, size, &is_zero, error))
+        return FALSE;
+      if (is_zero)
+        return TRUE;
+      *method = GDU_ERASE_METHOD_ZERO_OUT;
+      return erase_span (fd, method, buffer, offset, size, progress_func, user_data, cancellable, error);
+
+    case GDU_ERASE_METHOD_ZERO_OUT:
+      /* uses e.g. WRITE ZEROES if supported by the device - otherwise the kernel writes the zeroes */
+      if (ioctl (fd, BLKZEROOUT, range) != 0)
+        {
+          if (!is_unsupported_errno (errno))
+            goto ioctl_error;
+          *method = GDU_ERASE_METHOD_WRITE;
+          return erase_span (fd, method, buffer, offset, size, progress_func, user_data, cancellable, error);
+        }
+      if (!check_span_is_zero (fd, buffer, offset, size, &is_zero, error))
+        return FALSE;
+      if (!is_zero)
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                       C_("erase", "Data at offset %" G_GUINT64_FORMAT " was not erased"),
+                       offset);
+          return FALSE;
+        }
+      return TRUE;
+
+    case GDU_ERASE_METHOD_WRITE:
+      return write_zeroes (fd, buffer, offset, size, progress_func, user_data, cancellable, error);
+
+    default:
+      g_assert_not_reached ();
+    }
+
+ ioctl_error:
+  g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+               C_("erase", "Error erasing %" G_GUINT64_FORMAT " bytes at offset %" G_GUINT64_FORMAT ": %m"),
+               size, offset);
+  return FALSE;
+}
+
+/**
+ * gdu_erase_run:
+ * @fd: A file descriptor from gdu_erase_open_device().
+ * @disk_size: The size of the device, see gdu_benchmark_get_device_size().
+ * @allow_discard: Whether blocks may be discarded instead of zeroed if the device reads them back as zeroes.
+ * @progress_func: Function to call with the progress.
+ * @user_data: User data to pass to @progress_func.
+ * @cancellable: A #GCancellable or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Overwrites all of @fd with zeroes using the fastest method the device
+ * supports - discarding (if allowed), offloading the zeroing to the
+ * device or, if everything else fails, writing zeroes. Blocks the
+ * calling thread.
+ *
+ * Returns: %TRUE if the device was erased, %FALSE if @error is set.
+ */
+gboolean
+gdu_erase_run (gint                   fd,
+               guint64                disk_size,
+               gboolean               allow_discard,
+               GduEraseProgressFunc   progress_func,
+               gpointer               user_data,
+               GCancellable          *cancellable,
+               GError               **error)
+{
+  gboolean ret = FALSE;
+  GduEraseMethod method;
+  guchar *buffer_unaligned = NULL;
+  guchar *buffer = NULL;
+  long page_size;
+  guint64 offset;
+
+  /* O_DIRECT needs an aligned buffer */
+  page_size = sysconf (_SC_PAGESIZE);
+  buffer_unaligned = g_new0 (guchar, ERASE_WRITE_SIZE + page_size);
+  buffer = (guchar*) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
+
+  method = allow_discard ? GDU_ERASE_METHOD_SECURE_DISCARD : GDU_ERASE_METHOD_ZERO_OUT;
+  offset = 0;
+  while (offset < disk_size)
+    {
+      guint64 size;
+
+      if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        goto out;
+
+      size = MIN (ERASE_SPAN_SIZE, disk_size - offset);
+      if (!erase_span (fd, &method, buffer, offset, size, progress_func, user_data, cancellable, error))
+        goto out;
+      offset += size;
+
+      progress_func (offset, method, user_data);
+    }
+
+  if (fsync (fd) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   C_("erase", "Error syncing device: %m"));
+      goto out;
+    }
+
+  ret = TRUE;
+
+ out:
+  g_free (buffer_unaligned);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct
+{
+  guint64 offset;
+  guint64 size;
+} VerifyRange;
+
+typedef struct
+{
+  gint fd;
+  GArray *ranges; /* of VerifyRange, sorted by offset */
+  GCancellable *cancellable;
+
+  gint next_range;     /* atomic */
+  gint stop;           /* atomic */
+
+  GMutex lock;
+  GError *error;       /* protected by lock, first error wins */
+} VerifyData;
+
+static void
+verify_add_range (GArray  *ranges,
+                  guint64  offset,
+                  guint64  size,
+                  guint64  disk_size)
+{
+  VerifyRange range;
+
+  if (offset >= disk_size)
+    return;
+  range.offset = offset;
+  range.size = MIN (size, disk_size - offset);
+  g_array_append_val (ranges, range);
+}
+
+static gint
+verify_range_compare (gconstpointer a,
+                      gconstpointer b)
+{
+  const VerifyRange *ra = a;
+  const VerifyRange *rb = b;
+  if (ra->offset < rb->offset)
+    return -1;
+  else if (ra->offset > rb->offset)
+    return 1;
+  return 0;
+}
+
+static GArray *
+verify_choose_ranges (guint64 disk_size)
+{
+  GArray *ranges;
+  guint64 num_blocks;
+  guint64 num_samples;
+  guint64 n;
+  GRand *rand;
+
+  ranges = g_array_new (FALSE, FALSE, sizeof (VerifyRange));
+
+  /* MBR, GPT, most superblocks, ZFS labels at the start... */
+  verify_add_range (ranges, 0, VERIFY_METADATA_SIZE, disk_size);
+  /* ... the backup GPT, MD RAID 0.90/1.0 superblocks and ZFS labels at the end ... */
+  if (disk_size > VERIFY_METADATA_SIZE)
+    verify_add_range (ranges, disk_size - VERIFY_METADATA_SIZE, VERIFY_METADATA_SIZE, disk_size);
+  /* ... and the btrfs superblock mirrors */
+  verify_add_range (ranges, 64ULL * 1024 * 1024, VERIFY_SAMPLE_SIZE, disk_size);
+  verify_add_range (ranges, 256ULL * 1024 * 1024 * 1024, VERIFY_SAMPLE_SIZE, disk_size);
+
+  num_blocks = disk_size / VERIFY_SAMPLE_SIZE;
+  num_samples = ceil (log (VERIFY_ERROR_PROBABILITY) / log1p (-VERIFY_MISSED_FRACTION));
+  num_samples = MIN (num_samples, num_blocks);
+
+  rand = g_rand_new ();
+  for (n = 0; n < num_samples; n++)
+    {
+      guint64 block;
+      /* g_rand_int_range() is limited to 32 bits */
+      block = ((((guint64) g_rand_int (rand)) << 32) | g_rand_int (rand)) % num_blocks;
+      verify_add_range (ranges, block * VERIFY_SAMPLE_SIZE, VERIFY_SAMPLE_SIZE, disk_size);
+    }
+  g_rand_free (rand);
+
+  /* reading in order is kinder to rotational media */
+  g_array_sort (ranges, verify_range_compare);
+
+  return ranges;
+}
+
+static void
+verify_set_error (VerifyData *data,
+                  GError     *error)
+{
+  g_mutex_lock (&data->lock);
+  if (data->error == NULL)
+    data->error = error;
+  else
+    g_error_free (error);
+  g_mutex_unlock (&data->lock);
+  g_atomic_int_set (&data->stop, 1);
+}
+
+static gpointer
+verify_thread (gpointer user_data)
+{
+  VerifyData *data = user_data;
+  guchar *buffer_unaligned;
+  guchar *buffer;
+  long page_size;
+
+  page_size = sysconf (_SC_PAGESIZE);
+  buffer_unaligned = g_new0 (guchar, VERIFY_METADATA_SIZE + page_size);
+  buffer = (guchar*) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
+
+  while (!g_atomic_int_get (&data->stop))
+    {
+      const VerifyRange *range;
+      guint64 pos;
+      gint index;
+
+      index = g_atomic_int_add (&data->next_range, 1);
+      if (index >= (gint) data->ranges->len)
+        break;
+      range = &g_array_index (data->ranges, VerifyRange, index);
+
+      if (g_cancellable_is_cancelled (data->cancellable))
+        {
+          GError *error = NULL;
+          g_cancellable_set_error_if_cancelled (data->cancellable, &error);
+          verify_set_error (data, error);
+          break;
+        }
+
+      pos = 0;
+      while (pos < range->size)
+        {
+          ssize_t num_read;
+
+          num_read = pread (data->fd, buffer, range->size - pos, range->offset + pos);
+          if (num_read < 0)
+            {
+              if (errno == EAGAIN || errno == EINTR)
+                continue;
+              verify_set_error (data, g_error_new (G_IO_ERROR, g_io_error_from_errno (errno),
+                                                   C_("erase", "Error reading %" G_GUINT64_FORMAT " bytes from offset %" G_GUINT64_FORMAT ": %m"),
+                                                   range->size - pos, range->offset + pos));
+              goto out;
+            }
+          if (num_read == 0 || !buffer_is_zero (buffer, num_read))
+            {
+              verify_set_error (data, g_error_new (G_IO_ERROR, G_IO_ERROR_FAILED,
+                                                   C_("erase", "Data at offset %" G_GUINT64_FORMAT " was not erased"),
+                                                   range->offset + pos));
+              goto out;
+            }
+          pos += num_read;
+        }
+    }
+
+ out:
+  g_free (buffer_unaligned);
+  return NULL;
+}
+
+/**
+ * gdu_erase_verify:
+ * @fd: A file descriptor from gdu_erase_open_device().
+ * @disk_size: The size of the device, see gdu_benchmark_get_device_size().
+ * @cancellable: A #GCancellable or %NULL.
+ * @error: Return location for error or %NULL.
+ *
+ * Checks that an erased device reads back as zeroes. Instead of reading
+ * the whole device, the areas holding partition tables and superblocks
+ * are read along with enough randomly chosen blocks to make it very
+ * unlikely that a significant part of the device was missed - e.g.
+ * because it ignored discard requests. Several reads are kept in flight
+ * at the same time. Blocks the calling thread.
+ *
+ * Returns: %TRUE if all checked blocks are zero, %FALSE if @error is set.
+ */
+gboolean
+gdu_erase_verify (gint           fd,
+                  guint64        disk_size,
+                  GCancellable  *cancellable,
+                  GError       **error)
+{
+  VerifyData data = {0};
+  GThread *threads[VERIFY_QUEUE_DEPTH];
+  gboolean ret = FALSE;
+  guint n;
+
+  data.fd = fd;
+  data.ranges = verify_choose_ranges (disk_size);
+  data.cancellable = cancellable;
+  g_mutex_init (&data.lock);
+
+  for (n = 0; n < VERIFY_QUEUE_DEPTH; n++)
+    threads[n] = g_thread_new ("erase-verify-thread", verify_thread, &data);
+  for (n = 0; n < VERIFY_QUEUE_DEPTH; n++)
+    g_thread_join (threads[n]);
+
+  if (data.error != NULL)
+    {
+      g_propagate_error (error, data.error);
+      goto out;
+    }
+
+  ret = TRUE;
+
+ out:
+  g_mutex_clear (&data.lock);
+  g_array_unref (data.ranges);
+  return ret;
+}
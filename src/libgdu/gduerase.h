@@ -0,0 +1,43 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_ERASE_H__
+#define __GDU_ERASE_H__
+
+#include "libgdutypes.h"
+
+G_BEGIN_DECLS
+
+/* Called from the thread running gdu_erase_run() every time a span has been
+ * erased, or after every write if the zeroes have to be written by hand
+ */
+typedef void (*GduEraseProgressFunc) (guint64         bytes_erased,
+                                      GduEraseMethod  method,
+                                      gpointer        user_data);
+
+gint     gdu_erase_open_device (UDisksBlock           *block,
+                                GCancellable          *cancellable,
+                                GError               **error);
+
+gboolean gdu_erase_run         (gint                   fd,
+                                guint64                disk_size,
+                                gboolean               allow_discard,
+                                GduEraseProgressFunc   progress_func,
+                                gpointer               user_data,
+                                GCancellable          *cancellable,
+                                GError               **error);
+
+gboolean gdu_erase_verify      (gint                   fd,
+                                guint64                disk_size,
+                                GCancellable          *cancellable,
+                                GError               **error);
+
+G_END_DECLS
+
+#endif /* __GDU_ERASE_H__ */
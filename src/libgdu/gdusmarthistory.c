@@ -0,0 +1,844 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#include "config.h"
+
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gdusmarthistory.h"
+
+/* The history of each drive is kept in two files in the user's cache
+ * directory, both in the same format:
+ *
+ *  - <drive-id>.recent has every sample from the last 24 hours. Older
+ *    samples are dropped once they span 48 hours by rewriting the file.
+ *
+ *  - <drive-id>.daily has the first sample of every day and is never
+ *    rewritten. That's one record a day so even years of history can be
+ *    loaded at once, e.g. for a logarithmic time axis.
+ *
+ * Each file is a 16 byte header followed by records that are only ever
+ * appended. A record is its size as a varint followed by the time
+ * relative to the previous record, the number of attributes and for
+ * each attribute its id and its normalized and interpreted values
+ * relative to the values of the same attribute in the previous record.
+ * Numbers are unsigned LEB128 varints, signed ones zigzag-encoded first.
+ * Most attributes don't change between samples so they take three bytes
+ * each. A truncated record at the end (e.g. from a crash while
+ * appending) is ignored and overwritten by the next append.
+ *
+ * Several processes may record the same drive, e.g. the notify daemons
+ * of two sessions of the same user. Writers take an exclusive flock(2)
+ * on the file and pick up what the others appended before writing.
+ */
+
+#define HISTORY_MAGIC        "GDUSMART"
+#define HISTORY_VERSION      1
+#define HISTORY_HEADER_SIZE  16
+
+#define SECONDS_PER_DAY      (24 * 60 * 60)
+#define RECENT_SPAN          SECONDS_PER_DAY
+
+typedef struct
+{
+  guint8 id;
+  gint   current;
+  gint64 pretty;
+} Value;
+
+typedef struct
+{
+  gint64 time;
+  guint  first_value;
+  guint  num_values;
+} Sample;
+
+/* What the next record is encoded relative to */
+typedef struct
+{
+  gint64 last_time;
+  gint64 last_current[256];
+  gint64 last_pretty[256];
+} EncoderState;
+
+typedef struct
+{
+  gchar *path;
+  GArray *samples;    /* of Sample, oldest first */
+  GArray *values;     /* of Value */
+  gsize size;         /* size of the valid part of the file */
+  dev_t dev;          /* the file last synced with, see tier_sync() */
+  ino_t ino;
+  EncoderState state;
+} Tier;
+
+struct _GduSmartHistory
+{
+  gchar *dir;
+  Tier recent;
+  Tier daily;
+};
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+put_varint (GByteArray *buf,
+            guint64     value)
+{
+  do
+    {
+      guint8 byte = value & 0x7f;
+      value >>= 7;
+      if (value != 0)
+        byte |= 0x80;
+      g_byte_array_append (buf, &byte, 1);
+    }
+  while (value != 0);
+}
+
+static void
+put_signed_varint (GByteArray *buf,
+                   gint64      value)
+{
+  put_varint (buf, (((guint64) value) << 1) ^ (guint64) (value >> 63));
+}
+
+static gboolean
+get_varint (const guchar *data,
+            gsize         size,
+            gsize        *offset,
+            guint64      *out_value)
+{
+  guint64 value = 0;
+  guint shift;
+
+  for (shift = 0; shift < 64; shift += 7)
+    {
+      guint8 byte;
+
+      if (*offset >= size)
+        return FALSE;
+      byte = data[(*offset)++];
+      value |= ((guint64) (byte & 0x7f)) << shift;
+      if ((byte & 0x80) == 0)
+        {
+          *out_value = value;
+          return TRUE;
+        }
+    }
+  return FALSE;
+}
+
+static gboolean
+get_signed_varint (const guchar *data,
+                   gsize         size,
+                   gsize        *offset,
+                   gint64       *out_value)
+{
+  guint64 value;
+
+  if (!get_varint (data, size, offset, &value))
+    return FALSE;
+  *out_value = (gint64) (value >> 1) ^ -((gint64) (value & 1));
+  return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+tier_init (Tier        *tier,
+           const gchar *path)
+{
+  tier->path = g_strdup (path);
+  tier->samples = g_array_new (FALSE, FALSE, sizeof (Sample));
+  tier->values = g_array_new (FALSE, FALSE, sizeof (Value));
+  tier->size = 0;
+  tier->dev = 0;
+  tier->ino = 0;
+  memset (&tier->state, 0, sizeof tier->state);
+}
+
+static void
+tier_clear (Tier *tier)
+{
+  g_free (tier->path);
+  g_array_unref (tier->samples);
+  g_array_unref (tier->values);
+}
+
+static void
+tier_encode (Tier        *tier,
+             GByteArray  *buf,
+             gint64       time,
+             const Value *values,
+             guint        num_values)
+{
+  GByteArray *payload;
+  guint n;
+
+  payload = g_byte_array_new ();
+  put_varint (payload, time - tier->state.last_time);
+  put_varint (payload, num_values);
+  for (n = 0; n < num_values; n++)
+    {
+      g_byte_array_append (payload, &values[n].id, 1);
+      put_signed_varint (payload, values[n].current - tier->state.last_current[values[n].id]);
+      put_signed_varint (payload, values[n].pretty - tier->state.last_pretty[values[n].id]);
+    }
+  put_varint (buf, payload->len);
+  g_byte_array_append (buf, payload->data, payload->len);
+  g_byte_array_unref (payload);
+
+  tier->state.last_time = time;
+  for (n = 0; n < num_values; n++)
+    {
+      tier->state.last_current[values[n].id] = values[n].current;
+      tier->state.last_pretty[values[n].id] = values[n].pretty;
+    }
+}
+
+static void
+tier_add_sample (Tier        *tier,
+                 gint64       time,
+                 const Value *values,
+                 guint        num_values)
+{
+  Sample sample;
+
+  sample.time = time;
+  sample.first_value = tier->values->len;
+  sample.num_values = num_values;
+  g_array_append_val (tier->samples, sample);
+  g_array_append_vals (tier->values, values, num_values);
+}
+
+static gboolean
+tier_decode (Tier          *tier,
+             const guchar  *data,
+             gsize          size,
+             GError       **error)
+{
+  gsize offset;
+
+  /* empty, or a crash while the file was created */
+  if (size < HISTORY_HEADER_SIZE)
+    return TRUE;
+
+  if (memcmp (data, HISTORY_MAGIC, strlen (HISTORY_MAGIC)) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "%s is not a SMART history file", tier->path);
+      return FALSE;
+    }
+  if (GUINT32_FROM_LE (*((const guint32 *) (data + 8))) != HISTORY_VERSION)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Cannot decode version %d SMART history", GUINT32_FROM_LE (*((const guint32 *) (data + 8))));
+      return FALSE;
+    }
+
+  tier->size = HISTORY_HEADER_SIZE;
+  offset = HISTORY_HEADER_SIZE;
+  while (offset < size)
+    {
+      guint64 record_size;
+      guint64 time_delta;
+      guint64 num_values;
+      gsize end;
+      Sample sample;
+      guint first_value;
+      guint n;
+
+      if (!get_varint (data, size, &offset, &record_size) || record_size > size - offset)
+        break;
+      end = offset + record_size;
+
+      if (!get_varint (data, end, &offset, &time_delta) ||
+          !get_varint (data, end, &offset, &num_values) ||
+          num_values > 256)
+        break;
+
+      first_value = tier->values->len;
+      for (n = 0; n < num_values; n++)
+        {
+          Value value;
+          gint64 current_delta;
+          gint64 pretty_delta;
+
+          if (offset >= end)
+            break;
+          value.id = data[offset++];
+          if (!get_signed_varint (data, end, &offset, &current_delta) ||
+              !get_signed_varint (data, end, &offset, &pretty_delta))
+            break;
+          value.current = tier->state.last_current[value.id] + current_delta;
+          value.pretty = tier->state.last_pretty[value.id] + pretty_delta;
+          g_array_append_val (tier->values, value);
+        }
+      if (n < num_values)
+        {
+          /* corrupt record, treat it as the end */
+          g_array_set_size (tier->values, first_value);
+          break;
+        }
+
+      tier->state.last_time += time_delta;
+      for (n = first_value; n < tier->values->len; n++)
+        {
+          const Value *value = &g_array_index (tier->values, Value, n);
+          tier->state.last_current[value->id] = value->current;
+          tier->state.last_pretty[value->id] = value->pretty;
+        }
+      sample.time = tier->state.last_time;
+      sample.first_value = first_value;
+      sample.num_values = num_values;
+      g_array_append_val (tier->samples, sample);
+
+      offset = end;
+      tier->size = end;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+tier_load (Tier    *tier,
+           GError **error)
+{
+  gboolean ret = FALSE;
+  GError *local_error = NULL;
+  gchar *data = NULL;
+  gsize size;
+
+  if (!g_file_get_contents (tier->path, &data, &size, &local_error))
+    {
+      if (local_error->domain == G_FILE_ERROR && local_error->code == G_FILE_ERROR_NOENT)
+        {
+          /* don't complain about a missing file */
+          g_clear_error (&local_error);
+          ret = TRUE;
+          goto out;
+        }
+      g_propagate_error (error, local_error);
+      goto out;
+    }
+
+  ret = tier_decode (tier, (const guchar *) data, size, error);
+
+ out:
+  g_free (data);
+  return ret;
+}
+
+/* Opens and locks the file of @tier. Retries if tier_rewrite() in
+ * another process replaced the file while we were waiting for the lock.
+ *
+ * Returns: The file descriptor or -1 if @error is set.
+ */
+static gint
+tier_open_locked (Tier    *tier,
+                  GError **error)
+{
+  struct stat fd_statbuf;
+  struct stat path_statbuf;
+  gint fd;
+
+ again:
+  fd = g_open (tier->path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd == -1)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Error opening %s: %m", tier->path);
+      return -1;
+    }
+
+  if (flock (fd, LOCK_EX) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Error locking %s: %m", tier->path);
+      close (fd);
+      return -1;
+    }
+
+  if (fstat (fd, &fd_statbuf) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Error getting information about %s: %m", tier->path);
+      close (fd);
+      return -1;
+    }
+
+  if (stat (tier->path, &path_statbuf) != 0 ||
+      path_statbuf.st_dev != fd_statbuf.st_dev ||
+      path_statbuf.st_ino != fd_statbuf.st_ino)
+    {
+      close (fd);
+      goto again;
+    }
+
+  return fd;
+}
+
+/* Must hold the lock. Reloads @tier if another process changed the
+ * file since it was loaded, e.g. by appending.
+ */
+static gboolean
+tier_sync (Tier    *tier,
+           gint     fd,
+           GError **error)
+{
+  gboolean ret = FALSE;
+  struct stat statbuf;
+  guchar *data = NULL;
+  gsize pos = 0;
+
+  if (fstat (fd, &statbuf) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Error getting information about %s: %m", tier->path);
+      goto out;
+    }
+
+  /* a torn record of our own is cut off by tier_append() */
+  if ((gsize) statbuf.st_size == tier->size &&
+      statbuf.st_dev == tier->dev &&
+      statbuf.st_ino == tier->ino)
+    {
+      ret = TRUE;
+      goto out;
+    }
+
+  data = g_malloc (statbuf.st_size);
+  while (pos < (gsize) statbuf.st_size)
+    {
+      ssize_t num_read;
+
+      num_read = pread (fd, data + pos, statbuf.st_size - pos, pos);
+      if (num_read < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                       "Error reading %s: %m", tier->path);
+          goto out;
+        }
+      if (num_read == 0)
+        break;
+      pos += num_read;
+    }
+
+  g_array_set_size (tier->samples, 0);
+  g_array_set_size (tier->values, 0);
+  tier->size = 0;
+  memset (&tier->state, 0, sizeof tier->state);
+  ret = tier_decode (tier, data, pos, error);
+  if (ret)
+    {
+      tier->dev = statbuf.st_dev;
+      tier->ino = statbuf.st_ino;
+    }
+
+ out:
+  g_free (data);
+  return ret;
+}
+
+/* Appends a sample unless another process already recorded a newer one,
+ * or one from the same day if @once_a_day is %TRUE
+ */
+static gboolean
+tier_append (Tier         *tier,
+             gint64        time,
+             const Value  *values,
+             guint         num_values,
+             gboolean      once_a_day,
+             GError      **error)
+{
+  gboolean ret = FALSE;
+  EncoderState saved_state;
+  gboolean encoded = FALSE;
+  GByteArray *buf = NULL;
+  gint fd;
+
+  fd = tier_open_locked (tier, error);
+  if (fd == -1)
+    goto out;
+
+  if (!tier_sync (tier, fd, error))
+    goto out;
+
+  if (tier->samples->len > 0)
+    {
+      gint64 last_time = g_array_index (tier->samples, Sample, tier->samples->len - 1).time;
+      if (last_time >= time ||
+          (once_a_day && last_time / SECONDS_PER_DAY == time / SECONDS_PER_DAY))
+        {
+          ret = TRUE;
+          goto out;
+        }
+    }
+
+  saved_state = tier->state;
+  encoded = TRUE;
+  buf = g_byte_array_new ();
+  if (tier->size == 0)
+    {
+      guint32 u32;
+      g_byte_array_append (buf, (const guint8 *) HISTORY_MAGIC, strlen (HISTORY_MAGIC));
+      u32 = GUINT32_TO_LE (HISTORY_VERSION);
+      g_byte_array_append (buf, (const guint8 *) &u32, sizeof u32);
+      u32 = 0;
+      g_byte_array_append (buf, (const guint8 *) &u32, sizeof u32);
+    }
+  tier_encode (tier, buf, time, values, num_values);
+
+  /* drop a truncated record left behind by a crash, if any */
+  if (ftruncate (fd, tier->size) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Error truncating %s: %m", tier->path);
+      goto out;
+    }
+
+  if (pwrite (fd, buf->data, buf->len, tier->size) != (ssize_t) buf->len)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Error writing to %s: %m", tier->path);
+      goto out;
+    }
+
+  tier->size += buf->len;
+  tier_add_sample (tier, time, values, num_values);
+
+  ret = TRUE;
+
+ out:
+  if (!ret && encoded)
+    tier->state = saved_state;
+  if (fd != -1)
+    close (fd);
+  if (buf != NULL)
+    g_byte_array_unref (buf);
+  return ret;
+}
+
+/* Rewrites the tier with only the samples from @min_time on */
+static gboolean
+tier_rewrite (Tier     *tier,
+              gint64    min_time,
+              GError  **error)
+{
+  gboolean ret = FALSE;
+  EncoderState saved_state;
+  GArray *samples = NULL;
+  GArray *values = NULL;
+  GByteArray *buf = NULL;
+  guint first_sample;
+  guint32 u32;
+  guint n;
+  gint fd;
+
+  /* the file is replaced while holding the lock on the old one, see tier_open_locked() */
+  fd = tier_open_locked (tier, error);
+  if (fd == -1)
+    goto out;
+
+  if (!tier_sync (tier, fd, error))
+    goto out;
+
+  for (first_sample = 0; first_sample < tier->samples->len; first_sample++)
+    {
+      if (g_array_index (tier->samples, Sample, first_sample).time >= min_time)
+        break;
+    }
+  if (first_sample == 0)
+    {
+      /* another process already did it */
+      ret = TRUE;
+      goto out;
+    }
+
+  saved_state = tier->state;
+  memset (&tier->state, 0, sizeof tier->state);
+
+  samples = g_array_new (FALSE, FALSE, sizeof (Sample));
+  values = g_array_new (FALSE, FALSE, sizeof (Value));
+
+  buf = g_byte_array_new ();
+  g_byte_array_append (buf, (const guint8 *) HISTORY_MAGIC, strlen (HISTORY_MAGIC));
+  u32 = GUINT32_TO_LE (HISTORY_VERSION);
+  g_byte_array_append (buf, (const guint8 *) &u32, sizeof u32);
+  u32 = 0;
+  g_byte_array_append (buf, (const guint8 *) &u32, sizeof u32);
+
+  for (n = first_sample; n < tier->samples->len; n++)
+    {
+      Sample sample = g_array_index (tier->samples, Sample, n);
+      const Value *sample_values = &g_array_index (tier->values, Value, sample.first_value);
+
+      tier_encode (tier, buf, sample.time, sample_values, sample.num_values);
+      sample.first_value = values->len;
+      g_array_append_vals (values, sample_values, sample.num_values);
+      g_array_append_val (samples, sample);
+    }
+
+  if (!g_file_set_contents (tier->path, (const gchar *) buf->data, buf->len, error))
+    {
+      tier->state = saved_state;
+      goto out;
+    }
+
+  g_array_unref (tier->samples);
+  g_array_unref (tier->values);
+  tier->samples = samples;
+  tier->values = values;
+  samples = NULL;
+  values = NULL;
+  tier->size = buf->len;
+  /* it's a new file so the next writer reads it back in, see tier_sync() */
+  tier->ino = 0;
+
+  ret = TRUE;
+
+ out:
+  if (fd != -1)
+    close (fd);
+  if (samples != NULL)
+    g_array_unref (samples);
+  if (values != NULL)
+    g_array_unref (values);
+  if (buf != NULL)
+    g_byte_array_unref (buf);
+  return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * gdu_smart_history_load:
+ * @drive_id: The id of the drive, see udisks_drive_get_id().
+ * @error: Return location for error or %NULL.
+ *
+ * Loads the SMART history of the drive identified by @drive_id. A
+ * drive without history is treated as an empty history.
+ *
+ * Returns: A #GduSmartHistory (free with gdu_smart_history_free()) or %NULL if @error is set.
+ */
+GduSmartHistory *
+gdu_smart_history_load (const gchar  *drive_id,
+                        GError      **error)
+{
+  GduSmartHistory *history;
+  gchar *basename;
+  gchar *path;
+
+  history = g_new0 (GduSmartHistory, 1);
+  history->dir = g_build_filename (g_get_user_cache_dir (), "gnome-disks", "smart-history", NULL);
+
+  basename = g_strdelimit (g_strdup (drive_id), "/", '_');
+
+  path = g_strdup_printf ("%s/%s.recent", history->dir, basename);
+  tier_init (&history->recent, path);
+  g_free (path);
+
+  path = g_strdup_printf ("%s/%s.daily", history->dir, basename);
+  tier_init (&history->daily, path);
+  g_free (path);
+
+  g_free (basename);
+
+  if (!tier_load (&history->recent, error) || !tier_load (&history->daily, error))
+    {
+      gdu_smart_history_free (history);
+      history = NULL;
+    }
+
+  return history;
+}
+
+/**
+ * gdu_smart_history_free:
+ * @history: A #GduSmartHistory.
+ *
+ * Frees @history.
+ */
+void
+gdu_smart_history_free (GduSmartHistory *history)
+{
+  tier_clear (&history->recent);
+  tier_clear (&history->daily);
+  g_free (history->dir);
+  g_free (history);
+}
+
+/**
+ * gdu_smart_history_get_last_time:
+ * @history: A #GduSmartHistory.
+ *
+ * Returns: The time of the most recent sample in seconds since the Epoch or 0 if @history is empty.
+ */
+gint64
+gdu_smart_history_get_last_time (GduSmartHistory *history)
+{
+  if (history->recent.samples->len == 0)
+    return 0;
+  return g_array_index (history->recent.samples, Sample, history->recent.samples->len - 1).time;
+}
+
+/**
+ * gdu_smart_history_add:
+ * @history: A #GduSmartHistory.
+ * @time: When @attributes were read, in seconds since the Epoch.
+ * @attributes: A #GVariant of type a(ysqiiixia{sv}) as returned by the SmartGetAttributes() D-Bus method.
+ * @error: Return location for error or %NULL.
+ *
+ * Adds a sample to @history and appends it to the files on disk. Samples
+ * that aren't newer than gdu_smart_history_get_last_time() are ignored.
+ *
+ * Returns: %TRUE if the sample was added, %FALSE if @error is set.
+ */
+gboolean
+gdu_smart_history_add (GduSmartHistory  *history,
+                       gint64            time,
+                       GVariant         *attributes,
+                       GError          **error)
+{
+  gboolean ret = FALSE;
+  GArray *values;
+  GVariantIter iter;
+  guchar id;
+  gint current;
+  gint64 pretty;
+  const Sample *oldest;
+  const Sample *last_daily;
+
+  values = g_array_new (FALSE, FALSE, sizeof (Value));
+
+  if (time <= gdu_smart_history_get_last_time (history))
+    {
+      ret = TRUE;
+      goto out;
+    }
+
+  g_variant_iter_init (&iter, attributes);
+  while (g_variant_iter_next (&iter, "(y&sqiiixi@a{sv})",
+                              &id, NULL, NULL, &current, NULL, NULL, &pretty, NULL, NULL))
+    {
+      Value value;
+      value.id = id;
+      value.current = current;
+      value.pretty = pretty;
+      g_array_append_val (values, value);
+    }
+
+  if (g_mkdir_with_parents (history->dir, 0700) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                   "Error creating directory %s: %m", history->dir);
+      goto out;
+    }
+
+  if (!tier_append (&history->recent, time, (const Value *) values->data, values->len, FALSE, error))
+    goto out;
+
+  last_daily = NULL;
+  if (history->daily.samples->len > 0)
+    last_daily = &g_array_index (history->daily.samples, Sample, history->daily.samples->len - 1);
+  if (last_daily == NULL ||
+      (last_daily->time < time && last_daily->time / SECONDS_PER_DAY != time / SECONDS_PER_DAY))
+    {
+      if (!tier_append (&history->daily, time, (const Value *) values->data, values->len, TRUE, error))
+        goto out;
+    }
+
+  /* rewriting only when the recent tier spans twice as long as needed keeps it append-only most of the time */
+  oldest = &g_array_index (history->recent.samples, Sample, 0);
+  if (oldest->time < time - 2 * RECENT_SPAN)
+    {
+      if (!tier_rewrite (&history->recent, time - RECENT_SPAN, error))
+        goto out;
+    }
+
+  ret = TRUE;
+
+ out:
+  g_array_unref (values);
+  return ret;
+}
+
+static void
+add_points (GArray       *points,
+            const Tier   *tier,
+            guint8        id,
+            gint64        since,
+            gint64        until)
+{
+  guint n, m;
+
+  for (n = 0; n < tier->samples->len; n++)
+    {
+      const Sample *sample = &g_array_index (tier->samples, Sample, n);
+
+      if (sample->time < since)
+        continue;
+      if (sample->time >= until)
+        break;
+
+      for (m = 0; m < sample->num_values; m++)
+        {
+          const Value *value = &g_array_index (tier->values, Value, sample->first_value + m);
+          if (value->id == id)
+            {
+              GduSmartHistoryPoint point;
+              point.time = sample->time;
+              point.current = value->current;
+              point.pretty = value->pretty;
+              g_array_append_val (points, point);
+              break;
+            }
+        }
+    }
+}
+
+/**
+ * gdu_smart_history_get_points:
+ * @history: A #GduSmartHistory.
+ * @id: The id of the SMART attribute.
+ * @since: Ignore samples older than this, in seconds since the Epoch.
+ *
+ * Gets the values of the SMART attribute @id, oldest first. Samples
+ * from the last 24 hours are all included, older ones are one per day.
+ *
+ * Returns: A #GArray of #GduSmartHistoryPoint. Free with g_array_unref().
+ */
+GArray *
+gdu_smart_history_get_points (GduSmartHistory  *history,
+                              guint8            id,
+                              gint64            since)
+{
+  GArray *points;
+  gint64 recent_start = G_MAXINT64;
+
+  points = g_array_new (FALSE, FALSE, sizeof (GduSmartHistoryPoint));
+
+  if (history->recent.samples->len > 0)
+    recent_start = g_array_index (history->recent.samples, Sample, 0).time;
+
+  add_points (points, &history->daily, id, since, recent_start);
+  add_points (points, &history->recent, id, since, G_MAXINT64);
+
+  return points;
+}
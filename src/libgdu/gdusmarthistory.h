@@ -0,0 +1,48 @@
+/* -*- mode: C; c-file-style: "gnu"; indent-tabs-mode: nil; -*-
+ *
+ * Copyright (C) 2008-2013 Red Hat, Inc.
+ *
+ * Licensed under GPL version 2 or later.
+ *
+ * Author: David Zeuthen <zeuthen@gmail.com>
+ */
+
+#ifndef __GDU_SMART_HISTORY_H__
+#define __GDU_SMART_HISTORY_H__
+
+#include "libgdutypes.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GduSmartHistory GduSmartHistory;
+
+/**
+ * GduSmartHistoryPoint:
+ * @time: When the attributes were read, in seconds since the Epoch.
+ * @current: The normalized value or -1 if not applicable.
+ * @pretty: The interpreted value, see the SmartGetAttributes() D-Bus method.
+ *
+ * The value of a single SMART attribute at a point in time.
+ */
+typedef struct
+{
+  gint64 time;
+  gint   current;
+  gint64 pretty;
+} GduSmartHistoryPoint;
+
+GduSmartHistory *gdu_smart_history_load           (const gchar      *drive_id,
+                                                   GError          **error);
+void             gdu_smart_history_free           (GduSmartHistory  *history);
+gint64           gdu_smart_history_get_last_time  (GduSmartHistory  *history);
+gboolean         gdu_smart_history_add            (GduSmartHistory  *history,
+                                                   gint64            time,
+                                                   GVariant         *attributes,
+                                                   GError          **error);
+GArray          *gdu_smart_history_get_points     (GduSmartHistory  *history,
+                                                   guint8            id,
+                                                   gint64            since);
+
+G_END_DECLS
+
+#endif /* __GDU_SMART_HISTORY_H__ */
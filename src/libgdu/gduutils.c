@@ -902,6 +902,14 @@ gdu_utils_is_ntfs_available (UDisksClient *client)
 /* ---------------------------------------------------------------------------------------------------- */
 
 
+typedef enum
+{
+  UTIL_CACHE_RESIZE,
+  UTIL_CACHE_REPAIR,
+  UTIL_CACHE_CHECK,
+  UTIL_CACHE_N
+} UtilCacheKind;
+
 typedef struct
 {
   gboolean available;
@@ -909,6 +917,29 @@ typedef struct
   ResizeFlags mode;
 } UtilCacheEntry;
 
+/* One table per kind, mapping fstype -> UtilCacheEntry. They are filled
+ * asynchronously by gdu_utils_prefetch_capabilities(); a lookup that
+ * misses (e.g. before the replies are in) reports the type as not
+ * available and asks udisks about it in the background.
+ */
+static GHashTable *util_cache[UTIL_CACHE_N];
+/* fstype -> TRUE if a lookup missed while the call was in flight */
+static GHashTable *util_cache_pending[UTIL_CACHE_N];
+/* bumped on flush so replies to earlier prefetches are dropped */
+static guint util_cache_generation[UTIL_CACHE_N];
+G_LOCK_DEFINE_STATIC (util_cache_lock);
+
+/* only touched from the main thread */
+static GduUtilsCapabilitiesChangedFunc util_cache_changed_func = NULL;
+static gpointer util_cache_changed_user_data = NULL;
+
+typedef struct
+{
+  UtilCacheKind kind;
+  gchar *fstype;
+  guint generation;
+} UtilCachePrefetchData;
+
 static void
 util_cache_entry_free (UtilCacheEntry *data)
 {
@@ -916,101 +947,330 @@ util_cache_entry_free (UtilCacheEntry *data)
   g_free (data);
 }
 
-G_LOCK_DEFINE (can_resize_lock);
+static UtilCacheEntry *
+util_cache_entry_new (UtilCacheKind  kind,
+                      GVariant      *out_available)
+{
+  UtilCacheEntry *entry;
+  guint64 m = 0;
+
+  entry = g_new0 (UtilCacheEntry, 1);
+  if (out_available == NULL)
+    goto out;
 
-/* Uses an internal cache, set flush to rebuild it first */
-gboolean
-gdu_utils_can_resize (UDisksClient *client,
-                      const gchar  *fstype,
-                      gboolean      flush,
-                      ResizeFlags  *mode_out,
-                      gchar       **missing_util_out)
+  if (kind == UTIL_CACHE_RESIZE)
+    g_variant_get (out_available, "(bts)", &entry->available, &m, &entry->missing_util);
+  else
+    g_variant_get (out_available, "(bs)", &entry->available, &entry->missing_util);
+  entry->mode = (ResizeFlags) m;
+
+ out:
+  return entry;
+}
+
+/* must be called with util_cache_lock held */
+static GHashTable *
+util_cache_get_table (UtilCacheKind kind)
 {
-  static GHashTable *cache = NULL;
-  const gchar *const *supported_fs;
-  UtilCacheEntry *result;
+  if (util_cache[kind] == NULL)
+    util_cache[kind] = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) util_cache_entry_free);
+  return util_cache[kind];
+}
 
-  G_LOCK (can_resize_lock);
-  if (flush)
-    g_clear_pointer (&cache, g_hash_table_destroy);
+/* must be called with util_cache_lock held */
+static GHashTable *
+util_cache_get_pending (UtilCacheKind kind)
+{
+  if (util_cache_pending[kind] == NULL)
+    util_cache_pending[kind] = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  return util_cache_pending[kind];
+}
+
+/* must be called with util_cache_lock held */
+static void
+util_cache_flush (UtilCacheKind kind)
+{
+  if (util_cache[kind] != NULL)
+    g_hash_table_remove_all (util_cache[kind]);
+  if (util_cache_pending[kind] != NULL)
+    g_hash_table_remove_all (util_cache_pending[kind]);
+  util_cache_generation[kind]++;
+}
 
-  if (cache == NULL)
+static void
+util_cache_insert (UtilCacheKind   kind,
+                   const gchar    *fstype,
+                   UtilCacheEntry *entry)
+{
+  GHashTable *table = util_cache_get_table (kind);
+
+  if (g_hash_table_contains (table, fstype))
+    util_cache_entry_free (entry);
+  else
+    g_hash_table_insert (table, g_strdup (fstype), entry);
+}
+
+static void
+util_cache_prefetch_cb (GObject      *source_object,
+                        GAsyncResult *res,
+                        gpointer      user_data)
+{
+  UtilCachePrefetchData *data = user_data;
+  UDisksManager *manager = UDISKS_MANAGER (source_object);
+  GVariant *out_available = NULL;
+  gpointer missed = NULL;
+  gboolean ret = FALSE;
+
+  switch (data->kind)
     {
-      cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) util_cache_entry_free);
-      supported_fs = udisks_manager_get_supported_filesystems (udisks_client_get_manager (client));
-      for (gsize i = 0; supported_fs[i] != NULL; i++)
-        {
-          GVariant *out_available;
+    case UTIL_CACHE_RESIZE:
+      ret = udisks_manager_call_can_resize_finish (manager, &out_available, res, NULL);
+      break;
+    case UTIL_CACHE_REPAIR:
+      ret = udisks_manager_call_can_repair_finish (manager, &out_available, res, NULL);
+      break;
+    case UTIL_CACHE_CHECK:
+      ret = udisks_manager_call_can_check_finish (manager, &out_available, res, NULL);
+      break;
+    default:
+      g_assert_not_reached ();
+    }
 
-          if (udisks_manager_call_can_resize_sync (udisks_client_get_manager (client),
-                                                   supported_fs[i], &out_available, NULL, NULL))
-            {
-              UtilCacheEntry *entry;
-              guint64 m = 0;
-
-              entry = g_new0 (UtilCacheEntry, 1);
-              g_variant_get (out_available, "(bts)", &entry->available, &m, &entry->missing_util);
-              g_variant_unref (out_available);
-              entry->mode = (ResizeFlags) m;
-              g_hash_table_insert (cache, g_strdup (supported_fs[i]), entry);
-            }
-        }
+  G_LOCK (util_cache_lock);
+  if (data->generation == util_cache_generation[data->kind])
+    {
+      /* a failed call is cached as not available, like before */
+      util_cache_insert (data->kind, data->fstype, util_cache_entry_new (data->kind, ret ? out_available : NULL));
+      g_hash_table_lookup_extended (util_cache_get_pending (data->kind), data->fstype, NULL, &missed);
+      g_hash_table_remove (util_cache_get_pending (data->kind), data->fstype);
     }
-  G_UNLOCK (can_resize_lock);
+  G_UNLOCK (util_cache_lock);
 
-  result = g_hash_table_lookup (cache, fstype);
-  if (mode_out != NULL)
-    *mode_out = result ? result->mode : 0;
+  /* someone was told "not available" while we didn't know yet */
+  if (missed != NULL && util_cache_changed_func != NULL)
+    util_cache_changed_func (util_cache_changed_user_data);
 
-  if (missing_util_out != NULL)
-    *missing_util_out = result ? g_strdup (result->missing_util) : NULL;
+  if (out_available != NULL)
+    g_variant_unref (out_available);
+  g_free (data->fstype);
+  g_free (data);
+}
+
+/* must be called with util_cache_lock held, returns FALSE if @fstype is
+ * already cached or being asked about
+ */
+static gboolean
+util_cache_add_pending (UtilCacheKind  kind,
+                        const gchar   *fstype,
+                        gboolean       missed)
+{
+  GHashTable *pending = util_cache_get_pending (kind);
+
+  if (g_hash_table_contains (util_cache_get_table (kind), fstype))
+    return FALSE;
 
-  return result ? result->available : FALSE;
+  if (g_hash_table_contains (pending, fstype))
+    {
+      if (missed)
+        g_hash_table_insert (pending, g_strdup (fstype), GINT_TO_POINTER (TRUE));
+      return FALSE;
+    }
+
+  g_hash_table_insert (pending, g_strdup (fstype), GINT_TO_POINTER (missed));
+  return TRUE;
 }
 
-G_LOCK_DEFINE (can_repair_lock);
+static void
+util_cache_call (UDisksManager *manager,
+                 UtilCacheKind  kind,
+                 const gchar   *fstype,
+                 guint          generation)
+{
+  UtilCachePrefetchData *data;
 
-gboolean
-gdu_utils_can_repair (UDisksClient *client,
-                      const gchar  *fstype,
-                      gboolean      flush,
-                      gchar       **missing_util_out)
+  data = g_new0 (UtilCachePrefetchData, 1);
+  data->kind = kind;
+  data->fstype = g_strdup (fstype);
+  data->generation = generation;
+
+  switch (kind)
+    {
+    case UTIL_CACHE_RESIZE:
+      udisks_manager_call_can_resize (manager, fstype, NULL, util_cache_prefetch_cb, data);
+      break;
+    case UTIL_CACHE_REPAIR:
+      udisks_manager_call_can_repair (manager, fstype, NULL, util_cache_prefetch_cb, data);
+      break;
+    case UTIL_CACHE_CHECK:
+      udisks_manager_call_can_check (manager, fstype, NULL, util_cache_prefetch_cb, data);
+      break;
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static void
+util_cache_prefetch (UDisksManager *manager)
 {
-  static GHashTable *cache = NULL;
   const gchar *const *supported_fs;
-  UtilCacheEntry *result;
+  UtilCacheKind kind;
 
-  G_LOCK (can_repair_lock);
-  if (flush)
-    g_clear_pointer (&cache, g_hash_table_destroy);
+  supported_fs = udisks_manager_get_supported_filesystems (manager);
+  if (supported_fs == NULL)
+    return;
 
-  if (cache == NULL)
+  /* the calls are all sent right away and answered in parallel by udisks */
+  for (kind = 0; kind < UTIL_CACHE_N; kind++)
     {
-      cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) util_cache_entry_free);
-      supported_fs = udisks_manager_get_supported_filesystems (udisks_client_get_manager (client));
       for (gsize i = 0; supported_fs[i] != NULL; i++)
         {
-          GVariant *out_available;
+          gboolean send;
+          guint generation;
 
-          if (udisks_manager_call_can_repair_sync (udisks_client_get_manager (client),
-                                                   supported_fs[i], &out_available, NULL, NULL))
-            {
-              UtilCacheEntry *entry;
+          G_LOCK (util_cache_lock);
+          send = util_cache_add_pending (kind, supported_fs[i], FALSE);
+          generation = util_cache_generation[kind];
+          G_UNLOCK (util_cache_lock);
 
-              entry = g_new0 (UtilCacheEntry, 1);
-              g_variant_get (out_available, "(bs)", &entry->available, &entry->missing_util);
-              g_variant_unref (out_available);
-              g_hash_table_insert (cache, g_strdup (supported_fs[i]), entry);
-            }
+          if (send)
+            util_cache_call (manager, kind, supported_fs[i], generation);
         }
     }
-  G_UNLOCK (can_repair_lock);
+}
+
+static void
+on_manager_supported_filesystems_changed (GObject    *object,
+                                          GParamSpec *pspec,
+                                          gpointer    user_data)
+{
+  UtilCacheKind kind;
+
+  G_LOCK (util_cache_lock);
+  for (kind = 0; kind < UTIL_CACHE_N; kind++)
+    util_cache_flush (kind);
+  G_UNLOCK (util_cache_lock);
+
+  /* everything reads as not available until the new answers are in */
+  if (util_cache_changed_func != NULL)
+    util_cache_changed_func (util_cache_changed_user_data);
+
+  util_cache_prefetch (UDISKS_MANAGER (object));
+}
+
+/**
+ * gdu_utils_prefetch_capabilities:
+ * @client: A #UDisksClient.
+ * @changed_func: (allow-none): Function to call when a filesystem type
+ *   gdu_utils_can_resize(), gdu_utils_can_repair() or gdu_utils_can_check()
+ *   was asked about before it was known has been answered, or when the
+ *   cached answers were dropped, or %NULL.
+ * @user_data: User data to pass to @changed_func.
+ *
+ * Asynchronously asks udisks which filesystem types can be resized,
+ * repaired and checked so gdu_utils_can_resize(), gdu_utils_can_repair()
+ * and gdu_utils_can_check() never have to wait for it. The answers
+ * are fetched again whenever the supported filesystems change.
+ *
+ * Must be called from the main thread.
+ */
+void
+gdu_utils_prefetch_capabilities (UDisksClient                    *client,
+                                 GduUtilsCapabilitiesChangedFunc  changed_func,
+                                 gpointer                         user_data)
+{
+  UDisksManager *manager;
+
+  util_cache_changed_func = changed_func;
+  util_cache_changed_user_data = user_data;
+
+  manager = udisks_client_get_manager (client);
+  if (manager == NULL)
+    return;
+
+  if (g_object_get_data (G_OBJECT (manager), "x-gdu-prefetch-capabilities") == NULL)
+    {
+      g_object_set_data (G_OBJECT (manager), "x-gdu-prefetch-capabilities", GINT_TO_POINTER (1));
+      g_signal_connect (manager,
+                        "notify::supported-filesystems",
+                        G_CALLBACK (on_manager_supported_filesystems_changed),
+                        NULL);
+    }
 
-  result = g_hash_table_lookup (cache, fstype);
+  util_cache_prefetch (manager);
+}
+
+/* Looks up @fstype without blocking; on a cache miss @fstype is reported
+ * as not available and asked about in the background, see
+ * gdu_utils_prefetch_capabilities()
+ */
+static gboolean
+util_cache_lookup (UDisksClient   *client,
+                   UtilCacheKind   kind,
+                   const gchar    *fstype,
+                   gboolean        flush,
+                   ResizeFlags    *mode_out,
+                   gchar         **missing_util_out)
+{
+  UDisksManager *manager;
+  UtilCacheEntry *entry;
+  gboolean ret = FALSE;
+  ResizeFlags mode = 0;
+  gchar *missing_util = NULL;
+  gboolean send = FALSE;
+  guint generation = 0;
+
+  manager = udisks_client_get_manager (client);
+
+  G_LOCK (util_cache_lock);
+  if (flush)
+    util_cache_flush (kind);
+  entry = fstype != NULL ? g_hash_table_lookup (util_cache_get_table (kind), fstype) : NULL;
+  if (entry != NULL)
+    {
+      ret = entry->available;
+      mode = entry->mode;
+      missing_util = g_strdup (entry->missing_util);
+    }
+  /* only the supported filesystems are asked about */
+  else if (fstype != NULL && manager != NULL &&
+           g_strv_contains (udisks_manager_get_supported_filesystems (manager), fstype))
+    {
+      send = util_cache_add_pending (kind, fstype, TRUE);
+      generation = util_cache_generation[kind];
+    }
+  G_UNLOCK (util_cache_lock);
+
+  if (send)
+    util_cache_call (manager, kind, fstype, generation);
+
+  if (mode_out != NULL)
+    *mode_out = mode;
   if (missing_util_out != NULL)
-    *missing_util_out = result ? g_strdup (result->missing_util) : NULL;
+    *missing_util_out = missing_util;
+  else
+    g_free (missing_util);
 
-  return result ? result->available : FALSE;
+  return ret;
+}
+
+/* Uses an internal cache, set flush to rebuild it first */
+gboolean
+gdu_utils_can_resize (UDisksClient *client,
+                      const gchar  *fstype,
+                      gboolean      flush,
+                      ResizeFlags  *mode_out,
+                      gchar       **missing_util_out)
+{
+  return util_cache_lookup (client, UTIL_CACHE_RESIZE, fstype, flush, mode_out, missing_util_out);
+}
+
+gboolean
+gdu_utils_can_repair (UDisksClient *client,
+                      const gchar  *fstype,
+                      gboolean      flush,
+                      gchar       **missing_util_out)
+{
+  return util_cache_lookup (client, UTIL_CACHE_REPAIR, fstype, flush, NULL, missing_util_out);
 }
 
 gboolean
@@ -1025,51 +1285,13 @@ gdu_utils_can_take_ownership (const gchar *fstype)
   return TRUE;
 }
 
-G_LOCK_DEFINE (can_check_lock);
-
 gboolean
 gdu_utils_can_check (UDisksClient *client,
                      const gchar  *fstype,
                      gboolean      flush,
                      gchar       **missing_util_out)
 {
-  static GHashTable *cache = NULL;
-  const gchar *const *supported_fs;
-  UtilCacheEntry *result;
-
-  G_LOCK (can_check_lock);
-  if (flush && cache != NULL)
-    g_clear_pointer (&cache, g_hash_table_destroy);
-
-  if (cache == NULL)
-    {
-      cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) util_cache_entry_free);
-      supported_fs = udisks_manager_get_supported_filesystems (udisks_client_get_manager (client));
-      for (gsize i = 0; supported_fs[i] != NULL; i++)
-        {
-          GVariant *out_available;
-
-          if (udisks_manager_call_can_check_sync (udisks_client_get_manager (client),
-                                                  supported_fs[i], &out_available, NULL, NULL))
-            {
-              UtilCacheEntry *entry;
-              guint64 m = 0;
-
-              entry = g_new0 (UtilCacheEntry, 1);
-              g_variant_get (out_available, "(bs)", &entry->available, &entry->missing_util);
-              g_variant_unref (out_available);
-              entry->mode = (ResizeFlags) m;
-              g_hash_table_insert (cache, g_strdup (supported_fs[i]), entry);
-            }
-        }
-    }
-  G_UNLOCK (can_check_lock);
-
-  result = g_hash_table_lookup (cache, fstype);
-  if (missing_util_out != NULL)
-    *missing_util_out = result ? g_strdup (result->missing_util) : NULL;
-
-  return result ? result->available : FALSE;
+  return util_cache_lookup (client, UTIL_CACHE_CHECK, fstype, flush, NULL, missing_util_out);
 }
 
 
@@ -1186,82 +1408,204 @@ gdu_utils_get_pretty_uri (GFile *file)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* An index of how block devices relate to each other. It's built with a
+ * single pass over all objects the first time it's needed after something
+ * changed and then shared by all callers for the same client.
+ */
+typedef struct
+{
+  GDBusObjectManager *object_manager;
+  gboolean valid;
+  GHashTable *partitions;   /* table object path -> GPtrArray of partition objects */
+  GHashTable *cleartext;    /* crypto backing object path -> cleartext object */
+  GHashTable *drive_blocks; /* drive object path -> block object (not a partition) */
+} GduTopology;
+
+static void
+topology_invalidate (GduTopology *topology)
+{
+  topology->valid = FALSE;
+}
+
+static void
+on_topology_object_added (GDBusObjectManager *manager,
+                          GDBusObject        *object,
+                          gpointer            user_data)
+{
+  topology_invalidate (user_data);
+}
+
+static void
+on_topology_interface_added (GDBusObjectManager *manager,
+                             GDBusObject        *object,
+                             GDBusInterface     *interface,
+                             gpointer            user_data)
+{
+  topology_invalidate (user_data);
+}
+
+static void
+on_topology_interface_proxy_properties_changed (GDBusObjectManagerClient *manager,
+                                                GDBusObjectProxy         *object_proxy,
+                                                GDBusProxy               *interface_proxy,
+                                                GVariant                 *changed_properties,
+                                                const gchar *const       *invalidated_properties,
+                                                gpointer                  user_data)
+{
+  /* only these carry the properties the index is built from */
+  if (UDISKS_IS_BLOCK (interface_proxy) || UDISKS_IS_PARTITION (interface_proxy))
+    topology_invalidate (user_data);
+}
+
+static void
+topology_free (GduTopology *topology)
+{
+  g_signal_handlers_disconnect_by_data (topology->object_manager, topology);
+  g_object_unref (topology->object_manager);
+  g_hash_table_unref (topology->partitions);
+  g_hash_table_unref (topology->cleartext);
+  g_hash_table_unref (topology->drive_blocks);
+  g_free (topology);
+}
+
+static GduTopology *
+get_topology (UDisksClient *client)
+{
+  GduTopology *topology;
+  GList *objects;
+  GList *l;
+
+  topology = g_object_get_data (G_OBJECT (client), "x-gdu-topology");
+  if (topology == NULL)
+    {
+      topology = g_new0 (GduTopology, 1);
+      /* keep a ref since the client drops it before its data is destroyed */
+      topology->object_manager = g_object_ref (udisks_client_get_object_manager (client));
+      topology->partitions = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                    g_free, (GDestroyNotify) g_ptr_array_unref);
+      topology->cleartext = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+      topology->drive_blocks = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+      g_signal_connect (topology->object_manager, "object-added",
+                        G_CALLBACK (on_topology_object_added), topology);
+      g_signal_connect (topology->object_manager, "object-removed",
+                        G_CALLBACK (on_topology_object_added), topology);
+      g_signal_connect (topology->object_manager, "interface-added",
+                        G_CALLBACK (on_topology_interface_added), topology);
+      g_signal_connect (topology->object_manager, "interface-removed",
+                        G_CALLBACK (on_topology_interface_added), topology);
+      g_signal_connect (topology->object_manager, "interface-proxy-properties-changed",
+                        G_CALLBACK (on_topology_interface_proxy_properties_changed), topology);
+      g_object_set_data_full (G_OBJECT (client), "x-gdu-topology",
+                              topology, (GDestroyNotify) topology_free);
+    }
+
+  if (topology->valid)
+    goto out;
+
+  g_hash_table_remove_all (topology->partitions);
+  g_hash_table_remove_all (topology->cleartext);
+  g_hash_table_remove_all (topology->drive_blocks);
+
+  objects = g_dbus_object_manager_get_objects (topology->object_manager);
+  for (l = objects; l != NULL; l = l->next)
+    {
+      UDisksObject *object = UDISKS_OBJECT (l->data);
+      UDisksBlock *block;
+      UDisksPartition *partition;
+      const gchar *path;
+
+      block = udisks_object_peek_block (object);
+      if (block == NULL)
+        continue;
+
+      partition = udisks_object_peek_partition (object);
+      if (partition != NULL)
+        {
+          GPtrArray *partitions;
+
+          path = udisks_partition_get_table (partition);
+          partitions = g_hash_table_lookup (topology->partitions, path);
+          if (partitions == NULL)
+            {
+              partitions = g_ptr_array_new_with_free_func (g_object_unref);
+              g_hash_table_insert (topology->partitions, g_strdup (path), partitions);
+            }
+          g_ptr_array_add (partitions, g_object_ref (object));
+        }
+
+      path = udisks_block_get_crypto_backing_device (block);
+      if (g_strcmp0 (path, "/") != 0 && !g_hash_table_contains (topology->cleartext, path))
+        g_hash_table_insert (topology->cleartext, g_strdup (path), g_object_ref (object));
+
+      /* same as udisks_client_get_block_for_drive() */
+      path = udisks_block_get_drive (block);
+      if (partition == NULL && g_strcmp0 (path, "/") != 0 && !g_hash_table_contains (topology->drive_blocks, path))
+        g_hash_table_insert (topology->drive_blocks, g_strdup (path), g_object_ref (object));
+    }
+  g_list_free_full (objects, g_object_unref);
+
+  topology->valid = TRUE;
+
+ out:
+  return topology;
+}
+
 GList *
 gdu_utils_get_all_contained_objects (UDisksClient *client,
                                      UDisksObject *object)
 {
-  UDisksBlock *block = NULL;
-  UDisksDrive *drive = NULL;
+  GduTopology *topology;
   UDisksObject *block_object = NULL;
-  UDisksPartitionTable *partition_table = NULL;
-  GList *partitions = NULL;
-  GList *l;
-  GList *objects_to_check = NULL;
+  GPtrArray *objects_to_check;
+  GPtrArray *partitions;
+  GList *ret = NULL;
+  guint n;
+
+  topology = get_topology (client);
+  objects_to_check = g_ptr_array_new ();
 
-  drive = udisks_object_get_drive (object);
-  if (drive != NULL)
+  if (udisks_object_peek_drive (object) != NULL)
     {
-      block = udisks_client_get_block_for_drive (client,
-                                                 drive,
-                                                 FALSE /* get_physical */);
+      block_object = g_hash_table_lookup (topology->drive_blocks,
+                                          g_dbus_object_get_object_path (G_DBUS_OBJECT (object)));
     }
-  else
+  else if (udisks_object_peek_block (object) != NULL)
     {
-      block = udisks_object_get_block (object);
+      block_object = object;
     }
 
-  if (block != NULL)
+  if (block_object != NULL)
     {
-      block_object = (UDisksObject *) g_dbus_interface_dup_object (G_DBUS_INTERFACE (block));
-      if (block_object != NULL)
-        {
-          objects_to_check = g_list_prepend (objects_to_check, g_object_ref (block_object));
+      g_ptr_array_add (objects_to_check, block_object);
 
-          /* if we're a partitioned block device, add all partitions */
-          partition_table = udisks_object_get_partition_table (block_object);
-          if (partition_table != NULL)
+      /* if we're a partitioned block device, add all partitions */
+      if (udisks_object_peek_partition_table (block_object) != NULL)
+        {
+          partitions = g_hash_table_lookup (topology->partitions,
+                                            g_dbus_object_get_object_path (G_DBUS_OBJECT (block_object)));
+          if (partitions != NULL)
             {
-              partitions = udisks_client_get_partitions (client, partition_table);
-              for (l = partitions; l != NULL; l = l->next)
-                {
-                  UDisksPartition *partition = UDISKS_PARTITION (l->data);
-                  UDisksObject *partition_object;
-                  partition_object = (UDisksObject *) g_dbus_interface_dup_object (G_DBUS_INTERFACE (partition));
-                  if (partition_object != NULL)
-                    objects_to_check = g_list_append (objects_to_check, partition_object);
-                }
+              for (n = 0; n < partitions->len; n++)
+                g_ptr_array_add (objects_to_check, partitions->pdata[n]);
             }
         }
     }
 
-  /* Add LUKS objects */
-  for (l = objects_to_check; l != NULL; l = l->next)
+  /* Add LUKS objects - this also visits the added ones so nested LUKS is handled */
+  for (n = 0; n < objects_to_check->len; n++)
     {
-      UDisksObject *object_iter = UDISKS_OBJECT (l->data);
-      UDisksBlock *block_for_object;
-      block_for_object = udisks_object_peek_block (object_iter);
-      if (block_for_object != NULL)
-        {
-          UDisksBlock *cleartext;
-          cleartext = udisks_client_get_cleartext_block (client, block_for_object);
-          if (cleartext != NULL)
-            {
-              UDisksObject *cleartext_object;
-              cleartext_object = (UDisksObject *) g_dbus_interface_dup_object (G_DBUS_INTERFACE (cleartext));
-              if (cleartext_object != NULL)
-                objects_to_check = g_list_append (objects_to_check, cleartext_object);
-              g_object_unref (cleartext);
-            }
-        }
+      UDisksObject *cleartext_object;
+      cleartext_object = g_hash_table_lookup (topology->cleartext,
+                                              g_dbus_object_get_object_path (objects_to_check->pdata[n]));
+      if (cleartext_object != NULL)
+        g_ptr_array_add (objects_to_check, cleartext_object);
     }
 
-  g_clear_object (&partition_table);
-  g_list_free_full (partitions, g_object_unref);
-  g_clear_object (&block_object);
-  g_clear_object (&block);
-  g_clear_object (&drive);
+  for (n = objects_to_check->len; n > 0; n--)
+    ret = g_list_prepend (ret, g_object_ref (objects_to_check->pdata[n - 1]));
+  g_ptr_array_unref (objects_to_check);
 
-  return objects_to_check;
+  return ret;
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
@@ -1277,22 +1621,21 @@ gdu_utils_is_in_use_full (UDisksClient      *client,
   UDisksEncrypted *encrypted_to_lock = NULL;
   GList *l;
   GList *objects_to_check = NULL;
+  GduTopology *topology;
   gboolean ret = FALSE;
   gboolean last = TRUE;
 
   objects_to_check = gdu_utils_get_all_contained_objects (client, object);
+  topology = get_topology (client);
 
   /* Check in reverse order, e.g. cleartext before LUKS, partitions before the main block device */
   objects_to_check = g_list_reverse (objects_to_check);
   for (l = objects_to_check; l != NULL; l = l->next)
     {
       UDisksObject *object_iter = UDISKS_OBJECT (l->data);
-      UDisksBlock *block_for_object;
       UDisksFilesystem *filesystem_for_object;
       UDisksEncrypted *encrypted_for_object;
 
-      block_for_object = udisks_object_peek_block (object_iter);
-
       filesystem_for_object = udisks_object_peek_filesystem (object_iter);
       if (filesystem_for_object != NULL)
         {
@@ -1313,12 +1656,9 @@ gdu_utils_is_in_use_full (UDisksClient      *client,
       encrypted_for_object = udisks_object_peek_encrypted (object_iter);
       if (encrypted_for_object != NULL)
         {
-          UDisksBlock *cleartext;
-          cleartext = udisks_client_get_cleartext_block (client, block_for_object);
-          if (cleartext != NULL)
+          if (g_hash_table_contains (topology->cleartext,
+                                     g_dbus_object_get_object_path (G_DBUS_OBJECT (object_iter))))
             {
-              g_object_unref (cleartext);
-
               if (ret)
                 {
                   last = FALSE;
@@ -1363,37 +1703,54 @@ gdu_utils_is_in_use (UDisksClient *client,
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* How many of the objects passed to gdu_utils_ensure_unused_list() are worked on at the same time */
+#define UNUSE_MAX_PARALLEL 4
+
 typedef struct
 {
   UDisksClient *client;
   GtkWindow *parent_window;
   GList *objects;
-  GList *object_iter;
+  GList *object_iter; /* next object to start a branch for */
+  guint num_running;
+  gboolean starting;
   GTask *task;
   GCancellable *cancellable; /* borrowed ref */
-  guint last_mount_point_list_size; /* only for unuse_unmount_cb to check against a race in UDisks */
+  const gchar *error_message; /* for the first error */
+  GError *error;
 } UnuseData;
 
+/* Each object is handled by a branch of its own. The steps within a branch
+ * are ordered by gdu_utils_is_in_use_full() (cleartext before LUKS,
+ * partitions before the whole disk) while different branches don't depend
+ * on each other and run concurrently.
+ */
+typedef struct
+{
+  UnuseData *data;
+  UDisksObject *object;
+  guint last_mount_point_list_size; /* only for unuse_unmount_cb to check against a race in UDisks */
+} UnuseBranch;
+
 static void
 unuse_data_free (UnuseData *data)
 {
   g_clear_object (&data->client);
+  g_clear_object (&data->parent_window);
   g_list_free_full (data->objects, g_object_unref);
   g_clear_object (&data->task);
   g_slice_free (UnuseData, data);
 }
 
 static void
-unuse_data_complete (UnuseData    *data,
-                     const gchar  *error_message,
-                     GError       *error)
+unuse_data_complete (UnuseData *data)
 {
-  if (error != NULL)
+  if (data->error != NULL)
     {
       gdu_utils_show_error (data->parent_window,
-                            error_message,
-                            error);
-      g_task_return_error (data->task, error);
+                            data->error_message,
+                            data->error);
+      g_task_return_error (data->task, data->error);
     }
   else
     {
@@ -1402,21 +1759,82 @@ unuse_data_complete (UnuseData    *data,
   unuse_data_free (data);
 }
 
-static void unuse_data_iterate (UnuseData *data);
+static void unuse_branch_iterate (UnuseBranch *branch);
+
+static void
+unuse_data_start_branches (UnuseData *data)
+{
+  /* branches may finish right away, don't recurse into here from there */
+  if (data->starting)
+    return;
+
+  data->starting = TRUE;
+  while (data->num_running < UNUSE_MAX_PARALLEL &&
+         data->object_iter != NULL &&
+         data->error == NULL)
+    {
+      UnuseBranch *branch;
+
+      branch = g_slice_new0 (UnuseBranch);
+      branch->data = data;
+      branch->object = UDISKS_OBJECT (data->object_iter->data);
+      data->object_iter = data->object_iter->next;
+      data->num_running++;
+      unuse_branch_iterate (branch);
+    }
+  data->starting = FALSE;
+
+  /* don't start new branches after an error but let running ones finish */
+  if (data->num_running == 0 && (data->object_iter == NULL || data->error != NULL))
+    unuse_data_complete (data);
+}
+
+static void
+unuse_branch_complete (UnuseBranch  *branch,
+                       const gchar  *error_message,
+                       GError       *error)
+{
+  UnuseData *data = branch->data;
+
+  if (error != NULL)
+    {
+      if (data->error == NULL)
+        {
+          data->error_message = error_message;
+          data->error = error;
+        }
+      else
+        {
+          /* the first error is reported, with the others appended */
+          if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            {
+              gchar *message;
+              message = g_strdup_printf ("%s\n%s: %s", data->error->message, error_message, error->message);
+              g_free (data->error->message);
+              data->error->message = message;
+            }
+          g_error_free (error);
+        }
+    }
+
+  g_slice_free (UnuseBranch, branch);
+  data->num_running--;
+  unuse_data_start_branches (data);
+}
 
 static void
 unuse_unmount_cb (UDisksFilesystem *filesystem,
                   GAsyncResult     *res,
                   gpointer          user_data)
 {
-  UnuseData *data = user_data;
+  UnuseBranch *branch = user_data;
   GError *error = NULL;
 
   if (!udisks_filesystem_call_unmount_finish (filesystem,
                                               res,
                                               &error))
     {
-      unuse_data_complete (data, _("Error unmounting filesystem"), error);
+      unuse_branch_complete (branch, _("Error unmounting filesystem"), error);
     }
   else
     {
@@ -1426,13 +1844,13 @@ unuse_unmount_cb (UDisksFilesystem *filesystem,
       end_usec = g_get_monotonic_time () + (G_USEC_PER_SEC * 5);
 
       while (mount_points = udisks_filesystem_get_mount_points (filesystem),
-             (mount_points ? g_strv_length ((gchar **) mount_points) : 0) == data->last_mount_point_list_size &&
+             (mount_points ? g_strv_length ((gchar **) mount_points) : 0) == branch->last_mount_point_list_size &&
              g_get_monotonic_time () < end_usec)
       {
-        udisks_client_settle (data->client);
+        udisks_client_settle (branch->data->client);
       }
 
-      unuse_data_iterate (data);
+      unuse_branch_iterate (branch);
     }
 }
 
@@ -1441,18 +1859,18 @@ unuse_lock_cb (UDisksEncrypted  *encrypted,
                GAsyncResult     *res,
                gpointer          user_data)
 {
-  UnuseData *data = user_data;
+  UnuseBranch *branch = user_data;
   GError *error = NULL;
 
   if (!udisks_encrypted_call_lock_finish (encrypted,
                                           res,
                                           &error))
     {
-      unuse_data_complete (data, _("Error locking device"), error);
+      unuse_branch_complete (branch, _("Error locking device"), error);
     }
   else
     {
-      unuse_data_iterate (data);
+      unuse_branch_iterate (branch);
     }
 }
 
@@ -1461,26 +1879,27 @@ unuse_set_autoclear_cb (UDisksLoop   *loop,
                         GAsyncResult *res,
                         gpointer      user_data)
 {
-  UnuseData *data = user_data;
+  UnuseBranch *branch = user_data;
   GError *error = NULL;
 
   if (!udisks_loop_call_set_autoclear_finish (loop,
                                               res,
                                               &error))
     {
-      unuse_data_complete (data,
-                           _("Error disabling autoclear for loop device"),
-                           error);
+      unuse_branch_complete (branch,
+                             _("Error disabling autoclear for loop device"),
+                             error);
     }
   else
     {
-      unuse_data_iterate (data);
+      unuse_branch_iterate (branch);
     }
 }
 
 static void
-unuse_data_iterate (UnuseData *data)
+unuse_branch_iterate (UnuseBranch *branch)
 {
+  UnuseData *data = branch->data;
   UDisksObject *object;
   UDisksFilesystem *filesystem_to_unmount = NULL;
   UDisksEncrypted *encrypted_to_lock = NULL;
@@ -1488,7 +1907,7 @@ unuse_data_iterate (UnuseData *data)
   UDisksBlock *block;
   gboolean last;
 
-  object = UDISKS_OBJECT (data->object_iter->data);
+  object = branch->object;
   gdu_utils_is_in_use_full (data->client, object,
                             &filesystem_to_unmount, &encrypted_to_lock, NULL);
   block = udisks_object_peek_block (object);
@@ -1511,7 +1930,7 @@ unuse_data_iterate (UnuseData *data)
                                                   g_variant_new ("a{sv}", NULL),
                                                   data->cancellable,
                                                   (GAsyncReadyCallback) unuse_set_autoclear_cb,
-                                                  data);
+                                                  branch);
                   g_object_unref (loop);
                   g_clear_object (&encrypted_to_lock);
                   g_clear_object (&filesystem_to_unmount);
@@ -1528,12 +1947,12 @@ unuse_data_iterate (UnuseData *data)
       const gchar *const *mount_points;
 
       mount_points = udisks_filesystem_get_mount_points (filesystem_to_unmount);
-      data->last_mount_point_list_size = mount_points ? g_strv_length ((gchar **) mount_points) : 0;
+      branch->last_mount_point_list_size = mount_points ? g_strv_length ((gchar **) mount_points) : 0;
       udisks_filesystem_call_unmount (filesystem_to_unmount,
                                       g_variant_new ("a{sv}", NULL), /* options */
                                       data->cancellable, /* cancellable */
                                       (GAsyncReadyCallback) unuse_unmount_cb,
-                                      data);
+                                      branch);
     }
   else if (encrypted_to_lock != NULL)
     {
@@ -1541,27 +1960,42 @@ unuse_data_iterate (UnuseData *data)
                                   g_variant_new ("a{sv}", NULL), /* options */
                                   data->cancellable, /* cancellable */
                                   (GAsyncReadyCallback) unuse_lock_cb,
-                                  data);
+                                  branch);
     }
   else
     {
-      /* nothing left to do, move on to next object */
-      data->object_iter = data->object_iter->next;
-      if (data->object_iter != NULL)
-        {
-          unuse_data_iterate (data);
-        }
-      else
-        {
-          /* yay, no objects left, terminate without error */
-          unuse_data_complete (data, NULL, NULL);
-        }
+      /* nothing left to do for this object */
+      unuse_branch_complete (branch, NULL, NULL);
     }
 
   g_clear_object (&encrypted_to_lock);
   g_clear_object (&filesystem_to_unmount);
 }
 
+/* Returns TRUE if @object is one of the devices contained in another element of @objects */
+static gboolean
+is_contained_in_other (UDisksClient *client,
+                       GList        *objects,
+                       UDisksObject *object)
+{
+  gboolean ret = FALSE;
+  GList *l;
+
+  for (l = objects; l != NULL && !ret; l = l->next)
+    {
+      GList *contained;
+
+      if (l->data == object)
+        continue;
+
+      contained = gdu_utils_get_all_contained_objects (client, UDISKS_OBJECT (l->data));
+      ret = (g_list_find (contained, object) != NULL);
+      g_list_free_full (contained, g_object_unref);
+    }
+
+  return ret;
+}
+
 void
 gdu_utils_ensure_unused_list (UDisksClient         *client,
                               GtkWindow            *parent_window,
@@ -1571,6 +2005,7 @@ gdu_utils_ensure_unused_list (UDisksClient         *client,
                               gpointer              user_data)
 {
   UnuseData *data;
+  GList *l;
 
   g_return_if_fail (objects != NULL);
   g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
@@ -1578,8 +2013,14 @@ gdu_utils_ensure_unused_list (UDisksClient         *client,
   data = g_slice_new0 (UnuseData);
   data->client = g_object_ref (client);
   data->parent_window = (parent_window != NULL) ? g_object_ref (parent_window) : NULL;
-  data->objects = g_list_copy (objects);
-  g_list_foreach (data->objects, (GFunc) g_object_ref, NULL);
+  /* branches must not work on the same devices, e.g. a disk and one of its partitions */
+  for (l = objects; l != NULL; l = l->next)
+    {
+      UDisksObject *object = UDISKS_OBJECT (l->data);
+      if (g_list_find (data->objects, object) == NULL && !is_contained_in_other (client, objects, object))
+        data->objects = g_list_prepend (data->objects, g_object_ref (object));
+    }
+  data->objects = g_list_reverse (data->objects);
   data->object_iter = data->objects;
   data->cancellable = cancellable;
   data->task = g_task_new (G_OBJECT (client),
@@ -1587,7 +2028,7 @@ gdu_utils_ensure_unused_list (UDisksClient         *client,
                            callback,
                            user_data);
 
-  unuse_data_iterate (data);
+  unuse_data_start_branches (data);
 }
 
 gboolean
@@ -87,6 +87,12 @@ typedef enum {
   ONLINE_GROW = 1 << 4
 } ResizeFlags;
 
+typedef void (*GduUtilsCapabilitiesChangedFunc) (gpointer user_data);
+
+void gdu_utils_prefetch_capabilities (UDisksClient                    *client,
+                                      GduUtilsCapabilitiesChangedFunc  changed_func,
+                                      gpointer                         user_data);
+
 gboolean gdu_utils_can_resize (UDisksClient *client,
                                const gchar  *fstype,
                                gboolean      flush,
@@ -14,5 +14,9 @@
 #include "libgduenums.h"
 #include "libgduenumtypes.h"
 #include "gduutils.h"
+#include "gdubenchmark.h"
+#include "gdubenchmarkhistory.h"
+#include "gduerase.h"
+#include "gdusmarthistory.h"
 
 #endif /* __LIB_GDU_H__ */
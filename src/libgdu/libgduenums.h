@@ -21,6 +21,21 @@ typedef enum
   GDU_FORMAT_DURATION_FLAGS_NO_SECONDS           = (1<<1)
 } GduFormatDurationFlags;
 
+typedef enum
+{
+  GDU_BENCHMARK_SAMPLE_TYPE_READ,
+  GDU_BENCHMARK_SAMPLE_TYPE_WRITE,
+  GDU_BENCHMARK_SAMPLE_TYPE_ACCESS_TIME
+} GduBenchmarkSampleType;
+
+typedef enum
+{
+  GDU_ERASE_METHOD_SECURE_DISCARD,
+  GDU_ERASE_METHOD_DISCARD,
+  GDU_ERASE_METHOD_ZERO_OUT,
+  GDU_ERASE_METHOD_WRITE
+} GduEraseMethod;
+
 G_END_DECLS
 
 #endif /* __LIB_GDU_ENUMS_H__ */
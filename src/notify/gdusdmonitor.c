@@ -15,6 +15,7 @@
 #include <libnotify/notify.h>
 
 #include <udisks/udisks.h>
+#include <libgdu/libgdu.h>
 
 #include "gdusdmonitor.h"
 
@@ -31,16 +32,45 @@ struct GduSdMonitor {
   UDisksClient *client;
 
   /* ATA SMART problems */
-  GList *ata_smart_problems;
+  GHashTable *ata_smart_problems; /* set of UDisksObject */
   NotifyNotification *ata_smart_notification;
+
+  /* objects whose Drive.Ata interface changed since they were last checked */
+  GHashTable *dirty_objects; /* set of UDisksObject */
+  guint check_timeout_id;
+
+  /* ATA SMART history */
+  GHashTable *smart_histories; /* drive id -> GduSmartHistory, NULL if it can't be loaded */
+  GHashTable *smart_pending;   /* drive ids with a SmartGetAttributes() call in flight */
 };
 
 G_DEFINE_TYPE (GduSdMonitor, gdu_sd_monitor, G_TYPE_OBJECT);
 
-static void on_client_changed (UDisksClient *client,
-                               gpointer      user_data);
-
-static void update (GduSdMonitor *monitor);
+/* Changes to a drive are coalesced so it is checked at most once in this many seconds */
+#define CHECK_DELAY_SECONDS 2
+
+static void on_object_added (GDBusObjectManager *manager,
+                             GDBusObject        *object,
+                             gpointer            user_data);
+static void on_interface_added (GDBusObjectManager *manager,
+                                GDBusObject        *object,
+                                GDBusInterface     *interface,
+                                gpointer            user_data);
+static void on_interface_removed (GDBusObjectManager *manager,
+                                  GDBusObject        *object,
+                                  GDBusInterface     *interface,
+                                  gpointer            user_data);
+static void on_object_removed (GDBusObjectManager *manager,
+                               GDBusObject        *object,
+                               gpointer            user_data);
+static void on_interface_proxy_properties_changed (GDBusObjectManagerClient *manager,
+                                                   GDBusObjectProxy         *object_proxy,
+                                                   GDBusProxy               *interface_proxy,
+                                                   GVariant                 *changed_properties,
+                                                   const gchar *const       *invalidated_properties,
+                                                   gpointer                  user_data);
+
+static void check_all_objects (GduSdMonitor *monitor);
 
 static void
 udisks_client_cb (GObject      *source_object,
@@ -59,18 +89,52 @@ udisks_client_cb (GObject      *source_object,
     }
   else
     {
-      g_signal_connect (monitor->client,
-                        "changed",
-                        G_CALLBACK (on_client_changed),
+      GDBusObjectManager *object_manager = udisks_client_get_object_manager (monitor->client);
+
+      /* Only Drive.Ata changes matter - UDisksClient::changed fires for
+       * any change on any object which happens a lot
+       */
+      /* a new object only gets object-added, not interface-added for its initial interfaces */
+      g_signal_connect (object_manager,
+                        "object-added",
+                        G_CALLBACK (on_object_added),
                         monitor);
-      update (monitor);
+      g_signal_connect (object_manager,
+                        "interface-added",
+                        G_CALLBACK (on_interface_added),
+                        monitor);
+      g_signal_connect (object_manager,
+                        "interface-removed",
+                        G_CALLBACK (on_interface_removed),
+                        monitor);
+      g_signal_connect (object_manager,
+                        "object-removed",
+                        G_CALLBACK (on_object_removed),
+                        monitor);
+      g_signal_connect (object_manager,
+                        "interface-proxy-properties-changed",
+                        G_CALLBACK (on_interface_proxy_properties_changed),
+                        monitor);
+      check_all_objects (monitor);
     }
   g_object_unref (monitor);
 }
 
+static void
+smart_history_free (GduSmartHistory *history)
+{
+  if (history != NULL)
+    gdu_smart_history_free (history);
+}
+
 static void
 gdu_sd_monitor_init (GduSdMonitor *monitor)
 {
+  monitor->ata_smart_problems = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, NULL);
+  monitor->dirty_objects = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, NULL);
+  monitor->smart_histories = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                                    (GDestroyNotify) smart_history_free);
+  monitor->smart_pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
   udisks_client_new (NULL, /* GCancellable* */
                      udisks_client_cb,
                      g_object_ref (monitor));
@@ -83,12 +147,17 @@ gdu_sd_monitor_finalize (GObject *object)
 
   if (monitor->client != NULL)
     {
-      g_signal_handlers_disconnect_by_func (monitor->client, on_client_changed, monitor);
+      g_signal_handlers_disconnect_by_data (udisks_client_get_object_manager (monitor->client), monitor);
       g_clear_object (&monitor->client);
     }
 
-  g_list_free_full (monitor->ata_smart_problems, g_object_unref);
+  if (monitor->check_timeout_id != 0)
+    g_source_remove (monitor->check_timeout_id);
+  g_hash_table_unref (monitor->dirty_objects);
+  g_hash_table_unref (monitor->ata_smart_problems);
   g_clear_object (&monitor->ata_smart_notification);
+  g_hash_table_unref (monitor->smart_histories);
+  g_hash_table_unref (monitor->smart_pending);
 
   G_OBJECT_CLASS (gdu_sd_monitor_parent_class)->finalize (object);
 }
@@ -109,114 +178,6 @@ gdu_sd_monitor_new (void)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-static void
-diff_sorted_lists (GList         *list1,
-                   GList         *list2,
-                   GCompareFunc   compare,
-                   GList        **added,
-                   GList        **removed)
-{
-  int order;
-
-  *added = *removed = NULL;
-
-  while (list1 != NULL &&
-         list2 != NULL)
-    {
-      order = (*compare) (list1->data, list2->data);
-      if (order < 0)
-        {
-          *removed = g_list_prepend (*removed, list1->data);
-          list1 = list1->next;
-        }
-      else if (order > 0)
-        {
-          *added = g_list_prepend (*added, list2->data);
-          list2 = list2->next;
-        }
-      else
-        { /* same item */
-          list1 = list1->next;
-          list2 = list2->next;
-        }
-    }
-
-  while (list1 != NULL)
-    {
-      *removed = g_list_prepend (*removed, list1->data);
-      list1 = list1->next;
-    }
-  while (list2 != NULL)
-    {
-      *added = g_list_prepend (*added, list2->data);
-      list2 = list2->next;
-    }
-}
-
-static gint
-ptr_compare (gconstpointer a, gconstpointer b)
-{
-  if (a > b)
-    return 1;
-  else if (a < b)
-    return -1;
-  else
-    return 0;
-}
-
-/* ---------------------------------------------------------------------------------------------------- */
-
-typedef gboolean (*CheckProblemFunc) (GduSdMonitor   *monitor,
-                                      UDisksObject   *object);
-
-static void
-update_problems (GduSdMonitor      *monitor,
-                 GList            **problem_list,
-                 CheckProblemFunc   check_func)
-{
-  GList *want = NULL;
-  GList *added = NULL;
-  GList *removed = NULL;
-  GList *objects;
-  GList *l;
-
-  objects = g_dbus_object_manager_get_objects (udisks_client_get_object_manager (monitor->client));
-  for (l = objects; l != NULL; l = l->next)
-    {
-      UDisksObject *object = UDISKS_OBJECT (l->data);
-      if (check_func (monitor, object))
-        want = g_list_prepend (want, object);
-    }
-
-  want = g_list_sort (want, ptr_compare);
-  *problem_list = g_list_sort (*problem_list, ptr_compare);
-  diff_sorted_lists (*problem_list,
-                     want,
-                     ptr_compare,
-                     &added,
-                     &removed);
-
-  for (l = removed; l != NULL; l = l->next)
-    {
-      UDisksObject *object = UDISKS_OBJECT (l->data);
-      *problem_list = g_list_remove (*problem_list, object);
-      g_object_unref (object);
-    }
-
-  for (l = added; l != NULL; l = l->next)
-    {
-      UDisksObject *object = UDISKS_OBJECT (l->data);
-      *problem_list = g_list_prepend (*problem_list, g_object_ref (object));
-    }
-
-  g_list_free (removed);
-  g_list_free (added);
-  g_list_free (want);
-  g_list_free_full (objects, g_object_unref);
-}
-
-/* ---------------------------------------------------------------------------------------------------- */
-
 static void
 on_examine_action_clicked (NotifyNotification  *notification,
                            const gchar         *action,
@@ -230,22 +191,32 @@ on_examine_action_clicked (NotifyNotification  *notification,
 
   if (g_strcmp0 (action, "examine-smart") == 0)
     {
-      if (monitor->ata_smart_problems != NULL)
+      GHashTableIter iter;
+      UDisksObject *object = NULL;
+      UDisksObject *candidate;
+
+      /* pick the first drive in object path order so the choice doesn't depend on hash order */
+      g_hash_table_iter_init (&iter, monitor->ata_smart_problems);
+      while (g_hash_table_iter_next (&iter, (gpointer *) &candidate, NULL))
+        {
+          if (object == NULL ||
+              g_strcmp0 (g_dbus_object_get_object_path (G_DBUS_OBJECT (candidate)),
+                         g_dbus_object_get_object_path (G_DBUS_OBJECT (object))) < 0)
+            object = candidate;
+        }
+
+      if (object != NULL)
         {
-          UDisksObject *object = UDISKS_OBJECT (monitor->ata_smart_problems->data);
-          if (object != NULL)
+          UDisksDrive *drive = udisks_object_peek_drive (object);
+          if (drive != NULL)
             {
-              UDisksDrive *drive = udisks_object_peek_drive (object);
-              if (drive != NULL)
+              UDisksBlock *block = udisks_client_get_block_for_drive (monitor->client,
+                                                                      drive,
+                                                                      TRUE); /* get_physical */
+              if (block != NULL)
                 {
-                  UDisksBlock *block = udisks_client_get_block_for_drive (monitor->client,
-                                                                          drive,
-                                                                          TRUE); /* get_physical */
-                  if (block != NULL)
-                    {
-                      device_file = udisks_block_get_device (block);
-                      g_object_ref (block);
-                    }
+                  device_file = udisks_block_get_device (block);
+                  g_object_ref (block);
                 }
             }
         }
@@ -279,7 +250,7 @@ on_examine_action_clicked (NotifyNotification  *notification,
 
 static void
 update_notification (GduSdMonitor        *monitor,
-                     GList               *problems,
+                     guint                num_problems,
                      NotifyNotification **notification,
                      const gchar         *title,
                      const gchar         *text,
@@ -287,7 +258,7 @@ update_notification (GduSdMonitor        *monitor,
                      const gchar         *action,
                      const gchar         *action_label)
 {
-  if (g_list_length (problems) > 0)
+  if (num_problems > 0)
     {
       /* it could be the notification has already been presented, in that
        * case, don't show another one
@@ -345,12 +316,114 @@ check_for_ata_smart_problem (GduSdMonitor  *monitor,
   return ret;
 }
 
+typedef struct
+{
+  GduSdMonitor *monitor;
+  gchar *drive_id;
+  gint64 updated;
+} SampleData;
+
 static void
-update (GduSdMonitor *monitor)
+sample_smart_cb (GObject      *source_object,
+                 GAsyncResult *res,
+                 gpointer      user_data)
+{
+  SampleData *sample_data = user_data;
+  GduSdMonitor *monitor = sample_data->monitor;
+  GduSmartHistory *history;
+  GVariant *attributes = NULL;
+  GError *error = NULL;
+
+  g_hash_table_remove (monitor->smart_pending, sample_data->drive_id);
+
+  if (!udisks_drive_ata_call_smart_get_attributes_finish (UDISKS_DRIVE_ATA (source_object),
+                                                          &attributes,
+                                                          res,
+                                                          &error))
+    {
+      g_warning ("Error getting ATA SMART information: %s (%s, %d)",
+                 error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+      goto out;
+    }
+
+  history = g_hash_table_lookup (monitor->smart_histories, sample_data->drive_id);
+  if (history != NULL && !gdu_smart_history_add (history, sample_data->updated, attributes, &error))
+    {
+      g_warning ("Error saving ATA SMART history: %s (%s, %d)",
+                 error->message, g_quark_to_string (error->domain), error->code);
+      g_clear_error (&error);
+    }
+  g_variant_unref (attributes);
+
+ out:
+  g_object_unref (sample_data->monitor);
+  g_free (sample_data->drive_id);
+  g_free (sample_data);
+}
+
+/* Records the SMART attributes of the drive each time udisks refreshes
+ * them so the Disks application can show how they changed over time
+ */
+static void
+sample_smart_attributes (GduSdMonitor *monitor,
+                         UDisksObject *object)
+{
+  UDisksDrive *drive;
+  UDisksDriveAta *ata;
+  GduSmartHistory *history;
+  const gchar *drive_id;
+  SampleData *sample_data;
+  gint64 updated;
+
+  drive = udisks_object_peek_drive (object);
+  ata = udisks_object_peek_drive_ata (object);
+  if (drive == NULL || ata == NULL || !udisks_drive_ata_get_smart_enabled (ata))
+    return;
+
+  updated = udisks_drive_ata_get_smart_updated (ata);
+  drive_id = udisks_drive_get_id (drive);
+  if (updated == 0 || drive_id == NULL || drive_id[0] == '\0')
+    return;
+
+  if (g_hash_table_contains (monitor->smart_pending, drive_id))
+    return;
+
+  if (!g_hash_table_lookup_extended (monitor->smart_histories, drive_id, NULL, (gpointer *) &history))
+    {
+      GError *error = NULL;
+      history = gdu_smart_history_load (drive_id, &error);
+      if (history == NULL)
+        {
+          g_warning ("Error loading ATA SMART history: %s (%s, %d)",
+                     error->message, g_quark_to_string (error->domain), error->code);
+          g_clear_error (&error);
+        }
+      /* also remember failures so they're only reported once */
+      g_hash_table_insert (monitor->smart_histories, g_strdup (drive_id), history);
+    }
+  if (history == NULL || updated <= gdu_smart_history_get_last_time (history))
+    return;
+
+  sample_data = g_new0 (SampleData, 1);
+  sample_data->monitor = g_object_ref (monitor);
+  sample_data->drive_id = g_strdup (drive_id);
+  sample_data->updated = updated;
+  g_hash_table_add (monitor->smart_pending, g_strdup (drive_id));
+  udisks_drive_ata_call_smart_get_attributes (ata,
+                                              g_variant_new ("a{sv}", NULL), /* options */
+                                              NULL, /* GCancellable */
+                                              sample_smart_cb,
+                                              sample_data);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+update_ata_smart_notification (GduSdMonitor *monitor)
 {
-  update_problems (monitor, &monitor->ata_smart_problems, check_for_ata_smart_problem);
   update_notification (monitor,
-                       monitor->ata_smart_problems,
+                       g_hash_table_size (monitor->ata_smart_problems),
                        &monitor->ata_smart_notification,
                        /* Translators: This is used as the title of the SMART failure notification */
                        C_("notify-smart", "Hard Disk Problems Detected"),
@@ -362,12 +435,122 @@ update (GduSdMonitor *monitor)
                        C_("notify-smart", "Examine"));
 }
 
+static void
+check_object (GduSdMonitor *monitor,
+              UDisksObject *object)
+{
+  if (check_for_ata_smart_problem (monitor, object))
+    {
+      if (!g_hash_table_contains (monitor->ata_smart_problems, object))
+        g_hash_table_add (monitor->ata_smart_problems, g_object_ref (object));
+    }
+  else
+    {
+      g_hash_table_remove (monitor->ata_smart_problems, object);
+    }
+
+  sample_smart_attributes (monitor, object);
+}
+
+static void
+check_all_objects (GduSdMonitor *monitor)
+{
+  GList *objects;
+  GList *l;
+
+  objects = g_dbus_object_manager_get_objects (udisks_client_get_object_manager (monitor->client));
+  for (l = objects; l != NULL; l = l->next)
+    check_object (monitor, UDISKS_OBJECT (l->data));
+  g_list_free_full (objects, g_object_unref);
+
+  update_ata_smart_notification (monitor);
+}
+
+static gboolean
+on_check_timeout (gpointer user_data)
+{
+  GduSdMonitor *monitor = GDU_SD_MONITOR (user_data);
+  GHashTableIter iter;
+  UDisksObject *object;
+
+  monitor->check_timeout_id = 0;
+
+  g_hash_table_iter_init (&iter, monitor->dirty_objects);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &object, NULL))
+    check_object (monitor, object);
+  g_hash_table_remove_all (monitor->dirty_objects);
+
+  update_ata_smart_notification (monitor);
+
+  return FALSE; /* don't run again */
+}
+
+static void
+schedule_check (GduSdMonitor *monitor,
+                UDisksObject *object)
+{
+  if (!g_hash_table_contains (monitor->dirty_objects, object))
+    g_hash_table_add (monitor->dirty_objects, g_object_ref (object));
+
+  if (monitor->check_timeout_id == 0)
+    monitor->check_timeout_id = g_timeout_add_seconds (CHECK_DELAY_SECONDS, on_check_timeout, monitor);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static void
-on_client_changed (UDisksClient *client,
-                   gpointer      user_data)
+on_object_added (GDBusObjectManager *manager,
+                 GDBusObject        *object,
+                 gpointer            user_data)
+{
+  GduSdMonitor *monitor = GDU_SD_MONITOR (user_data);
+  if (udisks_object_peek_drive_ata (UDISKS_OBJECT (object)) != NULL)
+    schedule_check (monitor, UDISKS_OBJECT (object));
+}
+
+static void
+on_interface_added (GDBusObjectManager *manager,
+                    GDBusObject        *object,
+                    GDBusInterface     *interface,
+                    gpointer            user_data)
+{
+  GduSdMonitor *monitor = GDU_SD_MONITOR (user_data);
+  if (UDISKS_IS_DRIVE_ATA (interface))
+    schedule_check (monitor, UDISKS_OBJECT (object));
+}
+
+static void
+on_interface_removed (GDBusObjectManager *manager,
+                      GDBusObject        *object,
+                      GDBusInterface     *interface,
+                      gpointer            user_data)
+{
+  GduSdMonitor *monitor = GDU_SD_MONITOR (user_data);
+  if (UDISKS_IS_DRIVE_ATA (interface))
+    schedule_check (monitor, UDISKS_OBJECT (object));
+}
+
+static void
+on_object_removed (GDBusObjectManager *manager,
+                   GDBusObject        *object,
+                   gpointer            user_data)
+{
+  GduSdMonitor *monitor = GDU_SD_MONITOR (user_data);
+
+  g_hash_table_remove (monitor->dirty_objects, object);
+  if (g_hash_table_remove (monitor->ata_smart_problems, object))
+    update_ata_smart_notification (monitor);
+}
+
+static void
+on_interface_proxy_properties_changed (GDBusObjectManagerClient *manager,
+                                       GDBusObjectProxy         *object_proxy,
+                                       GDBusProxy               *interface_proxy,
+                                       GVariant                 *changed_properties,
+                                       const gchar *const       *invalidated_properties,
+                                       gpointer                  user_data)
 {
   GduSdMonitor *monitor = GDU_SD_MONITOR (user_data);
-  update (monitor);
+  if (UDISKS_IS_DRIVE_ATA (interface_proxy))
+    schedule_check (monitor, UDISKS_OBJECT (object_proxy));
 }